@@ -0,0 +1,248 @@
+#include "allocation_hooks.h"
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include "base/allocator/buildflags.h"
+
+#if BUILDFLAG(USE_ALLOCATOR_SHIM)
+#include "base/allocator/allocator_shim.h"
+#endif
+
+namespace self {
+
+namespace {
+std::atomic<bool> g_enabled(false);
+std::atomic<bool> g_time_allocations(false);
+std::atomic<int64_t> g_allocation_count(0);
+std::atomic<int64_t> g_free_count(0);
+std::atomic<int64_t> g_allocation_microseconds(0);
+
+#if BUILDFLAG(USE_ALLOCATOR_SHIM)
+using base::allocator::AllocatorDispatch;
+
+std::atomic<bool> g_dispatch_inserted(false);
+
+// 计一次分配或释放, 要计时的话从构造到析构都算在 malloc/free 里
+class ScopedCount {
+public:
+  ScopedCount(std::atomic<int64_t>* counter, int64_t count)
+    : timed_(g_time_allocations.load(std::memory_order_relaxed)) {
+    counter->fetch_add(count, std::memory_order_relaxed);
+    if (timed_) {
+      start_ = base::TimeTicks::Now();
+    }
+  }
+
+  ~ScopedCount() {
+    if (timed_) {
+      g_allocation_microseconds.fetch_add(
+        (base::TimeTicks::Now() - start_).InMicroseconds(), std::memory_order_relaxed);
+    }
+  }
+
+private:
+  const bool timed_;
+  base::TimeTicks start_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedCount);
+};
+
+bool IsCounting() {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+void* HookAlloc(const AllocatorDispatch* self, size_t size, void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting()) {
+    return next->alloc_function(next, size, context);
+  }
+  ScopedCount scoped_count(&g_allocation_count, 1);
+  return next->alloc_function(next, size, context);
+}
+
+void* HookZeroInitAlloc(const AllocatorDispatch* self, size_t n, size_t size, void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting()) {
+    return next->alloc_zero_initialized_function(next, n, size, context);
+  }
+  ScopedCount scoped_count(&g_allocation_count, 1);
+  return next->alloc_zero_initialized_function(next, n, size, context);
+}
+
+void* HookAllocAligned(
+  const AllocatorDispatch* self,
+  size_t alignment,
+  size_t size,
+  void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting()) {
+    return next->alloc_aligned_function(next, alignment, size, context);
+  }
+  ScopedCount scoped_count(&g_allocation_count, 1);
+  return next->alloc_aligned_function(next, alignment, size, context);
+}
+
+void* HookRealloc(const AllocatorDispatch* self, void* address, size_t size, void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting()) {
+    return next->realloc_function(next, address, size, context);
+  }
+  ScopedCount scoped_count(&g_allocation_count, 1);
+  return next->realloc_function(next, address, size, context);
+}
+
+void HookFree(const AllocatorDispatch* self, void* address, void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting() || !address) {
+    next->free_function(next, address, context);
+    return;
+  }
+  ScopedCount scoped_count(&g_free_count, 1);
+  next->free_function(next, address, context);
+}
+
+size_t HookGetSizeEstimate(const AllocatorDispatch* self, void* address, void* context) {
+  const AllocatorDispatch* const next = self->next;
+  return next->get_size_estimate_function(next, address, context);
+}
+
+unsigned HookBatchMalloc(
+  const AllocatorDispatch* self,
+  size_t size,
+  void** results,
+  unsigned num_requested,
+  void* context) {
+  const AllocatorDispatch* const next = self->next;
+  unsigned count = next->batch_malloc_function(next, size, results, num_requested, context);
+  if (IsCounting()) {
+    g_allocation_count.fetch_add(count, std::memory_order_relaxed);
+  }
+  return count;
+}
+
+void HookBatchFree(
+  const AllocatorDispatch* self,
+  void** to_be_freed,
+  unsigned num_to_be_freed,
+  void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (IsCounting()) {
+    g_free_count.fetch_add(num_to_be_freed, std::memory_order_relaxed);
+  }
+  next->batch_free_function(next, to_be_freed, num_to_be_freed, context);
+}
+
+void HookFreeDefiniteSize(
+  const AllocatorDispatch* self,
+  void* address,
+  size_t size,
+  void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting() || !address) {
+    next->free_definite_size_function(next, address, size, context);
+    return;
+  }
+  ScopedCount scoped_count(&g_free_count, 1);
+  next->free_definite_size_function(next, address, size, context);
+}
+
+void* HookAlignedMalloc(
+  const AllocatorDispatch* self,
+  size_t size,
+  size_t alignment,
+  void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting()) {
+    return next->aligned_malloc_function(next, size, alignment, context);
+  }
+  ScopedCount scoped_count(&g_allocation_count, 1);
+  return next->aligned_malloc_function(next, size, alignment, context);
+}
+
+void* HookAlignedRealloc(
+  const AllocatorDispatch* self,
+  void* address,
+  size_t size,
+  size_t alignment,
+  void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting()) {
+    return next->aligned_realloc_function(next, address, size, alignment, context);
+  }
+  ScopedCount scoped_count(&g_allocation_count, 1);
+  return next->aligned_realloc_function(next, address, size, alignment, context);
+}
+
+void HookAlignedFree(const AllocatorDispatch* self, void* address, void* context) {
+  const AllocatorDispatch* const next = self->next;
+  if (!IsCounting() || !address) {
+    next->aligned_free_function(next, address, context);
+    return;
+  }
+  ScopedCount scoped_count(&g_free_count, 1);
+  next->aligned_free_function(next, address, context);
+}
+
+AllocatorDispatch g_counting_dispatch = {
+  &HookAlloc,
+  &HookZeroInitAlloc,
+  &HookAllocAligned,
+  &HookRealloc,
+  &HookFree,
+  &HookGetSizeEstimate,
+  &HookBatchMalloc,
+  &HookBatchFree,
+  &HookFreeDefiniteSize,
+  &HookAlignedMalloc,
+  &HookAlignedRealloc,
+  &HookAlignedFree,
+  nullptr, /* next */
+};
+#endif
+}
+
+bool AllocationHooks::IsSupported() {
+#if BUILDFLAG(USE_ALLOCATOR_SHIM)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void AllocationHooks::Enable(bool time_allocations) {
+  g_time_allocations.store(time_allocations, std::memory_order_relaxed);
+#if BUILDFLAG(USE_ALLOCATOR_SHIM)
+  if (!g_dispatch_inserted.exchange(true)) {
+    base::allocator::InsertAllocatorDispatch(&g_counting_dispatch);
+  }
+#endif
+  g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void AllocationHooks::Disable() {
+  g_enabled.store(false, std::memory_order_relaxed);
+}
+
+void AllocationHooks::Reset() {
+  g_allocation_count.store(0, std::memory_order_relaxed);
+  g_free_count.store(0, std::memory_order_relaxed);
+  g_allocation_microseconds.store(0, std::memory_order_relaxed);
+}
+
+int64_t AllocationHooks::allocation_count() {
+  return g_allocation_count.load(std::memory_order_relaxed);
+}
+
+int64_t AllocationHooks::free_count() {
+  return g_free_count.load(std::memory_order_relaxed);
+}
+
+base::TimeDelta AllocationHooks::allocation_time() {
+  return base::TimeDelta::FromMicroseconds(
+    g_allocation_microseconds.load(std::memory_order_relaxed));
+}
+
+} //namespace self
@@ -0,0 +1,41 @@
+#ifndef ALLOCATION_HOOKS_H_
+#define ALLOCATION_HOOKS_H_
+
+#include <stdint.h>
+
+#include "base/macros.h"
+#include "base/time/time.h"
+
+namespace self {
+
+// Counts the allocations and frees of every thread through a dispatch of
+// base's allocator shim, so nothing replaces the global operator new. The
+// dispatch is inserted by the first Enable(): a process that never enables
+// the counting runs without it. The shim can not take a dispatch out again,
+// after Disable() an allocation pays one load and a branch more.
+//
+// Builds without the shim (use_allocator_shim=false: Windows debug or
+// component builds, sanitizers) count nothing, IsSupported() tells.
+class AllocationHooks {
+public:
+  static bool IsSupported();
+
+  // |time_allocations| also sums the time spent allocating and freeing,
+  // which slows every allocation down.
+  static void Enable(bool time_allocations);
+  static void Disable();
+
+  // Zeroes the counts, only meaningful while no other thread allocates.
+  static void Reset();
+
+  // Since the last Reset(), of all threads, while enabled.
+  static int64_t allocation_count();
+  static int64_t free_count();
+  static base::TimeDelta allocation_time();
+
+private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(AllocationHooks);
+};
+
+} // namespace self
+#endif // ALLOCATION_HOOKS_H_
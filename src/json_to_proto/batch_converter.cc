@@ -0,0 +1,213 @@
+#include "batch_converter.h"
+
+#include <algorithm>
+
+#include "base/files/file_enumerator.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "conversion_worker.h"
+#include "coroutine_pipeline.h"
+#include "json_unified_schema_builder.h"
+
+namespace self {
+
+namespace {
+static const char kInputPattern[] = "*.json";
+static const char kOutputExtension[] = ".pb";
+// 预估一个文件转换时占用的内存: 输入本身, message 树和输出大约是输入的几倍
+static const int64_t kMemoryPerInputByte = 4;
+}
+
+BatchConverter::BatchConverter(
+  const base::FilePath& output_dir,
+  int worker_count,
+  int64_t memory_budget,
+  SchemaMode schema_mode)
+  : output_dir_(output_dir),
+    worker_count_(worker_count),
+    memory_budget_(memory_budget),
+    schema_mode_(schema_mode),
+    max_enum_cardinality_(JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality),
+    use_coroutine_pipeline_(false),
+    memory_available_(&lock_),
+    in_flight_bytes_(0),
+    peak_in_flight_bytes_(0),
+    input_bytes_(0),
+    error_count_(0),
+    first_error_index_(0),
+    steal_count_(0) {
+}
+
+BatchConverter::~BatchConverter() {
+}
+
+bool BatchConverter::AddInputDirectory(
+  const base::FilePath& input_dir,
+  std::string& error_message) {
+  if (!base::DirectoryExists(input_dir)) {
+    error_message = "input directory does not exist: " + input_dir.AsUTF8Unsafe();
+    return false;
+  }
+  base::FileEnumerator file_enumerator(
+    input_dir, true, base::FileEnumerator::FILES, kInputPattern);
+  for (base::FilePath input_path = file_enumerator.Next(); !input_path.empty();
+    input_path = file_enumerator.Next()) {
+    base::FilePath relative_path;
+    if (!input_dir.AppendRelativePath(input_path, &relative_path)) {
+      relative_path = input_path.BaseName();
+    }
+    AddInput(input_path, relative_path);
+  }
+  return true;
+}
+
+bool BatchConverter::AddInputGlob(
+  const base::FilePath& input_glob,
+  std::string& error_message) {
+  base::FilePath input_dir = input_glob.DirName();
+  if (!base::DirectoryExists(input_dir)) {
+    error_message = "input directory does not exist: " + input_dir.AsUTF8Unsafe();
+    return false;
+  }
+  base::FileEnumerator file_enumerator(
+    input_dir, false, base::FileEnumerator::FILES, input_glob.BaseName().value());
+  for (base::FilePath input_path = file_enumerator.Next(); !input_path.empty();
+    input_path = file_enumerator.Next()) {
+    AddInput(input_path, input_path.BaseName());
+  }
+  return true;
+}
+
+bool BatchConverter::AddInputManifest(
+  const base::FilePath& manifest_path,
+  std::string& error_message) {
+  std::string manifest;
+  if (!base::ReadFileToString(manifest_path, &manifest)) {
+    error_message = "read manifest fail: " + manifest_path.AsUTF8Unsafe();
+    return false;
+  }
+  base::FilePath manifest_dir = manifest_path.DirName();
+  for (const std::string& line : base::SplitString(
+    manifest, "\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY)) {
+    if (line[0] == '#') {
+      continue;
+    }
+    base::FilePath path = base::FilePath::FromUTF8Unsafe(line);
+    if (path.IsAbsolute()) {
+      AddInput(path, path.BaseName());
+    } else if (path.ReferencesParent()) {
+      // 输出不能跑到 output dir 外面去
+      AddInput(manifest_dir.Append(path), path.BaseName());
+    } else {
+      AddInput(manifest_dir.Append(path), path);
+    }
+  }
+  return true;
+}
+
+bool BatchConverter::Convert(std::string& error_message) {
+  // 按输出路径排序, 结果和枚举顺序, 线程数都无关
+  std::sort(inputs_.begin(), inputs_.end(), [](const Input& left, const Input& right) {
+    return left.output_path < right.output_path;
+  });
+  for (size_t index = 1; index < inputs_.size(); index++) {
+    if (inputs_[index].output_path == inputs_[index - 1].output_path) {
+      error_message = "two inputs map to one output: " +
+        inputs_[index - 1].input_path.AsUTF8Unsafe() + ", " +
+        inputs_[index].input_path.AsUTF8Unsafe();
+      return false;
+    }
+  }
+  if (inputs_.empty()) {
+    error_message = "no input file";
+    return false;
+  }
+  if (use_coroutine_pipeline_) {
+    return ConvertOnCoroutinePipeline(error_message);
+  }
+
+  WorkStealingThreadPool thread_pool(worker_count_);
+  workers_.clear();
+  for (int index = 0; index < thread_pool.worker_count(); index++) {
+    workers_.emplace_back(new ConversionWorker(schema_mode_, max_enum_cardinality_));
+  }
+  thread_pool.Run(inputs_.size(), this);
+  // worker 的 descriptor pool 和 arena 只在这一批里有用
+  workers_.clear();
+  steal_count_ = thread_pool.steal_count();
+
+  if (error_count_ > 0) {
+    error_message = base::Int64ToString(error_count_) + " of " +
+      base::SizeTToString(inputs_.size()) + " files fail, first error: " +
+      inputs_[first_error_index_].input_path.AsUTF8Unsafe() + ": " + first_error_;
+    return false;
+  }
+  return true;
+}
+
+void BatchConverter::RunTask(size_t task_index, int worker_index) {
+  const Input& input = inputs_[task_index];
+  std::string error_message;
+  int64_t file_size = 0;
+  bool result = base::GetFileSize(input.input_path, &file_size);
+  if (result) {
+    int64_t memory = file_size * kMemoryPerInputByte;
+    AcquireMemory(memory);
+    result = workers_[worker_index]->ConvertFile(
+      input.input_path, input.output_path, error_message);
+    ReleaseMemory(memory);
+  } else {
+    error_message = "get input file size fail";
+  }
+
+  base::AutoLock auto_lock(lock_);
+  input_bytes_ += file_size;
+  if (!result) {
+    if (error_count_ == 0 || task_index < first_error_index_) {
+      first_error_index_ = task_index;
+      first_error_ = error_message;
+    }
+    error_count_++;
+  }
+}
+
+void BatchConverter::AddInput(
+  const base::FilePath& input_path,
+  const base::FilePath& relative_path) {
+  inputs_.push_back({input_path,
+    output_dir_.Append(relative_path).RemoveFinalExtension().AddExtension(kOutputExtension)});
+}
+
+bool BatchConverter::ConvertOnCoroutinePipeline(std::string& error_message) {
+  CoroutinePipeline pipeline(worker_count_, memory_budget_, schema_mode_);
+  pipeline.set_max_enum_cardinality(max_enum_cardinality_);
+  for (const Input& input : inputs_) {
+    pipeline.AddFile(input.input_path, input.output_path);
+  }
+  bool result = pipeline.Run(error_message);
+  input_bytes_ = pipeline.input_bytes();
+  error_count_ = pipeline.error_count();
+  peak_in_flight_bytes_ = pipeline.peak_in_flight_bytes();
+  return result;
+}
+
+void BatchConverter::AcquireMemory(int64_t bytes) {
+  base::AutoLock auto_lock(lock_);
+  // 没有文件在转换时总是放行, 否则比预算大的文件永远等不到
+  while (in_flight_bytes_ > 0 && in_flight_bytes_ + bytes > memory_budget_) {
+    memory_available_.Wait();
+  }
+  in_flight_bytes_ += bytes;
+  peak_in_flight_bytes_ = std::max(peak_in_flight_bytes_, in_flight_bytes_);
+}
+
+void BatchConverter::ReleaseMemory(int64_t bytes) {
+  base::AutoLock auto_lock(lock_);
+  in_flight_bytes_ -= bytes;
+  memory_available_.Broadcast();
+}
+
+} //namespace self
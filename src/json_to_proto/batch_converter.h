@@ -0,0 +1,117 @@
+#ifndef BATCH_CONVERTER_H_
+#define BATCH_CONVERTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/macros.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "build_proto_from_json.h"
+#include "work_stealing_thread_pool.h"
+
+namespace self {
+class ConversionWorker;
+
+// Converts many json files in one process on a WorkStealingThreadPool. Every
+// worker keeps its own descriptor pools, keyed by the json shape fingerprint,
+// and its own arena and buffers, so workers share nothing but the task
+// queues and the memory budget.
+//
+// The output of <input base>/a/b.json is <output dir>/a/b.pb, where the input
+// base is the directory, the glob's directory or the manifest's directory.
+class BatchConverter : public WorkStealingThreadPool::Delegate {
+public:
+  // A file is admitted when the estimated memory of the files in flight,
+  // this one included, stays within |memory_budget| bytes. A file larger
+  // than the budget runs alone.
+  BatchConverter(
+    const base::FilePath& output_dir,
+    int worker_count,
+    int64_t memory_budget,
+    SchemaMode schema_mode);
+
+  ~BatchConverter() override;
+
+  // See BuildProtoFromJson::set_max_enum_cardinality().
+  void set_max_enum_cardinality(size_t max_enum_cardinality) {
+    max_enum_cardinality_ = max_enum_cardinality;
+  }
+
+  // Converts the files on a CoroutinePipeline, which reads and writes them in
+  // chunks while they are converted, instead of one file at a time per
+  // worker. Fails in Convert() when coroutines are not built in.
+  void set_use_coroutine_pipeline(bool use_coroutine_pipeline) {
+    use_coroutine_pipeline_ = use_coroutine_pipeline;
+  }
+
+  // Every *.json file below |input_dir|, recursively.
+  bool AddInputDirectory(const base::FilePath& input_dir, std::string& error_message);
+
+  // Files matching the file name pattern of |input_glob|, e.g. data/*.json.
+  // The directory part is taken literally.
+  bool AddInputGlob(const base::FilePath& input_glob, std::string& error_message);
+
+  // One path per line, relative paths are resolved against the manifest's
+  // directory. Empty lines and lines starting with '#' are skipped.
+  bool AddInputManifest(const base::FilePath& manifest_path, std::string& error_message);
+
+  bool Convert(std::string& error_message);
+
+  size_t file_count() const { return inputs_.size(); }
+  int64_t error_count() const { return error_count_; }
+  int64_t input_bytes() const { return input_bytes_; }
+  int64_t peak_in_flight_bytes() const { return peak_in_flight_bytes_; }
+  int64_t steal_count() const { return steal_count_; }
+
+  void RunTask(size_t task_index, int worker_index) override;
+
+private:
+  struct Input {
+    base::FilePath input_path;
+    base::FilePath output_path;
+  };
+
+  // The output is |relative_path| below the output dir, with a .pb extension.
+  void AddInput(
+    const base::FilePath& input_path,
+    const base::FilePath& relative_path);
+
+  bool ConvertOnCoroutinePipeline(std::string& error_message);
+
+  void AcquireMemory(int64_t bytes);
+  void ReleaseMemory(int64_t bytes);
+
+private:
+  const base::FilePath output_dir_;
+  const int worker_count_;
+  const int64_t memory_budget_;
+  const SchemaMode schema_mode_;
+  size_t max_enum_cardinality_;
+  bool use_coroutine_pipeline_;
+
+  std::vector<Input> inputs_;
+  std::vector<std::unique_ptr<ConversionWorker>> workers_;
+
+  base::Lock lock_;
+  base::ConditionVariable memory_available_;
+  int64_t in_flight_bytes_;
+  int64_t peak_in_flight_bytes_;
+  int64_t input_bytes_;
+  int64_t error_count_;
+  // 取下标最小的失败文件, 多线程下报错也是确定的
+  size_t first_error_index_;
+  std::string first_error_;
+  int64_t steal_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(BatchConverter);
+};
+
+} // namespace self
+#endif // BATCH_CONVERTER_H_
@@ -0,0 +1,81 @@
+#include "batch_converter.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/stringprintf.h"
+#include "coroutine_pipeline.h"
+#include "json_input_generator.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+const int kFileCount = 24;
+const int kWorkerCount = 4;
+const int64_t kMemoryBudget = 64 << 20;
+
+// Converts every file of |input_dir| into |output_dir|.
+void ConvertDirectory(
+  const base::FilePath& input_dir,
+  const base::FilePath& output_dir,
+  bool use_coroutine_pipeline) {
+  BatchConverter batch_converter(output_dir, kWorkerCount, kMemoryBudget, SchemaMode::kUnified);
+  batch_converter.set_use_coroutine_pipeline(use_coroutine_pipeline);
+  std::string error_message;
+  ASSERT_TRUE(batch_converter.AddInputDirectory(input_dir, error_message)) << error_message;
+  ASSERT_TRUE(batch_converter.Convert(error_message)) << error_message;
+  EXPECT_EQ(static_cast<size_t>(kFileCount), batch_converter.file_count());
+  EXPECT_EQ(0, batch_converter.error_count());
+}
+
+} // namespace
+
+// The coroutine pipeline writes what the batch mode writes, file by file.
+TEST(BatchConverterTest, PipelineSameAsBatch) {
+  if (!CoroutinePipeline::IsSupported()) {
+    return;
+  }
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath input_dir = temp_dir.GetPath().AppendASCII("input");
+  // 一半放在子目录里, 输出也要按相对路径放
+  const base::FilePath sub_dir = input_dir.AppendASCII("sub");
+  ASSERT_TRUE(base::CreateDirectory(sub_dir));
+  std::vector<base::FilePath> relative_paths;
+  for (int index = 0; index < kFileCount; index++) {
+    // 几个大文件, 流水线要分几块读写
+    const std::string json = index % 8 == 0 ?
+      GenerateParallelDocument(256 * 1024) : GenerateWideArray(5 + index);
+    const base::FilePath relative_path = (index % 2 ?
+      base::FilePath(FILE_PATH_LITERAL("sub")) : base::FilePath())
+      .AppendASCII(base::StringPrintf("%06d.json", index));
+    ASSERT_EQ(static_cast<int>(json.size()), base::WriteFile(
+      input_dir.Append(relative_path), json.data(), static_cast<int>(json.size())));
+    relative_paths.push_back(relative_path);
+  }
+
+  const base::FilePath batch_output_dir = temp_dir.GetPath().AppendASCII("batch");
+  const base::FilePath pipeline_output_dir = temp_dir.GetPath().AppendASCII("pipeline");
+  ASSERT_NO_FATAL_FAILURE(ConvertDirectory(input_dir, batch_output_dir, false));
+  ASSERT_NO_FATAL_FAILURE(ConvertDirectory(input_dir, pipeline_output_dir, true));
+  for (const base::FilePath& relative_path : relative_paths) {
+    const base::FilePath output_path = relative_path.ReplaceExtension(FILE_PATH_LITERAL("pb"));
+    std::string batch_output;
+    std::string pipeline_output;
+    ASSERT_TRUE(base::ReadFileToString(batch_output_dir.Append(output_path), &batch_output))
+      << output_path.value();
+    ASSERT_TRUE(base::ReadFileToString(
+      pipeline_output_dir.Append(output_path), &pipeline_output)) << output_path.value();
+    EXPECT_FALSE(batch_output.empty());
+    EXPECT_EQ(batch_output, pipeline_output) << output_path.value();
+  }
+}
+
+} // namespace self
@@ -5,55 +5,74 @@
 #include "base/files/file_path.h"
 #include "base/macros.h"
 
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+
 namespace base {
   class DictionaryValue;
-  class ListValue;
 }
 
 namespace google {
 namespace protobuf {
-  class DescriptorProto;
   class FileDescriptorProto;
 } // namespace protobuf
 } // google
 
 namespace self {
+class JsonInputStream;
+
+enum class SchemaMode {
+  // 数组的每个元素生成一个 message 类型, 原来的行为
+  kPerElement,
+  // 数组的元素合并成一个 repeated 类型, 见 JsonUnifiedSchemaBuilder
+  kUnified,
+  // kUnified 的基础上按编码大小优化: 按出现的值选最窄的类型, 标量数组 packed,
+  // 出现最多的 key 用 1 字节的 tag
+  kCompact
+};
+
+class JsonSchemaBuilder;
+
 class BuildProtoFromJson {
 public:
   BuildProtoFromJson();
 
   ~BuildProtoFromJson();
 
-  std::unique_ptr<google::protobuf::FileDescriptorProto> 
-    CreateProtoFile(const base::DictionaryValue* dict_value);
+  // An empty proto file named and packaged like every generated schema.
+  static std::unique_ptr<google::protobuf::FileDescriptorProto> NewProtoFile();
 
-private:
-  void BuildProtoRecurveDictionaryValue(
-    const base::DictionaryValue* dict_value,
-    const std::string& key_name,
-    google::protobuf::DescriptorProto* parent_desc_proto,
+  // The builder that writes the schema of the events it receives into
+  // |file_desc_proto|. |max_enum_cardinality| only matters to kCompact.
+  static std::unique_ptr<JsonSchemaBuilder> CreateSchemaBuilder(
+    SchemaMode schema_mode,
+    size_t max_enum_cardinality,
     google::protobuf::FileDescriptorProto* file_desc_proto);
 
-  void BuildProtoRecurveListValue(
-    const base::ListValue* list_value,
-    const std::string& key_name,
-    google::protobuf::DescriptorProto* parent_desc_proto,
-    google::protobuf::FileDescriptorProto* file_desc_proto);
+  // kCompact: string fields with more distinct values stay strings, see
+  // JsonUnifiedSchemaBuilder.
+  void set_max_enum_cardinality(size_t max_enum_cardinality) {
+    max_enum_cardinality_ = max_enum_cardinality;
+  }
 
-  void BuildProtoJudgeType(
-    const base::Value* value,
-    const std::string& key_name,
-    google::protobuf::DescriptorProto* parent_desc_proto,
-    google::protobuf::FileDescriptorProto* file_desc_proto);
+  std::unique_ptr<google::protobuf::FileDescriptorProto>
+    CreateProtoFile(
+      const base::DictionaryValue* dict_value,
+      SchemaMode schema_mode,
+      std::string& error_message);
 
-  void BuildProtoListValueLogical(
-    const base::Value* value,
-    const std::string& key_name,
-    google::protobuf::DescriptorProto* desc_proto,
-    google::protobuf::FileDescriptorProto* file_desc_proto);
+  // Infers the schema from parse events instead of a base::Value tree.
+  std::unique_ptr<google::protobuf::FileDescriptorProto>
+    CreateProtoFileFromStream(
+      JsonInputStream* input_stream,
+      SchemaMode schema_mode,
+      std::string& error_message);
 
 private:
   const base::FilePath output_file_path_;
+  size_t max_enum_cardinality_;
 
 private:
   DISALLOW_COPY_AND_ASSIGN(BuildProtoFromJson);
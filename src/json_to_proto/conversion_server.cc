@@ -0,0 +1,656 @@
+#include "conversion_server.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/threading/simple_thread.h"
+#include "build/build_config.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "conversion_worker.h"
+
+#if defined(OS_POSIX)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace self {
+
+namespace {
+static const uint32_t kProtocolVersion = 1;
+static const size_t kFrameHeaderSize = 4;
+// 一帧最多 1 GB, 长度坏掉时不会去分配离谱的内存
+static const uint32_t kMaxFrameSize = 1u << 30;
+static const int kMaxSchemaMode = static_cast<int>(SchemaMode::kCompact);
+// 每个线程留的 ConversionWorker 个数上限, 请求换着用很多种枚举上限时淘汰最久没用的,
+// 每个 worker 都留着它推导过的 schema
+static const size_t kMaxConversionWorkers = 4;
+
+void WriteLengthDelimited(
+  google::protobuf::io::CodedOutputStream* coded_output,
+  const std::string& value) {
+  coded_output->WriteVarint32(static_cast<uint32_t>(value.size()));
+  coded_output->WriteString(value);
+}
+
+// Leaves room for the frame header at the front of |frame|.
+void BeginFrame(std::string* frame) {
+  frame->assign(kFrameHeaderSize, '\0');
+}
+
+// Writes the length of the frame into its header.
+void EndFrame(std::string* frame) {
+  google::protobuf::io::CodedOutputStream::WriteLittleEndian32ToArray(
+    static_cast<uint32_t>(frame->size() - kFrameHeaderSize),
+    reinterpret_cast<uint8_t*>(&(*frame)[0]));
+}
+
+void EncodeRequest(const ConversionRequest& request, std::string* frame) {
+  BeginFrame(frame);
+  {
+    google::protobuf::io::StringOutputStream string_output(frame);
+    google::protobuf::io::CodedOutputStream coded_output(&string_output);
+    coded_output.WriteVarint32(kProtocolVersion);
+    coded_output.WriteVarint32(static_cast<uint32_t>(request.type));
+    coded_output.WriteVarint32(static_cast<uint32_t>(request.schema_mode));
+    coded_output.WriteVarint64(request.max_enum_cardinality);
+    WriteLengthDelimited(&coded_output, request.input_path.AsUTF8Unsafe());
+    WriteLengthDelimited(&coded_output, request.output_path.AsUTF8Unsafe());
+  }
+  // 输入放在最后不带长度, 不用再编码一遍
+  frame->append(request.input);
+  EndFrame(frame);
+}
+
+bool DecodeRequest(const std::string& body, ConversionRequest* request) {
+  google::protobuf::io::CodedInputStream coded_input(
+    reinterpret_cast<const uint8_t*>(body.data()), static_cast<int>(body.size()));
+  uint32_t version = 0;
+  uint32_t type = 0;
+  uint32_t schema_mode = 0;
+  uint64_t max_enum_cardinality = 0;
+  std::string input_path;
+  std::string output_path;
+  uint32_t size = 0;
+  if (!coded_input.ReadVarint32(&version) || version != kProtocolVersion ||
+      !coded_input.ReadVarint32(&type) ||
+      type > static_cast<uint32_t>(ConversionRequest::Type::kShutdown) ||
+      !coded_input.ReadVarint32(&schema_mode) ||
+      schema_mode > static_cast<uint32_t>(kMaxSchemaMode) ||
+      !coded_input.ReadVarint64(&max_enum_cardinality) ||
+      !coded_input.ReadVarint32(&size) || !coded_input.ReadString(&input_path, size) ||
+      !coded_input.ReadVarint32(&size) || !coded_input.ReadString(&output_path, size)) {
+    return false;
+  }
+  request->type = static_cast<ConversionRequest::Type>(type);
+  request->schema_mode = static_cast<SchemaMode>(schema_mode);
+  request->max_enum_cardinality = static_cast<size_t>(max_enum_cardinality);
+  request->input_path = base::FilePath::FromUTF8Unsafe(input_path);
+  request->output_path = base::FilePath::FromUTF8Unsafe(output_path);
+  request->input.assign(body, coded_input.CurrentPosition(), std::string::npos);
+  return true;
+}
+
+void EncodeResponse(const ConversionResponse& response, std::string* frame) {
+  BeginFrame(frame);
+  {
+    google::protobuf::io::StringOutputStream string_output(frame);
+    google::protobuf::io::CodedOutputStream coded_output(&string_output);
+    coded_output.WriteVarint32(response.succeeded ? 1 : 0);
+    WriteLengthDelimited(&coded_output, response.error_message);
+  }
+  frame->append(response.output);
+  EndFrame(frame);
+}
+
+bool DecodeResponse(const std::string& body, ConversionResponse* response) {
+  google::protobuf::io::CodedInputStream coded_input(
+    reinterpret_cast<const uint8_t*>(body.data()), static_cast<int>(body.size()));
+  uint32_t succeeded = 0;
+  uint32_t size = 0;
+  if (!coded_input.ReadVarint32(&succeeded) ||
+      !coded_input.ReadVarint32(&size) ||
+      !coded_input.ReadString(&response->error_message, size)) {
+    return false;
+  }
+  response->succeeded = succeeded != 0;
+  response->output.assign(body, coded_input.CurrentPosition(), std::string::npos);
+  return true;
+}
+
+#if defined(OS_POSIX)
+#if defined(MSG_NOSIGNAL)
+// 对方关了连接时 send 返回 EPIPE, 不要 SIGPIPE 把进程杀掉
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+bool SendAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = ::send(fd, data, size, kSendFlags);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+// False at the end of the stream too, with |*end_of_stream| set when it
+// came before the first byte.
+bool ReceiveAll(int fd, char* data, size_t size, bool* end_of_stream) {
+  *end_of_stream = false;
+  size_t received = 0;
+  while (received < size) {
+    ssize_t count = ::recv(fd, data + received, size - received, 0);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (count == 0) {
+      *end_of_stream = received == 0;
+      return false;
+    }
+    received += static_cast<size_t>(count);
+  }
+  return true;
+}
+
+// Reads the body of the next frame. False with an empty |error_message| when
+// the peer closed the connection between frames.
+bool ReceiveFrame(int fd, std::string* body, std::string& error_message) {
+  char header[kFrameHeaderSize];
+  bool end_of_stream = false;
+  if (!ReceiveAll(fd, header, kFrameHeaderSize, &end_of_stream)) {
+    if (!end_of_stream) {
+      error_message = "receive frame fail";
+    }
+    return false;
+  }
+  uint32_t size = 0;
+  google::protobuf::io::CodedInputStream::ReadLittleEndian32FromArray(
+    reinterpret_cast<const uint8_t*>(header), &size);
+  if (size > kMaxFrameSize) {
+    error_message = "frame too large";
+    return false;
+  }
+  body->resize(size);
+  if (size > 0 && !ReceiveAll(fd, &(*body)[0], size, &end_of_stream)) {
+    error_message = "receive frame fail";
+    return false;
+  }
+  return true;
+}
+
+bool FillSocketAddress(
+  const base::FilePath& socket_path,
+  struct sockaddr_un* address,
+  std::string& error_message) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  const std::string& path = socket_path.value();
+  if (path.empty() || path.size() >= sizeof(address->sun_path)) {
+    error_message = "invalid socket path: " + path;
+    return false;
+  }
+  memcpy(address->sun_path, path.data(), path.size());
+  return true;
+}
+
+int NewSocket() {
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+#if defined(SO_NOSIGPIPE)
+  if (fd >= 0) {
+    int value = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &value, sizeof(value));
+  }
+#endif
+  return fd;
+}
+
+bool SetNonBlocking(int fd) {
+  int flags = ::fcntl(fd, F_GETFL);
+  return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+void CloseFd(int* fd) {
+  if (*fd >= 0) {
+    ::close(*fd);
+    *fd = -1;
+  }
+}
+#endif
+}
+
+ConversionRequest::ConversionRequest()
+  : type(Type::kConvertFile),
+    schema_mode(SchemaMode::kPerElement),
+    max_enum_cardinality(0) {
+}
+
+ConversionRequest::~ConversionRequest() {
+}
+
+ConversionResponse::ConversionResponse()
+  : succeeded(false) {
+}
+
+ConversionResponse::~ConversionResponse() {
+}
+
+// A worker thread, answering one request at a time with the
+// ConversionWorkers it keeps for the whole life of the server.
+class ConversionServer::Worker : public base::DelegateSimpleThread::Delegate {
+public:
+  explicit Worker(ConversionServer* server)
+    : server_(server),
+      use_count_(0) {
+  }
+
+  void Run() override;
+
+private:
+  // False when the connection is done with, closed by the client or broken.
+  bool ServeRequest(int connection_fd);
+
+  void Handle(const ConversionRequest& request, ConversionResponse* response);
+
+  ConversionWorker* GetConversionWorker(const ConversionRequest& request);
+
+  struct ConversionWorkerEntry {
+    std::unique_ptr<ConversionWorker> conversion_worker;
+    uint64_t last_use;
+  };
+  typedef std::map<std::pair<SchemaMode, size_t>, ConversionWorkerEntry> ConversionWorkerMap;
+
+private:
+  ConversionServer* const server_;
+  // 每种 schema 模式和枚举上限各一个, 客户端一般只用一种, 最多留 kMaxConversionWorkers 个
+  ConversionWorkerMap conversion_workers_;
+  uint64_t use_count_;
+  std::string frame_;
+  ConversionRequest request_;
+  ConversionResponse response_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
+void ConversionServer::Worker::Run() {
+  int connection_fd = -1;
+  while (server_->TakeConnection(&connection_fd)) {
+    if (ServeRequest(connection_fd)) {
+      server_->ReturnConnection(connection_fd);
+    } else {
+#if defined(OS_POSIX)
+      ::close(connection_fd);
+#endif
+    }
+  }
+}
+
+bool ConversionServer::Worker::ServeRequest(int connection_fd) {
+#if defined(OS_POSIX)
+  std::string error_message;
+  if (!ReceiveFrame(connection_fd, &frame_, error_message)) {
+    if (!error_message.empty()) {
+      DLOG(WARNING) << "conversion server connection: " << error_message;
+    }
+    return false;
+  }
+  response_.succeeded = false;
+  response_.error_message.clear();
+  response_.output.clear();
+  if (DecodeRequest(frame_, &request_)) {
+    Handle(request_, &response_);
+  } else {
+    response_.error_message = "invalid request";
+  }
+  server_->CountRequest(response_.succeeded);
+  EncodeResponse(response_, &frame_);
+  if (!SendAll(connection_fd, frame_.data(), frame_.size())) {
+    return false;
+  }
+  // 回复发出去以后再停
+  if (response_.succeeded && request_.type == ConversionRequest::Type::kShutdown) {
+    server_->Stop();
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ConversionServer::Worker::Handle(
+  const ConversionRequest& request,
+  ConversionResponse* response) {
+  switch (request.type) {
+    case ConversionRequest::Type::kConvertFile:
+      // 服务端的工作目录和客户端的不一样
+      if (!request.input_path.IsAbsolute() || !request.output_path.IsAbsolute()) {
+        response->error_message = "input and output paths have to be absolute";
+        return;
+      }
+      response->succeeded = GetConversionWorker(request)->ConvertFile(
+        request.input_path, request.output_path, response->error_message);
+      return;
+    case ConversionRequest::Type::kConvertInline:
+      response->succeeded = GetConversionWorker(request)->Convert(
+        request.input, &response->output, response->error_message);
+      if (!response->succeeded) {
+        response->output.clear();
+      }
+      return;
+    case ConversionRequest::Type::kShutdown:
+      response->succeeded = true;
+      return;
+  }
+}
+
+ConversionWorker* ConversionServer::Worker::GetConversionWorker(
+  const ConversionRequest& request) {
+  // 枚举上限只有 kCompact 用得上, 其他模式不按它分开
+  const size_t max_enum_cardinality =
+    request.schema_mode == SchemaMode::kCompact ? request.max_enum_cardinality : 0;
+  const ConversionWorkerMap::key_type key(request.schema_mode, max_enum_cardinality);
+  auto iter = conversion_workers_.find(key);
+  if (iter == conversion_workers_.end()) {
+    if (conversion_workers_.size() >= kMaxConversionWorkers) {
+      conversion_workers_.erase(std::min_element(
+        conversion_workers_.begin(), conversion_workers_.end(),
+        [](const ConversionWorkerMap::value_type& left,
+           const ConversionWorkerMap::value_type& right) {
+          return left.second.last_use < right.second.last_use;
+        }));
+    }
+    iter = conversion_workers_.insert(std::make_pair(key, ConversionWorkerEntry())).first;
+    iter->second.conversion_worker.reset(
+      new ConversionWorker(request.schema_mode, max_enum_cardinality));
+  }
+  iter->second.last_use = ++use_count_;
+  return iter->second.conversion_worker.get();
+}
+
+ConversionServer::ConversionServer(const base::FilePath& socket_path, int worker_count)
+  : socket_path_(socket_path),
+    worker_count_(worker_count > 0 ? worker_count : 1),
+    listen_fd_(-1),
+    connection_available_(&lock_),
+    stopping_(false),
+    connection_count_(0),
+    request_count_(0),
+    error_count_(0) {
+  wake_fds_[0] = -1;
+  wake_fds_[1] = -1;
+}
+
+ConversionServer::~ConversionServer() {
+  DCHECK(threads_.empty());
+#if defined(OS_POSIX)
+  CloseFd(&listen_fd_);
+  CloseFd(&wake_fds_[0]);
+  CloseFd(&wake_fds_[1]);
+#endif
+}
+
+bool ConversionServer::Start(std::string& error_message) {
+#if defined(OS_POSIX)
+  struct sockaddr_un address;
+  if (!FillSocketAddress(socket_path_, &address, error_message)) {
+    return false;
+  }
+  if (base::PathExists(socket_path_)) {
+    ConversionClient probe_client;
+    std::string probe_error;
+    if (probe_client.Connect(socket_path_, probe_error)) {
+      error_message = "a server is listening on " + socket_path_.AsUTF8Unsafe();
+      return false;
+    }
+    if (!base::DeleteFile(socket_path_, false)) {
+      error_message = "remove stale socket fail: " + socket_path_.AsUTF8Unsafe();
+      return false;
+    }
+  }
+  // 管道写满时 Run() 反正会醒, worker 不能卡在这里
+  if (::pipe(wake_fds_) != 0 || !SetNonBlocking(wake_fds_[0]) || !SetNonBlocking(wake_fds_[1])) {
+    error_message = "create wake pipe fail";
+    return false;
+  }
+  listen_fd_ = NewSocket();
+  if (listen_fd_ < 0 ||
+      ::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+      ::listen(listen_fd_, SOMAXCONN) != 0) {
+    error_message = std::string("listen on socket fail: ") + strerror(errno);
+    CloseFd(&listen_fd_);
+    return false;
+  }
+  return true;
+#else
+  error_message = "the conversion server needs unix domain sockets";
+  return false;
+#endif
+}
+
+void ConversionServer::Run() {
+#if defined(OS_POSIX)
+  DCHECK(listen_fd_ >= 0);
+  for (int index = 0; index < worker_count_; index++) {
+    workers_.emplace_back(new Worker(this));
+    threads_.emplace_back(
+      new base::DelegateSimpleThread(workers_.back().get(), "json_to_proto_server"));
+    threads_.back()->Start();
+  }
+
+  // 等下一个请求的连接, 只有这个线程碰
+  std::vector<int> idle_connections;
+  std::vector<int> ready_connections;
+  std::vector<struct pollfd> poll_fds;
+  while (true) {
+    poll_fds.clear();
+    poll_fds.push_back({listen_fd_, POLLIN, 0});
+    poll_fds.push_back({wake_fds_[0], POLLIN, 0});
+    for (int connection_fd : idle_connections) {
+      poll_fds.push_back({connection_fd, POLLIN, 0});
+    }
+    if (::poll(&poll_fds[0], poll_fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DPLOG(ERROR) << "poll fail";
+      break;
+    }
+
+    // 连接断开也算可读, 交给 worker 读到结束再关
+    ready_connections.clear();
+    size_t idle_count = 0;
+    for (size_t index = 0; index < idle_connections.size(); index++) {
+      if (poll_fds[index + 2].revents != 0) {
+        ready_connections.push_back(idle_connections[index]);
+      } else {
+        idle_connections[idle_count++] = idle_connections[index];
+      }
+    }
+    idle_connections.resize(idle_count);
+
+    if (poll_fds[1].revents != 0) {
+      char bytes[64];
+      while (::read(wake_fds_[0], bytes, sizeof(bytes)) > 0) {
+      }
+    }
+    if (poll_fds[0].revents & POLLIN) {
+      int connection_fd = ::accept(listen_fd_, nullptr, nullptr);
+      if (connection_fd >= 0) {
+        connection_count_++;
+        idle_connections.push_back(connection_fd);
+      }
+    }
+
+    base::AutoLock auto_lock(lock_);
+    if (stopping_) {
+      idle_connections.insert(idle_connections.end(),
+        ready_connections.begin(), ready_connections.end());
+      break;
+    }
+    idle_connections.insert(idle_connections.end(),
+      returned_connections_.begin(), returned_connections_.end());
+    returned_connections_.clear();
+    for (int connection_fd : ready_connections) {
+      pending_connections_.push_back(connection_fd);
+      connection_available_.Signal();
+    }
+  }
+
+  {
+    base::AutoLock auto_lock(lock_);
+    stopping_ = true;
+    connection_available_.Broadcast();
+  }
+  for (const std::unique_ptr<base::DelegateSimpleThread>& thread : threads_) {
+    thread->Join();
+  }
+  threads_.clear();
+  workers_.clear();
+  idle_connections.insert(idle_connections.end(),
+    pending_connections_.begin(), pending_connections_.end());
+  idle_connections.insert(idle_connections.end(),
+    returned_connections_.begin(), returned_connections_.end());
+  for (int connection_fd : idle_connections) {
+    ::close(connection_fd);
+  }
+  pending_connections_.clear();
+  returned_connections_.clear();
+  CloseFd(&listen_fd_);
+  base::DeleteFile(socket_path_, false);
+#endif
+}
+
+void ConversionServer::Stop() {
+  {
+    base::AutoLock auto_lock(lock_);
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+  }
+  Wake();
+}
+
+bool ConversionServer::TakeConnection(int* connection_fd) {
+  base::AutoLock auto_lock(lock_);
+  while (!stopping_ && pending_connections_.empty()) {
+    connection_available_.Wait();
+  }
+  if (stopping_) {
+    return false;
+  }
+  *connection_fd = pending_connections_.front();
+  pending_connections_.pop_front();
+  return true;
+}
+
+void ConversionServer::ReturnConnection(int connection_fd) {
+  {
+    base::AutoLock auto_lock(lock_);
+    returned_connections_.push_back(connection_fd);
+  }
+  Wake();
+}
+
+void ConversionServer::Wake() {
+#if defined(OS_POSIX)
+  char byte = 0;
+  while (::write(wake_fds_[1], &byte, 1) < 0 && errno == EINTR) {
+  }
+#endif
+}
+
+void ConversionServer::CountRequest(bool succeeded) {
+  base::AutoLock auto_lock(lock_);
+  request_count_++;
+  if (!succeeded) {
+    error_count_++;
+  }
+}
+
+ConversionClient::ConversionClient()
+  : socket_fd_(-1) {
+}
+
+ConversionClient::~ConversionClient() {
+#if defined(OS_POSIX)
+  CloseFd(&socket_fd_);
+#endif
+}
+
+bool ConversionClient::Connect(
+  const base::FilePath& socket_path,
+  std::string& error_message) {
+#if defined(OS_POSIX)
+  CloseFd(&socket_fd_);
+  struct sockaddr_un address;
+  if (!FillSocketAddress(socket_path, &address, error_message)) {
+    return false;
+  }
+  socket_fd_ = NewSocket();
+  if (socket_fd_ < 0 ||
+      ::connect(socket_fd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+    error_message = "connect to " + socket_path.AsUTF8Unsafe() + " fail: " + strerror(errno);
+    CloseFd(&socket_fd_);
+    return false;
+  }
+  return true;
+#else
+  error_message = "the conversion server needs unix domain sockets";
+  return false;
+#endif
+}
+
+bool ConversionClient::Send(
+  const ConversionRequest& request,
+  ConversionResponse* response,
+  std::string& error_message) {
+#if defined(OS_POSIX)
+  if (socket_fd_ < 0) {
+    error_message = "not connected";
+    return false;
+  }
+  EncodeRequest(request, &frame_);
+  if (!SendAll(socket_fd_, frame_.data(), frame_.size())) {
+    error_message = "send request fail";
+    return false;
+  }
+  if (!ReceiveFrame(socket_fd_, &frame_, error_message)) {
+    if (error_message.empty()) {
+      error_message = "server closed the connection";
+    }
+    return false;
+  }
+  if (!DecodeResponse(frame_, response)) {
+    error_message = "invalid response";
+    return false;
+  }
+  return true;
+#else
+  error_message = "the conversion server needs unix domain sockets";
+  return false;
+#endif
+}
+
+} //namespace self
@@ -0,0 +1,159 @@
+#ifndef CONVERSION_SERVER_H_
+#define CONVERSION_SERVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/macros.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "build_proto_from_json.h"
+
+namespace base {
+class DelegateSimpleThread;
+}
+
+namespace self {
+
+// A request to a ConversionServer. On the socket every request and response
+// is a frame, a little endian uint32 length and that many bytes:
+//
+//   request    varint version, type, schema mode, max enum cardinality,
+//              length delimited input path and output path, then the json
+//              of an inline request up to the end of the frame
+//   response   varint succeeded, length delimited error message, then the
+//              output of an inline request up to the end of the frame
+struct ConversionRequest {
+  enum class Type {
+    // Converts the file at |input_path| to |output_path|, both absolute paths
+    // the server can reach.
+    kConvertFile,
+    // Converts |input|, the output comes back in the response.
+    kConvertInline,
+    // Stops the server once the response is sent.
+    kShutdown,
+  };
+
+  ConversionRequest();
+  ~ConversionRequest();
+
+  Type type;
+  SchemaMode schema_mode;
+  size_t max_enum_cardinality;
+  base::FilePath input_path;
+  base::FilePath output_path;
+  std::string input;
+};
+
+struct ConversionResponse {
+  ConversionResponse();
+  ~ConversionResponse();
+
+  bool succeeded;
+  std::string error_message;
+  // The encoding of the root message of a kConvertInline request.
+  std::string output;
+};
+
+// Converts json for the clients of a Unix domain socket, so converting a
+// small file does not pay process startup, protobuf initialization and
+// schema inference every time. Run() polls the idle connections and hands
+// one with a request to a worker thread, which answers that request and gives
+// the connection back, so any number of connections share the workers. Each
+// worker keeps a ConversionWorker per schema mode, whose descriptor pools,
+// binding plans and arena stay warm from request to request.
+class ConversionServer {
+public:
+  ConversionServer(const base::FilePath& socket_path, int worker_count);
+
+  ~ConversionServer();
+
+  // Listens on the socket path. A socket file nobody answers on is left over
+  // from a server that died and is replaced.
+  bool Start(std::string& error_message);
+
+  // Serves until a kShutdown request or Stop(), then waits for the requests
+  // being converted, closes the connections and removes the socket file.
+  void Run();
+
+  // Makes Run() return, from any thread.
+  void Stop();
+
+  int worker_count() const { return worker_count_; }
+
+  // Only read once Run() returned.
+  int64_t connection_count() const { return connection_count_; }
+  int64_t request_count() const { return request_count_; }
+  int64_t error_count() const { return error_count_; }
+
+private:
+  class Worker;
+
+  // A connection with a request to read, false when the server stops.
+  bool TakeConnection(int* connection_fd);
+
+  // Gives a connection whose request was answered back to Run().
+  void ReturnConnection(int connection_fd);
+
+  // Wakes Run() up from poll.
+  void Wake();
+
+  void CountRequest(bool succeeded);
+
+private:
+  const base::FilePath socket_path_;
+  const int worker_count_;
+  int listen_fd_;
+  // 写一个字节把 Run() 从 poll 里叫醒
+  int wake_fds_[2];
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads_;
+
+  base::Lock lock_;
+  base::ConditionVariable connection_available_;
+  // 有请求可读, 等 worker 来取的连接
+  std::deque<int> pending_connections_;
+  // worker 答完一个请求还回来, 等 Run() 重新 poll 的连接
+  std::vector<int> returned_connections_;
+  bool stopping_;
+  int64_t connection_count_;
+  int64_t request_count_;
+  int64_t error_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ConversionServer);
+};
+
+// One connection to a ConversionServer, requests are sent one at a time.
+class ConversionClient {
+public:
+  ConversionClient();
+
+  ~ConversionClient();
+
+  bool Connect(const base::FilePath& socket_path, std::string& error_message);
+
+  // Sends |request| and waits for its response. False when the connection
+  // fails, a request the server could not convert is a response that did
+  // not succeed.
+  bool Send(
+    const ConversionRequest& request,
+    ConversionResponse* response,
+    std::string& error_message);
+
+private:
+  int socket_fd_;
+  std::string frame_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ConversionClient);
+};
+
+} // namespace self
+#endif // CONVERSION_SERVER_H_
@@ -0,0 +1,169 @@
+#include "conversion_server.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/macros.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/threading/simple_thread.h"
+#include "build/build_config.h"
+#include "conversion_worker.h"
+#include "json_input_generator.h"
+#include "json_unified_schema_builder.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+#if defined(OS_POSIX)
+
+namespace {
+
+const int kFileCount = 4;
+const int kWorkerCount = 2;
+
+class ServerRunner : public base::DelegateSimpleThread::Delegate {
+public:
+  explicit ServerRunner(ConversionServer* server)
+    : server_(server) {
+  }
+
+  void Run() override { server_->Run(); }
+
+private:
+  ConversionServer* const server_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ServerRunner);
+};
+
+// Sends every input inline and as a file and compares the responses with the
+// output of a ConversionWorker in this process. A failed assertion only
+// returns from here, the test still shuts the server down.
+void ExpectSameAsWorker(
+  const base::FilePath& temp_dir,
+  const std::vector<std::string>& inputs,
+  const std::vector<base::FilePath>& input_paths,
+  ConversionClient* client) {
+  std::string error_message;
+  ConversionWorker worker(SchemaMode::kPerElement,
+    JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality);
+  for (size_t index = 0; index < inputs.size(); index++) {
+    std::string output;
+    ASSERT_TRUE(worker.Convert(inputs[index], &output, error_message)) << error_message;
+
+    ConversionRequest request;
+    request.type = ConversionRequest::Type::kConvertInline;
+    request.max_enum_cardinality = JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality;
+    request.input = inputs[index];
+    ConversionResponse response;
+    ASSERT_TRUE(client->Send(request, &response, error_message)) << error_message;
+    EXPECT_TRUE(response.succeeded) << response.error_message;
+    EXPECT_EQ(output, response.output) << index;
+
+    const std::string name = base::SizeTToString(index);
+    const base::FilePath worker_output_path = temp_dir.AppendASCII(name + "_worker.pb");
+    ConversionRequest file_request;
+    file_request.max_enum_cardinality = JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality;
+    file_request.input_path = input_paths[index];
+    file_request.output_path = temp_dir.AppendASCII(name + "_server.pb");
+    ASSERT_TRUE(client->Send(file_request, &response, error_message)) << error_message;
+    EXPECT_TRUE(response.succeeded) << response.error_message;
+    ASSERT_TRUE(worker.ConvertFile(input_paths[index], worker_output_path, error_message))
+      << error_message;
+    std::string server_output;
+    std::string worker_output;
+    ASSERT_TRUE(base::ReadFileToString(file_request.output_path, &server_output));
+    ASSERT_TRUE(base::ReadFileToString(worker_output_path, &worker_output));
+    EXPECT_EQ(worker_output, server_output) << index;
+  }
+}
+
+// Starts a server on a socket in a temp dir and connects a client to it.
+class ConversionServerTest : public testing::Test {
+protected:
+  ConversionServerTest()
+    : connected_(false) {
+  }
+
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    const base::FilePath socket_path = temp_dir_.GetPath().AppendASCII("server.sock");
+    server_.reset(new ConversionServer(socket_path, kWorkerCount));
+    std::string error_message;
+    ASSERT_TRUE(server_->Start(error_message)) << error_message;
+    server_runner_.reset(new ServerRunner(server_.get()));
+    server_thread_.reset(
+      new base::DelegateSimpleThread(server_runner_.get(), "conversion_server"));
+    server_thread_->Start();
+    connected_ = client_.Connect(socket_path, error_message);
+    ASSERT_TRUE(connected_) << error_message;
+  }
+
+  void TearDown() override {
+    if (!server_thread_) {
+      return;
+    }
+    ConversionRequest request;
+    request.type = ConversionRequest::Type::kShutdown;
+    ConversionResponse response;
+    std::string error_message;
+    if (!connected_ || !client_.Send(request, &response, error_message)) {
+      // 连接坏了也要让 server 线程退出
+      server_->Stop();
+    }
+    server_thread_->Join();
+  }
+
+  base::ScopedTempDir temp_dir_;
+  std::unique_ptr<ConversionServer> server_;
+  std::unique_ptr<ServerRunner> server_runner_;
+  std::unique_ptr<base::DelegateSimpleThread> server_thread_;
+  ConversionClient client_;
+  bool connected_;
+};
+
+} // namespace
+
+TEST_F(ConversionServerTest, SameAsWorker) {
+  std::vector<std::string> inputs;
+  std::vector<base::FilePath> input_paths;
+  for (int index = 0; index < kFileCount; index++) {
+    inputs.push_back(GenerateRecord(index));
+    input_paths.push_back(temp_dir_.GetPath().AppendASCII(base::IntToString(index) + ".json"));
+    ASSERT_EQ(static_cast<int>(inputs.back().size()), base::WriteFile(
+      input_paths.back(), inputs.back().data(), static_cast<int>(inputs.back().size())));
+  }
+  ExpectSameAsWorker(temp_dir_.GetPath(), inputs, input_paths, &client_);
+}
+
+// Requests cycling through more enum cardinalities than a server thread keeps
+// workers for still convert like a worker with their cardinality.
+TEST_F(ConversionServerTest, ManyEnumCardinalities) {
+  const std::string input = "{\"a\":[\"x\",\"y\",\"z\",\"x\"],\"b\":\"y\"}";
+  std::string error_message;
+  for (int round = 0; round < 2; round++) {
+    for (size_t max_enum_cardinality = 1; max_enum_cardinality <= 10; max_enum_cardinality++) {
+      ConversionWorker worker(SchemaMode::kCompact, max_enum_cardinality);
+      std::string output;
+      ASSERT_TRUE(worker.Convert(input, &output, error_message)) << error_message;
+
+      ConversionRequest request;
+      request.type = ConversionRequest::Type::kConvertInline;
+      request.schema_mode = SchemaMode::kCompact;
+      request.max_enum_cardinality = max_enum_cardinality;
+      request.input = input;
+      ConversionResponse response;
+      ASSERT_TRUE(client_.Send(request, &response, error_message)) << error_message;
+      EXPECT_TRUE(response.succeeded) << response.error_message;
+      EXPECT_EQ(output, response.output) << max_enum_cardinality;
+    }
+  }
+}
+
+#endif // defined(OS_POSIX)
+
+} // namespace self
@@ -0,0 +1,218 @@
+#include "conversion_tracer.h"
+
+#include "allocation_hooks.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/process/process_handle.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/platform_thread.h"
+
+namespace self {
+
+namespace {
+static const char kTraceCategory[] = "json_to_proto";
+}
+
+std::atomic<ConversionTracer*> ConversionTracer::current_(nullptr);
+
+ConversionTracer::ConversionTracer()
+  : min_container_nodes_(kDefaultMinContainerNodes),
+    span_count_(0) {
+}
+
+ConversionTracer::~ConversionTracer() {
+  if (current() == this) {
+    Stop();
+  }
+}
+
+void ConversionTracer::Start() {
+  DCHECK(!current());
+  origin_ = base::TimeTicks::Now();
+  // 只在 trace 时才把计数的 dispatch 挂到 allocator shim 上
+  AllocationHooks::Enable(false);
+  current_.store(this, std::memory_order_release);
+}
+
+void ConversionTracer::Stop() {
+  DCHECK_EQ(current(), this);
+  current_.store(nullptr, std::memory_order_release);
+  AllocationHooks::Disable();
+}
+
+int64_t ConversionTracer::allocation_count() {
+  return AllocationHooks::allocation_count();
+}
+
+bool ConversionTracer::WriteFile(
+  const base::FilePath& trace_file_path,
+  std::string& error_message) const {
+  // 进程名的 metadata 事件让 chrome://tracing 显示成 json_to_proto 而不是 pid
+  std::string trace = base::StringPrintf(
+    "{\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lld,"
+    "\"args\":{\"name\":\"%s\"}}",
+    static_cast<long long>(base::GetCurrentProcId()), kTraceCategory);
+  trace += events_;
+  trace += "],\"displayTimeUnit\":\"ms\"}\n";
+  if (base::WriteFile(trace_file_path, trace.data(), static_cast<int>(trace.size())) !=
+      static_cast<int>(trace.size())) {
+    error_message = "write trace file fail";
+    return false;
+  }
+  return true;
+}
+
+void ConversionTracer::AddSpan(
+  const char* name,
+  base::TimeTicks start,
+  base::TimeTicks end,
+  const TraceArg* args,
+  size_t arg_count) {
+  // 先在锁外拼好, batch 模式下各个 worker 只在追加时互相等
+  std::string event = base::StringPrintf(
+    ",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%lld,\"tid\":%lld,"
+    "\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+    name, kTraceCategory,
+    static_cast<long long>(base::GetCurrentProcId()),
+    static_cast<long long>(base::PlatformThread::CurrentId()),
+    (start - origin_).InMicrosecondsF(),
+    (end - start).InMicrosecondsF());
+  for (size_t index = 0; index < arg_count; ++index) {
+    base::StringAppendF(&event, "%s\"%s\":%lld", index ? "," : "",
+      args[index].name, static_cast<long long>(args[index].value));
+  }
+  event += "}}";
+
+  base::AutoLock auto_lock(lock_);
+  events_ += event;
+  ++span_count_;
+}
+
+void ScopedTraceSpan::Begin(const char* name) {
+  name_ = name;
+  arg_count_ = 0;
+  start_allocation_count_ = ConversionTracer::allocation_count();
+  start_ = base::TimeTicks::Now();
+}
+
+void ScopedTraceSpan::End() {
+  base::TimeTicks end = base::TimeTicks::Now();
+  AddArgSlow("allocations", ConversionTracer::allocation_count() - start_allocation_count_);
+  tracer_->AddSpan(name_, start_, end, args_, arg_count_);
+}
+
+void ScopedTraceSpan::AddArgSlow(const char* name, int64_t value) {
+  DCHECK_LT(arg_count_, kMaxArgs);
+  if (arg_count_ < kMaxArgs) {
+    args_[arg_count_++] = TraceArg{name, value};
+  }
+}
+
+TracedJsonSaxHandler::TracedJsonSaxHandler(
+  ConversionTracer* tracer,
+  JsonSaxHandler* handler)
+  : tracer_(tracer),
+    handler_(handler),
+    node_count_(0) {
+  DCHECK(tracer_ && handler_);
+}
+
+TracedJsonSaxHandler::~TracedJsonSaxHandler() {
+}
+
+JsonSaxHandler* TracedJsonSaxHandler::Wrap(
+  JsonSaxHandler* handler,
+  std::unique_ptr<TracedJsonSaxHandler>* traced_handler) {
+  ConversionTracer* tracer = ConversionTracer::current();
+  if (!tracer) {
+    return handler;
+  }
+  traced_handler->reset(new TracedJsonSaxHandler(tracer, handler));
+  return traced_handler->get();
+}
+
+bool TracedJsonSaxHandler::OnStartObject() {
+  PushContainer();
+  return Check(handler_->OnStartObject());
+}
+
+bool TracedJsonSaxHandler::OnKey(const base::StringPiece& key) {
+  return Check(handler_->OnKey(key));
+}
+
+bool TracedJsonSaxHandler::OnEndObject() {
+  bool result = Check(handler_->OnEndObject());
+  PopContainer("JsonObject");
+  return result;
+}
+
+bool TracedJsonSaxHandler::OnStartArray() {
+  PushContainer();
+  return Check(handler_->OnStartArray());
+}
+
+bool TracedJsonSaxHandler::OnEndArray() {
+  bool result = Check(handler_->OnEndArray());
+  PopContainer("JsonArray");
+  return result;
+}
+
+bool TracedJsonSaxHandler::OnNull() {
+  ++node_count_;
+  return Check(handler_->OnNull());
+}
+
+bool TracedJsonSaxHandler::OnBoolean(bool value) {
+  ++node_count_;
+  return Check(handler_->OnBoolean(value));
+}
+
+bool TracedJsonSaxHandler::OnInteger(int64_t value) {
+  ++node_count_;
+  return Check(handler_->OnInteger(value));
+}
+
+bool TracedJsonSaxHandler::OnDouble(double value) {
+  ++node_count_;
+  return Check(handler_->OnDouble(value));
+}
+
+bool TracedJsonSaxHandler::OnString(const base::StringPiece& value) {
+  ++node_count_;
+  return Check(handler_->OnString(value));
+}
+
+void TracedJsonSaxHandler::PushContainer() {
+  Container container;
+  container.first_node = node_count_++;
+  container.allocation_count = ConversionTracer::allocation_count();
+  container.start = base::TimeTicks::Now();
+  containers_.push_back(container);
+}
+
+void TracedJsonSaxHandler::PopContainer(const char* name) {
+  DCHECK(!containers_.empty());
+  const Container& container = containers_.back();
+  int64_t nodes = node_count_ - container.first_node;
+  // 小的容器不单独记, 否则事件比文档本身还大
+  if (nodes >= tracer_->min_container_nodes()) {
+    base::TimeTicks end = base::TimeTicks::Now();
+    const TraceArg args[] = {
+      {"depth", static_cast<int64_t>(containers_.size())},
+      {"nodes", nodes},
+      {"allocations", ConversionTracer::allocation_count() - container.allocation_count},
+    };
+    tracer_->AddSpan(name, container.start, end, args, arraysize(args));
+  }
+  containers_.pop_back();
+}
+
+bool TracedJsonSaxHandler::Check(bool result) {
+  if (!result) {
+    error_message_ = handler_->error_message();
+  }
+  return result;
+}
+
+} //namespace self
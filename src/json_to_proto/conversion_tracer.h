@@ -0,0 +1,185 @@
+#ifndef CONVERSION_TRACER_H_
+#define CONVERSION_TRACER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "json_sax_reader.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace self {
+
+struct TraceArg {
+  const char* name;
+  int64_t value;
+};
+
+// Records the spans of a conversion and writes them as Chrome trace event
+// json, which chrome://tracing and Perfetto open. One tracer records at a
+// time. While none does a ScopedTraceSpan is one atomic load and a branch,
+// so the spans stay compiled in.
+class ConversionTracer {
+public:
+  // Objects and arrays with fewer nodes get no span of their own.
+  static const int64_t kDefaultMinContainerNodes = 10000;
+
+  ConversionTracer();
+
+  // Stops recording if Stop() was not called.
+  ~ConversionTracer();
+
+  void Start();
+  void Stop();
+
+  bool WriteFile(
+    const base::FilePath& trace_file_path,
+    std::string& error_message) const;
+
+  // The tracer recording right now, null while tracing is off.
+  static ConversionTracer* current() {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  // Allocations of every thread while a tracer records, counted through
+  // AllocationHooks. Zero in builds without base's allocator shim.
+  static int64_t allocation_count();
+
+  void set_min_container_nodes(int64_t min_container_nodes) {
+    min_container_nodes_ = min_container_nodes;
+  }
+  int64_t min_container_nodes() const { return min_container_nodes_; }
+
+  // A complete ("ph":"X") event on the calling thread.
+  void AddSpan(
+    const char* name,
+    base::TimeTicks start,
+    base::TimeTicks end,
+    const TraceArg* args,
+    size_t arg_count);
+
+  size_t span_count() const { return span_count_; }
+
+private:
+  static std::atomic<ConversionTracer*> current_;
+
+  base::TimeTicks origin_;
+  int64_t min_container_nodes_;
+  base::Lock lock_;
+  // 事件结束时直接写成 json, 逗号分隔, 写文件时套上外层
+  std::string events_;
+  size_t span_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ConversionTracer);
+};
+
+// Records the time from construction to destruction as one span of the
+// current tracer, with the allocations every thread made meanwhile.
+class ScopedTraceSpan {
+public:
+  static const size_t kMaxArgs = 5;
+
+  // |name| must outlive the tracer, a literal.
+  explicit ScopedTraceSpan(const char* name)
+    : tracer_(ConversionTracer::current()) {
+    if (tracer_) {
+      Begin(name);
+    }
+  }
+
+  ~ScopedTraceSpan() {
+    if (tracer_) {
+      End();
+    }
+  }
+
+  // Lets callers skip computing arguments nobody records.
+  bool enabled() const { return tracer_ != nullptr; }
+
+  void AddArg(const char* name, int64_t value) {
+    if (tracer_) {
+      AddArgSlow(name, value);
+    }
+  }
+
+private:
+  void Begin(const char* name);
+  void End();
+  void AddArgSlow(const char* name, int64_t value);
+
+private:
+  ConversionTracer* tracer_;
+  const char* name_;
+  base::TimeTicks start_;
+  int64_t start_allocation_count_;
+  TraceArg args_[kMaxArgs];
+  size_t arg_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedTraceSpan);
+};
+
+// Forwards the parse events to |handler| and gives every object and array of
+// at least min_container_nodes() nodes a span, so the levels of the document
+// that cost the most show up nested in the trace. A node is a value: an
+// object, an array or a scalar.
+class TracedJsonSaxHandler : public JsonSaxHandler {
+public:
+  TracedJsonSaxHandler(ConversionTracer* tracer, JsonSaxHandler* handler);
+
+  ~TracedJsonSaxHandler() override;
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+  int64_t node_count() const { return node_count_; }
+
+  // |handler| itself while tracing is off, otherwise a TracedJsonSaxHandler
+  // in front of it that |traced_handler| keeps.
+  static JsonSaxHandler* Wrap(
+    JsonSaxHandler* handler,
+    std::unique_ptr<TracedJsonSaxHandler>* traced_handler);
+
+private:
+  struct Container {
+    base::TimeTicks start;
+    int64_t first_node;
+    int64_t allocation_count;
+  };
+
+  void PushContainer();
+  void PopContainer(const char* name);
+  bool Check(bool result);
+
+private:
+  ConversionTracer* tracer_;
+  JsonSaxHandler* handler_;
+  std::vector<Container> containers_;
+  int64_t node_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(TracedJsonSaxHandler);
+};
+
+} // namespace self
+#endif // CONVERSION_TRACER_H_
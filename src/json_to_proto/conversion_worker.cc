@@ -0,0 +1,192 @@
+#include "conversion_worker.h"
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "conversion_tracer.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_shape_fingerprint.h"
+#include "json_stream_message_builder.h"
+#include "json_to_protobuf_serializer.h"
+
+namespace self {
+
+namespace {
+// 每个 worker 缓存的 schema 个数, 超过就全部丢掉重新来
+static const size_t kMaxCachedSchemas = 256;
+}
+
+ConversionWorker::ConversionWorker(SchemaMode schema_mode, size_t max_enum_cardinality)
+  : schema_mode_(schema_mode),
+    max_enum_cardinality_(max_enum_cardinality),
+    schema_hit_count_(0),
+    schema_miss_count_(0) {
+}
+
+ConversionWorker::~ConversionWorker() {
+}
+
+bool ConversionWorker::Convert(
+  const base::StringPiece& input,
+  std::string* output,
+  std::string& error_message) {
+  JsonStringInputStream input_stream(input);
+  return Convert(&input_stream, output, error_message);
+}
+
+bool ConversionWorker::Convert(
+  JsonInputStream* input_stream,
+  std::string* output,
+  std::string& error_message) {
+  bool cached = false;
+  Schema* schema = FindOrBuildSchema(input_stream, &cached, error_message);
+  if (!schema || !input_stream->Rewind()) {
+    return false;
+  }
+
+  output->clear();
+  bool result = FillMessage(input_stream, schema, output, error_message);
+  // message 都在 arena 上, 一次释放
+  arena_.Reset();
+  // 指纹只看结构, 缓存的 schema 可能放不下这个文件: kCompact 按推导 schema 的那个文件
+  // 收窄类型和枚举, 指纹也可能冲突. 和 SerializeFromStream 一样给这个文件重新推导一次
+  if (!result && cached) {
+    DropSchema(schema);
+    error_message.clear();
+    schema = input_stream->Rewind() ?
+      FindOrBuildSchema(input_stream, &cached, error_message) : nullptr;
+    if (!schema || !input_stream->Rewind()) {
+      return false;
+    }
+    output->clear();
+    result = FillMessage(input_stream, schema, output, error_message);
+    arena_.Reset();
+  }
+  return result;
+}
+
+bool ConversionWorker::ConvertFile(
+  const base::FilePath& input_path,
+  const base::FilePath& output_path,
+  std::string& error_message) {
+  ScopedTraceSpan span("ConvertFile");
+  if (!base::ReadFileToString(input_path, &input_buffer_)) {
+    error_message = "read input file fail";
+    return false;
+  }
+  span.AddArg("bytes", input_buffer_.size());
+  if (!Convert(input_buffer_, &output_buffer_, error_message)) {
+    return false;
+  }
+
+  if (!base::CreateDirectory(output_path.DirName())) {
+    error_message = "create output directory fail";
+    return false;
+  }
+  if (base::WriteFile(output_path, output_buffer_.data(),
+      static_cast<int>(output_buffer_.size())) != static_cast<int>(output_buffer_.size())) {
+    error_message = "write output file fail";
+    return false;
+  }
+  return true;
+}
+
+ConversionWorker::Schema* ConversionWorker::FindOrBuildSchema(
+  JsonInputStream* input_stream,
+  bool* cached,
+  std::string& error_message) {
+  JsonShapeFingerprint shape_fingerprint(schema_mode_, max_enum_cardinality_);
+  JsonSaxReader fingerprint_reader(input_stream);
+  if (!fingerprint_reader.Parse(&shape_fingerprint, error_message)) {
+    return nullptr;
+  }
+  auto iter = schemas_.find(shape_fingerprint.fingerprint());
+  *cached = iter != schemas_.end();
+  if (*cached) {
+    schema_hit_count_++;
+    return iter->second.get();
+  }
+  schema_miss_count_++;
+
+  if (!input_stream->Rewind()) {
+    error_message = "rewind input stream fail";
+    return nullptr;
+  }
+  BuildProtoFromJson build_proto_from_json;
+  build_proto_from_json.set_max_enum_cardinality(max_enum_cardinality_);
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(input_stream, schema_mode_, error_message);
+  if (!file_desc_proto) {
+    return nullptr;
+  }
+  std::unique_ptr<Schema> schema(new Schema());
+  const google::protobuf::FileDescriptor* file_desc = JsonToProtobufSerializer::BuildFile(
+    std::move(file_desc_proto), &schema->desc_pool, error_message);
+  if (!file_desc) {
+    return nullptr;
+  }
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  if (!root_desc) {
+    error_message = "no ROOT message in proto file";
+    return nullptr;
+  }
+  schema->dynamic_message_factory.reset(
+    new google::protobuf::DynamicMessageFactory(schema->desc_pool.get()));
+  schema->prototype = schema->dynamic_message_factory->GetPrototype(root_desc);
+
+  if (schemas_.size() >= kMaxCachedSchemas) {
+    schemas_.clear();
+  }
+  Schema* result = schema.get();
+  schemas_[shape_fingerprint.fingerprint()] = std::move(schema);
+  return result;
+}
+
+void ConversionWorker::DropSchema(const Schema* schema) {
+  for (auto iter = schemas_.begin(); iter != schemas_.end(); ++iter) {
+    if (iter->second.get() == schema) {
+      schemas_.erase(iter);
+      return;
+    }
+  }
+}
+
+bool ConversionWorker::FillMessage(
+  JsonInputStream* input_stream,
+  Schema* schema,
+  std::string* output,
+  std::string& error_message) {
+  google::protobuf::Message* root_message = schema->prototype->New(&arena_);
+  {
+    ScopedTraceSpan span("CreateMessage");
+    if (schema->message_builder) {
+      schema->message_builder->Reset(root_message);
+    } else {
+      schema->message_builder = JsonToProtobufSerializer::CreateMessageBuilder(
+        schema_mode_, root_message, schema->dynamic_message_factory.get());
+    }
+    std::unique_ptr<TracedJsonSaxHandler> traced_handler;
+    JsonSaxReader json_reader(input_stream);
+    if (!json_reader.Parse(
+          TracedJsonSaxHandler::Wrap(schema->message_builder.get(), &traced_handler),
+          error_message)) {
+      return false;
+    }
+    if (traced_handler) {
+      span.AddArg("nodes", traced_handler->node_count());
+    }
+  }
+  ScopedTraceSpan span("SerializeMessage");
+  if (!root_message->SerializeToString(output)) {
+    error_message = "serialize message fail";
+    return false;
+  }
+  span.AddArg("bytes", output->size());
+  return true;
+}
+
+} //namespace self
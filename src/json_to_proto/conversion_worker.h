@@ -0,0 +1,104 @@
+#ifndef CONVERSION_WORKER_H_
+#define CONVERSION_WORKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "google/protobuf/arena.h"
+#include "build_proto_from_json.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace google {
+namespace protobuf {
+class DescriptorPool;
+class DynamicMessageFactory;
+class Message;
+} // namespace protobuf
+} // google
+
+namespace self {
+class JsonInputStream;
+class JsonMessageBuilder;
+
+// Everything one thread needs to convert documents, reused from document to
+// document: a descriptor pool and a message builder per json shape
+// fingerprint, so the schema is inferred and the binding plan compiled once
+// per shape, one arena for the messages and the buffers. Used by one thread
+// at a time.
+class ConversionWorker {
+public:
+  ConversionWorker(SchemaMode schema_mode, size_t max_enum_cardinality);
+
+  ~ConversionWorker();
+
+  // Converts the json in |input| to the encoding of its root message.
+  bool Convert(
+    const base::StringPiece& input,
+    std::string* output,
+    std::string& error_message);
+
+  // Like above, |input_stream| is read once or twice for the schema and once
+  // for the values.
+  bool Convert(
+    JsonInputStream* input_stream,
+    std::string* output,
+    std::string& error_message);
+
+  // Converts |input_path| to |output_path|, creating the output directory.
+  bool ConvertFile(
+    const base::FilePath& input_path,
+    const base::FilePath& output_path,
+    std::string& error_message);
+
+  // Documents whose shape had a schema already, and ones that built one.
+  int64_t schema_hit_count() const { return schema_hit_count_; }
+  int64_t schema_miss_count() const { return schema_miss_count_; }
+
+private:
+  struct Schema {
+    std::unique_ptr<google::protobuf::DescriptorPool> desc_pool;
+    std::unique_ptr<google::protobuf::DynamicMessageFactory> dynamic_message_factory;
+    const google::protobuf::Message* prototype;
+    // 同一个 schema 的文件共用 builder, binding plan 只编译一次
+    std::unique_ptr<JsonMessageBuilder> message_builder;
+  };
+
+  // |cached| tells whether the schema was built for an earlier document.
+  Schema* FindOrBuildSchema(
+    JsonInputStream* input_stream,
+    bool* cached,
+    std::string& error_message);
+
+  bool FillMessage(
+    JsonInputStream* input_stream,
+    Schema* schema,
+    std::string* output,
+    std::string& error_message);
+
+  void DropSchema(const Schema* schema);
+
+private:
+  const SchemaMode schema_mode_;
+  const size_t max_enum_cardinality_;
+  std::map<uint64_t, std::unique_ptr<Schema>> schemas_;
+  google::protobuf::Arena arena_;
+  std::string input_buffer_;
+  std::string output_buffer_;
+  int64_t schema_hit_count_;
+  int64_t schema_miss_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ConversionWorker);
+};
+
+} // namespace self
+#endif // CONVERSION_WORKER_H_
@@ -2,23 +2,214 @@
 
 #include <fcntl.h> 
 #include <iostream>
-#include <io.h>
 #include <stdio.h>
 #include <map>
 
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/json/json_reader.h"
 #include "base/json/json_string_value_serializer.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "convert_switches.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
 
+#include "batch_converter.h"
+#include "build_proto_from_json.h"
+#include "conversion_server.h"
+#include "conversion_tracer.h"
+#include "incremental_converter.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
 #include "json_to_protobuf_serializer.h"
+#include "json_unified_schema_builder.h"
+#include "parallel_document_converter.h"
+#include "protobuf_file_output_stream.h"
+#include "protobuf_json_writer.h"
+#include "record_container.h"
+#include "record_stream_converter.h"
+#include "schema_cache.h"
 
 namespace self {
+
+namespace {
+static const int kDefaultMemoryBudgetMb = 1024;
+static const char kStreamingParser[] = "streaming";
+static const char kStructuralParser[] = "structural";
+static const char kGzipCompression[] = "gzip";
+static const char kZlibCompression[] = "zlib";
+static const int kMaxCompressionLevel = 9;
+
+bool GetJsonParserBackend(
+  const base::CommandLine* command_line,
+  JsonParserBackend* backend,
+  std::string& error_message) {
+  *backend = JsonParserBackend::kStreaming;
+  if (!command_line->HasSwitch(convert_switches::kJsonParser)) {
+    return true;
+  }
+  std::string parser = command_line->GetSwitchValueASCII(convert_switches::kJsonParser);
+  if (parser == kStructuralParser) {
+    *backend = JsonParserBackend::kStructuralIndex;
+  } else if (parser != kStreamingParser) {
+    error_message = "invalid json-parser";
+    return false;
+  }
+  return true;
+}
+
+bool GetJobs(
+  const base::CommandLine* command_line,
+  int* jobs,
+  std::string& error_message) {
+  *jobs = base::SysInfo::NumberOfProcessors();
+  if (command_line->HasSwitch(convert_switches::kJobs) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(convert_switches::kJobs), jobs) ||
+       *jobs <= 0)) {
+    error_message = "invalid jobs";
+    return false;
+  }
+  return true;
+}
+
+bool GetMaxEnumCardinality(
+  const base::CommandLine* command_line,
+  size_t* max_enum_cardinality,
+  std::string& error_message) {
+  *max_enum_cardinality = JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality;
+  if (!command_line->HasSwitch(convert_switches::kMaxEnumCardinality)) {
+    return true;
+  }
+  if (!base::StringToSizeT(
+        command_line->GetSwitchValueASCII(convert_switches::kMaxEnumCardinality),
+        max_enum_cardinality)) {
+    error_message = "invalid max-enum-cardinality";
+    return false;
+  }
+  return true;
+}
+
+// 压缩在 I/O 线程上做, 和编码重叠
+bool UseIoThread(const base::CommandLine* command_line) {
+  return command_line->HasSwitch(convert_switches::kOutputIoThread) ||
+    command_line->HasSwitch(convert_switches::kCompressOutput);
+}
+
+bool GetOutputOptions(
+  const base::CommandLine* command_line,
+  OutputStreamOptions* output_options,
+  std::string& error_message) {
+  if (command_line->HasSwitch(convert_switches::kOutputChunkKb)) {
+    int chunk_kb = 0;
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(convert_switches::kOutputChunkKb),
+          &chunk_kb) || chunk_kb <= 0) {
+      error_message = "invalid output-chunk-kb";
+      return false;
+    }
+    output_options->buffer_size = static_cast<size_t>(chunk_kb) << 10;
+  }
+  if (!command_line->HasSwitch(convert_switches::kCompressOutput)) {
+    return true;
+  }
+  const std::string compression =
+    command_line->GetSwitchValueASCII(convert_switches::kCompressOutput);
+  if (compression == kGzipCompression) {
+    output_options->compression = OutputCompression::kGzip;
+  } else if (compression == kZlibCompression) {
+    output_options->compression = OutputCompression::kZlib;
+  } else {
+    error_message = "invalid compress-output: " + compression;
+    return false;
+  }
+  if (command_line->HasSwitch(convert_switches::kCompressionLevel) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(convert_switches::kCompressionLevel),
+        &output_options->compression_level) ||
+       output_options->compression_level < 0 ||
+       output_options->compression_level > kMaxCompressionLevel)) {
+    error_message = "invalid compression-level";
+    return false;
+  }
+  // 容器要按偏移直接读块, 压缩了就读不了
+  if (command_line->HasSwitch(convert_switches::kContainerOutput)) {
+    error_message = "container-output can not be compressed";
+    return false;
+  }
+  return true;
+}
+
+// 没有 --container-output 时返回 true, |container_options| 不动
+bool GetContainerOptions(
+  const base::CommandLine* command_line,
+  RecordContainerOptions* container_options,
+  std::string& error_message) {
+  if (command_line->HasSwitch(convert_switches::kContainerBlockKb)) {
+    int block_kb = 0;
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(convert_switches::kContainerBlockKb),
+          &block_kb) || block_kb <= 0) {
+      error_message = "invalid container-block-kb";
+      return false;
+    }
+    container_options->block_size = static_cast<size_t>(block_kb) << 10;
+  }
+  container_options->stat_fields = base::SplitString(
+    command_line->GetSwitchValueASCII(convert_switches::kContainerStatFields),
+    ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  return true;
+}
+
+// 两种 parser 共用的 schema, 输出和内存选项. |output_options| 和
+// |container_options| 要活得比 |json_to_protobuf_serializer| 久
+bool ApplySerializerSwitches(
+  const base::CommandLine* command_line,
+  OutputStreamOptions* output_options,
+  RecordContainerOptions* container_options,
+  JsonToProtobufSerializer* json_to_protobuf_serializer,
+  std::string& error_message) {
+  size_t max_enum_cardinality = 0;
+  if (!GetMaxEnumCardinality(command_line, &max_enum_cardinality, error_message)) {
+    return false;
+  }
+  json_to_protobuf_serializer->set_max_enum_cardinality(max_enum_cardinality);
+  json_to_protobuf_serializer->set_use_arena(
+    command_line->HasSwitch(convert_switches::kUseArena));
+  json_to_protobuf_serializer->set_use_io_thread(UseIoThread(command_line));
+  if (!GetOutputOptions(command_line, output_options, error_message)) {
+    return false;
+  }
+  json_to_protobuf_serializer->set_output_options(output_options);
+  json_to_protobuf_serializer->set_write_descriptor_set(
+    command_line->HasSwitch(convert_switches::kWriteDescriptorSet));
+  if (command_line->HasSwitch(convert_switches::kContainerOutput)) {
+    if (!GetContainerOptions(command_line, container_options, error_message)) {
+      return false;
+    }
+    json_to_protobuf_serializer->set_container_options(container_options);
+  }
+  return true;
+}
+
+SchemaMode GetSchemaMode(const base::CommandLine* command_line) {
+  // 紧凑模式建立在合并数组的 schema 上, 不需要再加 --unify-array-schema
+  if (command_line->HasSwitch(convert_switches::kCompactWireTypes)) {
+    return SchemaMode::kCompact;
+  }
+  // 增量和并行模式要求同一个子树在哪里都是同一个类型, 每个元素一个类型的 schema 做不到.
+  // 记录流里后面记录的数组长度和第一条不同, 也只能用合并数组的 schema
+  return command_line->HasSwitch(convert_switches::kUnifyArraySchema) ||
+    command_line->HasSwitch(convert_switches::kRecordStream) ||
+    command_line->HasSwitch(convert_switches::kIncremental) ||
+    command_line->HasSwitch(convert_switches::kParallelSubtrees) ?
+    SchemaMode::kUnified : SchemaMode::kPerElement;
+}
+}
+
 ConvertJsonToProtobuf::ConvertJsonToProtobuf() {
 }
 
@@ -28,6 +219,61 @@ ConvertJsonToProtobuf::~ConvertJsonToProtobuf() {
 bool ConvertJsonToProtobuf::Convert(
   const base::CommandLine* command_line,
   std::string& error_message) {
+  // 所有模式里的 JsonSaxReader 都按这个选 parser, batch 的 worker 也一样
+  JsonParserBackend backend = JsonParserBackend::kStreaming;
+  if (!GetJsonParserBackend(command_line, &backend, error_message)) {
+    return false;
+  }
+  JsonSaxReader::set_default_backend(backend);
+
+  if (!command_line->HasSwitch(convert_switches::kTraceFile)) {
+    return DoConvert(command_line, error_message);
+  }
+
+  int64_t min_container_nodes = ConversionTracer::kDefaultMinContainerNodes;
+  if (command_line->HasSwitch(convert_switches::kTraceMinNodes) &&
+      (!base::StringToInt64(command_line->GetSwitchValueASCII(convert_switches::kTraceMinNodes),
+        &min_container_nodes) || min_container_nodes <= 0)) {
+    error_message = "invalid trace-min-nodes";
+    return false;
+  }
+  ConversionTracer tracer;
+  tracer.set_min_container_nodes(min_container_nodes);
+  tracer.Start();
+  bool result = false;
+  {
+    ScopedTraceSpan span("Convert");
+    result = DoConvert(command_line, error_message);
+  }
+  tracer.Stop();
+  // 转换失败时的 trace 也有用, 照样写出来
+  std::string trace_error_message;
+  if (!tracer.WriteFile(command_line->GetSwitchValuePath(convert_switches::kTraceFile),
+      trace_error_message)) {
+    if (result) {
+      error_message = trace_error_message;
+    }
+    return false;
+  }
+  return result;
+}
+
+bool ConvertJsonToProtobuf::DoConvert(
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  if (command_line->HasSwitch(convert_switches::kServe)) {
+    return Serve(command_line, error_message);
+  }
+  if (command_line->HasSwitch(convert_switches::kStopServer)) {
+    return StopServer(command_line->GetSwitchValuePath(convert_switches::kStopServer),
+      error_message);
+  }
+  if (command_line->HasSwitch(convert_switches::kInputDir) ||
+      command_line->HasSwitch(convert_switches::kInputGlob) ||
+      command_line->HasSwitch(convert_switches::kInputManifest)) {
+    return ConvertBatch(command_line, error_message);
+  }
+
   base::FilePath input_file_path = 
     command_line->GetSwitchValuePath(convert_switches::kInputFilePath);
   base::FilePath output_file_path = 
@@ -37,26 +283,558 @@ bool ConvertJsonToProtobuf::Convert(
     return false;
   }
 
+  if (command_line->HasSwitch(convert_switches::kServer)) {
+    return ConvertOnServer(input_file_path, output_file_path, command_line, error_message);
+  }
+  if (command_line->HasSwitch(convert_switches::kToJson)) {
+    base::FilePath descriptor_set_file_path =
+      command_line->GetSwitchValuePath(convert_switches::kDescriptorSetFilePath);
+    if (descriptor_set_file_path.empty()) {
+      descriptor_set_file_path = JsonToProtobufSerializer::DescriptorSetPath(input_file_path);
+    }
+    return ConvertToJson(input_file_path, output_file_path, descriptor_set_file_path,
+      command_line->HasSwitch(convert_switches::kMmapInput),
+      error_message);
+  }
+  SchemaMode schema_mode = GetSchemaMode(command_line);
+  if (command_line->HasSwitch(convert_switches::kRecordStream)) {
+    return ConvertRecordStream(input_file_path, output_file_path,
+      command_line->HasSwitch(convert_switches::kMmapInput),
+      UseIoThread(command_line),
+      schema_mode,
+      command_line,
+      error_message);
+  }
+  if (command_line->HasSwitch(convert_switches::kIncremental)) {
+    return ConvertIncremental(input_file_path, output_file_path,
+      command_line->HasSwitch(convert_switches::kMmapInput),
+      schema_mode,
+      command_line,
+      error_message);
+  }
+  if (command_line->HasSwitch(convert_switches::kParallelSubtrees)) {
+    return ConvertParallel(input_file_path, output_file_path,
+      command_line->HasSwitch(convert_switches::kMmapInput),
+      schema_mode,
+      command_line,
+      error_message);
+  }
+  if (command_line->HasSwitch(convert_switches::kUseDomParser)) {
+    return ConvertWithDomParser(input_file_path, output_file_path, schema_mode, command_line,
+      error_message);
+  }
+  return ConvertWithStreamParser(input_file_path, output_file_path,
+    command_line->HasSwitch(convert_switches::kMmapInput),
+    command_line->GetSwitchValuePath(convert_switches::kSchemaCacheDir),
+    schema_mode,
+    command_line,
+    error_message);
+}
+
+bool ConvertJsonToProtobuf::ConvertWithDomParser(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  SchemaMode schema_mode,
+  const base::CommandLine* command_line,
+  std::string& error_message) {
   std::unique_ptr<base::DictionaryValue> root_dict = 
     ParseInputJson(input_file_path, error_message);
   if (!root_dict) {
     error_message += "\nparse input_file json fail!";
     return false;
   }
+  OutputStreamOptions output_options;
+  RecordContainerOptions container_options;
+  JsonToProtobufSerializer json_to_protobuf_serializer(output_file_path);
+  json_to_protobuf_serializer.set_schema_mode(schema_mode);
+  if (!ApplySerializerSwitches(command_line, &output_options, &container_options,
+        &json_to_protobuf_serializer, error_message)) {
+    return false;
+  }
+  if (!json_to_protobuf_serializer.SerializeValue(*root_dict.get(), error_message)) {
+    error_message += "\nconvert input_file json fail!";
+    return false;
+  }
+  return true;
+}
+
+bool ConvertJsonToProtobuf::ConvertWithStreamParser(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  bool mmap_input,
+  const base::FilePath& schema_cache_dir,
+  SchemaMode schema_mode,
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  std::unique_ptr<JsonInputStream> input_stream =
+    OpenInputStream(input_file_path, mmap_input, error_message);
+  if (!input_stream) {
+    return false;
+  }
+  std::unique_ptr<SchemaCache> schema_cache;
+  if (!schema_cache_dir.empty()) {
+    schema_cache.reset(new SchemaCache(schema_cache_dir));
+  }
+  OutputStreamOptions output_options;
+  RecordContainerOptions container_options;
   JsonToProtobufSerializer json_to_protobuf_serializer(output_file_path);
-  json_to_protobuf_serializer.Serialize(*root_dict.get());
-  
+  json_to_protobuf_serializer.set_schema_cache(schema_cache.get());
+  json_to_protobuf_serializer.set_schema_mode(schema_mode);
+  if (!ApplySerializerSwitches(command_line, &output_options, &container_options,
+        &json_to_protobuf_serializer, error_message)) {
+    return false;
+  }
+  if (!json_to_protobuf_serializer.SerializeFromStream(input_stream.get(), error_message)) {
+    error_message += "\nconvert input_file json fail!";
+    return false;
+  }
+
+  if (schema_cache) {
+    int64_t total_hit_count = 0;
+    int64_t total_miss_count = 0;
+    if (schema_cache->UpdateTotalCounters(&total_hit_count, &total_miss_count)) {
+      ::printf("schema cache: %s, total hit %lld, total miss %lld\n",
+        schema_cache->hit_count() > 0 ? "hit" : "miss",
+        static_cast<long long>(total_hit_count),
+        static_cast<long long>(total_miss_count));
+    }
+  }
   return true;
 }
 
+bool ConvertJsonToProtobuf::ConvertRecordStream(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  bool mmap_input,
+  bool use_io_thread,
+  SchemaMode schema_mode,
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  // 记录流每条记录单独推导和填充, 整个文件一次转换的开关不能悄悄忽略掉
+  static const char* const kSingleDocumentSwitches[] = {
+    convert_switches::kIncremental,
+    convert_switches::kParallelSubtrees,
+    convert_switches::kUseDomParser,
+    convert_switches::kSchemaCacheDir,
+    convert_switches::kUseArena,
+  };
+  for (const char* switch_name : kSingleDocumentSwitches) {
+    if (command_line->HasSwitch(switch_name)) {
+      error_message = std::string(switch_name) + " can not be used with record stream";
+      return false;
+    }
+  }
+  size_t max_enum_cardinality = 0;
+  if (!GetMaxEnumCardinality(command_line, &max_enum_cardinality, error_message)) {
+    return false;
+  }
+  std::unique_ptr<JsonInputStream> input_stream =
+    OpenInputStream(input_file_path, mmap_input, error_message);
+  if (!input_stream) {
+    return false;
+  }
+  OutputStreamOptions output_options;
+  if (!GetOutputOptions(command_line, &output_options, error_message)) {
+    return false;
+  }
+  RecordContainerOptions container_options;
+  RecordStreamConverter record_stream_converter(schema_mode, max_enum_cardinality);
+  record_stream_converter.set_use_io_thread(use_io_thread);
+  record_stream_converter.set_output_options(&output_options);
+  record_stream_converter.set_write_descriptor_set(
+    command_line->HasSwitch(convert_switches::kWriteDescriptorSet));
+  if (command_line->HasSwitch(convert_switches::kContainerOutput)) {
+    if (!GetContainerOptions(command_line, &container_options, error_message)) {
+      return false;
+    }
+    record_stream_converter.set_container_options(&container_options);
+  }
+  if (!record_stream_converter.Convert(input_stream.get(), output_file_path, error_message)) {
+    error_message += "\nconvert record stream fail!";
+    return false;
+  }
+  return true;
+}
+
+bool ConvertJsonToProtobuf::ConvertIncremental(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  bool mmap_input,
+  SchemaMode schema_mode,
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  // 增量转换自己推导 schema, 用自己的 arena, 输出是缓存的子树编码拼起来的,
+  // 这些开关都用不上, 不能悄悄忽略掉
+  static const char* const kNonIncrementalSwitches[] = {
+    convert_switches::kParallelSubtrees,
+    convert_switches::kUseDomParser,
+    convert_switches::kSchemaCacheDir,
+    convert_switches::kUseArena,
+    convert_switches::kContainerOutput,
+  };
+  for (const char* switch_name : kNonIncrementalSwitches) {
+    if (command_line->HasSwitch(switch_name)) {
+      error_message = std::string(switch_name) + " can not be used with incremental";
+      return false;
+    }
+  }
+  std::unique_ptr<JsonInputStream> input_stream =
+    OpenInputStream(input_file_path, mmap_input, error_message);
+  if (!input_stream) {
+    return false;
+  }
+  size_t max_enum_cardinality = 0;
+  if (!GetMaxEnumCardinality(command_line, &max_enum_cardinality, error_message)) {
+    return false;
+  }
+  IncrementalConverter incremental_converter(schema_mode);
+  incremental_converter.set_max_enum_cardinality(max_enum_cardinality);
+  OutputStreamOptions output_options;
+  if (!GetOutputOptions(command_line, &output_options, error_message)) {
+    return false;
+  }
+  incremental_converter.set_use_io_thread(UseIoThread(command_line));
+  incremental_converter.set_output_options(&output_options);
+  incremental_converter.set_write_descriptor_set(
+    command_line->HasSwitch(convert_switches::kWriteDescriptorSet));
+  if (!incremental_converter.Convert(input_stream.get(), output_file_path, error_message)) {
+    error_message += "\nconvert input_file json fail!";
+    return false;
+  }
+  const int64_t output_bytes =
+    incremental_converter.reused_bytes() + incremental_converter.encoded_bytes();
+  ::printf("incremental: %lld of %lld subtrees reused, %.1f%% of the output encoded\n",
+    static_cast<long long>(incremental_converter.reused_subtree_count()),
+    static_cast<long long>(incremental_converter.subtree_count()),
+    output_bytes > 0 ? incremental_converter.encoded_bytes() * 100.0 / output_bytes : 0.0);
+  return true;
+}
+
+bool ConvertJsonToProtobuf::ConvertParallel(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  bool mmap_input,
+  SchemaMode schema_mode,
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  // 每个任务在自己的 arena 上用流式 parser 填充, 输出是各个任务的编码拼起来的,
+  // 容器要整条记录, 拼不了. 这些开关不能悄悄忽略掉
+  static const char* const kNonParallelSwitches[] = {
+    convert_switches::kUseDomParser,
+    convert_switches::kSchemaCacheDir,
+    convert_switches::kUseArena,
+    convert_switches::kContainerOutput,
+  };
+  for (const char* switch_name : kNonParallelSwitches) {
+    if (command_line->HasSwitch(switch_name)) {
+      error_message = std::string(switch_name) + " can not be used with parallel-subtrees";
+      return false;
+    }
+  }
+  std::unique_ptr<JsonInputStream> input_stream =
+    OpenInputStream(input_file_path, mmap_input, error_message);
+  if (!input_stream) {
+    return false;
+  }
+  int jobs = 0;
+  size_t max_enum_cardinality = 0;
+  OutputStreamOptions output_options;
+  if (!GetJobs(command_line, &jobs, error_message) ||
+      !GetMaxEnumCardinality(command_line, &max_enum_cardinality, error_message) ||
+      !GetOutputOptions(command_line, &output_options, error_message)) {
+    return false;
+  }
+  ParallelDocumentConverter parallel_converter(schema_mode, jobs);
+  parallel_converter.set_max_enum_cardinality(max_enum_cardinality);
+  parallel_converter.set_use_io_thread(UseIoThread(command_line));
+  parallel_converter.set_output_options(&output_options);
+  parallel_converter.set_write_descriptor_set(
+    command_line->HasSwitch(convert_switches::kWriteDescriptorSet));
+  if (!parallel_converter.Convert(input_stream.get(), output_file_path, error_message)) {
+    error_message += "\nconvert input_file json fail!";
+    return false;
+  }
+  const int64_t event_count = parallel_converter.event_count();
+  ::printf("parallel: %llu tasks on %d workers, %.1f%% of the events split off the root\n",
+    static_cast<unsigned long long>(parallel_converter.task_count()), jobs,
+    event_count > 0 ? parallel_converter.split_event_count() * 100.0 / event_count : 0.0);
+  return true;
+}
+
+bool ConvertJsonToProtobuf::ConvertToJson(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  const base::FilePath& descriptor_set_file_path,
+  bool mmap_input,
+  std::string& error_message) {
+  std::string descriptor_set_data;
+  google::protobuf::FileDescriptorSet file_desc_set;
+  if (!base::ReadFileToString(descriptor_set_file_path, &descriptor_set_data) ||
+      !file_desc_set.ParseFromString(descriptor_set_data) ||
+      file_desc_set.file_size() != 1) {
+    error_message = "read descriptor set fail: " + descriptor_set_file_path.AsUTF8Unsafe();
+    return false;
+  }
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = nullptr;
+  {
+    ScopedTraceSpan span("BuildFile");
+    span.AddArg("descriptors", file_desc_set.file(0).message_type_size());
+    file_desc = desc_pool.BuildFile(file_desc_set.file(0));
+  }
+  if (!file_desc) {
+    error_message = "build proto file fail";
+    return false;
+  }
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  if (!root_desc) {
+    error_message = "no ROOT message in proto file";
+    return false;
+  }
+
+  base::MemoryMappedFile mapped_file;
+  std::string input_data;
+  const char* data = nullptr;
+  size_t size = 0;
+  if (mmap_input) {
+    if (!mapped_file.Initialize(input_file_path)) {
+      error_message = "map input file fail: " + input_file_path.AsUTF8Unsafe();
+      return false;
+    }
+    data = reinterpret_cast<const char*>(mapped_file.data());
+    size = mapped_file.length();
+  } else {
+    if (!base::ReadFileToString(input_file_path, &input_data)) {
+      error_message = "read input file fail: " + input_file_path.AsUTF8Unsafe();
+      return false;
+    }
+    data = input_data.data();
+    size = input_data.size();
+  }
+
+  ScopedTraceSpan span("WriteJson");
+  span.AddArg("bytes", size);
+  ProtobufJsonWriter protobuf_json_writer;
+  if (!protobuf_json_writer.Open(output_file_path, error_message)) {
+    return false;
+  }
+  if (!protobuf_json_writer.WriteMessage(root_desc, data, size, error_message)) {
+    std::string close_error_message;
+    protobuf_json_writer.Close(close_error_message);
+    error_message += "\nconvert input_file protobuf fail!";
+    return false;
+  }
+  return protobuf_json_writer.Close(error_message);
+}
+
+bool ConvertJsonToProtobuf::ConvertBatch(
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  // ConversionWorker 只按 schema 模式和 enum 上限转换, 其他模式和输出的开关不能悄悄忽略掉
+  static const char* const kSingleFileSwitches[] = {
+    convert_switches::kToJson,
+    convert_switches::kRecordStream,
+    convert_switches::kIncremental,
+    convert_switches::kParallelSubtrees,
+    convert_switches::kUseDomParser,
+    convert_switches::kSchemaCacheDir,
+    convert_switches::kUseArena,
+    convert_switches::kOutputIoThread,
+    convert_switches::kWriteDescriptorSet,
+    convert_switches::kContainerOutput,
+    convert_switches::kCompressOutput,
+  };
+  for (const char* switch_name : kSingleFileSwitches) {
+    if (command_line->HasSwitch(switch_name)) {
+      error_message = std::string(switch_name) + " can not be used with batch";
+      return false;
+    }
+  }
+  int jobs = 0;
+  if (!GetJobs(command_line, &jobs, error_message)) {
+    return false;
+  }
+  int memory_budget_mb = kDefaultMemoryBudgetMb;
+  if (command_line->HasSwitch(convert_switches::kMemoryBudgetMb) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(convert_switches::kMemoryBudgetMb),
+        &memory_budget_mb) || memory_budget_mb <= 0)) {
+    error_message = "invalid memory-budget-mb";
+    return false;
+  }
+  size_t max_enum_cardinality = 0;
+  if (!GetMaxEnumCardinality(command_line, &max_enum_cardinality, error_message)) {
+    return false;
+  }
+  SchemaMode schema_mode = GetSchemaMode(command_line);
+
+  BatchConverter batch_converter(
+    command_line->GetSwitchValuePath(convert_switches::kOutputDir),
+    jobs, static_cast<int64_t>(memory_budget_mb) << 20, schema_mode);
+  batch_converter.set_max_enum_cardinality(max_enum_cardinality);
+  batch_converter.set_use_coroutine_pipeline(
+    command_line->HasSwitch(convert_switches::kCoroutinePipeline));
+  if ((command_line->HasSwitch(convert_switches::kInputDir) &&
+       !batch_converter.AddInputDirectory(
+         command_line->GetSwitchValuePath(convert_switches::kInputDir), error_message)) ||
+      (command_line->HasSwitch(convert_switches::kInputGlob) &&
+       !batch_converter.AddInputGlob(
+         command_line->GetSwitchValuePath(convert_switches::kInputGlob), error_message)) ||
+      (command_line->HasSwitch(convert_switches::kInputManifest) &&
+       !batch_converter.AddInputManifest(
+         command_line->GetSwitchValuePath(convert_switches::kInputManifest), error_message))) {
+    return false;
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  bool result = batch_converter.Convert(error_message);
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  ::printf("batch: %lld files, %d jobs, %.1f ms, %.1f MB/s, %lld steals, "
+    "peak in flight %.1f MB\n",
+    static_cast<long long>(batch_converter.file_count()),
+    jobs,
+    elapsed.InMillisecondsF(),
+    batch_converter.input_bytes() / (1024.0 * 1024.0) / elapsed.InSecondsF(),
+    static_cast<long long>(batch_converter.steal_count()),
+    batch_converter.peak_in_flight_bytes() / (1024.0 * 1024.0));
+  if (!result) {
+    error_message += "\nconvert batch fail!";
+    return false;
+  }
+  return true;
+}
+
+bool ConvertJsonToProtobuf::Serve(
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  int jobs = 0;
+  if (!GetJobs(command_line, &jobs, error_message)) {
+    return false;
+  }
+  ConversionServer conversion_server(
+    command_line->GetSwitchValuePath(convert_switches::kServe), jobs);
+  if (!conversion_server.Start(error_message)) {
+    return false;
+  }
+  ::printf("serving on %s with %d workers\n",
+    command_line->GetSwitchValuePath(convert_switches::kServe).AsUTF8Unsafe().c_str(), jobs);
+  ::fflush(stdout);
+  conversion_server.Run();
+  ::printf("served %lld connections, %lld requests, %lld fail\n",
+    static_cast<long long>(conversion_server.connection_count()),
+    static_cast<long long>(conversion_server.request_count()),
+    static_cast<long long>(conversion_server.error_count()));
+  return true;
+}
+
+bool ConvertJsonToProtobuf::StopServer(
+  const base::FilePath& socket_path,
+  std::string& error_message) {
+  ConversionClient conversion_client;
+  if (!conversion_client.Connect(socket_path, error_message)) {
+    return false;
+  }
+  ConversionRequest request;
+  request.type = ConversionRequest::Type::kShutdown;
+  ConversionResponse response;
+  return conversion_client.Send(request, &response, error_message);
+}
+
+bool ConvertJsonToProtobuf::ConvertOnServer(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  const base::CommandLine* command_line,
+  std::string& error_message) {
+  // server 只做 batch 那样的转换, 其他模式的开关不能悄悄忽略掉
+  static const char* const kLocalOnlySwitches[] = {
+    convert_switches::kToJson,
+    convert_switches::kRecordStream,
+    convert_switches::kIncremental,
+    convert_switches::kParallelSubtrees,
+    convert_switches::kUseDomParser,
+    convert_switches::kSchemaCacheDir,
+    convert_switches::kWriteDescriptorSet,
+    convert_switches::kContainerOutput,
+    convert_switches::kCompressOutput,
+  };
+  for (const char* switch_name : kLocalOnlySwitches) {
+    if (command_line->HasSwitch(switch_name)) {
+      error_message = std::string(switch_name) + " can not be used with server";
+      return false;
+    }
+  }
+  ConversionRequest request;
+  request.schema_mode = GetSchemaMode(command_line);
+  if (!GetMaxEnumCardinality(command_line, &request.max_enum_cardinality, error_message)) {
+    return false;
+  }
+  const bool send_inline = command_line->HasSwitch(convert_switches::kServerInline);
+  if (send_inline) {
+    request.type = ConversionRequest::Type::kConvertInline;
+    if (!base::ReadFileToString(input_file_path, &request.input)) {
+      error_message = "read input file fail";
+      return false;
+    }
+  } else {
+    // server 的工作目录不是这里, 路径都转成绝对的
+    base::FilePath current_dir;
+    if (!base::GetCurrentDirectory(&current_dir)) {
+      error_message = "get current directory fail";
+      return false;
+    }
+    request.type = ConversionRequest::Type::kConvertFile;
+    request.input_path = input_file_path.IsAbsolute() ?
+      input_file_path : current_dir.Append(input_file_path);
+    request.output_path = output_file_path.IsAbsolute() ?
+      output_file_path : current_dir.Append(output_file_path);
+  }
+
+  ConversionClient conversion_client;
+  ConversionResponse response;
+  if (!conversion_client.Connect(command_line->GetSwitchValuePath(convert_switches::kServer),
+        error_message) ||
+      !conversion_client.Send(request, &response, error_message)) {
+    return false;
+  }
+  if (!response.succeeded) {
+    error_message = response.error_message;
+    return false;
+  }
+  if (send_inline && base::WriteFile(output_file_path, response.output.data(),
+      static_cast<int>(response.output.size())) != static_cast<int>(response.output.size())) {
+    error_message = "write output file fail";
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<JsonInputStream> ConvertJsonToProtobuf::OpenInputStream(
+  const base::FilePath& input_file_path,
+  bool mmap_input,
+  std::string& error_message) {
+  if (mmap_input) {
+    std::unique_ptr<JsonMappedInputStream> mapped_input_stream(new JsonMappedInputStream());
+    if (!mapped_input_stream->Open(input_file_path, error_message)) {
+      return nullptr;
+    }
+    return std::move(mapped_input_stream);
+  }
+  std::unique_ptr<JsonFileInputStream> file_input_stream(new JsonFileInputStream());
+  if (!file_input_stream->Open(input_file_path, error_message)) {
+    return nullptr;
+  }
+  return std::move(file_input_stream);
+}
+
 std::unique_ptr<base::DictionaryValue>
 ConvertJsonToProtobuf::ParseInputJson(
   const base::FilePath& input_file_path,
   std::string& error_message) {
+  ScopedTraceSpan span("ParseInputJson");
   base::File::Info file_info;
   if (!base::GetFileInfo(input_file_path, &file_info)) {
     return nullptr;
   }
+  span.AddArg("bytes", file_info.size);
   std::unique_ptr<char[]> read_buffer(new char[file_info.size]);
   if (!base::ReadFile(input_file_path, read_buffer.get(), file_info.size)) {
     return nullptr;
@@ -13,6 +13,11 @@ class FilePath;
 class ListValue;
 }
 
+namespace self {
+class JsonInputStream;
+enum class SchemaMode;
+}
+
 namespace self {
 
 class ConvertJsonToProtobuf {
@@ -30,6 +35,89 @@ public:
 private:
   ConvertJsonToProtobuf();
 
+  bool DoConvert(
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  bool ConvertWithDomParser(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    SchemaMode schema_mode,
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  bool ConvertWithStreamParser(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    bool mmap_input,
+    const base::FilePath& schema_cache_dir,
+    SchemaMode schema_mode,
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  bool ConvertRecordStream(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    bool mmap_input,
+    bool use_io_thread,
+    SchemaMode schema_mode,
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  // --incremental, reuses the encoded subtrees of the previous run.
+  bool ConvertIncremental(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    bool mmap_input,
+    SchemaMode schema_mode,
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  // --parallel-subtrees, fills the large subtrees on a thread pool.
+  bool ConvertParallel(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    bool mmap_input,
+    SchemaMode schema_mode,
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  // --to-json, |input_file_path| is a protobuf file of the schema in
+  // |descriptor_set_file_path|.
+  bool ConvertToJson(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    const base::FilePath& descriptor_set_file_path,
+    bool mmap_input,
+    std::string& error_message);
+
+  // --input-dir, --input-glob or --input-manifest, converted on a thread pool.
+  bool ConvertBatch(
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  // --serve, converts for the clients of a ConversionServer until stopped.
+  bool Serve(
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  // --stop-server.
+  bool StopServer(
+    const base::FilePath& socket_path,
+    std::string& error_message);
+
+  // --server, the server listening on the socket converts the file.
+  bool ConvertOnServer(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    const base::CommandLine* command_line,
+    std::string& error_message);
+
+  std::unique_ptr<JsonInputStream> OpenInputStream(
+    const base::FilePath& input_file_path,
+    bool mmap_input,
+    std::string& error_message);
+
   std::unique_ptr<base::DictionaryValue> ParseInputJson(
     const base::FilePath& input_file_path,
     std::string& error_message);
@@ -4,4 +4,116 @@ namespace convert_switches {
 
 extern const char kInputFilePath[] = "input-file-path";
 extern const char kOutputFilePath[] = "output-file-path";
+// Parse the whole input into a base::Value tree before converting, the old
+// path. By default the input is streamed.
+extern const char kUseDomParser[] = "use-dom-parser";
+// Map the input file read-only and parse straight from the mapping instead of
+// reading it in chunks. Only used by the stream parser.
+extern const char kMmapInput[] = "mmap-input";
+// "streaming" (default) or "structural": index the whole input with SIMD
+// first and parse from the index. Used by every mode that streams json in.
+extern const char kJsonParser[] = "json-parser";
+// The input is newline delimited json with one record per line, the output is
+// length delimited protobuf records of one schema inferred from all records.
+// Implies kUnifyArraySchema unless kCompactWireTypes is given. Not used with
+// incremental, parallel subtree, dom parser, schema cache and arena.
+extern const char kRecordStream[] = "record-stream";
+// Directory of schemas keyed by the json shape fingerprint. Inputs with a
+// known shape skip schema inference.
+extern const char kSchemaCacheDir[] = "schema-cache-dir";
+// Keep the encoding of every large object reached through keys alone next to
+// the output, named like the output with ".subtrees" appended, and copy the
+// unchanged ones on the next run instead of encoding them again. Implies
+// kUnifyArraySchema unless kCompactWireTypes is given. Not used with parallel
+// subtree, dom parser, schema cache, arena and container output.
+extern const char kIncremental[] = "incremental";
+// Fill the large objects and arrays of objects under the root's keys on kJobs
+// threads, each on an arena of its own, and splice their encodings. The
+// output is the same as without it. Implies kUnifyArraySchema unless
+// kCompactWireTypes is given. Not used with dom parser, schema cache, arena and
+// container output.
+extern const char kParallelSubtrees[] = "parallel-subtrees";
+// Give all elements of an array one repeated message type holding the union of
+// their fields, instead of one message type per element.
+extern const char kUnifyArraySchema[] = "unify-array-schema";
+// Like kUnifyArraySchema, but every field gets the narrowest type its values
+// fit, repeated numbers are packed and the most frequent keys of a message
+// get the one byte field numbers. Repeating strings become enums. Implies
+// kUnifyArraySchema.
+extern const char kCompactWireTypes[] = "compact-wire-types";
+// With kCompactWireTypes, string fields with more distinct values than this
+// stay strings instead of becoming enums. 0 turns enums off.
+extern const char kMaxEnumCardinality[] = "max-enum-cardinality";
+// Create the messages of a conversion on one protobuf arena that is freed at
+// once, instead of one heap allocation per sub-message.
+extern const char kUseArena[] = "use-arena";
+// Write the output file on a background thread while the message is still
+// being encoded, or the next records converted in record stream mode.
+extern const char kOutputIoThread[] = "output-io-thread";
+// Compress the output file, "gzip" or "zlib", on the output I/O thread so
+// encoding and compression overlap. Implies kOutputIoThread. Not used by
+// batch, server and container output.
+extern const char kCompressOutput[] = "compress-output";
+// 0 to 9, defaults to 6.
+extern const char kCompressionLevel[] = "compression-level";
+// Bytes of output encoded before a chunk is written or handed to the I/O
+// thread, in KB, defaults to 1024.
+extern const char kOutputChunkKb[] = "output-chunk-kb";
+// Write the inferred schema as a FileDescriptorSet next to the output, named
+// like the output with ".desc" appended.
+extern const char kWriteDescriptorSet[] = "write-descriptor-set";
+// Write the output as a record container: blocks of length delimited records,
+// the schema and an index of the blocks at the end, so a reader can fetch one
+// record or filter on a field without decoding the whole file. The records of
+// kRecordStream, or the one root message otherwise. Not used by batch and
+// incremental mode.
+extern const char kContainerOutput[] = "container-output";
+// Bytes of records in a container block in KB, defaults to 64.
+extern const char kContainerBlockKb[] = "container-block-kb";
+// Comma separated json keys, dotted for nested ones, whose min and max every
+// container block records.
+extern const char kContainerStatFields[] = "container-stat-fields";
+// Reverse mode: the input is a protobuf file written by this tool, the output
+// is the json it came from.
+extern const char kToJson[] = "to-json";
+// Reverse mode schema, a FileDescriptorSet written by --write-descriptor-set.
+// Defaults to the input path with ".desc" appended.
+extern const char kDescriptorSetFilePath[] = "descriptor-set-file-path";
+// Batch mode inputs: every *.json below a directory, the files matching a
+// pattern like data/*.json, or a file listing one input path per line. Batch
+// mode only takes the schema switches, the switches of the other modes and of
+// the output file are rejected.
+extern const char kInputDir[] = "input-dir";
+extern const char kInputGlob[] = "input-glob";
+extern const char kInputManifest[] = "input-manifest";
+// Batch mode output, the directory tree of the inputs is kept.
+extern const char kOutputDir[] = "output-dir";
+// Batch, serve and parallel subtree mode worker threads, defaults to the
+// number of processors.
+extern const char kJobs[] = "jobs";
+// Batch mode limit on the estimated memory of the files being converted at
+// once, defaults to 1024.
+extern const char kMemoryBudgetMb[] = "memory-budget-mb";
+// Batch mode: read, parse, convert and write as a pipeline of coroutines, the
+// files read in chunks while they are parsed. Needs a build with
+// enable_json_to_proto_coroutines.
+extern const char kCoroutinePipeline[] = "coroutine-pipeline";
+// Serve mode: convert the requests of the clients connecting to the Unix
+// domain socket at this path, keeping the schemas warm between requests.
+extern const char kServe[] = "serve";
+// Client mode: have the server listening on the socket at this path convert
+// the input file to the output file, with the schema switches of this
+// command line.
+extern const char kServer[] = "server";
+// Client mode: send the input itself and write the output here, for a server
+// that cannot reach the paths.
+extern const char kServerInline[] = "server-inline";
+// Stop the server listening on the socket at this path.
+extern const char kStopServer[] = "stop-server";
+// Write the time, bytes, nodes, descriptors and allocations of each phase as
+// Chrome trace event json, for chrome://tracing or Perfetto.
+extern const char kTraceFile[] = "trace-file";
+// Objects and arrays of at least this many values get a span of their own in
+// the trace, defaults to 10000.
+extern const char kTraceMinNodes[] = "trace-min-nodes";
 }
\ No newline at end of file
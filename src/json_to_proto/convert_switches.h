@@ -5,6 +5,40 @@ namespace convert_switches {
 
 extern const char kInputFilePath[];
 extern const char kOutputFilePath[];
+extern const char kUseDomParser[];
+extern const char kMmapInput[];
+extern const char kJsonParser[];
+extern const char kRecordStream[];
+extern const char kSchemaCacheDir[];
+extern const char kIncremental[];
+extern const char kParallelSubtrees[];
+extern const char kUnifyArraySchema[];
+extern const char kCompactWireTypes[];
+extern const char kMaxEnumCardinality[];
+extern const char kUseArena[];
+extern const char kOutputIoThread[];
+extern const char kCompressOutput[];
+extern const char kCompressionLevel[];
+extern const char kOutputChunkKb[];
+extern const char kWriteDescriptorSet[];
+extern const char kContainerOutput[];
+extern const char kContainerBlockKb[];
+extern const char kContainerStatFields[];
+extern const char kToJson[];
+extern const char kDescriptorSetFilePath[];
+extern const char kInputDir[];
+extern const char kInputGlob[];
+extern const char kInputManifest[];
+extern const char kOutputDir[];
+extern const char kJobs[];
+extern const char kMemoryBudgetMb[];
+extern const char kCoroutinePipeline[];
+extern const char kServe[];
+extern const char kServer[];
+extern const char kServerInline[];
+extern const char kStopServer[];
+extern const char kTraceFile[];
+extern const char kTraceMinNodes[];
 
 } // namespace convert_switches
 
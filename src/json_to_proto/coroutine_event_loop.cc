@@ -0,0 +1,169 @@
+#include "coroutine_event_loop.h"
+
+#if defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+
+#include <algorithm>
+#include <string>
+
+#include "base/strings/string_number_conversions.h"
+#include "base/threading/simple_thread.h"
+
+namespace self {
+
+LoopTask::promise_type::~promise_type() {
+  if (event_loop) {
+    event_loop->OnTaskDone();
+  }
+}
+
+EventLoop::EventLoop()
+  : handle_posted_(&lock_),
+    live_task_count_(0) {
+}
+
+EventLoop::~EventLoop() {
+  DCHECK_EQ(live_task_count_, 0);
+}
+
+void EventLoop::Spawn(LoopTask task) {
+  DCHECK(task.handle_);
+  task.handle_.promise().event_loop = this;
+  live_task_count_++;
+  Post(task.handle_);
+  // 协程帧从这里起归 loop 管, 跑完自己释放
+  task.handle_ = nullptr;
+}
+
+void EventLoop::Post(coro::coroutine_handle<> handle) {
+  base::AutoLock auto_lock(lock_);
+  ready_handles_.push_back(handle);
+  handle_posted_.Signal();
+}
+
+void EventLoop::Run() {
+  while (live_task_count_ > 0) {
+    coro::coroutine_handle<> handle;
+    {
+      base::AutoLock auto_lock(lock_);
+      // 所有协程都挂在阻塞调用上时, 等线程池把它们送回来
+      while (ready_handles_.empty()) {
+        handle_posted_.Wait();
+      }
+      handle = ready_handles_.front();
+      ready_handles_.pop_front();
+    }
+    handle.resume();
+  }
+}
+
+void EventLoop::OnTaskDone() {
+  DCHECK_GT(live_task_count_, 0);
+  live_task_count_--;
+}
+
+class BlockingThreadPool::Worker : public base::DelegateSimpleThread::Delegate {
+public:
+  explicit Worker(BlockingThreadPool* thread_pool) : thread_pool_(thread_pool) {}
+
+  void Run() override {
+    Call call;
+    while (thread_pool_->PopCall(&call)) {
+      call.call();
+      // 调用的结果已经写进协程帧, 之后只由 loop 线程碰它
+      thread_pool_->event_loop_->Post(call.handle);
+    }
+  }
+
+private:
+  BlockingThreadPool* thread_pool_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
+BlockingThreadPool::BlockingThreadPool(
+  EventLoop* event_loop,
+  int thread_count,
+  const char* name)
+  : event_loop_(event_loop),
+    call_queued_(&lock_),
+    stopping_(false) {
+  for (int index = 0; index < std::max(thread_count, 1); index++) {
+    workers_.emplace_back(new Worker(this));
+    threads_.emplace_back(new base::DelegateSimpleThread(
+      workers_.back().get(), std::string(name) + "_" + base::IntToString(index)));
+    threads_.back()->Start();
+  }
+}
+
+BlockingThreadPool::~BlockingThreadPool() {
+  {
+    base::AutoLock auto_lock(lock_);
+    stopping_ = true;
+    call_queued_.Broadcast();
+  }
+  for (auto& thread : threads_) {
+    thread->Join();
+  }
+}
+
+void BlockingThreadPool::Enqueue(
+  std::function<void()> call,
+  coro::coroutine_handle<> handle) {
+  base::AutoLock auto_lock(lock_);
+  calls_.push_back({std::move(call), handle});
+  call_queued_.Signal();
+}
+
+bool BlockingThreadPool::PopCall(Call* call) {
+  base::AutoLock auto_lock(lock_);
+  while (calls_.empty() && !stopping_) {
+    call_queued_.Wait();
+  }
+  if (calls_.empty()) {
+    return false;
+  }
+  *call = std::move(calls_.front());
+  calls_.pop_front();
+  return true;
+}
+
+LoopMemoryBudget::LoopMemoryBudget(EventLoop* event_loop, int64_t budget)
+  : event_loop_(event_loop),
+    budget_(budget),
+    held_bytes_(0),
+    peak_held_bytes_(0) {
+}
+
+LoopMemoryBudget::~LoopMemoryBudget() {
+  DCHECK(waiters_.empty());
+}
+
+void LoopMemoryBudget::Release(int64_t bytes) {
+  held_bytes_ -= bytes;
+  DCHECK_GE(held_bytes_, 0);
+  // 按到达的顺序放行, 大文件不会被后面的小文件一直插队
+  while (!waiters_.empty() && Fits(waiters_.front().bytes)) {
+    Waiter waiter = waiters_.front();
+    waiters_.pop_front();
+    held_bytes_ += waiter.bytes;
+    peak_held_bytes_ = std::max(peak_held_bytes_, held_bytes_);
+    event_loop_->Post(waiter.handle);
+  }
+}
+
+bool LoopMemoryBudget::Fits(int64_t bytes) const {
+  return held_bytes_ == 0 || held_bytes_ + bytes <= budget_;
+}
+
+bool LoopMemoryBudget::TryAcquire(int64_t bytes) {
+  if (!waiters_.empty() || !Fits(bytes)) {
+    return false;
+  }
+  held_bytes_ += bytes;
+  peak_held_bytes_ = std::max(peak_held_bytes_, held_bytes_);
+  return true;
+}
+
+} //namespace self
+#endif // defined(JSON_TO_PROTO_ENABLE_COROUTINES)
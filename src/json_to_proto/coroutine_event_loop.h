@@ -0,0 +1,392 @@
+#ifndef COROUTINE_EVENT_LOOP_H_
+#define COROUTINE_EVENT_LOOP_H_
+
+// Only built with JSON_TO_PROTO_ENABLE_COROUTINES, see BUILD.gn: the rest of
+// the tree is C++14 and the coroutines need -fcoroutines-ts, /await or C++20.
+#if defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+namespace self {
+namespace coro = std;
+}
+#else
+#include <experimental/coroutine>
+namespace self {
+namespace coro = std::experimental;
+}
+#endif
+
+namespace base {
+class DelegateSimpleThread;
+}
+
+namespace self {
+
+class EventLoop;
+
+// The return type of a coroutine started with EventLoop::Spawn(). It starts
+// suspended, runs on the loop thread and frees itself when it returns.
+class LoopTask {
+public:
+  struct promise_type {
+    promise_type() : event_loop(nullptr) {}
+    ~promise_type();
+
+    LoopTask get_return_object() {
+      return LoopTask(coro::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    coro::suspend_always initial_suspend() { return {}; }
+    coro::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    // 这个工程不用异常
+    void unhandled_exception() { std::terminate(); }
+
+    EventLoop* event_loop;
+  };
+
+  LoopTask(LoopTask&& other) : handle_(other.handle_) { other.handle_ = nullptr; }
+
+  ~LoopTask() {
+    // 没交给 Spawn() 的协程还没开始跑, 直接销毁
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+private:
+  friend class EventLoop;
+
+  explicit LoopTask(coro::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  coro::coroutine_handle<promise_type> handle_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(LoopTask);
+};
+
+// Resumes coroutines on the thread that calls Run(), one at a time, so the
+// state they share needs no lock. Other threads hand a coroutine back with
+// Post().
+class EventLoop {
+public:
+  EventLoop();
+
+  ~EventLoop();
+
+  // Runs |task| from the next turn of the loop on.
+  void Spawn(LoopTask task);
+
+  // Resumes |handle| on the loop thread. Called from any thread.
+  void Post(coro::coroutine_handle<> handle);
+
+  // Returns once every spawned coroutine has returned.
+  void Run();
+
+private:
+  friend struct LoopTask::promise_type;
+
+  void OnTaskDone();
+
+private:
+  base::Lock lock_;
+  base::ConditionVariable handle_posted_;
+  std::deque<coro::coroutine_handle<>> ready_handles_;
+  // Only touched on the loop thread.
+  int live_task_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(EventLoop);
+};
+
+// Threads for the blocking calls of the coroutines: file I/O, or a whole
+// conversion. A coroutine awaiting RunBlocking() is suspended until the call
+// returned on one of the threads, then resumed on its loop.
+class BlockingThreadPool {
+public:
+  BlockingThreadPool(EventLoop* event_loop, int thread_count, const char* name);
+
+  // Joins the threads, the calls queued are run first.
+  ~BlockingThreadPool();
+
+  class Awaiter {
+  public:
+    Awaiter(BlockingThreadPool* thread_pool, std::function<void()> call)
+      : thread_pool_(thread_pool),
+        call_(std::move(call)) {
+    }
+
+    bool await_ready() const { return false; }
+    void await_suspend(coro::coroutine_handle<> handle) {
+      thread_pool_->Enqueue(std::move(call_), handle);
+    }
+    void await_resume() {}
+
+  private:
+    BlockingThreadPool* thread_pool_;
+    std::function<void()> call_;
+  };
+
+  // co_await RunBlocking(...). |call| returns its results through its
+  // captures, which live in the awaiting coroutine's frame.
+  Awaiter RunBlocking(std::function<void()> call) {
+    return Awaiter(this, std::move(call));
+  }
+
+private:
+  class Worker;
+
+  struct Call {
+    std::function<void()> call;
+    coro::coroutine_handle<> handle;
+  };
+
+  void Enqueue(std::function<void()> call, coro::coroutine_handle<> handle);
+
+  // Returns false once the pool is being destroyed and no call is left.
+  bool PopCall(Call* call);
+
+private:
+  EventLoop* event_loop_;
+
+  base::Lock lock_;
+  base::ConditionVariable call_queued_;
+  std::deque<Call> calls_;
+  bool stopping_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(BlockingThreadPool);
+};
+
+// A bounded queue of pointers between the coroutines of one loop. Push()
+// suspends while the queue is full, Pop() while it is empty, so a fast stage
+// can not run ahead of a slow one by more than |capacity| items.
+template <typename T>
+class LoopChannel {
+public:
+  LoopChannel(EventLoop* event_loop, size_t capacity)
+    : event_loop_(event_loop),
+      capacity_(capacity > 0 ? capacity : 1),
+      closed_(false) {
+  }
+
+  class PushAwaiter {
+  public:
+    PushAwaiter(LoopChannel* channel, T* item) : channel_(channel), item_(item) {}
+
+    bool await_ready() { return channel_->TryPush(item_); }
+    void await_suspend(coro::coroutine_handle<> handle) {
+      channel_->pushers_.push_back({item_, handle});
+    }
+    void await_resume() {}
+
+  private:
+    LoopChannel* channel_;
+    T* item_;
+  };
+
+  class PopAwaiter {
+  public:
+    explicit PopAwaiter(LoopChannel* channel) : channel_(channel), item_(nullptr) {}
+
+    bool await_ready() { return channel_->TryPop(&item_); }
+    void await_suspend(coro::coroutine_handle<> handle) {
+      channel_->poppers_.push_back({&item_, handle});
+    }
+    T* await_resume() { return item_; }
+
+  private:
+    LoopChannel* channel_;
+    T* item_;
+  };
+
+  // Not after Close().
+  PushAwaiter Push(T* item) { return PushAwaiter(this, item); }
+
+  // Null once the channel is closed and drained.
+  PopAwaiter Pop() { return PopAwaiter(this); }
+
+  // Wakes the coroutines waiting in Pop() when nothing is left.
+  void Close() {
+    closed_ = true;
+    if (items_.empty()) {
+      for (const Popper& popper : poppers_) {
+        *popper.item = nullptr;
+        event_loop_->Post(popper.handle);
+      }
+      poppers_.clear();
+    }
+  }
+
+private:
+  struct Pusher {
+    T* item;
+    coro::coroutine_handle<> handle;
+  };
+
+  struct Popper {
+    T** item;
+    coro::coroutine_handle<> handle;
+  };
+
+  bool TryPush(T* item) {
+    DCHECK(!closed_);
+    // 有人在等就直接交给它
+    if (!poppers_.empty()) {
+      Popper popper = poppers_.front();
+      poppers_.pop_front();
+      *popper.item = item;
+      event_loop_->Post(popper.handle);
+      return true;
+    }
+    if (items_.size() < capacity_) {
+      items_.push_back(item);
+      return true;
+    }
+    return false;
+  }
+
+  bool TryPop(T** item) {
+    if (!items_.empty()) {
+      *item = items_.front();
+      items_.pop_front();
+      if (!pushers_.empty()) {
+        Pusher pusher = pushers_.front();
+        pushers_.pop_front();
+        items_.push_back(pusher.item);
+        event_loop_->Post(pusher.handle);
+      }
+      return true;
+    }
+    if (closed_) {
+      *item = nullptr;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  EventLoop* event_loop_;
+  const size_t capacity_;
+  std::deque<T*> items_;
+  std::deque<Pusher> pushers_;
+  std::deque<Popper> poppers_;
+  bool closed_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(LoopChannel);
+};
+
+// Bytes of memory the coroutines of one loop may hold at once. Acquire()
+// suspends until the bytes fit, in order of arrival. Like
+// BatchConverter::AcquireMemory(), a request larger than the budget is let
+// through when nothing else is held.
+class LoopMemoryBudget {
+public:
+  LoopMemoryBudget(EventLoop* event_loop, int64_t budget);
+
+  ~LoopMemoryBudget();
+
+  class Awaiter {
+  public:
+    Awaiter(LoopMemoryBudget* memory_budget, int64_t bytes)
+      : memory_budget_(memory_budget),
+        bytes_(bytes) {
+    }
+
+    bool await_ready() { return memory_budget_->TryAcquire(bytes_); }
+    void await_suspend(coro::coroutine_handle<> handle) {
+      memory_budget_->waiters_.push_back({bytes_, handle});
+    }
+    void await_resume() {}
+
+  private:
+    LoopMemoryBudget* memory_budget_;
+    const int64_t bytes_;
+  };
+
+  Awaiter Acquire(int64_t bytes) { return Awaiter(this, bytes); }
+
+  void Release(int64_t bytes);
+
+  int64_t peak_held_bytes() const { return peak_held_bytes_; }
+
+private:
+  struct Waiter {
+    int64_t bytes;
+    coro::coroutine_handle<> handle;
+  };
+
+  bool Fits(int64_t bytes) const;
+  bool TryAcquire(int64_t bytes);
+
+private:
+  EventLoop* event_loop_;
+  const int64_t budget_;
+  int64_t held_bytes_;
+  int64_t peak_held_bytes_;
+  std::deque<Waiter> waiters_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(LoopMemoryBudget);
+};
+
+// A flag coroutines of one loop can wait for. Set once, never reset.
+class LoopEvent {
+public:
+  explicit LoopEvent(EventLoop* event_loop) : event_loop_(event_loop), is_set_(false) {}
+
+  class Awaiter {
+  public:
+    explicit Awaiter(LoopEvent* event) : event_(event) {}
+
+    bool await_ready() const { return event_->is_set_; }
+    void await_suspend(coro::coroutine_handle<> handle) {
+      event_->waiters_.push_back(handle);
+    }
+    void await_resume() {}
+
+  private:
+    LoopEvent* event_;
+  };
+
+  Awaiter Wait() { return Awaiter(this); }
+
+  void Set() {
+    is_set_ = true;
+    for (coro::coroutine_handle<> handle : waiters_) {
+      event_loop_->Post(handle);
+    }
+    waiters_.clear();
+  }
+
+private:
+  EventLoop* event_loop_;
+  bool is_set_;
+  std::vector<coro::coroutine_handle<>> waiters_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(LoopEvent);
+};
+
+} // namespace self
+#endif // defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+#endif // COROUTINE_EVENT_LOOP_H_
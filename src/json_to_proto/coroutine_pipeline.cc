@@ -0,0 +1,328 @@
+#include "coroutine_pipeline.h"
+
+#include <algorithm>
+
+#include "base/files/file.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "json_unified_schema_builder.h"
+
+#if defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+#include "conversion_tracer.h"
+#include "conversion_worker.h"
+#include "coroutine_event_loop.h"
+#include "json_input_stream.h"
+#endif
+
+namespace self {
+
+namespace {
+#if defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+// 和 BatchConverter 一样按输入的几倍预估一个文件占用的内存
+static const int64_t kMemoryPerInputByte = 4;
+// 文件读写都是阻塞调用, 放在这几个线程上, 同时在读写的块数就是 I/O 队列深度
+static const int kIoThreadCount = 4;
+static const int kWriterCount = 2;
+static const int kReadChunkSize = 1 << 20;
+static const int kWriteChunkSize = 1 << 20;
+#endif
+}
+
+#if defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+
+// The state of one Run(). Every member but the thread pools' queues is only
+// touched on the loop thread, or by the one blocking call a coroutine awaits.
+class CoroutinePipeline::Runner {
+public:
+  explicit Runner(CoroutinePipeline* pipeline);
+
+  ~Runner();
+
+  bool Run(std::string& error_message);
+
+private:
+  struct Job {
+    explicit Job(EventLoop* event_loop) : input_done(event_loop) {}
+
+    size_t index;
+    const File* file;
+    base::File input_file;
+    int64_t length;
+    int64_t memory;
+    std::unique_ptr<JsonChunkQueueInputStream> input_stream;
+    // Set once the last chunk is appended and the input file closed.
+    LoopEvent input_done;
+    std::string read_error;
+    bool succeeded;
+    std::string output;
+    std::string error_message;
+  };
+
+  // Opens the files in order, and once their memory fits the budget starts
+  // reading them and hands them to the converters.
+  LoopTask AdmitFiles();
+
+  LoopTask ReadFile(Job* job);
+
+  LoopTask ConvertFiles();
+
+  LoopTask WriteFiles();
+
+  // Frees what |job| holds and counts its error.
+  void FinishJob(Job* job, const std::string& write_error);
+
+private:
+  CoroutinePipeline* pipeline_;
+
+  // 线程池要在 loop 之前析构
+  EventLoop event_loop_;
+  BlockingThreadPool io_thread_pool_;
+  BlockingThreadPool convert_thread_pool_;
+  LoopMemoryBudget memory_budget_;
+  // Files read or being read, waiting for a converter.
+  LoopChannel<Job> convert_channel_;
+  // Files converted, waiting for a writer.
+  LoopChannel<Job> write_channel_;
+  int running_converter_count_;
+
+  std::vector<std::unique_ptr<Job>> jobs_;
+  size_t first_error_index_;
+  std::string first_error_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(Runner);
+};
+
+CoroutinePipeline::Runner::Runner(CoroutinePipeline* pipeline)
+  : pipeline_(pipeline),
+    io_thread_pool_(&event_loop_, kIoThreadCount, "json_to_proto_io"),
+    convert_thread_pool_(&event_loop_, pipeline->worker_count_, "json_to_proto_worker"),
+    memory_budget_(&event_loop_, pipeline->memory_budget_),
+    convert_channel_(&event_loop_, pipeline->worker_count_),
+    write_channel_(&event_loop_, kWriterCount),
+    running_converter_count_(0),
+    first_error_index_(0) {
+}
+
+CoroutinePipeline::Runner::~Runner() {
+}
+
+bool CoroutinePipeline::Runner::Run(std::string& error_message) {
+  for (size_t index = 0; index < pipeline_->files_.size(); index++) {
+    jobs_.emplace_back(new Job(&event_loop_));
+    jobs_.back()->index = index;
+    jobs_.back()->file = &pipeline_->files_[index];
+    jobs_.back()->length = 0;
+    jobs_.back()->memory = 0;
+    jobs_.back()->succeeded = false;
+  }
+
+  event_loop_.Spawn(AdmitFiles());
+  running_converter_count_ = std::max(pipeline_->worker_count_, 1);
+  for (int index = 0; index < running_converter_count_; index++) {
+    event_loop_.Spawn(ConvertFiles());
+  }
+  for (int index = 0; index < kWriterCount; index++) {
+    event_loop_.Spawn(WriteFiles());
+  }
+  event_loop_.Run();
+  pipeline_->peak_in_flight_bytes_ = memory_budget_.peak_held_bytes();
+
+  if (pipeline_->error_count_ > 0) {
+    error_message = base::Int64ToString(pipeline_->error_count_) + " of " +
+      base::SizeTToString(jobs_.size()) + " files fail, first error: " +
+      pipeline_->files_[first_error_index_].input_path.AsUTF8Unsafe() + ": " + first_error_;
+    return false;
+  }
+  return true;
+}
+
+LoopTask CoroutinePipeline::Runner::AdmitFiles() {
+  for (const std::unique_ptr<Job>& job_ptr : jobs_) {
+    Job* job = job_ptr.get();
+    co_await io_thread_pool_.RunBlocking([job] {
+      job->input_file.Initialize(job->file->input_path,
+        base::File::FLAG_OPEN | base::File::FLAG_READ | base::File::FLAG_SEQUENTIAL_SCAN);
+      if (job->input_file.IsValid()) {
+        job->length = job->input_file.GetLength();
+      }
+    });
+    if (!job->input_file.IsValid() || job->length < 0) {
+      job->read_error = "open input file fail";
+      job->length = 0;
+      job->input_done.Set();
+      co_await convert_channel_.Push(job);
+      continue;
+    }
+
+    job->memory = job->length * kMemoryPerInputByte;
+    co_await memory_budget_.Acquire(job->memory);
+    job->input_stream.reset(new JsonChunkQueueInputStream(job->length));
+    event_loop_.Spawn(ReadFile(job));
+    // converter 都忙时停在这里, 已经开始读的文件照样读下去
+    co_await convert_channel_.Push(job);
+  }
+  convert_channel_.Close();
+}
+
+LoopTask CoroutinePipeline::Runner::ReadFile(Job* job) {
+  bool succeeded = true;
+  int64_t offset = 0;
+  while (offset < job->length) {
+    int size = static_cast<int>(std::min<int64_t>(kReadChunkSize, job->length - offset));
+    std::string chunk;
+    int read_size = 0;
+    co_await io_thread_pool_.RunBlocking([job, offset, size, &chunk, &read_size] {
+      chunk.resize(size);
+      read_size = job->input_file.Read(offset, &chunk[0], size);
+    });
+    if (read_size <= 0) {
+      succeeded = false;
+      break;
+    }
+    chunk.resize(read_size);
+    offset += read_size;
+    job->input_stream->Append(std::move(chunk));
+  }
+  co_await io_thread_pool_.RunBlocking([job] {
+    job->input_file.Close();
+  });
+  if (!succeeded) {
+    job->read_error = "read input file fail";
+  }
+  job->input_stream->Finish(succeeded);
+  job->input_done.Set();
+}
+
+LoopTask CoroutinePipeline::Runner::ConvertFiles() {
+  // 每个 converter 一个 worker, 它的调用一个接一个, 同一时刻只在一个线程上
+  ConversionWorker worker(pipeline_->schema_mode_, pipeline_->max_enum_cardinality_);
+  while (Job* job = co_await convert_channel_.Pop()) {
+    if (job->read_error.empty()) {
+      co_await convert_thread_pool_.RunBlocking([job, &worker] {
+        ScopedTraceSpan span("ConvertFile");
+        span.AddArg("bytes", job->length);
+        job->succeeded = worker.Convert(
+          job->input_stream.get(), &job->output, job->error_message);
+      });
+    }
+    co_await write_channel_.Push(job);
+  }
+  if (--running_converter_count_ == 0) {
+    write_channel_.Close();
+  }
+}
+
+LoopTask CoroutinePipeline::Runner::WriteFiles() {
+  while (Job* job = co_await write_channel_.Pop()) {
+    // 解析失败时读可能还没完, 块要等读完才能丢
+    co_await job->input_done.Wait();
+    std::string write_error;
+    if (job->read_error.empty() && job->succeeded) {
+      base::File output_file;
+      co_await io_thread_pool_.RunBlocking([job, &output_file] {
+        if (base::CreateDirectory(job->file->output_path.DirName())) {
+          output_file.Initialize(job->file->output_path,
+            base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+        }
+      });
+      if (!output_file.IsValid()) {
+        write_error = "create output file fail";
+      }
+      size_t offset = 0;
+      while (write_error.empty() && offset < job->output.size()) {
+        int size = static_cast<int>(std::min<size_t>(kWriteChunkSize, job->output.size() - offset));
+        int written = 0;
+        co_await io_thread_pool_.RunBlocking([job, offset, size, &output_file, &written] {
+          written = output_file.WriteAtCurrentPos(job->output.data() + offset, size);
+        });
+        if (written != size) {
+          write_error = "write output file fail";
+        }
+        offset += size;
+      }
+      if (output_file.IsValid()) {
+        co_await io_thread_pool_.RunBlocking([&output_file] {
+          output_file.Close();
+        });
+      }
+    }
+    FinishJob(job, write_error);
+  }
+}
+
+void CoroutinePipeline::Runner::FinishJob(Job* job, const std::string& write_error) {
+  memory_budget_.Release(job->memory);
+  if (job->input_stream) {
+    job->input_stream->Clear();
+  }
+  std::string().swap(job->output);
+  pipeline_->input_bytes_ += job->length;
+
+  std::string error_message = job->read_error;
+  if (error_message.empty() && !job->succeeded) {
+    error_message = job->error_message;
+  }
+  if (error_message.empty()) {
+    error_message = write_error;
+  }
+  if (error_message.empty()) {
+    return;
+  }
+  if (pipeline_->error_count_ == 0 || job->index < first_error_index_) {
+    first_error_index_ = job->index;
+    first_error_ = error_message;
+  }
+  pipeline_->error_count_++;
+}
+
+#endif // defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+
+CoroutinePipeline::CoroutinePipeline(
+  int worker_count,
+  int64_t memory_budget,
+  SchemaMode schema_mode)
+  : worker_count_(worker_count > 0 ? worker_count : 1),
+    memory_budget_(memory_budget),
+    schema_mode_(schema_mode),
+    max_enum_cardinality_(JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality),
+    error_count_(0),
+    input_bytes_(0),
+    peak_in_flight_bytes_(0) {
+}
+
+CoroutinePipeline::~CoroutinePipeline() {
+}
+
+bool CoroutinePipeline::IsSupported() {
+#if defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void CoroutinePipeline::AddFile(
+  const base::FilePath& input_path,
+  const base::FilePath& output_path) {
+  files_.push_back({input_path, output_path});
+}
+
+bool CoroutinePipeline::Run(std::string& error_message) {
+  error_count_ = 0;
+  input_bytes_ = 0;
+  peak_in_flight_bytes_ = 0;
+#if defined(JSON_TO_PROTO_ENABLE_COROUTINES)
+  if (files_.empty()) {
+    return true;
+  }
+  Runner runner(this);
+  return runner.Run(error_message);
+#else
+  error_message = "built without coroutine support, see enable_json_to_proto_coroutines";
+  return false;
+#endif
+}
+
+} //namespace self
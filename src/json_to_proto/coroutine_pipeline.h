@@ -0,0 +1,88 @@
+#ifndef COROUTINE_PIPELINE_H_
+#define COROUTINE_PIPELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/macros.h"
+#include "build_proto_from_json.h"
+
+namespace self {
+
+// Converts many json files as a pipeline of coroutines on one event loop:
+// readers stream every file in chunks into a JsonChunkQueueInputStream,
+// converters parse and convert it while it is still being read, writers
+// write the encodings out in chunks. File I/O runs on a few blocking I/O
+// threads and the conversions on |worker_count| threads, the coroutines only
+// hand the files from stage to stage. Stages are joined by bounded channels
+// and the files in flight by a memory budget, so reading runs ahead of the
+// converters only as far as there is memory for, and the disk keeps busy
+// while the cores are, even when the files do not fit the page cache.
+//
+// Writes the same outputs as BatchConverter. With SchemaMode::kCompact the
+// narrow types of a file come from the file of the same shape its worker saw
+// first, so they depend on which files share a worker, like the steals of
+// BatchConverter. Run() fails when the tree was built without
+// JSON_TO_PROTO_ENABLE_COROUTINES.
+class CoroutinePipeline {
+public:
+  // See BatchConverter::BatchConverter().
+  CoroutinePipeline(
+    int worker_count,
+    int64_t memory_budget,
+    SchemaMode schema_mode);
+
+  ~CoroutinePipeline();
+
+  // Whether Run() is built in.
+  static bool IsSupported();
+
+  // See BuildProtoFromJson::set_max_enum_cardinality().
+  void set_max_enum_cardinality(size_t max_enum_cardinality) {
+    max_enum_cardinality_ = max_enum_cardinality;
+  }
+
+  // The output directory is created when missing.
+  void AddFile(const base::FilePath& input_path, const base::FilePath& output_path);
+
+  // Converts every file added. On failure the others are still converted and
+  // |error_message| is the error of the first failed file in the order they
+  // were added.
+  bool Run(std::string& error_message);
+
+  size_t file_count() const { return files_.size(); }
+  int64_t error_count() const { return error_count_; }
+  int64_t input_bytes() const { return input_bytes_; }
+  int64_t peak_in_flight_bytes() const { return peak_in_flight_bytes_; }
+
+private:
+  class Runner;
+
+  struct File {
+    base::FilePath input_path;
+    base::FilePath output_path;
+  };
+
+private:
+  const int worker_count_;
+  const int64_t memory_budget_;
+  const SchemaMode schema_mode_;
+  size_t max_enum_cardinality_;
+
+  std::vector<File> files_;
+
+  int64_t error_count_;
+  int64_t input_bytes_;
+  int64_t peak_in_flight_bytes_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(CoroutinePipeline);
+};
+
+} // namespace self
+#endif // COROUTINE_PIPELINE_H_
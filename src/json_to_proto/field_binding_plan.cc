@@ -0,0 +1,208 @@
+#include "field_binding_plan.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "google/protobuf/descriptor.h"
+#include "json_unified_schema_builder.h"
+
+namespace self {
+
+namespace {
+
+SetterKind GetSetterKind(const google::protobuf::FieldDescriptor* field_desc) {
+  switch (field_desc->cpp_type()) {
+  case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+    return SetterKind::kBool;
+  case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+    return SetterKind::kInt64;
+  case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+    return SetterKind::kInt32;
+  case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+    return SetterKind::kUint32;
+  case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+    return SetterKind::kFloat;
+  case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+    return SetterKind::kDouble;
+  case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+    return SetterKind::kString;
+  case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+    return SetterKind::kEnum;
+  case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+    return SetterKind::kMessage;
+  default:
+    return SetterKind::kUnsupported;
+  }
+}
+
+bool IsVariant(const google::protobuf::Descriptor* desc) {
+  // JsonUnifiedSchemaBuilder 只在 variant message 里用 oneof
+  return desc->oneof_decl_count() == 1 &&
+    desc->oneof_decl(0)->name() == JsonUnifiedSchemaBuilder::kVariantOneofName;
+}
+
+const FieldBinding* FindBindingByFieldName(
+  const FieldBinding* bindings,
+  size_t binding_count,
+  const char* field_name) {
+  for (size_t i = 0; i < binding_count; ++i) {
+    if (bindings[i].field_desc->name() == field_name) {
+      return &bindings[i];
+    }
+  }
+  return nullptr;
+}
+
+}
+
+const google::protobuf::EnumValueDescriptor* FieldBinding::FindEnumValue(
+  const base::StringPiece& string) const {
+  const EnumStringValue* enum_values_end = enum_values + enum_value_count;
+  const EnumStringValue* iter = std::lower_bound(enum_values, enum_values_end, string,
+    [](const EnumStringValue& enum_value, const base::StringPiece& string) {
+      return enum_value.string < string;
+    });
+  if (iter == enum_values_end || iter->string != string) {
+    return nullptr;
+  }
+  return iter->value_desc;
+}
+
+MessageBindingPlan::MessageBindingPlan(const google::protobuf::Descriptor* desc)
+  : desc_(desc),
+    bindings_(nullptr),
+    binding_count_(0),
+    sorted_bindings_(nullptr),
+    is_variant_(false),
+    item_binding_(nullptr) {
+  DCHECK(desc_);
+  std::fill(std::begin(variant_bindings_), std::end(variant_bindings_), nullptr);
+}
+
+const FieldBinding* MessageBindingPlan::FindBinding(
+  const base::StringPiece& key,
+  size_t* hint) const {
+  if (*hint < binding_count_ && bindings_[*hint].key == key) {
+    return &bindings_[(*hint)++];
+  }
+  const FieldBinding** sorted_end = sorted_bindings_ + binding_count_;
+  const FieldBinding** iter = std::lower_bound(sorted_bindings_, sorted_end, key,
+    [](const FieldBinding* binding, const base::StringPiece& key) {
+      return binding->key < key;
+    });
+  if (iter == sorted_end || (*iter)->key != key) {
+    return nullptr;
+  }
+  *hint = (*iter)->index + 1;
+  return *iter;
+}
+
+BindingPlanCache::BindingPlanCache(SchemaMode schema_mode)
+  : schema_mode_(schema_mode),
+    plans_(0, std::hash<const google::protobuf::Descriptor*>(),
+      std::equal_to<const google::protobuf::Descriptor*>(),
+      MonotonicArenaAllocator<PlanEntry>(&arena_)) {
+}
+
+BindingPlanCache::~BindingPlanCache() {
+}
+
+const MessageBindingPlan* BindingPlanCache::GetPlan(
+  const google::protobuf::Descriptor* desc) {
+  auto iter = plans_.find(desc);
+  if (iter != plans_.end()) {
+    return iter->second;
+  }
+  return Compile(desc);
+}
+
+MessageBindingPlan* BindingPlanCache::Compile(const google::protobuf::Descriptor* desc) {
+  // 先放进表里再编译子类型, 自引用的类型也只编译一次
+  MessageBindingPlan* plan = arena_.New<MessageBindingPlan>(desc);
+  plans_[desc] = plan;
+
+  const size_t binding_count = desc->field_count();
+  plan->bindings_ = arena_.NewArray<FieldBinding>(binding_count);
+  plan->sorted_bindings_ = arena_.NewArray<const FieldBinding*>(binding_count);
+  plan->binding_count_ = binding_count;
+  for (size_t i = 0; i < binding_count; ++i) {
+    const google::protobuf::FieldDescriptor* field_desc = desc->field(static_cast<int>(i));
+    FieldBinding& binding = plan->bindings_[i];
+    binding.key = schema_mode_ == SchemaMode::kUnified ?
+      base::StringPiece(field_desc->json_name()) : base::StringPiece(field_desc->name());
+    binding.field_desc = field_desc;
+    binding.setter_kind = GetSetterKind(field_desc);
+    binding.repeated = field_desc->is_repeated();
+    binding.index = i;
+    binding.child_plan = binding.setter_kind == SetterKind::kMessage ?
+      GetPlan(field_desc->message_type()) : nullptr;
+    binding.enum_values = nullptr;
+    binding.enum_value_count = 0;
+    if (binding.setter_kind == SetterKind::kEnum) {
+      CompileEnumValues(field_desc->enum_type(), &binding);
+    }
+    plan->sorted_bindings_[i] = &binding;
+  }
+  std::sort(plan->sorted_bindings_, plan->sorted_bindings_ + binding_count,
+    [](const FieldBinding* left, const FieldBinding* right) {
+      return left->key < right->key;
+    });
+
+  if (schema_mode_ != SchemaMode::kUnified) {
+    return plan;
+  }
+
+  plan->item_binding_ =
+    FindBindingByFieldName(plan->bindings_, binding_count, JsonUnifiedSchemaBuilder::kItemFieldName);
+  plan->is_variant_ = IsVariant(desc);
+  if (plan->is_variant_) {
+    static const struct {
+      JsonValueType value_type;
+      const char* field_name;
+    } kVariantFields[] = {
+      {JsonValueType::kBoolean, JsonUnifiedSchemaBuilder::kBoolValueFieldName},
+      {JsonValueType::kInteger, JsonUnifiedSchemaBuilder::kIntValueFieldName},
+      {JsonValueType::kDouble, JsonUnifiedSchemaBuilder::kDoubleValueFieldName},
+      {JsonValueType::kString, JsonUnifiedSchemaBuilder::kStringValueFieldName},
+      {JsonValueType::kObject, JsonUnifiedSchemaBuilder::kObjectValueFieldName},
+      {JsonValueType::kArray, JsonUnifiedSchemaBuilder::kListValueFieldName},
+    };
+    for (const auto& variant_field : kVariantFields) {
+      plan->variant_bindings_[static_cast<size_t>(variant_field.value_type)] =
+        FindBindingByFieldName(plan->bindings_, binding_count, variant_field.field_name);
+    }
+    // 整数和小数同时出现时 schema 里只有 double_value
+    const FieldBinding*& integer_binding =
+      plan->variant_bindings_[static_cast<size_t>(JsonValueType::kInteger)];
+    if (!integer_binding) {
+      integer_binding = plan->variant_bindings_[static_cast<size_t>(JsonValueType::kDouble)];
+    }
+  }
+  return plan;
+}
+
+void BindingPlanCache::CompileEnumValues(
+  const google::protobuf::EnumDescriptor* enum_desc,
+  FieldBinding* binding) {
+  // 同一个枚举被多个字段用到时各编译一份, 只有 kCompact 的 schema 有枚举
+  const size_t value_count = enum_desc->value_count();
+  EnumStringValue* enum_values = arena_.NewArray<EnumStringValue>(value_count);
+  std::string string;
+  for (size_t i = 0; i < value_count; ++i) {
+    const google::protobuf::EnumValueDescriptor* value_desc =
+      enum_desc->value(static_cast<int>(i));
+    if (!JsonUnifiedSchemaBuilder::EnumValueString(
+          enum_desc->name(), value_desc->name(), &string)) {
+      return;
+    }
+    enum_values[i] = {arena_.CopyString(string), value_desc};
+  }
+  std::sort(enum_values, enum_values + value_count,
+    [](const EnumStringValue& left, const EnumStringValue& right) {
+      return left.string < right.string;
+    });
+  binding->enum_values = enum_values;
+  binding->enum_value_count = value_count;
+}
+
+} //namespace self
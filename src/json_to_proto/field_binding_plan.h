@@ -0,0 +1,159 @@
+#ifndef FIELD_BINDING_PLAN_H_
+#define FIELD_BINDING_PLAN_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "build_proto_from_json.h"
+#include "monotonic_arena.h"
+
+namespace google {
+namespace protobuf {
+class Descriptor;
+class EnumDescriptor;
+class EnumValueDescriptor;
+class FieldDescriptor;
+} // namespace protobuf
+} // google
+
+namespace self {
+
+enum class JsonValueType {
+  kBoolean,
+  kInteger,
+  kDouble,
+  kString,
+  kObject,
+  kArray
+};
+
+// Which reflection setter a field takes, decided once from its cpp type.
+enum class SetterKind {
+  kBool,
+  kInt64,
+  // SchemaMode::kCompact narrows integers and doubles to these.
+  kInt32,
+  kUint32,
+  kFloat,
+  kDouble,
+  kString,
+  // SchemaMode::kCompact turns low-cardinality strings into these.
+  kEnum,
+  kMessage,
+  kUnsupported
+};
+
+class MessageBindingPlan;
+
+// The json string an enum value of JsonUnifiedSchemaBuilder stands for.
+struct EnumStringValue {
+  base::StringPiece string;
+  const google::protobuf::EnumValueDescriptor* value_desc;
+};
+
+struct FieldBinding {
+  // The json key the field is found by, points into the descriptor.
+  base::StringPiece key;
+  const google::protobuf::FieldDescriptor* field_desc;
+  SetterKind setter_kind;
+  bool repeated;
+  // Position in declaration order.
+  size_t index;
+  // kMessage: the plan of the field's message type.
+  const MessageBindingPlan* child_plan;
+  // kEnum: the values sorted by string, empty for enums whose value names
+  // are no json strings.
+  const EnumStringValue* enum_values;
+  size_t enum_value_count;
+
+  // The value for |string|, nullptr when the enum has none.
+  const google::protobuf::EnumValueDescriptor* FindEnumValue(
+    const base::StringPiece& string) const;
+};
+
+// Every field of one message type in declaration order, plus a table sorted
+// by key. Documents mostly repeat the key order the schema was inferred in,
+// so a lookup first tries the field after the previous match and only then
+// searches the table. Plans live in their BindingPlanCache's arena.
+class MessageBindingPlan {
+public:
+  explicit MessageBindingPlan(const google::protobuf::Descriptor* desc);
+
+  const google::protobuf::Descriptor* descriptor() const { return desc_; }
+
+  size_t binding_count() const { return binding_count_; }
+
+  const FieldBinding& binding(size_t index) const { return bindings_[index]; }
+
+  // |hint| is the position expected next, it is moved past the match.
+  // Returns nullptr when no field has |key|.
+  const FieldBinding* FindBinding(const base::StringPiece& key, size_t* hint) const;
+
+  // SchemaMode::kUnified only. A variant message holds one field per json
+  // value type in a oneof, nullptr for the types the path never had.
+  bool is_variant() const { return is_variant_; }
+
+  const FieldBinding* variant_binding(JsonValueType value_type) const {
+    return variant_bindings_[static_cast<size_t>(value_type)];
+  }
+
+  // SchemaMode::kUnified only. The field of an array-of-arrays wrapper.
+  const FieldBinding* item_binding() const { return item_binding_; }
+
+private:
+  friend class BindingPlanCache;
+
+  const google::protobuf::Descriptor* desc_;
+  FieldBinding* bindings_;
+  size_t binding_count_;
+  const FieldBinding** sorted_bindings_;
+  bool is_variant_;
+  const FieldBinding* variant_bindings_[static_cast<size_t>(JsonValueType::kArray) + 1];
+  const FieldBinding* item_binding_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(MessageBindingPlan);
+};
+
+// Compiles a message type and every type reachable from it into plans, once.
+// In kPerElement mode the key is the field name, in kUnified mode it is the
+// json_name that keeps the original key.
+class BindingPlanCache {
+public:
+  explicit BindingPlanCache(SchemaMode schema_mode);
+
+  ~BindingPlanCache();
+
+  const MessageBindingPlan* GetPlan(const google::protobuf::Descriptor* desc);
+
+  size_t plan_count() const { return plans_.size(); }
+
+private:
+  typedef std::pair<const google::protobuf::Descriptor* const, MessageBindingPlan*> PlanEntry;
+
+  MessageBindingPlan* Compile(const google::protobuf::Descriptor* desc);
+
+  void CompileEnumValues(
+    const google::protobuf::EnumDescriptor* enum_desc,
+    FieldBinding* binding);
+
+private:
+  const SchemaMode schema_mode_;
+  // 每个 message 类型编译一次, 每个元素一个类型时会有上千个, 全放在 arena 里
+  MonotonicArena arena_;
+  std::unordered_map<const google::protobuf::Descriptor*, MessageBindingPlan*,
+    std::hash<const google::protobuf::Descriptor*>,
+    std::equal_to<const google::protobuf::Descriptor*>,
+    MonotonicArenaAllocator<PlanEntry>> plans_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(BindingPlanCache);
+};
+
+} // namespace self
+#endif // FIELD_BINDING_PLAN_H_
@@ -0,0 +1,188 @@
+#include "field_binding_plan.h"
+
+#include <memory>
+#include <string>
+
+#include "build_proto_from_json.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "json_input_stream.h"
+#include "json_unified_schema_builder.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+void AddField(
+  google::protobuf::DescriptorProto* desc_proto,
+  const char* name,
+  const char* json_name,
+  int number,
+  google::protobuf::FieldDescriptorProto::Type type,
+  google::protobuf::FieldDescriptorProto::Label label,
+  const char* type_name) {
+  google::protobuf::FieldDescriptorProto* field_proto = desc_proto->add_field();
+  field_proto->set_name(name);
+  field_proto->set_json_name(json_name);
+  field_proto->set_number(number);
+  field_proto->set_type(type);
+  field_proto->set_label(label);
+  if (type_name) {
+    field_proto->set_type_name(type_name);
+  }
+}
+
+// NODE { b, a_key (json "a-key"), c, NODE child, repeated NODE children }
+const google::protobuf::Descriptor* BuildNode(google::protobuf::DescriptorPool* desc_pool) {
+  google::protobuf::FileDescriptorProto file_desc_proto;
+  file_desc_proto.set_name("node.proto");
+  google::protobuf::DescriptorProto* desc_proto = file_desc_proto.add_message_type();
+  desc_proto->set_name("NODE");
+  AddField(desc_proto, "b", "b", 1, google::protobuf::FieldDescriptorProto::TYPE_BOOL,
+    google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL, nullptr);
+  AddField(desc_proto, "a_key", "a-key", 2, google::protobuf::FieldDescriptorProto::TYPE_INT64,
+    google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL, nullptr);
+  AddField(desc_proto, "c", "c", 3, google::protobuf::FieldDescriptorProto::TYPE_STRING,
+    google::protobuf::FieldDescriptorProto::LABEL_REPEATED, nullptr);
+  AddField(desc_proto, "child", "child", 4, google::protobuf::FieldDescriptorProto::TYPE_MESSAGE,
+    google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL, "NODE");
+  AddField(desc_proto, "children", "children", 5,
+    google::protobuf::FieldDescriptorProto::TYPE_MESSAGE,
+    google::protobuf::FieldDescriptorProto::LABEL_REPEATED, "NODE");
+  const google::protobuf::FileDescriptor* file_desc = desc_pool->BuildFile(file_desc_proto);
+  EXPECT_TRUE(file_desc);
+  return file_desc ? file_desc->FindMessageTypeByName("NODE") : nullptr;
+}
+
+} // namespace
+
+// A self referencing type is compiled once and every field gets its setter.
+TEST(BindingPlanCacheTest, CompilesEveryTypeOnce) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* node_desc = BuildNode(&desc_pool);
+  ASSERT_TRUE(node_desc);
+  BindingPlanCache plan_cache(SchemaMode::kPerElement);
+  const MessageBindingPlan* plan = plan_cache.GetPlan(node_desc);
+  ASSERT_TRUE(plan);
+  EXPECT_EQ(plan, plan_cache.GetPlan(node_desc));
+  EXPECT_EQ(1u, plan_cache.plan_count());
+  EXPECT_EQ(node_desc, plan->descriptor());
+
+  ASSERT_EQ(5u, plan->binding_count());
+  EXPECT_EQ(SetterKind::kBool, plan->binding(0).setter_kind);
+  EXPECT_EQ(SetterKind::kInt64, plan->binding(1).setter_kind);
+  EXPECT_EQ(SetterKind::kString, plan->binding(2).setter_kind);
+  EXPECT_TRUE(plan->binding(2).repeated);
+  EXPECT_EQ(SetterKind::kMessage, plan->binding(3).setter_kind);
+  EXPECT_FALSE(plan->binding(3).repeated);
+  EXPECT_EQ(plan, plan->binding(3).child_plan);
+  EXPECT_TRUE(plan->binding(4).repeated);
+  EXPECT_EQ(plan, plan->binding(4).child_plan);
+  for (size_t i = 0; i < plan->binding_count(); ++i) {
+    EXPECT_EQ(i, plan->binding(i).index);
+  }
+  EXPECT_FALSE(plan->is_variant());
+  EXPECT_FALSE(plan->item_binding());
+}
+
+// Keys in declaration order move the hint along, any other order still finds
+// the field through the sorted table.
+TEST(BindingPlanCacheTest, FindBindingInAnyOrder) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* node_desc = BuildNode(&desc_pool);
+  ASSERT_TRUE(node_desc);
+  BindingPlanCache plan_cache(SchemaMode::kPerElement);
+  const MessageBindingPlan* plan = plan_cache.GetPlan(node_desc);
+  ASSERT_TRUE(plan);
+
+  size_t hint = 0;
+  for (const char* key : {"b", "a_key", "c", "child", "children"}) {
+    const FieldBinding* binding = plan->FindBinding(key, &hint);
+    ASSERT_TRUE(binding) << key;
+    EXPECT_EQ(key, binding->field_desc->name());
+    EXPECT_EQ(binding->index + 1, hint);
+  }
+
+  for (const char* key : {"children", "b", "child", "c", "a_key", "b"}) {
+    const FieldBinding* binding = plan->FindBinding(key, &hint);
+    ASSERT_TRUE(binding) << key;
+    EXPECT_EQ(key, binding->field_desc->name());
+    EXPECT_EQ(binding->index + 1, hint);
+  }
+
+  hint = 2;
+  EXPECT_FALSE(plan->FindBinding("a-key", &hint));
+  EXPECT_FALSE(plan->FindBinding("", &hint));
+  EXPECT_FALSE(plan->FindBinding("zz", &hint));
+  EXPECT_EQ(2u, hint);
+}
+
+// kUnified looks fields up by the json_name that keeps the original key.
+TEST(BindingPlanCacheTest, UnifiedKeysAreJsonNames) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* node_desc = BuildNode(&desc_pool);
+  ASSERT_TRUE(node_desc);
+  BindingPlanCache plan_cache(SchemaMode::kUnified);
+  const MessageBindingPlan* plan = plan_cache.GetPlan(node_desc);
+  ASSERT_TRUE(plan);
+  size_t hint = 0;
+  const FieldBinding* binding = plan->FindBinding("a-key", &hint);
+  ASSERT_TRUE(binding);
+  EXPECT_EQ("a_key", binding->field_desc->name());
+  EXPECT_FALSE(plan->FindBinding("a_key", &hint));
+}
+
+// Variant messages map every json value type to its oneof field, integers
+// fall back to double_value, and array-of-arrays wrappers expose item.
+TEST(BindingPlanCacheTest, UnifiedVariantAndItem) {
+  JsonStringInputStream input_stream(
+    "{\"v\":[1,\"s\",{\"b\":true},[2]],\"m\":[[1],[2]],\"n\":[1,2.5,\"s\"]}");
+  BuildProtoFromJson build_proto_from_json;
+  std::string error_message;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(
+      &input_stream, SchemaMode::kUnified, error_message);
+  ASSERT_TRUE(file_desc_proto) << error_message;
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(*file_desc_proto);
+  ASSERT_TRUE(file_desc);
+  BindingPlanCache plan_cache(SchemaMode::kUnified);
+  const MessageBindingPlan* plan = plan_cache.GetPlan(file_desc->FindMessageTypeByName("ROOT"));
+  ASSERT_TRUE(plan);
+  EXPECT_FALSE(plan->is_variant());
+
+  size_t hint = 0;
+  const FieldBinding* v_binding = plan->FindBinding("v", &hint);
+  ASSERT_TRUE(v_binding && v_binding->child_plan);
+  const MessageBindingPlan* v_plan = v_binding->child_plan;
+  ASSERT_TRUE(v_plan->is_variant());
+  EXPECT_FALSE(v_plan->variant_binding(JsonValueType::kBoolean));
+  EXPECT_FALSE(v_plan->variant_binding(JsonValueType::kDouble));
+  ASSERT_TRUE(v_plan->variant_binding(JsonValueType::kInteger));
+  EXPECT_EQ(JsonUnifiedSchemaBuilder::kIntValueFieldName,
+            v_plan->variant_binding(JsonValueType::kInteger)->field_desc->name());
+  ASSERT_TRUE(v_plan->variant_binding(JsonValueType::kString));
+  ASSERT_TRUE(v_plan->variant_binding(JsonValueType::kObject));
+  ASSERT_TRUE(v_plan->variant_binding(JsonValueType::kArray));
+  EXPECT_EQ(JsonUnifiedSchemaBuilder::kListValueFieldName,
+            v_plan->variant_binding(JsonValueType::kArray)->field_desc->name());
+
+  const FieldBinding* m_binding = plan->FindBinding("m", &hint);
+  ASSERT_TRUE(m_binding && m_binding->child_plan);
+  EXPECT_FALSE(m_binding->child_plan->is_variant());
+  const FieldBinding* item_binding = m_binding->child_plan->item_binding();
+  ASSERT_TRUE(item_binding);
+  EXPECT_TRUE(item_binding->repeated);
+  EXPECT_EQ(SetterKind::kInt64, item_binding->setter_kind);
+
+  const FieldBinding* n_binding = plan->FindBinding("n", &hint);
+  ASSERT_TRUE(n_binding && n_binding->child_plan);
+  const MessageBindingPlan* n_plan = n_binding->child_plan;
+  ASSERT_TRUE(n_plan->is_variant());
+  ASSERT_TRUE(n_plan->variant_binding(JsonValueType::kDouble));
+  EXPECT_EQ(n_plan->variant_binding(JsonValueType::kDouble),
+            n_plan->variant_binding(JsonValueType::kInteger));
+}
+
+} // namespace self
@@ -0,0 +1,596 @@
+#include "incremental_converter.h"
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <utility>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "conversion_tracer.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_stream_message_builder.h"
+#include "json_stream_schema_builder.h"
+#include "json_tape.h"
+#include "json_to_protobuf_serializer.h"
+#include "json_unified_schema_builder.h"
+#include "monotonic_arena.h"
+#include "protobuf_file_output_stream.h"
+#include "subtree_cache.h"
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/message.h"
+
+namespace self {
+
+namespace {
+// FNV-1a 64
+static const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kFnvPrime = 1099511628211ULL;
+static const size_t kNoUnit = static_cast<size_t>(-1);
+
+void MixNumber(uint64_t* hash, uint64_t value) {
+  for (int shift = 0; shift < 64; shift += 8) {
+    *hash ^= static_cast<uint8_t>(value >> shift);
+    *hash *= kFnvPrime;
+  }
+}
+
+void MixString(uint64_t* hash, const std::string& value) {
+  MixNumber(hash, value.size());
+  for (char c : value) {
+    *hash ^= static_cast<uint8_t>(c);
+    *hash *= kFnvPrime;
+  }
+}
+
+template <typename TypeProto>
+const TypeProto* FindTypeProto(
+  const std::map<std::string, const TypeProto*>& type_protos,
+  const std::string& type_name) {
+  auto iter = type_protos.find(type_name);
+  return iter == type_protos.end() ? nullptr : iter->second;
+}
+
+// Passes the events on, except for the objects at |skipped_ordinals| and the
+// keys in front of them, the subtrees copied from the cache. A key has to
+// stay valid until the next event, as the keys of a JsonTape do.
+class SubtreeSkippingHandler : public JsonSaxHandler {
+public:
+  SubtreeSkippingHandler(
+    JsonSaxHandler* handler,
+    const std::vector<size_t>* skipped_ordinals)
+    : handler_(handler),
+      skipped_ordinals_(skipped_ordinals),
+      next_skipped_(0),
+      object_count_(0),
+      skip_depth_(0),
+      has_pending_key_(false) {
+  }
+
+  bool OnStartObject() override {
+    const size_t object_ordinal = object_count_++;
+    if (skip_depth_ > 0) {
+      ++skip_depth_;
+      return true;
+    }
+    if (next_skipped_ < skipped_ordinals_->size() &&
+        (*skipped_ordinals_)[next_skipped_] == object_ordinal) {
+      ++next_skipped_;
+      skip_depth_ = 1;
+      has_pending_key_ = false;
+      return true;
+    }
+    return FlushKey() && Forward(handler_->OnStartObject());
+  }
+
+  bool OnKey(const base::StringPiece& key) override {
+    // key 要等到值来了才知道跳不跳
+    if (skip_depth_ == 0) {
+      pending_key_ = key;
+      has_pending_key_ = true;
+    }
+    return true;
+  }
+
+  bool OnEndObject() override {
+    if (skip_depth_ > 0) {
+      --skip_depth_;
+      return true;
+    }
+    return Forward(handler_->OnEndObject());
+  }
+
+  bool OnStartArray() override {
+    return skip_depth_ > 0 || (FlushKey() && Forward(handler_->OnStartArray()));
+  }
+
+  bool OnEndArray() override {
+    return skip_depth_ > 0 || Forward(handler_->OnEndArray());
+  }
+
+  bool OnNull() override {
+    return skip_depth_ > 0 || (FlushKey() && Forward(handler_->OnNull()));
+  }
+
+  bool OnBoolean(bool value) override {
+    return skip_depth_ > 0 || (FlushKey() && Forward(handler_->OnBoolean(value)));
+  }
+
+  bool OnInteger(int64_t value) override {
+    return skip_depth_ > 0 || (FlushKey() && Forward(handler_->OnInteger(value)));
+  }
+
+  bool OnDouble(double value) override {
+    return skip_depth_ > 0 || (FlushKey() && Forward(handler_->OnDouble(value)));
+  }
+
+  bool OnString(const base::StringPiece& value) override {
+    return skip_depth_ > 0 || (FlushKey() && Forward(handler_->OnString(value)));
+  }
+
+private:
+  bool FlushKey() {
+    if (!has_pending_key_) {
+      return true;
+    }
+    has_pending_key_ = false;
+    return Forward(handler_->OnKey(pending_key_));
+  }
+
+  bool Forward(bool result) {
+    if (!result) {
+      error_message_ = handler_->error_message();
+    }
+    return result;
+  }
+
+private:
+  JsonSaxHandler* handler_;
+  const std::vector<size_t>* skipped_ordinals_;
+  size_t next_skipped_;
+  size_t object_count_;
+  size_t skip_depth_;
+  base::StringPiece pending_key_;
+  bool has_pending_key_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(SubtreeSkippingHandler);
+};
+}
+
+IncrementalConverter::IncrementalConverter(SchemaMode schema_mode)
+  : schema_mode_(schema_mode),
+    max_enum_cardinality_(JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality),
+    min_subtree_events_(kDefaultMinSubtreeEvents),
+    use_io_thread_(false),
+    output_options_(nullptr),
+    write_descriptor_set_(false),
+    subtree_count_(0),
+    reused_subtree_count_(0),
+    reused_bytes_(0),
+    encoded_bytes_(0) {
+  DCHECK(schema_mode_ != SchemaMode::kPerElement);
+}
+
+IncrementalConverter::~IncrementalConverter() {
+}
+
+base::FilePath IncrementalConverter::SidecarPath(const base::FilePath& output_file_path) {
+  return output_file_path.AddExtension(FILE_PATH_LITERAL("subtrees"));
+}
+
+bool IncrementalConverter::Convert(
+  JsonInputStream* input_stream,
+  const base::FilePath& output_file_path,
+  std::string& error_message) {
+  DCHECK(input_stream);
+  if (output_file_path.empty()) {
+    error_message = "incremental conversion needs an output file";
+    return false;
+  }
+  units_.clear();
+  message_protos_.clear();
+  enum_protos_.clear();
+  shape_hashes_.clear();
+  subtree_count_ = 0;
+  reused_subtree_count_ = 0;
+  reused_bytes_ = 0;
+  encoded_bytes_ = 0;
+
+  const base::FilePath sidecar_path = SidecarPath(output_file_path);
+  SubtreeCache old_cache;
+  {
+    ScopedTraceSpan span("LoadSubtreeCache");
+    std::string load_error_message;
+    if (!old_cache.Load(sidecar_path, load_error_message)) {
+      // 旁路文件坏了就当没有, 这次全部重新编码, 写完覆盖掉它
+      LOG(WARNING) << "ignore subtree cache: " << load_error_message;
+    }
+    span.AddArg("entries", old_cache.entry_count());
+  }
+
+  // 推导 schema, 记 tape 和算子树的 hash 共用一遍解析
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    BuildProtoFromJson::NewProtoFile();
+  MonotonicArena tape_arena;
+  JsonTape json_tape(&tape_arena);
+  JsonSubtreeHasher subtree_hasher(min_subtree_events_);
+  {
+    ScopedTraceSpan span("CreateProtoFile");
+    span.AddArg("bytes", input_stream->GetLength());
+    std::unique_ptr<JsonSchemaBuilder> schema_builder =
+      BuildProtoFromJson::CreateSchemaBuilder(
+        schema_mode_, max_enum_cardinality_, file_desc_proto.get());
+    JsonSaxTee schema_tee(schema_builder.get(), &json_tape);
+    JsonSaxTee hash_tee(&schema_tee, &subtree_hasher);
+    std::unique_ptr<TracedJsonSaxHandler> traced_handler;
+    JsonSaxReader json_reader(input_stream);
+    if (!json_reader.Parse(TracedJsonSaxHandler::Wrap(&hash_tee, &traced_handler),
+          error_message) ||
+        !schema_builder->Finish(error_message)) {
+      return false;
+    }
+    if (traced_handler) {
+      span.AddArg("nodes", traced_handler->node_count());
+    }
+    span.AddArg("descriptors", file_desc_proto->message_type_size());
+  }
+  if (subtree_hasher.subtrees().empty()) {
+    error_message = "root value is not a json object";
+    return false;
+  }
+
+  // 命中和形状都在 FileDescriptorProto 上判断, 整个文件不用先建出来
+  for (const google::protobuf::DescriptorProto& desc_proto : file_desc_proto->message_type()) {
+    message_protos_[desc_proto.name()] = &desc_proto;
+  }
+  for (const google::protobuf::EnumDescriptorProto& enum_desc_proto :
+       file_desc_proto->enum_type()) {
+    enum_protos_[enum_desc_proto.name()] = &enum_desc_proto;
+  }
+  if (!ResolveUnits(subtree_hasher.subtrees(), old_cache, error_message)) {
+    return false;
+  }
+  if (write_descriptor_set_) {
+    // 描述文件要完整的 schema, 只有这时才把整个文件建一遍
+    std::unique_ptr<google::protobuf::DescriptorPool> full_desc_pool;
+    const google::protobuf::FileDescriptor* full_file_desc =
+      JsonToProtobufSerializer::BuildFile(
+        std::unique_ptr<google::protobuf::FileDescriptorProto>(
+          new google::protobuf::FileDescriptorProto(*file_desc_proto)),
+        &full_desc_pool, error_message);
+    if (!full_file_desc ||
+        !JsonToProtobufSerializer::WriteDescriptorSet(
+          full_file_desc, output_file_path, error_message)) {
+      return false;
+    }
+  }
+
+  const size_t root_cached_entry = units_.front().cached_entry;
+  if (root_cached_entry != SubtreeCache::kNotFound) {
+    // 整个文档都没变, 旁路文件也不用重写
+    reused_subtree_count_ = 1;
+    reused_bytes_ = old_cache.entry(root_cached_entry).body_size;
+    return WriteOutput(old_cache, root_cached_entry, output_file_path, error_message);
+  }
+
+  // 只建变了的部分用到的类型
+  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = JsonToProtobufSerializer::BuildFile(
+    NewPrunedProtoFile(file_desc_proto.get()), &desc_pool, error_message);
+  if (!file_desc) {
+    return false;
+  }
+  const google::protobuf::Descriptor* root_desc =
+    file_desc->FindMessageTypeByName(units_.front().desc_proto->name());
+  DCHECK(root_desc);
+
+  // 新缓存里复制过来的条目指向旧缓存的字节, 旧缓存要活得更久
+  SubtreeCache new_cache;
+  size_t root_entry = SubtreeCache::kNotFound;
+  {
+    std::unique_ptr<google::protobuf::DynamicMessageFactory> dynamic_message_factory(
+      new google::protobuf::DynamicMessageFactory(desc_pool.get()));
+    std::unique_ptr<google::protobuf::Message> root_message(
+      dynamic_message_factory->GetPrototype(root_desc)->New());
+    {
+      ScopedTraceSpan span("CreateMessage");
+      // 命中的子树连同前面的 key 一起跳过, message 里只剩变了的部分
+      std::vector<size_t> skipped_ordinals;
+      for (const Unit& unit : units_) {
+        if (unit.cached_entry != SubtreeCache::kNotFound) {
+          skipped_ordinals.push_back(unit.subtree->object_ordinal);
+        }
+      }
+      span.AddArg("skipped_subtrees", skipped_ordinals.size());
+      std::unique_ptr<JsonMessageBuilder> message_builder =
+        JsonToProtobufSerializer::CreateMessageBuilder(
+          schema_mode_, root_message.get(), dynamic_message_factory.get());
+      SubtreeSkippingHandler skipping_handler(message_builder.get(), &skipped_ordinals);
+      std::unique_ptr<TracedJsonSaxHandler> traced_handler;
+      if (!json_tape.Replay(TracedJsonSaxHandler::Wrap(&skipping_handler, &traced_handler),
+            error_message)) {
+        return false;
+      }
+      if (traced_handler) {
+        span.AddArg("nodes", traced_handler->node_count());
+      }
+    }
+    ScopedTraceSpan span("EncodeSubtrees");
+    root_entry = EncodeUnit(0, root_message.get(), old_cache, &new_cache);
+    span.AddArg("bytes", encoded_bytes_);
+    span.AddArg("reused_bytes", reused_bytes_);
+  }
+
+  if (!WriteOutput(new_cache, root_entry, output_file_path, error_message)) {
+    return false;
+  }
+  ScopedTraceSpan span("StoreSubtreeCache");
+  span.AddArg("entries", new_cache.entry_count());
+  return new_cache.Store(sidecar_path, error_message);
+}
+
+bool IncrementalConverter::ResolveUnits(
+  const std::vector<JsonSubtreeHasher::Subtree>& subtrees,
+  const SubtreeCache& old_cache,
+  std::string& error_message) {
+  const google::protobuf::DescriptorProto* root_desc_proto =
+    FindTypeProto(message_protos_, "ROOT");
+  if (!root_desc_proto) {
+    error_message = "no ROOT message in proto file";
+    return false;
+  }
+  // 子树按先父后子排好, 父对象的字段总是先找到
+  std::vector<size_t> unit_indexes(subtrees.size(), kNoUnit);
+  for (size_t index = 0; index < subtrees.size(); ++index) {
+    const JsonSubtreeHasher::Subtree& subtree = subtrees[index];
+    if (!subtree.reusable) {
+      continue;
+    }
+    ++subtree_count_;
+    Unit unit;
+    unit.subtree = &subtree;
+    unit.desc_proto = root_desc_proto;
+    unit.field_number = 0;
+    size_t parent_index = kNoUnit;
+    if (subtree.parent != JsonSubtreeHasher::kNoParent) {
+      parent_index = unit_indexes[subtree.parent];
+      // 父对象整个从缓存复制时, 下面的子树不用再看
+      if (parent_index == kNoUnit ||
+          units_[parent_index].cached_entry != SubtreeCache::kNotFound) {
+        continue;
+      }
+      const google::protobuf::FieldDescriptorProto* field_desc_proto =
+        FindSubtreeField(*units_[parent_index].desc_proto, subtree.key);
+      if (!field_desc_proto) {
+        continue;
+      }
+      unit.desc_proto = FindTypeProto(message_protos_, field_desc_proto->type_name());
+      unit.field_number = field_desc_proto->number();
+    }
+    unit.shape_hash = ShapeHash(*unit.desc_proto);
+    unit.cached_entry = old_cache.Find(subtree.content_hash, unit.shape_hash);
+    unit_indexes[index] = units_.size();
+    if (parent_index != kNoUnit) {
+      units_[parent_index].children.push_back(units_.size());
+    }
+    units_.push_back(std::move(unit));
+  }
+  return true;
+}
+
+const google::protobuf::FieldDescriptorProto* IncrementalConverter::FindSubtreeField(
+  const google::protobuf::DescriptorProto& desc_proto,
+  const std::string& key) const {
+  for (const google::protobuf::FieldDescriptorProto& field_desc_proto : desc_proto.field()) {
+    if (!field_desc_proto.has_json_name() || field_desc_proto.json_name() != key) {
+      continue;
+    }
+    if (field_desc_proto.type() != google::protobuf::FieldDescriptorProto::TYPE_MESSAGE ||
+        field_desc_proto.label() == google::protobuf::FieldDescriptorProto::LABEL_REPEATED) {
+      return nullptr;
+    }
+    // 同一个 key 下还出现过别的 json 类型时字段是带 oneof 的 variant, 不单独缓存
+    const google::protobuf::DescriptorProto* message_desc_proto =
+      FindTypeProto(message_protos_, field_desc_proto.type_name());
+    if (!message_desc_proto || message_desc_proto->oneof_decl_size() > 0) {
+      return nullptr;
+    }
+    return &field_desc_proto;
+  }
+  return nullptr;
+}
+
+uint64_t IncrementalConverter::ShapeHash(const google::protobuf::DescriptorProto& desc_proto) {
+  auto iter = shape_hashes_.find(&desc_proto);
+  if (iter != shape_hashes_.end()) {
+    return iter->second;
+  }
+  // 推导出的 schema 是一棵树, 不会递归回自己
+  uint64_t hash = kFnvOffsetBasis;
+  MixNumber(&hash, desc_proto.field_size());
+  MixNumber(&hash, desc_proto.oneof_decl_size());
+  for (const google::protobuf::FieldDescriptorProto& field_desc_proto : desc_proto.field()) {
+    MixNumber(&hash, field_desc_proto.has_json_name());
+    MixString(&hash, field_desc_proto.json_name());
+    MixNumber(&hash, field_desc_proto.number());
+    MixNumber(&hash, field_desc_proto.type());
+    MixNumber(&hash, field_desc_proto.label());
+    MixNumber(&hash, field_desc_proto.options().packed());
+    MixNumber(&hash, field_desc_proto.has_oneof_index() ?
+      field_desc_proto.oneof_index() + 1 : 0);
+    if (field_desc_proto.type() == google::protobuf::FieldDescriptorProto::TYPE_MESSAGE) {
+      const google::protobuf::DescriptorProto* message_desc_proto =
+        FindTypeProto(message_protos_, field_desc_proto.type_name());
+      MixNumber(&hash, message_desc_proto ? ShapeHash(*message_desc_proto) : 0);
+    } else if (field_desc_proto.type() == google::protobuf::FieldDescriptorProto::TYPE_ENUM) {
+      // 枚举值对应的 json 字符串从枚举名和值名推出来
+      const google::protobuf::EnumDescriptorProto* enum_desc_proto =
+        FindTypeProto(enum_protos_, field_desc_proto.type_name());
+      if (!enum_desc_proto) {
+        continue;
+      }
+      MixString(&hash, enum_desc_proto->name());
+      MixNumber(&hash, enum_desc_proto->value_size());
+      for (const google::protobuf::EnumValueDescriptorProto& value_desc_proto :
+           enum_desc_proto->value()) {
+        MixString(&hash, value_desc_proto.name());
+        MixNumber(&hash, value_desc_proto.number());
+      }
+    }
+  }
+  shape_hashes_[&desc_proto] = hash;
+  return hash;
+}
+
+std::unique_ptr<google::protobuf::FileDescriptorProto>
+IncrementalConverter::NewPrunedProtoFile(
+  google::protobuf::FileDescriptorProto* file_desc_proto) const {
+  // 从缓存复制的子树不进 message, 它们的字段从父类型里去掉
+  std::map<const google::protobuf::DescriptorProto*, std::set<int>> dropped_fields;
+  for (const Unit& unit : units_) {
+    if (unit.cached_entry != SubtreeCache::kNotFound) {
+      continue;
+    }
+    for (size_t child_index : unit.children) {
+      if (units_[child_index].cached_entry != SubtreeCache::kNotFound) {
+        dropped_fields[unit.desc_proto].insert(units_[child_index].field_number);
+      }
+    }
+  }
+
+  // 类型以外的部分原样复制. 先把类型的数组换出来, 复制完再换回去, 类型本身的地址不变
+  google::protobuf::RepeatedPtrField<google::protobuf::DescriptorProto> message_types;
+  google::protobuf::RepeatedPtrField<google::protobuf::EnumDescriptorProto> enum_types;
+  message_types.Swap(file_desc_proto->mutable_message_type());
+  enum_types.Swap(file_desc_proto->mutable_enum_type());
+  std::unique_ptr<google::protobuf::FileDescriptorProto> pruned_file_desc_proto(
+    new google::protobuf::FileDescriptorProto(*file_desc_proto));
+  message_types.Swap(file_desc_proto->mutable_message_type());
+  enum_types.Swap(file_desc_proto->mutable_enum_type());
+
+  // 从 ROOT 开始, 只留下还引用得到的类型
+  std::set<std::string> added_types;
+  std::vector<const google::protobuf::DescriptorProto*> pending_desc_protos;
+  pending_desc_protos.push_back(units_.front().desc_proto);
+  added_types.insert(units_.front().desc_proto->name());
+  while (!pending_desc_protos.empty()) {
+    const google::protobuf::DescriptorProto* desc_proto = pending_desc_protos.back();
+    pending_desc_protos.pop_back();
+    google::protobuf::DescriptorProto* pruned_desc_proto =
+      pruned_file_desc_proto->add_message_type();
+    *pruned_desc_proto = *desc_proto;
+    auto dropped = dropped_fields.find(desc_proto);
+    if (dropped != dropped_fields.end()) {
+      int kept_count = 0;
+      for (int index = 0; index < pruned_desc_proto->field_size(); ++index) {
+        if (!dropped->second.count(pruned_desc_proto->field(index).number())) {
+          pruned_desc_proto->mutable_field()->SwapElements(kept_count++, index);
+        }
+      }
+      while (pruned_desc_proto->field_size() > kept_count) {
+        pruned_desc_proto->mutable_field()->RemoveLast();
+      }
+    }
+
+    for (const google::protobuf::FieldDescriptorProto& field_desc_proto :
+         pruned_desc_proto->field()) {
+      if (!field_desc_proto.has_type_name() ||
+          !added_types.insert(field_desc_proto.type_name()).second) {
+        continue;
+      }
+      if (field_desc_proto.type() == google::protobuf::FieldDescriptorProto::TYPE_ENUM) {
+        const google::protobuf::EnumDescriptorProto* enum_desc_proto =
+          FindTypeProto(enum_protos_, field_desc_proto.type_name());
+        if (enum_desc_proto) {
+          *pruned_file_desc_proto->add_enum_type() = *enum_desc_proto;
+        }
+      } else {
+        const google::protobuf::DescriptorProto* message_desc_proto =
+          FindTypeProto(message_protos_, field_desc_proto.type_name());
+        if (message_desc_proto) {
+          pending_desc_protos.push_back(message_desc_proto);
+        }
+      }
+    }
+  }
+  return pruned_file_desc_proto;
+}
+
+size_t IncrementalConverter::EncodeUnit(
+  size_t unit_index,
+  google::protobuf::Message* message,
+  const SubtreeCache& old_cache,
+  SubtreeCache* new_cache) {
+  const Unit& unit = units_[unit_index];
+  const google::protobuf::Reflection* reflection = message->GetReflection();
+  std::vector<SubtreeCache::ChildRef> children;
+  for (size_t child_index : unit.children) {
+    const Unit& child = units_[child_index];
+    SubtreeCache::ChildRef child_ref = {0, child.field_number, SubtreeCache::kNotFound};
+    if (child.cached_entry != SubtreeCache::kNotFound) {
+      child_ref.entry = new_cache->CopyFrom(old_cache, child.cached_entry);
+      ++reused_subtree_count_;
+      reused_bytes_ += old_cache.entry(child.cached_entry).body_size;
+    } else {
+      const google::protobuf::FieldDescriptor* field_desc =
+        message->GetDescriptor()->FindFieldByNumber(child.field_number);
+      DCHECK(field_desc);
+      if (!reflection->HasField(*message, field_desc)) {
+        continue;
+      }
+      child_ref.entry = EncodeUnit(child_index,
+        reflection->MutableMessage(message, field_desc), old_cache, new_cache);
+      // 子树的编码已经进了缓存, 父 message 只序列化剩下的字段
+      reflection->ClearField(message, field_desc);
+    }
+    children.push_back(child_ref);
+  }
+  std::sort(children.begin(), children.end(),
+    [](const SubtreeCache::ChildRef& left, const SubtreeCache::ChildRef& right) {
+      return left.field_number < right.field_number;
+    });
+
+  std::string own_bytes;
+  message->SerializeToString(&own_bytes);
+  encoded_bytes_ += own_bytes.size();
+  return new_cache->Add(unit.subtree->content_hash, unit.shape_hash,
+    std::move(own_bytes), std::move(children));
+}
+
+bool IncrementalConverter::WriteOutput(
+  const SubtreeCache& cache,
+  size_t entry,
+  const base::FilePath& output_file_path,
+  std::string& error_message) {
+  ScopedTraceSpan span("WriteOutput");
+  ProtobufFileOutputStream output_stream;
+  if (output_options_) {
+    output_stream.set_options(*output_options_);
+  }
+  if (!output_stream.Open(output_file_path, use_io_thread_, error_message)) {
+    return false;
+  }
+  bool written = false;
+  {
+    google::protobuf::io::CodedOutputStream coded_output(&output_stream);
+    cache.WriteBody(entry, &coded_output);
+    written = !coded_output.HadError();
+  }
+  if (!written) {
+    // 写失败时 Close 给出的原因更准确
+    if (output_stream.Close(error_message)) {
+      error_message = "write output fail";
+    }
+    return false;
+  }
+  span.AddArg("bytes", output_stream.ByteCount());
+  return output_stream.Close(error_message);
+}
+
+} //namespace self
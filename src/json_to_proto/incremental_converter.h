@@ -0,0 +1,172 @@
+#ifndef INCREMENTAL_CONVERTER_H_
+#define INCREMENTAL_CONVERTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "build_proto_from_json.h"
+#include "json_subtree_hasher.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace google {
+namespace protobuf {
+class DescriptorProto;
+class EnumDescriptorProto;
+class FieldDescriptorProto;
+class FileDescriptorProto;
+class Message;
+} // namespace protobuf
+} // google
+
+namespace self {
+
+class JsonInputStream;
+class SubtreeCache;
+struct OutputStreamOptions;
+
+// Converts one document like JsonToProtobufSerializer and keeps a
+// SubtreeCache next to the output. On the next run every subtree whose
+// content and message type are unchanged is copied from the cache instead of
+// being filled and encoded again, so for a few edited keys the work after
+// parsing follows the size of the edit, not of the document. The output is
+// byte for byte what a full conversion writes.
+//
+// Parsing, hashing and schema inference still walk the whole document; the
+// subtrees are only recognized by their hash. Only the message types of the
+// changed subtrees are built into a descriptor pool. Only SchemaMode::kUnified and
+// kCompact are supported: a subtree of those always gets the same message
+// type wherever it sits, kPerElement numbers its types and fields across the
+// whole document.
+class IncrementalConverter {
+public:
+  // Objects of fewer events get no cache entry of their own.
+  static const int64_t kDefaultMinSubtreeEvents = 64;
+
+  explicit IncrementalConverter(SchemaMode schema_mode);
+
+  ~IncrementalConverter();
+
+  // The output path with ".subtrees" appended.
+  static base::FilePath SidecarPath(const base::FilePath& output_file_path);
+
+  // See BuildProtoFromJson::set_max_enum_cardinality().
+  void set_max_enum_cardinality(size_t max_enum_cardinality) {
+    max_enum_cardinality_ = max_enum_cardinality;
+  }
+
+  void set_min_subtree_events(int64_t min_subtree_events) {
+    min_subtree_events_ = min_subtree_events;
+  }
+
+  // See JsonToProtobufSerializer::set_use_io_thread().
+  void set_use_io_thread(bool use_io_thread) { use_io_thread_ = use_io_thread; }
+
+  // See JsonToProtobufSerializer::set_output_options().
+  void set_output_options(const OutputStreamOptions* output_options) {
+    output_options_ = output_options;
+  }
+
+  // See JsonToProtobufSerializer::set_write_descriptor_set().
+  void set_write_descriptor_set(bool write_descriptor_set) {
+    write_descriptor_set_ = write_descriptor_set;
+  }
+
+  bool Convert(
+    JsonInputStream* input_stream,
+    const base::FilePath& output_file_path,
+    std::string& error_message);
+
+  // Of the last Convert(): subtrees that could be cached, those copied from
+  // the cache, and the bytes of the output copied and encoded anew.
+  int64_t subtree_count() const { return subtree_count_; }
+  int64_t reused_subtree_count() const { return reused_subtree_count_; }
+  int64_t reused_bytes() const { return reused_bytes_; }
+  int64_t encoded_bytes() const { return encoded_bytes_; }
+
+private:
+  // A subtree that got a message field of its own.
+  struct Unit {
+    const JsonSubtreeHasher::Subtree* subtree;
+    const google::protobuf::DescriptorProto* desc_proto;
+    // The number of its field in the parent, 0 for the root.
+    int field_number;
+    uint64_t shape_hash;
+    // The entry in the previous run's cache, SubtreeCache::kNotFound on a
+    // miss.
+    size_t cached_entry;
+    std::vector<size_t> children;
+  };
+
+  // Pairs the subtrees with the fields of the inferred schema, whose types
+  // are in |message_protos_|. Children of a cache hit are left out.
+  bool ResolveUnits(
+    const std::vector<JsonSubtreeHasher::Subtree>& subtrees,
+    const SubtreeCache& old_cache,
+    std::string& error_message);
+
+  // The field the object under |key| is filled into, null unless it is a
+  // plain message field.
+  const google::protobuf::FieldDescriptorProto* FindSubtreeField(
+    const google::protobuf::DescriptorProto& desc_proto,
+    const std::string& key) const;
+
+  // Hashes what decides the encoding of a message type: the numbers, types
+  // and json names of its fields, enum values and nested types, but not the
+  // type names, which follow the subtree's path. Works on the inferred
+  // DescriptorProto, so a run that hits the cache never builds the file.
+  uint64_t ShapeHash(const google::protobuf::DescriptorProto& desc_proto);
+
+  // The inferred file with only the types the changed subtrees need: the
+  // fields of subtrees copied from the cache are dropped from their parents
+  // and nothing else refers to the types under them.
+  std::unique_ptr<google::protobuf::FileDescriptorProto> NewPrunedProtoFile(
+    google::protobuf::FileDescriptorProto* file_desc_proto) const;
+
+  // Moves the encoding of |message|, the message of units_[unit_index], into
+  // |new_cache| and returns its entry.
+  size_t EncodeUnit(
+    size_t unit_index,
+    google::protobuf::Message* message,
+    const SubtreeCache& old_cache,
+    SubtreeCache* new_cache);
+
+  bool WriteOutput(
+    const SubtreeCache& cache,
+    size_t entry,
+    const base::FilePath& output_file_path,
+    std::string& error_message);
+
+private:
+  const SchemaMode schema_mode_;
+  size_t max_enum_cardinality_;
+  int64_t min_subtree_events_;
+  bool use_io_thread_;
+  const OutputStreamOptions* output_options_;
+  bool write_descriptor_set_;
+
+  std::vector<Unit> units_;
+  // The types of the inferred file by name.
+  std::map<std::string, const google::protobuf::DescriptorProto*> message_protos_;
+  std::map<std::string, const google::protobuf::EnumDescriptorProto*> enum_protos_;
+  std::map<const google::protobuf::DescriptorProto*, uint64_t> shape_hashes_;
+
+  int64_t subtree_count_;
+  int64_t reused_subtree_count_;
+  int64_t reused_bytes_;
+  int64_t encoded_bytes_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(IncrementalConverter);
+};
+
+} // namespace self
+#endif // INCREMENTAL_CONVERTER_H_
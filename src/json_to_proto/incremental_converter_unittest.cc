@@ -0,0 +1,112 @@
+#include "incremental_converter.h"
+
+#include <string>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "convert_json_to_protobuf.h"
+#include "convert_switches.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_to_protobuf_serializer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+class IncrementalConverterTest : public testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    full_output_path_ = temp_dir_.GetPath().AppendASCII("full.pb");
+    output_path_ = temp_dir_.GetPath().AppendASCII("incremental.pb");
+  }
+
+  // Converts |json| without a sidecar, the output the incremental one has to
+  // match.
+  std::string ConvertFull(const std::string& json) {
+    JsonStringInputStream input_stream(json);
+    JsonToProtobufSerializer json_to_protobuf_serializer(full_output_path_);
+    json_to_protobuf_serializer.set_schema_mode(SchemaMode::kUnified);
+    std::string error_message;
+    EXPECT_TRUE(json_to_protobuf_serializer.SerializeFromStream(&input_stream, error_message))
+      << error_message;
+    std::string output;
+    EXPECT_TRUE(base::ReadFileToString(full_output_path_, &output));
+    return output;
+  }
+
+  std::string ConvertIncremental(
+    const std::string& json,
+    IncrementalConverter* incremental_converter) {
+    JsonStringInputStream input_stream(json);
+    std::string error_message;
+    EXPECT_TRUE(incremental_converter->Convert(&input_stream, output_path_, error_message))
+      << error_message;
+    std::string output;
+    EXPECT_TRUE(base::ReadFileToString(output_path_, &output));
+    return output;
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath full_output_path_;
+  base::FilePath output_path_;
+};
+
+} // namespace
+
+// The first run without a sidecar, a run on the same input and runs after a
+// few edits, each from the first run's sidecar, all write what a full
+// conversion writes.
+TEST_F(IncrementalConverterTest, SameAsFullConversion) {
+  const std::string corpus = CorpusGenerator(CorpusShape()).Generate();
+  const std::string full_output = ConvertFull(corpus);
+  ASSERT_FALSE(full_output.empty());
+
+  IncrementalConverter incremental_converter(SchemaMode::kUnified);
+  EXPECT_EQ(full_output, ConvertIncremental(corpus, &incremental_converter));
+  EXPECT_EQ(0, incremental_converter.reused_subtree_count());
+  std::string sidecar;
+  ASSERT_TRUE(base::ReadFileToString(
+    IncrementalConverter::SidecarPath(output_path_), &sidecar));
+
+  EXPECT_EQ(full_output, ConvertIncremental(corpus, &incremental_converter));
+  EXPECT_GT(incremental_converter.reused_subtree_count(), 0);
+
+  for (int edit_count : {1, 10, 100}) {
+    const std::string edited = EditCorpus(corpus, edit_count);
+    // 每次都从第一次的旁路文件开始
+    ASSERT_EQ(static_cast<int>(sidecar.size()), base::WriteFile(
+      IncrementalConverter::SidecarPath(output_path_), sidecar.data(),
+      static_cast<int>(sidecar.size())));
+    EXPECT_EQ(ConvertFull(edited), ConvertIncremental(edited, &incremental_converter))
+      << edit_count << " edits";
+  }
+}
+
+// Switches incremental conversion has no use for fail instead of being
+// ignored.
+TEST_F(IncrementalConverterTest, UnusedSwitchesRejected) {
+  const base::FilePath input_path = temp_dir_.GetPath().AppendASCII("input.json");
+  ASSERT_EQ(7, base::WriteFile(input_path, "{\"a\":1}", 7));
+  for (const char* switch_name : {convert_switches::kParallelSubtrees,
+                                  convert_switches::kUseDomParser,
+                                  convert_switches::kSchemaCacheDir,
+                                  convert_switches::kUseArena,
+                                  convert_switches::kContainerOutput}) {
+    base::CommandLine command_line(base::CommandLine::NO_PROGRAM);
+    command_line.AppendSwitchPath(convert_switches::kInputFilePath, input_path);
+    command_line.AppendSwitchPath(convert_switches::kOutputFilePath, output_path_);
+    command_line.AppendSwitch(convert_switches::kIncremental);
+    command_line.AppendSwitch(switch_name);
+    std::string error_message;
+    EXPECT_FALSE(ConvertJsonToProtobuf::New()->Convert(&command_line, error_message));
+    EXPECT_EQ(std::string(switch_name) + " can not be used with incremental", error_message);
+  }
+  EXPECT_FALSE(base::PathExists(output_path_));
+}
+
+} // namespace self
@@ -0,0 +1,256 @@
+#include "json_input_generator.h"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+
+namespace self {
+
+namespace {
+
+// 默认大约 250 KB, 每个元素一个类型时 field number 也不超限
+const int kDefaultCorpusDepth = 2;
+const int kDefaultCorpusWidth = 8;
+const int kDefaultCorpusArrayLength = 12;
+const int kDefaultCorpusStringLength = 24;
+const int kDefaultCorpusTypeWeights[] = {4, 2, 1, 3};
+const uint32_t kDefaultCorpusSeed = 2018052116;
+// 顶层几个大数组和一个大对象, 各占一份. 对象按组放 record, key 太多字段号会超限
+const int kParallelArrayCount = 3;
+const int kParallelGroupCount = 8;
+
+bool WriteString(base::File* file, const std::string& data) {
+  return file->WriteAtCurrentPos(data.data(), static_cast<int>(data.size())) ==
+    static_cast<int>(data.size());
+}
+
+} // namespace
+
+std::string GenerateRecord(int index) {
+  return base::StringPrintf(
+    "{\"version\": %d, \"type_id\": %d, \"delay_time\": %d, "
+    "\"describe\": \"permission %d\", "
+    "\"intent\": {\"action\": \"android.settings.ACTION_%d\"}, "
+    "\"step\": [{\"find_node\": {\"find_text\": \"text %d\", "
+    "\"scroll_node\": \"android.widget.ListView\", \"click_type\": \"parent\", "
+    "\"is_permission_open\": {\"state\": {\"in_parent_index\": %d, "
+    "\"check_node_type\": \"android.widget.CheckBox\"}}}}, "
+    "{\"find_node\": {\"find_text\": \"ok %d\", \"click_type\": \"self\"}}]}",
+    2018052116 + index, index % 7, 1000 + index, index, index, index, index % 3, index);
+}
+
+std::string GenerateWideArray(int length) {
+  std::string json = "{\"version\": 2018052116, \"records\": [";
+  for (int index = 0; index < length; index++) {
+    if (index > 0) {
+      json.push_back(',');
+    }
+    std::string record = GenerateRecord(index);
+    if (index % 3 == 0) {
+      record.insert(record.size() - 1, base::StringPrintf(", \"retry\": %d", index));
+    }
+    json += record;
+  }
+  json += "]}";
+  return json;
+}
+
+bool GenerateRecordStream(const base::FilePath& file_path, int record_count) {
+  base::File file(file_path, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+  if (!file.IsValid()) {
+    return false;
+  }
+  std::string buffer;
+  for (int index = 0; index < record_count; index++) {
+    buffer += GenerateRecord(index);
+    buffer.push_back('\n');
+    if (buffer.size() >= (1 << 20) || index + 1 == record_count) {
+      if (!WriteString(&file, buffer)) {
+        return false;
+      }
+      buffer.clear();
+    }
+  }
+  return true;
+}
+
+std::string GenerateParallelDocument(int64_t target_size) {
+  const int record_count = static_cast<int>(
+    target_size / (kParallelArrayCount + 1) / GenerateRecord(0).size());
+  std::string json = "{\"version\": 2018052116";
+  int index = 0;
+  for (int array = 0; array < kParallelArrayCount; array++) {
+    base::StringAppendF(&json, ", \"records_%d\": [", array);
+    for (int record = 0; record < record_count; record++) {
+      if (record > 0) {
+        json.push_back(',');
+      }
+      json += GenerateRecord(index++);
+    }
+    json += "]";
+  }
+  json += ", \"permissions\": {";
+  for (int group = 0; group < kParallelGroupCount; group++) {
+    base::StringAppendF(&json, "%s\"group_%d\": [", group > 0 ? ", " : "", group);
+    for (int record = 0; record < record_count / kParallelGroupCount; record++) {
+      if (record > 0) {
+        json.push_back(',');
+      }
+      json += GenerateRecord(index++);
+    }
+    json += "]";
+  }
+  json += "}, \"describe\": \"parallel\"}";
+  return json;
+}
+
+std::string EditCorpus(const std::string& json, int edit_count) {
+  static const char kDescribeKey[] = "\"describe\": \"";
+  std::vector<size_t> offsets;
+  for (size_t offset = json.find(kDescribeKey); offset != std::string::npos;
+       offset = json.find(kDescribeKey, offset + 1)) {
+    offsets.push_back(offset + sizeof(kDescribeKey) - 1);
+  }
+  std::string edited = json;
+  const size_t count = std::min(offsets.size(), static_cast<size_t>(edit_count));
+  if (count == 0) {
+    return edited;
+  }
+  const size_t stride = offsets.size() / count;
+  // 从后往前插, 前面的位置不会变
+  for (size_t index = count; index > 0; index--) {
+    edited.insert(offsets[(index - 1) * stride], 1, 'x');
+  }
+  return edited;
+}
+
+CorpusShape::CorpusShape()
+  : depth(kDefaultCorpusDepth),
+    width(kDefaultCorpusWidth),
+    array_length(kDefaultCorpusArrayLength),
+    string_length(kDefaultCorpusStringLength),
+    seed(kDefaultCorpusSeed) {
+  std::copy(std::begin(kDefaultCorpusTypeWeights), std::end(kDefaultCorpusTypeWeights),
+    type_weights);
+}
+
+CorpusGenerator::CorpusGenerator(const CorpusShape& shape)
+  : shape_(shape),
+    state_(shape.seed ? shape.seed : 1),
+    type_weight_sum_(0) {
+  for (int type_weight : shape_.type_weights) {
+    type_weight_sum_ += type_weight;
+  }
+}
+
+std::string CorpusGenerator::Generate() {
+  std::string json = "{\"version\": 2018052116, \"common_permission\": ";
+  AppendGroup(shape_.depth, &json);
+  json += "}\n";
+  return json;
+}
+
+uint32_t CorpusGenerator::NextRandom() {
+  state_ ^= state_ << 13;
+  state_ ^= state_ >> 17;
+  state_ ^= state_ << 5;
+  return state_;
+}
+
+void CorpusGenerator::AppendGroup(int depth, std::string* json) {
+  json->push_back('{');
+  for (int index = 0; index < shape_.width; index++) {
+    if (index > 0) {
+      json->append(", ");
+    }
+    base::StringAppendF(json, "\"permission_%d\": ", index);
+    if (depth > 1) {
+      AppendGroup(depth - 1, json);
+    } else {
+      AppendPermission(json);
+    }
+  }
+  json->push_back('}');
+}
+
+void CorpusGenerator::AppendPermission(std::string* json) {
+  json->append("{\"delay_time\": ");
+  AppendScalar(json);
+  json->append(", \"type_id\": ");
+  AppendScalar(json);
+  json->append(", \"describe\": ");
+  AppendString(json);
+  json->append(", \"intent\": {\"action\": ");
+  AppendString(json);
+  json->append("}, \"step\": [");
+  for (int index = 0; index < shape_.array_length; index++) {
+    if (index > 0) {
+      json->append(", ");
+    }
+    AppendStep(json);
+  }
+  json->append("]}");
+}
+
+void CorpusGenerator::AppendStep(std::string* json) {
+  json->append("{\"find_node\": {\"find_text\": ");
+  AppendString(json);
+  json->append(", \"scroll_node\": ");
+  AppendString(json);
+  json->append(", \"click_type\": ");
+  AppendString(json);
+  json->append(", \"is_permission_open\": {\"state\": {\"in_parent_index\": ");
+  AppendScalar(json);
+  json->append(", \"check_node_type\": ");
+  AppendString(json);
+  json->append("}}}}");
+}
+
+void CorpusGenerator::AppendScalar(std::string* json) {
+  int pick = type_weight_sum_ > 0 ? static_cast<int>(NextRandom() % type_weight_sum_) : 0;
+  int type = 0;
+  while (type < 3 && pick >= shape_.type_weights[type]) {
+    pick -= shape_.type_weights[type];
+    type++;
+  }
+  switch (type) {
+  case 0:
+    json->append(base::IntToString(static_cast<int>(NextRandom() % 100000)));
+    break;
+  case 1:
+    base::StringAppendF(json, "%d.%02d",
+      static_cast<int>(NextRandom() % 10000), static_cast<int>(NextRandom() % 100));
+    break;
+  case 2:
+    json->append(NextRandom() % 2 ? "true" : "false");
+    break;
+  default:
+    AppendString(json);
+    break;
+  }
+}
+
+// 和 superman.json 一样夹杂中文, 每个中文字符 3 个字节
+void CorpusGenerator::AppendString(std::string* json) {
+  static const char kAsciiCharacters[] = "abcdefghijklmnopqrstuvwxyz._";
+  static const char* const kChineseCharacters[] = {
+    "通", "知", "读", "取", "权", "限", "开", "启", "游", "戏", "超", "人",
+  };
+  json->push_back('"');
+  for (int index = 0; index < shape_.string_length; index++) {
+    const uint32_t random = NextRandom();
+    if (random % 4 == 0) {
+      json->append(kChineseCharacters[(random >> 2) % arraysize(kChineseCharacters)]);
+    } else {
+      json->push_back(kAsciiCharacters[(random >> 2) % (sizeof(kAsciiCharacters) - 1)]);
+    }
+  }
+  json->push_back('"');
+}
+
+} // namespace self
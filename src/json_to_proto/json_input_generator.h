@@ -0,0 +1,88 @@
+#ifndef JSON_INPUT_GENERATOR_H_
+#define JSON_INPUT_GENERATOR_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "base/macros.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace self {
+
+// Generated json inputs shared by json_to_proto_benchmark and
+// json_to_proto_unittests. The same arguments always give the same bytes.
+
+// One record shaped like a superman.json step, |index| varies the values but
+// never the shape.
+std::string GenerateRecord(int index);
+
+// A document whose only array holds |length| records. Every third record has
+// an extra key, so the unified schema has to merge the fields.
+std::string GenerateWideArray(int length);
+
+// Writes |record_count| records, one per line.
+bool GenerateRecordStream(const base::FilePath& file_path, int record_count);
+
+// One document whose top level holds a few arrays of records and an object of
+// arrays of records, about |target_size| bytes in all.
+std::string GenerateParallelDocument(int64_t target_size);
+
+// Inserts a character into the describe string of |edit_count| permissions
+// spread over |json|, so the content changes but the schema does not.
+std::string EditCorpus(const std::string& json, int edit_count);
+
+// Knobs of the corpus generated from the shape of superman.json, about 250 KB
+// by default.
+struct CorpusShape {
+  CorpusShape();
+
+  // Levels of permission groups above the permissions.
+  int depth;
+  // Keys per permission group.
+  int width;
+  // Steps per permission.
+  int array_length;
+  // Characters per generated string.
+  int string_length;
+  // Weights of integer, double, bool and string for every scalar value.
+  int type_weights[4];
+  uint32_t seed;
+};
+
+// Nests groups of permissions like superman.json's common_permission, every
+// permission has superman.json's keys and |array_length| steps. Values are
+// drawn from a xorshift generator, the same shape always gives the same bytes.
+class CorpusGenerator {
+public:
+  explicit CorpusGenerator(const CorpusShape& shape);
+
+  std::string Generate();
+
+private:
+  uint32_t NextRandom();
+
+  void AppendGroup(int depth, std::string* json);
+
+  void AppendPermission(std::string* json);
+
+  void AppendStep(std::string* json);
+
+  void AppendScalar(std::string* json);
+
+  void AppendString(std::string* json);
+
+private:
+  const CorpusShape shape_;
+  uint32_t state_;
+  int type_weight_sum_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(CorpusGenerator);
+};
+
+} // namespace self
+#endif // JSON_INPUT_GENERATOR_H_
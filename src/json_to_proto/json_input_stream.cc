@@ -0,0 +1,221 @@
+#include "json_input_stream.h"
+
+#include <algorithm>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "build/build_config.h"
+
+#if defined(OS_POSIX)
+#include <sys/mman.h>
+#endif
+
+namespace self {
+
+JsonFileInputStream::JsonFileInputStream(size_t chunk_size)
+  : length_(0),
+    chunk_size_(chunk_size) {
+  DCHECK(chunk_size_ > 0);
+}
+
+JsonFileInputStream::~JsonFileInputStream() {
+}
+
+bool JsonFileInputStream::Open(
+  const base::FilePath& file_path,
+  std::string& error_message) {
+  file_ = base::File(file_path,
+    base::File::FLAG_OPEN | base::File::FLAG_READ | base::File::FLAG_SEQUENTIAL_SCAN);
+  if (!file_.IsValid()) {
+    error_message = "open input file fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  length_ = file_.GetLength();
+  if (length_ < 0) {
+    error_message = "get input file length fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  buffer_.reset(new char[chunk_size_]);
+  return true;
+}
+
+bool JsonFileInputStream::Next(const char** data, size_t* size) {
+  DCHECK(data && size);
+  if (!file_.IsValid()) {
+    return false;
+  }
+  int read_size = file_.ReadAtCurrentPos(buffer_.get(),
+    static_cast<int>(std::min<size_t>(chunk_size_, INT32_MAX)));
+  if (read_size <= 0) {
+    return false;
+  }
+  *data = buffer_.get();
+  *size = static_cast<size_t>(read_size);
+  return true;
+}
+
+bool JsonFileInputStream::Rewind() {
+  if (!file_.IsValid()) {
+    return false;
+  }
+  return file_.Seek(base::File::FROM_BEGIN, 0) == 0;
+}
+
+int64_t JsonFileInputStream::GetLength() const {
+  return length_;
+}
+
+JsonMappedInputStream::JsonMappedInputStream()
+  : consumed_(false) {
+}
+
+JsonMappedInputStream::~JsonMappedInputStream() {
+}
+
+bool JsonMappedInputStream::Open(
+  const base::FilePath& file_path,
+  std::string& error_message) {
+  base::File file(file_path,
+    base::File::FLAG_OPEN | base::File::FLAG_READ | base::File::FLAG_SEQUENTIAL_SCAN);
+  if (!file.IsValid()) {
+    error_message = "open input file fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  if (file.GetLength() <= 0) {
+    error_message = "input file is empty: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  if (!mapped_file_.Initialize(std::move(file))) {
+    error_message = "map input file fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+#if defined(OS_POSIX)
+  // 只做一次从头到尾的顺序扫描, 让内核加大预读并尽早回收读过的页
+  if (::madvise(const_cast<uint8_t*>(mapped_file_.data()), mapped_file_.length(),
+                MADV_SEQUENTIAL) != 0) {
+    DPLOG(WARNING) << "madvise MADV_SEQUENTIAL fail";
+  }
+#endif
+  consumed_ = false;
+  return true;
+}
+
+bool JsonMappedInputStream::Next(const char** data, size_t* size) {
+  DCHECK(data && size);
+  if (consumed_ || !mapped_file_.IsValid()) {
+    return false;
+  }
+  consumed_ = true;
+  *data = reinterpret_cast<const char*>(mapped_file_.data());
+  *size = mapped_file_.length();
+  return true;
+}
+
+bool JsonMappedInputStream::Rewind() {
+  if (!mapped_file_.IsValid()) {
+    return false;
+  }
+  consumed_ = false;
+  return true;
+}
+
+int64_t JsonMappedInputStream::GetLength() const {
+  return static_cast<int64_t>(mapped_file_.length());
+}
+
+JsonStringInputStream::JsonStringInputStream()
+  : consumed_(false) {
+}
+
+JsonStringInputStream::JsonStringInputStream(const base::StringPiece& data)
+  : data_(data),
+    consumed_(false) {
+}
+
+JsonStringInputStream::~JsonStringInputStream() {
+}
+
+void JsonStringInputStream::Reset(const base::StringPiece& data) {
+  data_ = data;
+  consumed_ = false;
+}
+
+bool JsonStringInputStream::Next(const char** data, size_t* size) {
+  DCHECK(data && size);
+  if (consumed_ || data_.empty()) {
+    return false;
+  }
+  consumed_ = true;
+  *data = data_.data();
+  *size = data_.size();
+  return true;
+}
+
+bool JsonStringInputStream::Rewind() {
+  consumed_ = false;
+  return true;
+}
+
+int64_t JsonStringInputStream::GetLength() const {
+  return static_cast<int64_t>(data_.size());
+}
+
+JsonChunkQueueInputStream::JsonChunkQueueInputStream(int64_t length)
+  : length_(length),
+    chunk_added_(&lock_),
+    finished_(false),
+    failed_(false),
+    next_chunk_(0) {
+}
+
+JsonChunkQueueInputStream::~JsonChunkQueueInputStream() {
+}
+
+void JsonChunkQueueInputStream::Append(std::string chunk) {
+  base::AutoLock auto_lock(lock_);
+  DCHECK(!finished_);
+  chunks_.push_back(std::unique_ptr<std::string>(new std::string(std::move(chunk))));
+  chunk_added_.Signal();
+}
+
+void JsonChunkQueueInputStream::Finish(bool succeeded) {
+  base::AutoLock auto_lock(lock_);
+  finished_ = true;
+  // 读失败了后面的块不会来, 已经来的也不再给, parser 报输入不完整
+  failed_ = !succeeded;
+  chunk_added_.Signal();
+}
+
+void JsonChunkQueueInputStream::Clear() {
+  base::AutoLock auto_lock(lock_);
+  DCHECK(finished_);
+  std::vector<std::unique_ptr<std::string>>().swap(chunks_);
+  next_chunk_ = 0;
+}
+
+bool JsonChunkQueueInputStream::Next(const char** data, size_t* size) {
+  DCHECK(data && size);
+  base::AutoLock auto_lock(lock_);
+  while (next_chunk_ >= chunks_.size() && !finished_) {
+    chunk_added_.Wait();
+  }
+  if (failed_ || next_chunk_ >= chunks_.size()) {
+    return false;
+  }
+  const std::string& chunk = *chunks_[next_chunk_++];
+  *data = chunk.data();
+  *size = chunk.size();
+  return true;
+}
+
+bool JsonChunkQueueInputStream::Rewind() {
+  base::AutoLock auto_lock(lock_);
+  next_chunk_ = 0;
+  return true;
+}
+
+int64_t JsonChunkQueueInputStream::GetLength() const {
+  return length_;
+}
+
+} //namespace self
@@ -0,0 +1,159 @@
+#ifndef JSON_INPUT_STREAM_H_
+#define JSON_INPUT_STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace self {
+
+// Hands out the input json in chunks. A chunk stays valid until the next call
+// to Next() or Rewind(), so the reader never needs the whole document in memory.
+class JsonInputStream {
+public:
+  virtual ~JsonInputStream() {}
+
+  // Returns false at the end of the input or on a read error.
+  virtual bool Next(const char** data, size_t* size) = 0;
+
+  // Restarts from the first byte, the converter reads the input once for the
+  // schema and once for the values.
+  virtual bool Rewind() = 0;
+
+  virtual int64_t GetLength() const = 0;
+};
+
+class JsonFileInputStream : public JsonInputStream {
+public:
+  static const size_t kDefaultChunkSize = 1 << 20;
+
+  explicit JsonFileInputStream(size_t chunk_size = kDefaultChunkSize);
+
+  ~JsonFileInputStream() override;
+
+  bool Open(const base::FilePath& file_path, std::string& error_message);
+
+  bool Next(const char** data, size_t* size) override;
+
+  bool Rewind() override;
+
+  int64_t GetLength() const override;
+
+private:
+  base::File file_;
+  int64_t length_;
+  const size_t chunk_size_;
+  std::unique_ptr<char[]> buffer_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonFileInputStream);
+};
+
+// Maps the whole file read-only and hands it out as one chunk, so strings
+// without escapes reach the handlers as views into the mapping and the input
+// is never copied.
+class JsonMappedInputStream : public JsonInputStream {
+public:
+  JsonMappedInputStream();
+
+  ~JsonMappedInputStream() override;
+
+  bool Open(const base::FilePath& file_path, std::string& error_message);
+
+  bool Next(const char** data, size_t* size) override;
+
+  bool Rewind() override;
+
+  int64_t GetLength() const override;
+
+private:
+  base::MemoryMappedFile mapped_file_;
+  bool consumed_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonMappedInputStream);
+};
+
+// Wraps json that is already in memory, e.g. one line of a record stream. The
+// data is not copied and must outlive the stream.
+class JsonStringInputStream : public JsonInputStream {
+public:
+  JsonStringInputStream();
+
+  explicit JsonStringInputStream(const base::StringPiece& data);
+
+  ~JsonStringInputStream() override;
+
+  void Reset(const base::StringPiece& data);
+
+  bool Next(const char** data, size_t* size) override;
+
+  bool Rewind() override;
+
+  int64_t GetLength() const override;
+
+private:
+  base::StringPiece data_;
+  bool consumed_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonStringInputStream);
+};
+
+// Chunks handed over by another thread while they are read, so a parse can
+// start before the file is in memory. Next() waits for the next chunk. Every
+// chunk is kept until Clear(), a Rewind() starts over without reading again.
+class JsonChunkQueueInputStream : public JsonInputStream {
+public:
+  explicit JsonChunkQueueInputStream(int64_t length);
+
+  ~JsonChunkQueueInputStream() override;
+
+  // Called by the producer.
+  void Append(std::string chunk);
+
+  // No chunk comes after this. |succeeded| is false on a read error, Next()
+  // then ends early.
+  void Finish(bool succeeded);
+
+  // Drops the chunks, only once Finish() was called and nobody reads.
+  void Clear();
+
+  bool Next(const char** data, size_t* size) override;
+
+  bool Rewind() override;
+
+  int64_t GetLength() const override;
+
+private:
+  const int64_t length_;
+
+  base::Lock lock_;
+  base::ConditionVariable chunk_added_;
+  // Behind a pointer, so a chunk never moves once appended.
+  std::vector<std::unique_ptr<std::string>> chunks_;
+  bool finished_;
+  bool failed_;
+  // Index of the chunk Next() returns next, only touched by the reader.
+  size_t next_chunk_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonChunkQueueInputStream);
+};
+
+} // namespace self
+#endif // JSON_INPUT_STREAM_H_
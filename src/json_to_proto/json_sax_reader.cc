@@ -0,0 +1,567 @@
+#include "json_sax_reader.h"
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "json_input_stream.h"
+#include "json_structural_reader.h"
+
+namespace self {
+
+namespace {
+static bool IsDigit(int c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool IsPlainStringChar(char c) {
+  return c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20;
+}
+
+static int HexValue(int c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+}
+
+std::atomic<JsonParserBackend> JsonSaxReader::default_backend_(JsonParserBackend::kStreaming);
+
+JsonSaxReader::JsonSaxReader(JsonInputStream* input_stream)
+  : input_stream_(input_stream),
+    backend_(default_backend()),
+    cursor_(nullptr),
+    end_(nullptr),
+    input_end_(false),
+    line_(1),
+    column_(1) {
+  DCHECK(input_stream_);
+}
+
+JsonSaxReader::~JsonSaxReader() {
+}
+
+bool JsonSaxReader::Parse(
+  JsonSaxHandler* handler,
+  std::string& error_message) {
+  DCHECK(handler);
+  if (backend_ == JsonParserBackend::kStructuralIndex) {
+    if (!structural_reader_) {
+      structural_reader_.reset(new JsonStructuralReader(input_stream_));
+    }
+    return structural_reader_->Parse(handler, error_message);
+  }
+
+  cursor_ = nullptr;
+  end_ = nullptr;
+  input_end_ = false;
+  line_ = 1;
+  column_ = 1;
+  stack_.clear();
+  error_message_.clear();
+
+  if (!ParseDocument(handler)) {
+    error_message = error_message_;
+    return false;
+  }
+  return true;
+}
+
+bool JsonSaxReader::ParseDocument(JsonSaxHandler* handler) {
+  // utf-8 bom
+  if (Peek() == 0xEF) {
+    Advance();
+    if (Peek() != 0xBB) {
+      return ReportError("invalid utf-8 bom");
+    }
+    Advance();
+    if (Peek() != 0xBF) {
+      return ReportError("invalid utf-8 bom");
+    }
+    Advance();
+    column_ = 1;
+  }
+
+  State state = State::kValue;
+  while (state != State::kDone) {
+    SkipWhitespace();
+    int c = Peek();
+    switch (state) {
+    case State::kValue: {
+      if (!ParseValue(handler, &state)) {
+        return false;
+      }
+    } break;
+    case State::kObjectKeyOrEnd: {
+      if (c == '}') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+        break;
+      }
+      if (!ParseKey(handler)) {
+        return false;
+      }
+      state = State::kValue;
+    } break;
+    case State::kObjectKey: {
+      if (!ParseKey(handler)) {
+        return false;
+      }
+      state = State::kValue;
+    } break;
+    case State::kObjectCommaOrEnd: {
+      if (c == ',') {
+        Advance();
+        state = State::kObjectKey;
+      } else if (c == '}') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+      } else {
+        return ReportError("expected ',' or '}'");
+      }
+    } break;
+    case State::kArrayValueOrEnd: {
+      if (c == ']') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+      } else {
+        state = State::kValue;
+      }
+    } break;
+    case State::kArrayCommaOrEnd: {
+      if (c == ',') {
+        Advance();
+        state = State::kValue;
+      } else if (c == ']') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+      } else {
+        return ReportError("expected ',' or ']'");
+      }
+    } break;
+    default: {
+      NOTREACHED();
+    } break;
+    }
+  }
+
+  SkipWhitespace();
+  if (Peek() != -1) {
+    return ReportError("unexpected data after root value");
+  }
+  return true;
+}
+
+bool JsonSaxReader::ParseValue(JsonSaxHandler* handler, State* state) {
+  int c = Peek();
+  switch (c) {
+  case '{':
+  case '[': {
+    if (stack_.size() >= kStackMaxDepth) {
+      return ReportError("too much nesting");
+    }
+    Advance();
+    stack_.push_back(static_cast<char>(c));
+    bool result = (c == '{') ? handler->OnStartObject() : handler->OnStartArray();
+    if (!result) {
+      return ReportHandlerError(handler);
+    }
+    *state = (c == '{') ? State::kObjectKeyOrEnd : State::kArrayValueOrEnd;
+    return true;
+  }
+  case '"': {
+    base::StringPiece value;
+    if (!ParseString(&value)) {
+      return false;
+    }
+    if (!handler->OnString(value)) {
+      return ReportHandlerError(handler);
+    }
+  } break;
+  case 't': {
+    if (!ParseLiteral("true")) {
+      return false;
+    }
+    if (!handler->OnBoolean(true)) {
+      return ReportHandlerError(handler);
+    }
+  } break;
+  case 'f': {
+    if (!ParseLiteral("false")) {
+      return false;
+    }
+    if (!handler->OnBoolean(false)) {
+      return ReportHandlerError(handler);
+    }
+  } break;
+  case 'n': {
+    if (!ParseLiteral("null")) {
+      return false;
+    }
+    if (!handler->OnNull()) {
+      return ReportHandlerError(handler);
+    }
+  } break;
+  default: {
+    if (c == '-' || IsDigit(c)) {
+      if (!ParseNumber(handler)) {
+        return false;
+      }
+      break;
+    }
+    if (c == -1) {
+      return ReportError("unexpected end of input");
+    }
+    return ReportError("unexpected token");
+  }
+  }
+  *state = StateAfterValue();
+  return true;
+}
+
+bool JsonSaxReader::ParseKey(JsonSaxHandler* handler) {
+  if (Peek() != '"') {
+    return ReportError("expected object key");
+  }
+  base::StringPiece key;
+  if (!ParseString(&key)) {
+    return false;
+  }
+  if (!handler->OnKey(key)) {
+    return ReportHandlerError(handler);
+  }
+  SkipWhitespace();
+  if (Peek() != ':') {
+    return ReportError("expected ':'");
+  }
+  Advance();
+  return true;
+}
+
+bool JsonSaxReader::ParseString(base::StringPiece* value) {
+  DCHECK(Peek() == '"');
+  Advance();
+  if (cursor_ == end_) {
+    Fill();
+  }
+
+  // 绝大多数字符串没有转义并且不跨 chunk, 直接返回指向输入的 StringPiece
+  const char* start = cursor_;
+  const char* position = start;
+  while (position < end_ && IsPlainStringChar(*position)) {
+    ++position;
+  }
+  if (position < end_ && *position == '"') {
+    value->set(start, position - start);
+    column_ += static_cast<int>(position - start) + 1;
+    cursor_ = position + 1;
+    return true;
+  }
+
+  string_buffer_.assign(start, position - start);
+  column_ += static_cast<int>(position - start);
+  cursor_ = position;
+  while (true) {
+    int c = Peek();
+    if (c == -1) {
+      return ReportError("unterminated string");
+    }
+    if (c == '"') {
+      Advance();
+      break;
+    }
+    if (c == '\\') {
+      Advance();
+      if (!DecodeEscape()) {
+        return false;
+      }
+      continue;
+    }
+    if (c < 0x20) {
+      return ReportError("control character in string");
+    }
+    const char* run = cursor_;
+    while (cursor_ < end_ && IsPlainStringChar(*cursor_)) {
+      ++cursor_;
+    }
+    string_buffer_.append(run, cursor_ - run);
+    column_ += static_cast<int>(cursor_ - run);
+  }
+  *value = string_buffer_;
+  return true;
+}
+
+bool JsonSaxReader::DecodeEscape() {
+  int c = Peek();
+  if (c == -1) {
+    return ReportError("unterminated string");
+  }
+  Advance();
+  switch (c) {
+  case '"':
+  case '\\':
+  case '/': {
+    string_buffer_.push_back(static_cast<char>(c));
+  } break;
+  case 'b': {
+    string_buffer_.push_back('\b');
+  } break;
+  case 'f': {
+    string_buffer_.push_back('\f');
+  } break;
+  case 'n': {
+    string_buffer_.push_back('\n');
+  } break;
+  case 'r': {
+    string_buffer_.push_back('\r');
+  } break;
+  case 't': {
+    string_buffer_.push_back('\t');
+  } break;
+  case 'u': {
+    uint32_t code_point = 0;
+    if (!ReadHex4(&code_point)) {
+      return false;
+    }
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+      if (Peek() != '\\') {
+        return ReportError("invalid surrogate pair");
+      }
+      Advance();
+      if (Peek() != 'u') {
+        return ReportError("invalid surrogate pair");
+      }
+      Advance();
+      uint32_t low_surrogate = 0;
+      if (!ReadHex4(&low_surrogate)) {
+        return false;
+      }
+      if (low_surrogate < 0xDC00 || low_surrogate > 0xDFFF) {
+        return ReportError("invalid surrogate pair");
+      }
+      code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+    } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+      return ReportError("invalid surrogate pair");
+    }
+    AppendUtf8(code_point);
+  } break;
+  default: {
+    return ReportError("invalid escape sequence");
+  }
+  }
+  return true;
+}
+
+bool JsonSaxReader::ReadHex4(uint32_t* code_unit) {
+  uint32_t result = 0;
+  for (int index = 0; index < 4; index++) {
+    int digit = HexValue(Peek());
+    if (digit < 0) {
+      return ReportError("invalid \\u escape");
+    }
+    Advance();
+    result = (result << 4) | static_cast<uint32_t>(digit);
+  }
+  *code_unit = result;
+  return true;
+}
+
+void JsonSaxReader::AppendUtf8(uint32_t code_point) {
+  if (code_point < 0x80) {
+    string_buffer_.push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    string_buffer_.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    string_buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    string_buffer_.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    string_buffer_.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    string_buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    string_buffer_.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    string_buffer_.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    string_buffer_.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    string_buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+bool JsonSaxReader::ParseNumber(JsonSaxHandler* handler) {
+  number_buffer_.clear();
+  bool is_double = false;
+
+  if (Peek() == '-') {
+    number_buffer_.push_back('-');
+    Advance();
+  }
+  int c = Peek();
+  if (c == '0') {
+    number_buffer_.push_back('0');
+    Advance();
+    if (IsDigit(Peek())) {
+      return ReportError("leading zero in number");
+    }
+  } else if (IsDigit(c)) {
+    while (IsDigit(c = Peek())) {
+      number_buffer_.push_back(static_cast<char>(c));
+      Advance();
+    }
+  } else {
+    return ReportError("invalid number");
+  }
+
+  if (Peek() == '.') {
+    is_double = true;
+    number_buffer_.push_back('.');
+    Advance();
+    if (!IsDigit(Peek())) {
+      return ReportError("invalid number");
+    }
+    while (IsDigit(c = Peek())) {
+      number_buffer_.push_back(static_cast<char>(c));
+      Advance();
+    }
+  }
+
+  c = Peek();
+  if (c == 'e' || c == 'E') {
+    is_double = true;
+    number_buffer_.push_back('e');
+    Advance();
+    c = Peek();
+    if (c == '+' || c == '-') {
+      number_buffer_.push_back(static_cast<char>(c));
+      Advance();
+    }
+    if (!IsDigit(Peek())) {
+      return ReportError("invalid number");
+    }
+    while (IsDigit(c = Peek())) {
+      number_buffer_.push_back(static_cast<char>(c));
+      Advance();
+    }
+  }
+
+  if (!is_double) {
+    // base::JSONReader 只把 int 范围内的整数当整数, 更大的按 double 处理.
+    // 两种解析器要对同一个文件推导出同样的 schema
+    int integer_value = 0;
+    if (base::StringToInt(number_buffer_, &integer_value)) {
+      if (!handler->OnInteger(integer_value)) {
+        return ReportHandlerError(handler);
+      }
+      return true;
+    }
+  }
+  double double_value = 0.0;
+  if (!base::StringToDouble(number_buffer_, &double_value)) {
+    return ReportError("invalid number");
+  }
+  if (!handler->OnDouble(double_value)) {
+    return ReportHandlerError(handler);
+  }
+  return true;
+}
+
+bool JsonSaxReader::ParseLiteral(const char* literal) {
+  for (const char* position = literal; *position; ++position) {
+    if (Peek() != *position) {
+      return ReportError("unexpected token");
+    }
+    Advance();
+  }
+  return true;
+}
+
+bool JsonSaxReader::EndContainer(JsonSaxHandler* handler, State* state) {
+  DCHECK(!stack_.empty());
+  char open = stack_.back();
+  stack_.pop_back();
+  Advance();
+  bool result = (open == '{') ? handler->OnEndObject() : handler->OnEndArray();
+  if (!result) {
+    return ReportHandlerError(handler);
+  }
+  *state = StateAfterValue();
+  return true;
+}
+
+JsonSaxReader::State JsonSaxReader::StateAfterValue() const {
+  if (stack_.empty()) {
+    return State::kDone;
+  }
+  return (stack_.back() == '{') ? State::kObjectCommaOrEnd : State::kArrayCommaOrEnd;
+}
+
+int JsonSaxReader::Peek() {
+  if (cursor_ == end_ && !Fill()) {
+    return -1;
+  }
+  return static_cast<unsigned char>(*cursor_);
+}
+
+void JsonSaxReader::Advance() {
+  DCHECK(cursor_ < end_);
+  if (*cursor_ == '\n') {
+    ++line_;
+    column_ = 1;
+  } else {
+    ++column_;
+  }
+  ++cursor_;
+}
+
+bool JsonSaxReader::Fill() {
+  while (!input_end_) {
+    const char* data = nullptr;
+    size_t size = 0;
+    if (!input_stream_->Next(&data, &size)) {
+      input_end_ = true;
+      break;
+    }
+    if (size > 0) {
+      cursor_ = data;
+      end_ = data + size;
+      return true;
+    }
+  }
+  return false;
+}
+
+void JsonSaxReader::SkipWhitespace() {
+  while (cursor_ != end_ || Fill()) {
+    char c = *cursor_;
+    if (c == ' ' || c == '\t' || c == '\r') {
+      ++column_;
+    } else if (c == '\n') {
+      ++line_;
+      column_ = 1;
+    } else {
+      return;
+    }
+    ++cursor_;
+  }
+}
+
+bool JsonSaxReader::ReportError(const std::string& reason) {
+  error_message_ = reason;
+  error_message_ += ("\n line: " + base::IntToString(line_));
+  error_message_ += ("\n column: " + base::IntToString(column_));
+  return false;
+}
+
+bool JsonSaxReader::ReportHandlerError(JsonSaxHandler* handler) {
+  if (handler->error_message().empty()) {
+    return ReportError("convert stopped");
+  }
+  return ReportError(handler->error_message());
+}
+
+} //namespace self
@@ -0,0 +1,135 @@
+#ifndef JSON_SAX_READER_H_
+#define JSON_SAX_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+
+namespace self {
+
+class JsonInputStream;
+class JsonStructuralReader;
+
+// How JsonSaxReader reads its input.
+enum class JsonParserBackend {
+  // Byte by byte, one input chunk at a time.
+  kStreaming,
+  // Through JsonStructuralReader, with the whole input in memory.
+  kStructuralIndex
+};
+
+// Receives the parse events in document order. A StringPiece is only valid
+// during the callback. Returning false stops the parse.
+class JsonSaxHandler {
+public:
+  virtual ~JsonSaxHandler() {}
+
+  virtual bool OnStartObject() = 0;
+  virtual bool OnKey(const base::StringPiece& key) = 0;
+  virtual bool OnEndObject() = 0;
+  virtual bool OnStartArray() = 0;
+  virtual bool OnEndArray() = 0;
+  virtual bool OnNull() = 0;
+  virtual bool OnBoolean(bool value) = 0;
+  // Integers in the int range, larger ones arrive as doubles like they do
+  // from base::JSONReader.
+  virtual bool OnInteger(int64_t value) = 0;
+  virtual bool OnDouble(double value) = 0;
+  virtual bool OnString(const base::StringPiece& value) = 0;
+
+  // Filled in by the handler when it returns false.
+  const std::string& error_message() const { return error_message_; }
+
+protected:
+  std::string error_message_;
+};
+
+// Event driven json parser. It never builds a tree, the memory it holds is
+// one input chunk, the container stack and the string being decoded.
+class JsonSaxReader {
+public:
+  static const size_t kStackMaxDepth = 200;
+
+  explicit JsonSaxReader(JsonInputStream* input_stream);
+
+  ~JsonSaxReader();
+
+  // The backend readers created afterwards start with, kStreaming unless the
+  // --json-parser switch says otherwise.
+  static JsonParserBackend default_backend() {
+    return default_backend_.load(std::memory_order_relaxed);
+  }
+  static void set_default_backend(JsonParserBackend backend) {
+    default_backend_.store(backend, std::memory_order_relaxed);
+  }
+
+  void set_backend(JsonParserBackend backend) { backend_ = backend; }
+
+  bool Parse(JsonSaxHandler* handler, std::string& error_message);
+
+private:
+  enum class State {
+    kValue,
+    kObjectKeyOrEnd,
+    kObjectKey,
+    kObjectCommaOrEnd,
+    kArrayValueOrEnd,
+    kArrayCommaOrEnd,
+    kDone
+  };
+
+  bool ParseDocument(JsonSaxHandler* handler);
+  bool ParseValue(JsonSaxHandler* handler, State* state);
+  bool ParseKey(JsonSaxHandler* handler);
+  bool ParseString(base::StringPiece* value);
+  bool ParseNumber(JsonSaxHandler* handler);
+  bool ParseLiteral(const char* literal);
+  bool DecodeEscape();
+  bool ReadHex4(uint32_t* code_unit);
+  void AppendUtf8(uint32_t code_point);
+  bool EndContainer(JsonSaxHandler* handler, State* state);
+  State StateAfterValue() const;
+
+  // Returns -1 at the end of the input.
+  int Peek();
+  void Advance();
+  bool Fill();
+  void SkipWhitespace();
+
+  bool ReportError(const std::string& reason);
+  bool ReportHandlerError(JsonSaxHandler* handler);
+
+private:
+  static std::atomic<JsonParserBackend> default_backend_;
+
+  JsonInputStream* input_stream_;
+  JsonParserBackend backend_;
+  // Created on the first Parse() with kStructuralIndex, kept for its buffers.
+  std::unique_ptr<JsonStructuralReader> structural_reader_;
+
+  const char* cursor_;
+  const char* end_;
+  bool input_end_;
+
+  int line_;
+  int column_;
+
+  // '{' or '[' for every open container.
+  std::vector<char> stack_;
+  std::string string_buffer_;
+  std::string number_buffer_;
+  std::string error_message_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonSaxReader);
+};
+
+} // namespace self
+#endif // JSON_SAX_READER_H_
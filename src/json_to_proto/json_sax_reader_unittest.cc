@@ -0,0 +1,125 @@
+#include "json_sax_reader.h"
+
+#include <memory>
+#include <string>
+
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "build_proto_from_json.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "json_input_stream.h"
+#include "json_stream_message_builder.h"
+#include "json_to_protobuf_serializer.h"
+#include "json_value_walker.h"
+#include "protobuf_json_writer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+// 重复的 key, 各种值都有, 流式和 dom 都应该留下最后一个值
+const char kDuplicateKeyJson[] =
+  "{\"a\":1,\"b\":{\"x\":1,\"d\":{\"p\":1}},\"a\":2,\"b\":{\"y\":\"s\",\"d\":{\"q\":2}},"
+  "\"c\":[1,2],\"c\":[3],\"e\":[{\"u\":1}],\"e\":[{\"v\":2},{\"w\":3}],"
+  "\"f\":{\"g\":1},\"f\":null,\"h\":[1],\"h\":[],\"n\":1,\"n\":2.5}";
+// 同一个 key 的值换了种类, 最后一个值说了算
+const char kMixedDuplicateKeyJson[] =
+  "{\"a\":\"x\",\"a\":1,\"b\":{\"x\":1},\"b\":\"s\",\"c\":1,\"c\":{\"y\":[1]},"
+  "\"d\":[1,2],\"d\":{\"z\":1},\"e\":{\"p\":{\"q\":1},\"p\":2},\"e\":{\"r\":true},"
+  "\"f\":[{\"u\":1}],\"f\":[1],\"g\":true,\"g\":[{\"v\":1}],\"h\":\"s\",\"h\":[],"
+  "\"i\":{\"x\":1},\"i\":5,\"i\":{\"y\":2},\"j\":[\"s\"],\"j\":[1],"
+  "\"k\":{\"m\":[{\"w\":1}]},\"k\":{\"m\":{\"w\":\"t\"}}}";
+
+// Converts |json| with the message types of |schema_mode| and writes it back
+// to json. |use_dom| parses it with base::JSONReader first, like
+// --use-dom-parser.
+bool ConvertAndWriteJson(
+  const std::string& json,
+  SchemaMode schema_mode,
+  bool use_dom,
+  std::string* output,
+  std::string& error_message) {
+  std::unique_ptr<base::Value> dom_value;
+  if (use_dom) {
+    dom_value = base::JSONReader::Read(json);
+    if (!dom_value || !dom_value->is_dict()) {
+      error_message = "dom parse fail";
+      return false;
+    }
+  }
+  JsonStringInputStream input_stream(json);
+  BuildProtoFromJson build_proto_from_json;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto = use_dom ?
+    build_proto_from_json.CreateProtoFile(static_cast<const base::DictionaryValue*>(
+      dom_value.get()), schema_mode, error_message) :
+    build_proto_from_json.CreateProtoFileFromStream(
+      &input_stream, schema_mode, error_message);
+  if (!file_desc_proto) {
+    return false;
+  }
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(*file_desc_proto);
+  if (!file_desc) {
+    error_message = "build proto file fail";
+    return false;
+  }
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  std::unique_ptr<google::protobuf::Message> root_message(
+    dynamic_message_factory.GetPrototype(root_desc)->New());
+  std::unique_ptr<JsonMessageBuilder> message_builder =
+    JsonToProtobufSerializer::CreateMessageBuilder(
+      schema_mode, root_message.get(), &dynamic_message_factory);
+  bool result = false;
+  if (use_dom) {
+    result = JsonValueWalker::Walk(*dom_value, message_builder.get(), error_message);
+  } else {
+    input_stream.Rewind();
+    JsonSaxReader json_reader(&input_stream);
+    result = json_reader.Parse(message_builder.get(), error_message);
+  }
+  if (!result) {
+    return false;
+  }
+  const std::string encoded = root_message->SerializeAsString();
+  ProtobufJsonWriter protobuf_json_writer;
+  if (!protobuf_json_writer.WriteMessage(
+        root_desc, encoded.data(), encoded.size(), error_message)) {
+    return false;
+  }
+  output->swap(*protobuf_json_writer.buffer());
+  return true;
+}
+
+} // namespace
+
+// The stream parser has to keep the last value of a repeated key like the dom
+// parser, also when the kind of the value changes, in every schema mode. The
+// key order differs, so the json written back is compared parsed.
+TEST(JsonSaxReaderTest, DuplicateKeysLikeDomParser) {
+  for (SchemaMode schema_mode :
+       {SchemaMode::kPerElement, SchemaMode::kUnified, SchemaMode::kCompact}) {
+    for (const char* json : {kDuplicateKeyJson, kMixedDuplicateKeyJson}) {
+      SCOPED_TRACE(json);
+      std::string error_message;
+      std::string stream_json;
+      std::string dom_json;
+      ASSERT_TRUE(ConvertAndWriteJson(json, schema_mode, false, &stream_json, error_message))
+        << error_message;
+      ASSERT_TRUE(ConvertAndWriteJson(json, schema_mode, true, &dom_json, error_message))
+        << error_message;
+      std::unique_ptr<base::Value> stream_value = base::JSONReader::Read(stream_json);
+      std::unique_ptr<base::Value> dom_value = base::JSONReader::Read(dom_json);
+      ASSERT_TRUE(stream_value);
+      ASSERT_TRUE(dom_value);
+      EXPECT_TRUE(stream_value->Equals(dom_value.get()))
+        << "stream: " << stream_json << "\ndom:    " << dom_json;
+    }
+  }
+}
+
+} // namespace self
@@ -0,0 +1,150 @@
+#include "json_shape_fingerprint.h"
+
+#include "base/logging.h"
+
+namespace self {
+
+namespace {
+// FNV-1a 64
+static const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kFnvPrime = 1099511628211ULL;
+
+enum ScalarKind : uint32_t {
+  kBooleanKind = 1 << 0,
+  kIntegerKind = 1 << 1,
+  kDoubleKind = 1 << 2,
+  kStringKind = 1 << 3,
+};
+}
+
+JsonShapeFingerprint::JsonShapeFingerprint(SchemaMode schema_mode, uint64_t seed_value)
+  : merge_elements_(schema_mode != SchemaMode::kPerElement),
+    hash_(kFnvOffsetBasis) {
+  // kPerElement 不混入模式, 和以前的缓存文件名保持一致
+  if (schema_mode != SchemaMode::kPerElement) {
+    Mix(static_cast<char>(schema_mode));
+  }
+  if (seed_value) {
+    Mix(base::StringPiece(reinterpret_cast<const char*>(&seed_value),
+                          sizeof(seed_value)));
+  }
+}
+
+JsonShapeFingerprint::~JsonShapeFingerprint() {
+}
+
+bool JsonShapeFingerprint::OnStartObject() {
+  if (!stack_.empty() && !PrepareValue(true)) {
+    stack_.push_back({FrameType::kSkip, 0});
+    return true;
+  }
+  Mix('{');
+  stack_.push_back({FrameType::kObject, 0});
+  return true;
+}
+
+bool JsonShapeFingerprint::OnKey(const base::StringPiece& key) {
+  DCHECK(!stack_.empty());
+  if (stack_.back().type == FrameType::kObject) {
+    Mix('k');
+    Mix(key);
+  }
+  return true;
+}
+
+bool JsonShapeFingerprint::OnEndObject() {
+  DCHECK(!stack_.empty());
+  if (stack_.back().type == FrameType::kObject) {
+    Mix('}');
+  }
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonShapeFingerprint::OnStartArray() {
+  if (!stack_.empty() && !PrepareValue(true)) {
+    stack_.push_back({FrameType::kSkip, 0});
+    return true;
+  }
+  Mix('[');
+  stack_.push_back(
+    {merge_elements_ ? FrameType::kMergedList : FrameType::kPendingList, 0});
+  return true;
+}
+
+bool JsonShapeFingerprint::OnEndArray() {
+  DCHECK(!stack_.empty());
+  const Frame& frame = stack_.back();
+  if (frame.type == FrameType::kMergedList) {
+    // 合并的 schema 里标量元素的类型是所有元素类型的并集, 和顺序, 个数无关
+    Mix(static_cast<char>(frame.scalar_kinds));
+  }
+  if (frame.type != FrameType::kSkip) {
+    Mix(']');
+  }
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonShapeFingerprint::OnNull() {
+  // message 数组里的 null 会占用一个元素下标, 影响后面元素的类型名
+  if (!stack_.empty() && stack_.back().type == FrameType::kContainerList) {
+    Mix('n');
+  }
+  return true;
+}
+
+bool JsonShapeFingerprint::OnBoolean(bool value) {
+  return AddScalar('b', kBooleanKind);
+}
+
+bool JsonShapeFingerprint::OnInteger(int64_t value) {
+  return AddScalar('i', kIntegerKind);
+}
+
+bool JsonShapeFingerprint::OnDouble(double value) {
+  return AddScalar('d', kDoubleKind);
+}
+
+bool JsonShapeFingerprint::OnString(const base::StringPiece& value) {
+  return AddScalar('s', kStringKind);
+}
+
+bool JsonShapeFingerprint::PrepareValue(bool is_container) {
+  DCHECK(!stack_.empty());
+  FrameType& frame_type = stack_.back().type;
+  if (frame_type == FrameType::kPendingList) {
+    frame_type = is_container ? FrameType::kContainerList : FrameType::kScalarList;
+    return true;
+  }
+  return frame_type == FrameType::kObject || frame_type == FrameType::kContainerList ||
+    frame_type == FrameType::kMergedList;
+}
+
+bool JsonShapeFingerprint::AddScalar(char type_tag, uint32_t scalar_kind) {
+  if (stack_.empty() || !PrepareValue(false)) {
+    return true;
+  }
+  Frame& frame = stack_.back();
+  if (frame.type == FrameType::kMergedList) {
+    frame.scalar_kinds |= scalar_kind;
+    return true;
+  }
+  Mix(type_tag);
+  return true;
+}
+
+void JsonShapeFingerprint::Mix(char tag) {
+  hash_ ^= static_cast<unsigned char>(tag);
+  hash_ *= kFnvPrime;
+}
+
+void JsonShapeFingerprint::Mix(const base::StringPiece& data) {
+  for (char c : data) {
+    Mix(c);
+  }
+  // 分隔符, 避免 "ab"+"c" 和 "a"+"bc" 得到相同的结果
+  Mix('\0');
+}
+
+} //namespace self
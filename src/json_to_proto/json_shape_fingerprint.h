@@ -0,0 +1,80 @@
+#ifndef JSON_SHAPE_FINGERPRINT_H_
+#define JSON_SHAPE_FINGERPRINT_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/macros.h"
+#include "build_proto_from_json.h"
+#include "json_sax_reader.h"
+
+namespace self {
+
+// Hashes the structure of a document: key names, value types and nesting,
+// never the values. Two documents with the same fingerprint get the same
+// schema structure in |schema_mode|, so only what the schema builder looks at
+// is hashed. For SchemaMode::kPerElement a scalar array contributes the type
+// of its first element only and nulls contribute nothing. The unified schema
+// folds every element of an array, so there a scalar array contributes the
+// set of types of all its elements. Compact mode also narrows by the values,
+// a cached compact schema can still be too narrow for a document.
+class JsonShapeFingerprint : public JsonSaxHandler {
+public:
+  // |schema_mode| and then |seed_value| are mixed in first, so the same shape
+  // gets different fingerprints where it gets different schemas.
+  explicit JsonShapeFingerprint(
+    SchemaMode schema_mode = SchemaMode::kPerElement,
+    uint64_t seed_value = 0);
+
+  ~JsonShapeFingerprint() override;
+
+  uint64_t fingerprint() const { return hash_; }
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+private:
+  enum class FrameType {
+    kObject,
+    kPendingList,
+    kContainerList,
+    kScalarList,
+    // SchemaMode::kUnified and kCompact: every element counts
+    kMergedList,
+    kSkip
+  };
+
+  struct Frame {
+    FrameType type;
+    // kMergedList: the types of the scalar elements, mixed in at the end
+    uint32_t scalar_kinds;
+  };
+
+  // Returns false when the value does not change the schema.
+  bool PrepareValue(bool is_container);
+
+  bool AddScalar(char type_tag, uint32_t scalar_kind);
+
+  void Mix(char tag);
+  void Mix(const base::StringPiece& data);
+
+private:
+  const bool merge_elements_;
+  std::vector<Frame> stack_;
+  uint64_t hash_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonShapeFingerprint);
+};
+
+} // namespace self
+#endif // JSON_SHAPE_FINGERPRINT_H_
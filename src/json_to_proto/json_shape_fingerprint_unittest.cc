@@ -0,0 +1,127 @@
+#include "json_shape_fingerprint.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "json_input_stream.h"
+#include "json_to_protobuf_serializer.h"
+#include "json_unified_schema_builder.h"
+#include "schema_cache.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+uint64_t Fingerprint(const char* json, SchemaMode schema_mode) {
+  JsonStringInputStream input_stream(json);
+  JsonShapeFingerprint shape_fingerprint(
+    schema_mode, JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality);
+  JsonSaxReader json_reader(&input_stream);
+  std::string error_message;
+  EXPECT_TRUE(json_reader.Parse(&shape_fingerprint, error_message)) << error_message;
+  return shape_fingerprint.fingerprint();
+}
+
+} // namespace
+
+// The unified schema folds every element of an array, so the types of all
+// scalar elements count, their order and number do not.
+TEST(JsonShapeFingerprintTest, ScalarArrayElementsMerged) {
+  for (SchemaMode schema_mode : {SchemaMode::kUnified, SchemaMode::kCompact}) {
+    const uint64_t integers = Fingerprint("{\"a\":[1,2]}", schema_mode);
+    EXPECT_NE(integers, Fingerprint("{\"a\":[1,2.5]}", schema_mode));
+    EXPECT_NE(integers, Fingerprint("{\"a\":[1,\"x\"]}", schema_mode));
+    EXPECT_NE(integers, Fingerprint("{\"a\":[1,true]}", schema_mode));
+    EXPECT_NE(Fingerprint("{\"a\":[1,2.5]}", schema_mode),
+              Fingerprint("{\"a\":[1,\"x\"]}", schema_mode));
+    EXPECT_NE(integers, Fingerprint("{\"a\":[1,{\"b\":1}]}", schema_mode));
+    EXPECT_NE(Fingerprint("{\"a\":[1,{\"b\":1}]}", schema_mode),
+              Fingerprint("{\"a\":[1,{\"c\":1}]}", schema_mode));
+
+    EXPECT_EQ(integers, Fingerprint("{\"a\":[7]}", schema_mode));
+    EXPECT_EQ(integers, Fingerprint("{\"a\":[3,1,4,1,5]}", schema_mode));
+    EXPECT_EQ(Fingerprint("{\"a\":[\"x\",1]}", schema_mode),
+              Fingerprint("{\"a\":[1,\"y\",2]}", schema_mode));
+  }
+}
+
+// The per element schema types a scalar array by its first element.
+TEST(JsonShapeFingerprintTest, ScalarArrayFirstElementPerElement) {
+  EXPECT_EQ(Fingerprint("{\"a\":[1,2]}", SchemaMode::kPerElement),
+            Fingerprint("{\"a\":[1,\"x\"]}", SchemaMode::kPerElement));
+  EXPECT_NE(Fingerprint("{\"a\":[1,2]}", SchemaMode::kPerElement),
+            Fingerprint("{\"a\":[\"x\",2]}", SchemaMode::kPerElement));
+}
+
+TEST(JsonShapeFingerprintTest, SchemaModeMixedIn) {
+  const char kJson[] = "{\"a\":1,\"b\":{\"c\":\"x\"}}";
+  EXPECT_NE(Fingerprint(kJson, SchemaMode::kPerElement),
+            Fingerprint(kJson, SchemaMode::kUnified));
+  EXPECT_NE(Fingerprint(kJson, SchemaMode::kUnified),
+            Fingerprint(kJson, SchemaMode::kCompact));
+}
+
+// Documents whose scalar arrays differ in their element types must not share
+// a cache entry.
+TEST(SchemaCacheTest, ScalarArrayKindsMiss) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  for (SchemaMode schema_mode : {SchemaMode::kUnified, SchemaMode::kCompact}) {
+    SchemaCache schema_cache(temp_dir.GetPath().AppendASCII(
+      schema_mode == SchemaMode::kUnified ? "unified" : "compact"));
+    JsonToProtobufSerializer serializer(temp_dir.GetPath().AppendASCII("output.pb"));
+    serializer.set_schema_mode(schema_mode);
+    serializer.set_schema_cache(&schema_cache);
+    for (const char* json : {"{\"a\":[1,2]}", "{\"a\":[1,2.5]}", "{\"a\":[1,\"x\"]}"}) {
+      JsonStringInputStream input_stream(json);
+      std::string error_message;
+      EXPECT_TRUE(serializer.SerializeFromStream(&input_stream, error_message))
+        << error_message;
+    }
+    EXPECT_EQ(0, schema_cache.hit_count());
+    EXPECT_EQ(3, schema_cache.miss_count());
+
+    JsonStringInputStream input_stream("{\"a\":[2,1,3]}");
+    std::string error_message;
+    EXPECT_TRUE(serializer.SerializeFromStream(&input_stream, error_message)) << error_message;
+    EXPECT_EQ(1, schema_cache.hit_count());
+  }
+}
+
+// An entry stored under a fingerprint loads back unchanged.
+TEST(SchemaCacheTest, StoreAndLoad) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  SchemaCache schema_cache(temp_dir.GetPath().AppendASCII("cache"));
+  EXPECT_FALSE(schema_cache.Load(1));
+
+  google::protobuf::FileDescriptorProto file_desc_proto;
+  file_desc_proto.set_name("cached.proto");
+  file_desc_proto.add_message_type()->set_name("ROOT");
+  ASSERT_TRUE(schema_cache.Store(1, file_desc_proto));
+  std::unique_ptr<google::protobuf::FileDescriptorProto> loaded = schema_cache.Load(1);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(file_desc_proto.SerializeAsString(), loaded->SerializeAsString());
+  EXPECT_FALSE(schema_cache.Load(2));
+  EXPECT_EQ(1, schema_cache.hit_count());
+  EXPECT_EQ(2, schema_cache.miss_count());
+
+  int64_t total_hit_count = 0;
+  int64_t total_miss_count = 0;
+  ASSERT_TRUE(schema_cache.UpdateTotalCounters(&total_hit_count, &total_miss_count));
+  EXPECT_EQ(1, total_hit_count);
+  EXPECT_EQ(2, total_miss_count);
+  SchemaCache next_schema_cache(temp_dir.GetPath().AppendASCII("cache"));
+  ASSERT_TRUE(next_schema_cache.Load(1));
+  ASSERT_TRUE(next_schema_cache.UpdateTotalCounters(&total_hit_count, &total_miss_count));
+  EXPECT_EQ(2, total_hit_count);
+  EXPECT_EQ(2, total_miss_count);
+}
+
+} // namespace self
@@ -0,0 +1,512 @@
+#include "json_stream_message_builder.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+
+namespace self {
+
+namespace {
+static const int kStartIndex = 1;
+static const int kNoIndex = -1;
+
+// |field_name| == ToLowerASCII(key + "_" + index), compared in place. With an
+// empty |key| only the index at the end is compared, it is unique already.
+bool MatchesGeneratedName(
+  const std::string& field_name,
+  const base::StringPiece& key,
+  int index) {
+  char digits[16];
+  size_t digit_count = 0;
+  do {
+    digits[digit_count++] = static_cast<char>('0' + index % 10);
+    index /= 10;
+  } while (index > 0);
+  if (field_name.size() < digit_count + 1) {
+    return false;
+  }
+  const size_t separator = field_name.size() - digit_count - 1;
+  if (field_name[separator] != '_') {
+    return false;
+  }
+  for (size_t i = 0; i < digit_count; ++i) {
+    if (field_name[separator + 1 + i] != digits[digit_count - 1 - i]) {
+      return false;
+    }
+  }
+  return key.empty() || (separator == key.size() &&
+    base::EqualsCaseInsensitiveASCII(base::StringPiece(field_name.data(), separator), key));
+}
+
+// The fields of an array's message type have no json_name, see
+// JsonStreamSchemaBuilder.
+bool IsElementList(const MessageBindingPlan* plan) {
+  return plan->binding_count() > 0 && !plan->binding(0).field_desc->has_json_name();
+}
+
+}
+
+JsonStreamMessageBuilder::JsonStreamMessageBuilder(
+  google::protobuf::Message* root_message,
+  google::protobuf::MessageFactory* message_factory)
+  : root_message_(root_message),
+    message_factory_(message_factory),
+    plan_cache_(SchemaMode::kPerElement),
+    next_index_(kStartIndex) {
+  DCHECK(root_message_ && message_factory_);
+}
+
+JsonStreamMessageBuilder::~JsonStreamMessageBuilder() {
+}
+
+void JsonStreamMessageBuilder::Reset(google::protobuf::Message* root_message) {
+  DCHECK(root_message);
+  root_message_ = root_message;
+  stack_.clear();
+  deferred_mismatches_.clear();
+  key_name_.clear();
+  next_index_ = kStartIndex;
+  error_message_.clear();
+}
+
+bool JsonStreamMessageBuilder::OnStartObject() {
+  if (stack_.empty()) {
+    stack_.push_back({FrameType::kMessage, root_message_,
+      plan_cache_.GetPlan(root_message_->GetDescriptor()), nullptr, 0, kNoIndex});
+    return true;
+  }
+
+  int index = kNoIndex;
+  Target target = Target::kIgnore;
+  if (!PrepareValue(true, &index, &target)) {
+    return false;
+  }
+  if (target == Target::kIgnore) {
+    stack_.push_back({FrameType::kSkip, nullptr, nullptr, nullptr, 0, kNoIndex});
+    return true;
+  }
+  Frame& parent = stack_.back();
+  const int field_index = GenerateIndex();
+  if (!parent.message) {
+    stack_.push_back({FrameType::kMessage, nullptr, nullptr, nullptr, 0, kNoIndex});
+    return true;
+  }
+  const FieldBinding* binding = FindBinding(&parent, field_index, ValueKind::kObject);
+  if (binding && (binding->setter_kind != SetterKind::kMessage || binding->repeated)) {
+    error_message_ = "value type does not match field: " + binding->field_desc->name();
+    binding = nullptr;
+  }
+  if (!binding) {
+    DeferMismatch(stack_.size() - 1);
+    stack_.push_back({FrameType::kMessage, nullptr, nullptr, nullptr, 0, kNoIndex});
+    return true;
+  }
+  if (parent.type == FrameType::kMessage) {
+    ResolveKey(stack_.size() - 1);
+    ClearEarlierValue(&parent, binding);
+  }
+  google::protobuf::Message* current_message = parent.message->GetReflection()->MutableMessage(
+    parent.message, binding->field_desc, message_factory_);
+  stack_.push_back({FrameType::kMessage, current_message, binding->child_plan, binding, 0,
+    kNoIndex});
+  return true;
+}
+
+bool JsonStreamMessageBuilder::OnKey(const base::StringPiece& key) {
+  key.CopyToString(&key_name_);
+  return true;
+}
+
+bool JsonStreamMessageBuilder::OnEndObject() {
+  DCHECK(!stack_.empty());
+  return PopFrame();
+}
+
+bool JsonStreamMessageBuilder::OnStartArray() {
+  if (stack_.empty()) {
+    error_message_ = "root value is not a json object";
+    return false;
+  }
+
+  int index = kNoIndex;
+  Target target = Target::kIgnore;
+  if (!PrepareValue(true, &index, &target)) {
+    return false;
+  }
+  if (target == Target::kIgnore) {
+    stack_.push_back({FrameType::kSkip, nullptr, nullptr, nullptr, 0, kNoIndex});
+    return true;
+  }
+  // 数组的字段等第一个元素来了才知道是什么类型, 字段加在当前 message 上
+  stack_.push_back({FrameType::kPendingList, stack_.back().message, nullptr, nullptr, 0, index});
+  return true;
+}
+
+bool JsonStreamMessageBuilder::OnEndArray() {
+  DCHECK(!stack_.empty());
+  // 空数组没有字段, 但重复的 key 上一次的值要去掉
+  if (stack_.back().type == FrameType::kPendingList && stack_.size() >= 2) {
+    ClearRepeatedKey(stack_.size() - 2);
+  }
+  return PopFrame();
+}
+
+bool JsonStreamMessageBuilder::OnNull() {
+  if (stack_.empty()) {
+    return true;
+  }
+  if (stack_.back().type == FrameType::kMessageList) {
+    GenerateIndex();
+  } else if (stack_.back().type == FrameType::kMessage) {
+    ClearRepeatedKey(stack_.size() - 1);
+  }
+  return true;
+}
+
+bool JsonStreamMessageBuilder::OnBoolean(bool value) {
+  ScalarValue scalar_value = {ScalarValue::Type::kBoolean, value, 0, 0.0, base::StringPiece()};
+  return AssignScalar(scalar_value);
+}
+
+bool JsonStreamMessageBuilder::OnInteger(int64_t value) {
+  ScalarValue scalar_value = {ScalarValue::Type::kInteger, false, value, 0.0, base::StringPiece()};
+  return AssignScalar(scalar_value);
+}
+
+bool JsonStreamMessageBuilder::OnDouble(double value) {
+  ScalarValue scalar_value = {ScalarValue::Type::kDouble, false, 0, value, base::StringPiece()};
+  return AssignScalar(scalar_value);
+}
+
+bool JsonStreamMessageBuilder::OnString(const base::StringPiece& value) {
+  ScalarValue scalar_value = {ScalarValue::Type::kString, false, 0, 0.0, value};
+  return AssignScalar(scalar_value);
+}
+
+bool JsonStreamMessageBuilder::PrepareValue(
+  bool is_container,
+  int* index,
+  Target* target) {
+  DCHECK(!stack_.empty());
+  Frame& frame = stack_.back();
+
+  if (frame.type == FrameType::kPendingList) {
+    // kPendingList 和它所在的 message 的 frame 相邻, 数组的字段属于那个 message
+    DCHECK_GE(stack_.size(), 2u);
+    const size_t owner_depth = stack_.size() - 2;
+    Frame& owner = stack_[owner_depth];
+    if (is_container) {
+      const int field_index = GenerateIndex();
+      frame.hint = 0;
+      frame.type = FrameType::kMessageList;
+      if (frame.message) {
+        const FieldBinding* binding = FindBinding(&owner, field_index, ValueKind::kList);
+        if (binding && (binding->setter_kind != SetterKind::kMessage || binding->repeated)) {
+          error_message_ = "value type does not match field: " + binding->field_desc->name();
+          binding = nullptr;
+        }
+        if (binding) {
+          if (owner.type == FrameType::kMessage) {
+            ResolveKey(owner_depth);
+            ClearEarlierValue(&owner, binding);
+          }
+          frame.message = frame.message->GetReflection()->MutableMessage(
+            frame.message, binding->field_desc, message_factory_);
+          frame.plan = binding->child_plan;
+          frame.binding = binding;
+        } else {
+          DeferMismatch(owner_depth);
+          frame.message = nullptr;
+        }
+      }
+    } else {
+      frame.type = FrameType::kScalarList;
+      if (frame.message) {
+        const FieldBinding* binding = FindBinding(&owner, frame.index, ValueKind::kScalar);
+        if (binding && !binding->repeated) {
+          error_message_ = "field is not repeated: " + binding->field_desc->name();
+          binding = nullptr;
+        }
+        if (binding) {
+          if (owner.type == FrameType::kMessage) {
+            ResolveKey(owner_depth);
+          }
+          // 新的数组字段一定是空的, 有元素说明 key 重复了, 只留最后一个数组
+          if (frame.message->GetReflection()->FieldSize(*frame.message, binding->field_desc) > 0) {
+            frame.message->GetReflection()->ClearField(frame.message, binding->field_desc);
+          }
+          frame.binding = binding;
+        } else {
+          DeferMismatch(owner_depth);
+          frame.message = nullptr;
+        }
+      }
+    }
+  }
+
+  switch (frame.type) {
+  case FrameType::kMessage: {
+    *index = kNoIndex;
+    *target = Target::kSetField;
+  } break;
+  case FrameType::kMessageList: {
+    *index = GenerateIndex();
+    *target = Target::kSetField;
+  } break;
+  case FrameType::kScalarList: {
+    // 标量数组里的容器没有对应的字段
+    *target = is_container ? Target::kIgnore : Target::kAddField;
+  } break;
+  default: {
+    *target = Target::kIgnore;
+  } break;
+  }
+  return true;
+}
+
+bool JsonStreamMessageBuilder::AssignScalar(const ScalarValue& value) {
+  int index = kNoIndex;
+  Target target = Target::kIgnore;
+  if (!PrepareValue(false, &index, &target)) {
+    return false;
+  }
+
+  Frame& frame = stack_.back();
+  if (!frame.message) {
+    return true;
+  }
+  switch (target) {
+  case Target::kSetField: {
+    const FieldBinding* binding = FindBinding(&frame, index, ValueKind::kScalar);
+    if (binding && binding->repeated) {
+      error_message_ = "value type does not match field: " + binding->field_desc->name();
+      binding = nullptr;
+    }
+    if (binding && WriteScalar(value, binding, false, frame.message)) {
+      if (frame.type == FrameType::kMessage) {
+        ResolveKey(stack_.size() - 1);
+      }
+      return true;
+    }
+    DeferMismatch(stack_.size() - 1);
+    return true;
+  }
+  case Target::kAddField: {
+    return WriteScalar(value, frame.binding, true, frame.message);
+  }
+  default: {
+  } break;
+  }
+  return true;
+}
+
+bool JsonStreamMessageBuilder::WriteScalar(
+  const ScalarValue& value,
+  const FieldBinding* binding,
+  bool repeated,
+  google::protobuf::Message* message) {
+  const google::protobuf::FieldDescriptor* field_desc = binding->field_desc;
+  const google::protobuf::Reflection* reflection = message->GetReflection();
+  switch (binding->setter_kind) {
+  case SetterKind::kBool: {
+    if (value.type != ScalarValue::Type::kBoolean) {
+      break;
+    }
+    if (repeated) {
+      reflection->AddBool(message, field_desc, value.boolean_value);
+    } else {
+      reflection->SetBool(message, field_desc, value.boolean_value);
+    }
+  } return true;
+  case SetterKind::kInt64: {
+    if (value.type != ScalarValue::Type::kInteger) {
+      break;
+    }
+    if (repeated) {
+      reflection->AddInt64(message, field_desc, value.integer_value);
+    } else {
+      reflection->SetInt64(message, field_desc, value.integer_value);
+    }
+  } return true;
+  case SetterKind::kDouble: {
+    double double_value = 0.0;
+    if (value.type == ScalarValue::Type::kDouble) {
+      double_value = value.double_value;
+    } else if (value.type == ScalarValue::Type::kInteger) {
+      double_value = static_cast<double>(value.integer_value);
+    } else {
+      break;
+    }
+    if (repeated) {
+      reflection->AddDouble(message, field_desc, double_value);
+    } else {
+      reflection->SetDouble(message, field_desc, double_value);
+    }
+  } return true;
+  case SetterKind::kString: {
+    if (value.type != ScalarValue::Type::kString) {
+      break;
+    }
+    value.string_value.CopyToString(&string_value_);
+    if (repeated) {
+      reflection->AddString(message, field_desc, string_value_);
+    } else {
+      reflection->SetString(message, field_desc, string_value_);
+    }
+  } return true;
+  default: {
+  } break;
+  }
+
+  // 标量数组的类型由第一个元素决定, 类型不同的元素直接丢弃
+  if (repeated) {
+    return true;
+  }
+  error_message_ = "value type does not match field: " + field_desc->name();
+  return false;
+}
+
+const FieldBinding* JsonStreamMessageBuilder::FindBinding(
+  Frame* owner,
+  int index,
+  ValueKind kind) {
+  DCHECK(owner->plan);
+  const MessageBindingPlan* plan = owner->plan;
+  // 数组元素没有 key, 名字全靠下标
+  base::StringPiece key;
+  if (owner->type == FrameType::kMessage) {
+    key = key_name_;
+  }
+
+  const FieldBinding* binding = nullptr;
+  if (index == kNoIndex) {
+    binding = plan->FindBinding(key, &owner->hint);
+  } else if (owner->hint < plan->binding_count() &&
+    MatchesGeneratedName(plan->binding(owner->hint).field_desc->name(), key, index)) {
+    binding = &plan->binding(owner->hint++);
+  } else {
+    // 只有文档和推断 schema 的那一份结构不同时才会走到这里
+    for (size_t i = 0; i < plan->binding_count(); ++i) {
+      if (MatchesGeneratedName(plan->binding(i).field_desc->name(), key, index)) {
+        binding = &plan->binding(i);
+        owner->hint = i + 1;
+        break;
+      }
+    }
+  }
+  if (!binding && owner->type == FrameType::kMessage && index != kNoIndex) {
+    // 同一个对象里重复的 key 沿用第一次的字段, 下标却是新的, 按 json_name 找回来.
+    // 后来的值覆盖前面的, 和 base::JSONReader 一样
+    binding = FindRepeatedKeyBinding(owner);
+    // 字段换成了另一种容器, 后面还有这个 key 的值
+    if (binding && IsElementList(binding->child_plan) != (kind == ValueKind::kList)) {
+      binding = nullptr;
+    }
+  }
+  if (!binding) {
+    error_message_ = "no field for json key: " + (index == kNoIndex ? key.as_string() :
+      base::ToLowerASCII(key.as_string() + "_" + base::IntToString(index)));
+  }
+  return binding;
+}
+
+const FieldBinding* JsonStreamMessageBuilder::FindRepeatedKeyBinding(const Frame* owner) const {
+  DCHECK(owner->plan);
+  const MessageBindingPlan* plan = owner->plan;
+  for (size_t i = 0; i < plan->binding_count(); ++i) {
+    const FieldBinding& binding = plan->binding(i);
+    if (binding.setter_kind == SetterKind::kMessage &&
+      binding.field_desc->json_name() == key_name_) {
+      return &binding;
+    }
+  }
+  return nullptr;
+}
+
+void JsonStreamMessageBuilder::ClearRepeatedKey(size_t depth) {
+  Frame* owner = &stack_[depth];
+  if (owner->type != FrameType::kMessage || !owner->message) {
+    return;
+  }
+  size_t hint = owner->hint;
+  const FieldBinding* binding = owner->plan->FindBinding(key_name_, &hint);
+  if (!binding) {
+    binding = FindRepeatedKeyBinding(owner);
+  }
+  if (binding) {
+    owner->message->GetReflection()->ClearField(owner->message, binding->field_desc);
+  }
+  ResolveKey(depth);
+}
+
+void JsonStreamMessageBuilder::ClearEarlierValue(
+  Frame* owner,
+  const FieldBinding* binding) {
+  // 字段已经有值说明 key 重复了, 前面的值可能写进了最后一个值才有的字段,
+  // 从空的 message 开始
+  const google::protobuf::Reflection* reflection = owner->message->GetReflection();
+  if (reflection->HasField(*owner->message, binding->field_desc)) {
+    reflection->ClearField(owner->message, binding->field_desc);
+  }
+}
+
+void JsonStreamMessageBuilder::DeferMismatch(size_t depth) {
+  DCHECK(deferred_mismatches_.empty() || deferred_mismatches_.back().depth <= depth);
+  // 数组元素没有 key, 数组结束时交给数组的 key
+  deferred_mismatches_.push_back({depth,
+    stack_[depth].type == FrameType::kMessage ? key_name_ : std::string(), std::string()});
+  deferred_mismatches_.back().error_message.swap(error_message_);
+}
+
+void JsonStreamMessageBuilder::ResolveKey(size_t depth) {
+  if (deferred_mismatches_.empty()) {
+    return;
+  }
+  // 更深的 frame 都已经结束, 这一层的都在末尾
+  std::vector<DeferredMismatch>::iterator first = deferred_mismatches_.end();
+  while (first != deferred_mismatches_.begin() && (first - 1)->depth == depth) {
+    --first;
+  }
+  deferred_mismatches_.erase(std::remove_if(first, deferred_mismatches_.end(),
+    [this](const DeferredMismatch& mismatch) {
+      return mismatch.key == key_name_;
+    }), deferred_mismatches_.end());
+}
+
+bool JsonStreamMessageBuilder::PopFrame() {
+  DCHECK(!stack_.empty());
+  const size_t depth = stack_.size() - 1;
+  if (deferred_mismatches_.empty() || deferred_mismatches_.back().depth != depth) {
+    stack_.pop_back();
+    return true;
+  }
+  const Frame& frame = stack_.back();
+  if (depth == 0 || !frame.binding) {
+    error_message_ = deferred_mismatches_.back().error_message;
+    return false;
+  }
+  // 整个容器被同一个 key 后面的值替换掉时, 里面放不进去的值也就不算数了
+  DeferredMismatch mismatch;
+  mismatch.depth = depth - 1;
+  if (stack_[depth - 1].type == FrameType::kMessage) {
+    mismatch.key = frame.binding->field_desc->json_name();
+  }
+  mismatch.error_message.swap(deferred_mismatches_.back().error_message);
+  while (!deferred_mismatches_.empty() && deferred_mismatches_.back().depth == depth) {
+    deferred_mismatches_.pop_back();
+  }
+  deferred_mismatches_.push_back(std::move(mismatch));
+  stack_.pop_back();
+  return true;
+}
+
+int JsonStreamMessageBuilder::GenerateIndex() {
+  return next_index_++;
+}
+
+} //namespace self
@@ -0,0 +1,183 @@
+#ifndef JSON_STREAM_MESSAGE_BUILDER_H_
+#define JSON_STREAM_MESSAGE_BUILDER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "field_binding_plan.h"
+#include "json_sax_reader.h"
+
+namespace google {
+namespace protobuf {
+class Message;
+class MessageFactory;
+} // namespace protobuf
+} // google
+
+namespace self {
+
+// Fills a message from parse events.
+class JsonMessageBuilder : public JsonSaxHandler {
+public:
+  // Starts over with another root message of the same type.
+  virtual void Reset(google::protobuf::Message* root_message) = 0;
+};
+
+// Fills |root_message| from parse events. The message types must come from
+// JsonStreamSchemaBuilder run over the same kind of document, the names of
+// array elements are derived with the same counter. The last value of a key
+// repeated in one object replaces the earlier ones. A value that does not fit
+// its field, because the schema took the kind of a later value of the key, is
+// walked without being written. It only fails the conversion once it is clear
+// that no later value of the key, or of a key around it, replaces it.
+class JsonStreamMessageBuilder : public JsonMessageBuilder {
+public:
+  JsonStreamMessageBuilder(
+    google::protobuf::Message* root_message,
+    google::protobuf::MessageFactory* message_factory);
+
+  ~JsonStreamMessageBuilder() override;
+
+  // Starts over with another root message, keeps the frame stack's memory and
+  // the binding plans.
+  void Reset(google::protobuf::Message* root_message) override;
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+private:
+  enum class FrameType {
+    kMessage,
+    kPendingList,
+    kMessageList,
+    kScalarList,
+    kSkip
+  };
+
+  enum class Target {
+    kIgnore,
+    kSetField,
+    kAddField
+  };
+
+  enum class ValueKind {
+    kScalar,
+    kObject,
+    kList
+  };
+
+  struct Frame {
+    FrameType type;
+    // nullptr while walking a value that is not written, the indexes are
+    // still counted
+    google::protobuf::Message* message;
+    // kMessage, kMessageList: the plan of |message|
+    const MessageBindingPlan* plan;
+    // kScalarList: the repeated field every element goes to. kMessage,
+    // kMessageList: the field the container went to, nullptr for the root
+    const FieldBinding* binding;
+    // kMessage, kMessageList: where the plan looks for the next field first
+    size_t hint;
+    // kPendingList: the index in the array's name, -1 when the name is the key
+    int index;
+  };
+
+  // A value in the container at |depth| of the stack that did not fit, |key|
+  // is empty in arrays.
+  struct DeferredMismatch {
+    size_t depth;
+    std::string key;
+    std::string error_message;
+  };
+
+  struct ScalarValue {
+    enum class Type {
+      kBoolean,
+      kInteger,
+      kDouble,
+      kString
+    };
+    Type type;
+    bool boolean_value;
+    int64_t integer_value;
+    double double_value;
+    base::StringPiece string_value;
+  };
+
+  // |index| is the index generated for the value's name, -1 when the value
+  // is named by its key.
+  bool PrepareValue(bool is_container, int* index, Target* target);
+
+  bool AssignScalar(const ScalarValue& value);
+
+  bool WriteScalar(
+    const ScalarValue& value,
+    const FieldBinding* binding,
+    bool repeated,
+    google::protobuf::Message* message);
+
+  // The field of |owner|'s message named by the key or by |index|. Field
+  // names are derived from the key and the shared counter exactly as in
+  // JsonStreamSchemaBuilder, but never built: the field expected next is
+  // checked first and the rest of the plan searched only when the document
+  // differs from the one the schema was inferred from. |kind| is the kind of
+  // the value, a repeated key whose field holds another kind has none.
+  const FieldBinding* FindBinding(Frame* owner, int index, ValueKind kind);
+
+  // The message field of the current key in the object |owner|, whose
+  // generated name carries the index of the key's first occurrence.
+  const FieldBinding* FindRepeatedKeyBinding(const Frame* owner) const;
+
+  // A null or an empty array in the object at |depth|: no field, but the
+  // earlier value of a repeated key is dropped all the same.
+  void ClearRepeatedKey(size_t depth);
+
+  // An object or array value of a key in |owner| starts from an empty
+  // message even when an earlier value of the key filled the field.
+  void ClearEarlierValue(Frame* owner, const FieldBinding* binding);
+
+  // The current value does not fit its field in the container at |depth| and
+  // is walked without being written. error_message_ is kept for when the
+  // container ends and no later value of the key replaced it.
+  void DeferMismatch(size_t depth);
+
+  // A value of the current key in the object at |depth| went in, the earlier
+  // ones that did not fit are replaced by it.
+  void ResolveKey(size_t depth);
+
+  // Pops the top frame. Mismatches left in it move up to the key the frame
+  // is the value of, a later value of that key replaces the whole container.
+  // Fails when they reach the root.
+  bool PopFrame();
+
+  int GenerateIndex();
+
+private:
+  google::protobuf::Message* root_message_;
+  google::protobuf::MessageFactory* message_factory_;
+  BindingPlanCache plan_cache_;
+  std::vector<Frame> stack_;
+  // 按 depth 排好序, 只有文档里有重复的 key 时才会有
+  std::vector<DeferredMismatch> deferred_mismatches_;
+  std::string key_name_;
+  int next_index_;
+  // 反射的 SetString 只收 std::string, 复用同一个, 不用每个值构造一次
+  std::string string_value_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonStreamMessageBuilder);
+};
+
+} // namespace self
+#endif // JSON_STREAM_MESSAGE_BUILDER_H_
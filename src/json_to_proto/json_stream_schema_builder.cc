@@ -0,0 +1,379 @@
+#include "json_stream_schema_builder.h"
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+
+namespace self {
+
+namespace {
+static const char kRootName[] = "root";
+static const int kStartIndex = 1;
+}
+
+JsonStreamSchemaBuilder::JsonStreamSchemaBuilder(
+  google::protobuf::FileDescriptorProto* file_desc_proto)
+  : file_desc_proto_(file_desc_proto),
+    next_index_(kStartIndex),
+    next_number_(kStartIndex) {
+  DCHECK(file_desc_proto_);
+}
+
+JsonStreamSchemaBuilder::~JsonStreamSchemaBuilder() {
+}
+
+bool JsonStreamSchemaBuilder::Finish(std::string& error_message) {
+  if (file_desc_proto_->message_type_size() == 0) {
+    error_message = "root value is not a json object";
+    return false;
+  }
+  if (!stack_.empty()) {
+    error_message = "json document is not complete";
+    return false;
+  }
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::OnStartObject() {
+  if (stack_.empty()) {
+    if (file_desc_proto_->message_type_size() > 0) {
+      error_message_ = "more than one root value";
+      return false;
+    }
+    google::protobuf::DescriptorProto* root_desc_proto = file_desc_proto_->add_message_type();
+    root_desc_proto->set_name(base::ToUpperASCII(kRootName));
+    stack_.push_back({FrameType::kMessage, root_desc_proto, std::string(), std::string()});
+    return true;
+  }
+
+  bool add_field = false;
+  std::string key_name;
+  std::string json_name;
+  if (!PrepareValue(true, google::protobuf::FieldDescriptorProto::TYPE_MESSAGE,
+    &add_field, &key_name, &json_name)) {
+    return false;
+  }
+  if (!add_field) {
+    stack_.push_back({FrameType::kSkip, nullptr, std::string(), std::string()});
+    return true;
+  }
+  // 重复的 key 也要消耗一个下标, JsonStreamMessageBuilder 按同样的方式计数
+  std::string unique_key_name = key_name + "_" + base::IntToString(GenerateIndex());
+  KeyField* key_field = FindKeyField(&stack_.back(), key_name);
+  if (key_field && key_field->kind == FieldKind::kMessage) {
+    PushReusedMessage(key_field->desc_proto);
+    return true;
+  }
+  google::protobuf::DescriptorProto* current_desc_proto = nullptr;
+  if (key_field) {
+    current_desc_proto = AddMessageType(unique_key_name);
+    RetypeKeyField(key_field, FieldKind::kMessage,
+      google::protobuf::FieldDescriptorProto::TYPE_MESSAGE,
+      base::ToLowerASCII(unique_key_name), current_desc_proto);
+  } else {
+    current_desc_proto = AddMessageField(unique_key_name, json_name, stack_.back().desc_proto);
+    AddKeyField(&stack_.back(), FieldKind::kMessage,
+      stack_.back().desc_proto->mutable_field(stack_.back().desc_proto->field_size() - 1),
+      current_desc_proto);
+  }
+  stack_.push_back({FrameType::kMessage, current_desc_proto, std::string(), std::string()});
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::OnKey(const base::StringPiece& key) {
+  key.CopyToString(&key_name_);
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::OnEndObject() {
+  DCHECK(!stack_.empty());
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::OnStartArray() {
+  if (stack_.empty()) {
+    error_message_ = "root value is not a json object";
+    return false;
+  }
+
+  bool add_field = false;
+  std::string key_name;
+  std::string json_name;
+  if (!PrepareValue(true, google::protobuf::FieldDescriptorProto::TYPE_MESSAGE,
+    &add_field, &key_name, &json_name)) {
+    return false;
+  }
+  if (!add_field) {
+    stack_.push_back({FrameType::kSkip, nullptr, std::string(), std::string()});
+    return true;
+  }
+  stack_.push_back({FrameType::kPendingList, stack_.back().desc_proto, key_name, json_name});
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::OnEndArray() {
+  DCHECK(!stack_.empty());
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::OnNull() {
+  // null 没有对应的 proto 类型, 不生成字段. 数组里的 null 仍然占用一个下标,
+  // JsonStreamMessageBuilder 按同样的方式计数
+  if (!stack_.empty() && stack_.back().type == FrameType::kMessageList) {
+    GenerateIndex();
+  }
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::OnBoolean(bool value) {
+  return AddScalarField(google::protobuf::FieldDescriptorProto::TYPE_BOOL);
+}
+
+bool JsonStreamSchemaBuilder::OnInteger(int64_t value) {
+  return AddScalarField(google::protobuf::FieldDescriptorProto::TYPE_INT64);
+}
+
+bool JsonStreamSchemaBuilder::OnDouble(double value) {
+  return AddScalarField(google::protobuf::FieldDescriptorProto::TYPE_DOUBLE);
+}
+
+bool JsonStreamSchemaBuilder::OnString(const base::StringPiece& value) {
+  return AddScalarField(google::protobuf::FieldDescriptorProto::TYPE_STRING);
+}
+
+bool JsonStreamSchemaBuilder::PrepareValue(
+  bool is_container,
+  google::protobuf::FieldDescriptorProto::Type type,
+  bool* add_field,
+  std::string* name,
+  std::string* json_name) {
+  DCHECK(!stack_.empty());
+  Frame& frame = stack_.back();
+  *add_field = false;
+
+  if (frame.type == FrameType::kPendingList) {
+    // kPendingList 和它所在的 frame 相邻, 数组的字段属于那个 frame
+    DCHECK_GE(stack_.size(), 2u);
+    Frame* owner = &stack_[stack_.size() - 2];
+    KeyField* key_field = FindKeyField(owner, frame.json_name);
+    if (is_container) {
+      //每一个数组里面的子项都会分配一个message,由于json这些子项是不会有name的，所以每个子项的名
+      //字在父项的名字基础上进行数字递增
+      std::string unique_key_name = frame.name + "_" + base::IntToString(GenerateIndex());
+      if (key_field && key_field->kind == FieldKind::kMessageList) {
+        // 重复的 key, 元素接着加在原来的数组类型上
+        frame.desc_proto = key_field->desc_proto;
+        frame.name = key_field->field_desc_proto->name();
+      } else if (key_field) {
+        frame.desc_proto = AddMessageType(unique_key_name);
+        frame.name = base::ToLowerASCII(unique_key_name);
+        RetypeKeyField(key_field, FieldKind::kMessageList,
+          google::protobuf::FieldDescriptorProto::TYPE_MESSAGE, frame.name, frame.desc_proto);
+      } else {
+        google::protobuf::DescriptorProto* owner_desc_proto = frame.desc_proto;
+        frame.desc_proto = AddMessageField(unique_key_name, frame.json_name, owner_desc_proto);
+        frame.name = base::ToLowerASCII(unique_key_name);
+        AddKeyField(owner, FieldKind::kMessageList,
+          owner_desc_proto->mutable_field(owner_desc_proto->field_size() - 1), frame.desc_proto);
+      }
+      frame.type = FrameType::kMessageList;
+    } else {
+      // 由第一个元素决定整个数组的类型, 后面的元素不再影响 schema.
+      // 重复的 key 以最后一个数组为准
+      if (key_field) {
+        if (key_field->kind != FieldKind::kScalarList ||
+          key_field->field_desc_proto->type() != type) {
+          RetypeKeyField(key_field, FieldKind::kScalarList, type, frame.name, nullptr);
+        }
+      } else {
+        google::protobuf::FieldDescriptorProto* field_desc_proto = frame.desc_proto->add_field();
+        field_desc_proto->set_label(google::protobuf::FieldDescriptorProto_Label_LABEL_REPEATED);
+        field_desc_proto->set_type(type);
+        field_desc_proto->set_name(frame.name);
+        if (!frame.json_name.empty()) {
+          field_desc_proto->set_json_name(frame.json_name);
+        }
+        field_desc_proto->set_number(GenerateNumber());
+        AddKeyField(owner, FieldKind::kScalarList, field_desc_proto, nullptr);
+      }
+      frame.type = FrameType::kScalarList;
+      return true;
+    }
+  }
+
+  switch (frame.type) {
+  case FrameType::kMessage: {
+    *name = key_name_;
+    *json_name = key_name_;
+    *add_field = true;
+  } break;
+  case FrameType::kMessageList: {
+    *name = frame.name + "_" + base::IntToString(GenerateIndex());
+    json_name->clear();
+    *add_field = true;
+  } break;
+  default: {
+  } break;
+  }
+  return true;
+}
+
+bool JsonStreamSchemaBuilder::AddScalarField(
+  google::protobuf::FieldDescriptorProto::Type type) {
+  bool add_field = false;
+  std::string key_name;
+  std::string json_name;
+  if (!PrepareValue(false, type, &add_field, &key_name, &json_name)) {
+    return false;
+  }
+  if (!add_field) {
+    return true;
+  }
+  KeyField* key_field = FindKeyField(&stack_.back(), key_name);
+  if (key_field) {
+    google::protobuf::FieldDescriptorProto* field_desc_proto = key_field->field_desc_proto;
+    if (key_field->kind == FieldKind::kScalar) {
+      if (field_desc_proto->type() == type) {
+        return true;
+      }
+      // 整数和小数都放得进 double, 写 message 时整数会转成 double
+      const bool is_number = type == google::protobuf::FieldDescriptorProto::TYPE_INT64 ||
+        type == google::protobuf::FieldDescriptorProto::TYPE_DOUBLE;
+      const bool field_is_number =
+        field_desc_proto->type() == google::protobuf::FieldDescriptorProto::TYPE_INT64 ||
+        field_desc_proto->type() == google::protobuf::FieldDescriptorProto::TYPE_DOUBLE;
+      if (is_number && field_is_number) {
+        field_desc_proto->set_type(google::protobuf::FieldDescriptorProto::TYPE_DOUBLE);
+        return true;
+      }
+    }
+    RetypeKeyField(key_field, FieldKind::kScalar, type, key_name, nullptr);
+    return true;
+  }
+  google::protobuf::FieldDescriptorProto* field_desc_proto = stack_.back().desc_proto->add_field();
+  field_desc_proto->set_label(google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL);
+  field_desc_proto->set_type(type);
+  field_desc_proto->set_name(key_name);
+  if (!json_name.empty()) {
+    field_desc_proto->set_json_name(json_name);
+  }
+  field_desc_proto->set_number(GenerateNumber());
+  AddKeyField(&stack_.back(), FieldKind::kScalar, field_desc_proto, nullptr);
+  return true;
+}
+
+JsonStreamSchemaBuilder::KeyField* JsonStreamSchemaBuilder::FindKeyField(
+  Frame* owner,
+  const std::string& key) {
+  if (owner->type != FrameType::kMessage) {
+    return nullptr;
+  }
+  KeyFieldMap::iterator iter = owner->key_fields.find(key);
+  return iter == owner->key_fields.end() ? nullptr : &iter->second;
+}
+
+void JsonStreamSchemaBuilder::RetypeKeyField(
+  KeyField* key_field,
+  FieldKind kind,
+  google::protobuf::FieldDescriptorProto::Type type,
+  const std::string& name,
+  google::protobuf::DescriptorProto* desc_proto) {
+  // 字段号和 json_name 不变, 键表里的 StringPiece 仍然有效. 前面的值生成的
+  // message 类型留在文件里, 不再有字段引用它
+  google::protobuf::FieldDescriptorProto* field_desc_proto = key_field->field_desc_proto;
+  field_desc_proto->set_name(name);
+  field_desc_proto->set_type(type);
+  field_desc_proto->set_label(kind == FieldKind::kScalarList ?
+    google::protobuf::FieldDescriptorProto_Label_LABEL_REPEATED :
+    google::protobuf::FieldDescriptorProto_Label_LABEL_OPTIONAL);
+  if (desc_proto) {
+    field_desc_proto->set_type_name(desc_proto->name());
+  } else {
+    field_desc_proto->clear_type_name();
+  }
+  key_field->kind = kind;
+  key_field->desc_proto = desc_proto;
+}
+
+void JsonStreamSchemaBuilder::AddKeyField(
+  Frame* owner,
+  FieldKind kind,
+  google::protobuf::FieldDescriptorProto* field_desc_proto,
+  google::protobuf::DescriptorProto* desc_proto) {
+  if (owner->type != FrameType::kMessage) {
+    return;
+  }
+  owner->key_fields[field_desc_proto->json_name()] = {kind, field_desc_proto, desc_proto};
+}
+
+void JsonStreamSchemaBuilder::PushReusedMessage(google::protobuf::DescriptorProto* desc_proto) {
+  stack_.push_back({FrameType::kMessage, desc_proto, std::string(), std::string()});
+  Frame& frame = stack_.back();
+  for (int i = 0; i < desc_proto->field_size(); ++i) {
+    google::protobuf::FieldDescriptorProto* field_desc_proto = desc_proto->mutable_field(i);
+    KeyField key_field = {FieldKind::kScalar, field_desc_proto, nullptr};
+    if (field_desc_proto->label() ==
+      google::protobuf::FieldDescriptorProto_Label_LABEL_REPEATED) {
+      key_field.kind = FieldKind::kScalarList;
+    } else if (field_desc_proto->type() ==
+      google::protobuf::FieldDescriptorProto_Type_TYPE_MESSAGE) {
+      // 数组的 message 类型里的字段没有 json_name, 对象的都有
+      key_field.desc_proto = FindMessageType(field_desc_proto->type_name());
+      DCHECK(key_field.desc_proto);
+      key_field.kind = key_field.desc_proto->field_size() > 0 &&
+        !key_field.desc_proto->field(0).has_json_name() ?
+        FieldKind::kMessageList : FieldKind::kMessage;
+    }
+    frame.key_fields[field_desc_proto->json_name()] = key_field;
+  }
+}
+
+google::protobuf::DescriptorProto* JsonStreamSchemaBuilder::FindMessageType(
+  const std::string& name) {
+  // 只有重复的 key 才会走到这里
+  for (int i = 0; i < file_desc_proto_->message_type_size(); ++i) {
+    if (file_desc_proto_->message_type(i).name() == name) {
+      return file_desc_proto_->mutable_message_type(i);
+    }
+  }
+  return nullptr;
+}
+
+google::protobuf::DescriptorProto* JsonStreamSchemaBuilder::AddMessageType(
+  const std::string& unique_key_name) {
+  google::protobuf::DescriptorProto* desc_proto = file_desc_proto_->add_message_type();
+  desc_proto->set_name(base::ToUpperASCII(unique_key_name));
+  return desc_proto;
+}
+
+google::protobuf::DescriptorProto* JsonStreamSchemaBuilder::AddMessageField(
+  const std::string& unique_key_name,
+  const std::string& json_name,
+  google::protobuf::DescriptorProto* parent_desc_proto) {
+  DCHECK(parent_desc_proto);
+  google::protobuf::DescriptorProto* current_desc_proto = AddMessageType(unique_key_name);
+
+  google::protobuf::FieldDescriptorProto* field_desc_proto = parent_desc_proto->add_field();
+  field_desc_proto->set_label(google::protobuf::FieldDescriptorProto_Label_LABEL_OPTIONAL);
+  field_desc_proto->set_type(google::protobuf::FieldDescriptorProto_Type_TYPE_MESSAGE);
+  field_desc_proto->set_type_name(current_desc_proto->name());
+  field_desc_proto->set_name(base::ToLowerASCII(unique_key_name));
+  // 数组元素没有 key, 不设 json_name, 反向转换靠这个区分数组和对象
+  if (!json_name.empty()) {
+    field_desc_proto->set_json_name(json_name);
+  }
+  field_desc_proto->set_number(GenerateNumber());
+  return current_desc_proto;
+}
+
+int JsonStreamSchemaBuilder::GenerateIndex() {
+  return next_index_++;
+}
+
+int JsonStreamSchemaBuilder::GenerateNumber() {
+  return next_number_++;
+}
+
+} //namespace self
@@ -0,0 +1,154 @@
+#ifndef JSON_STREAM_SCHEMA_BUILDER_H_
+#define JSON_STREAM_SCHEMA_BUILDER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "json_sax_reader.h"
+
+namespace self {
+
+// Writes message types into a FileDescriptorProto while receiving parse
+// events.
+class JsonSchemaBuilder : public JsonSaxHandler {
+public:
+  // Completes the proto file, called after the last event.
+  virtual bool Finish(std::string& error_message) = 0;
+};
+
+// Infers one message type per container, array elements included, from parse
+// events, so the only state is one frame per open container. Fields of json
+// keys carry the original key as json_name, the fields of array elements have
+// none, which is how an array message is told from an object message. Every
+// conversion owns its builder, the index and field number counters are not
+// shared.
+//
+// A key repeated in one object keeps the field of its first occurrence, an
+// object value reuses its message type, so the last value can replace the
+// earlier ones like base::JSONReader does. Integers and doubles under one key
+// share a double field. A value of another kind retypes the field to the
+// latest kind, the values before it are left out by JsonStreamMessageBuilder.
+class JsonStreamSchemaBuilder : public JsonSchemaBuilder {
+public:
+  explicit JsonStreamSchemaBuilder(
+    google::protobuf::FileDescriptorProto* file_desc_proto);
+
+  ~JsonStreamSchemaBuilder() override;
+
+  bool Finish(std::string& error_message) override;
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+private:
+  enum class FrameType {
+    kMessage,
+    // json 数组, 还没有看到第一个元素, 不知道是 message 数组还是标量数组
+    kPendingList,
+    kMessageList,
+    kScalarList,
+    kSkip
+  };
+
+  enum class FieldKind {
+    kScalar,
+    kScalarList,
+    kMessage,
+    kMessageList
+  };
+
+  // The field a key of an object got.
+  struct KeyField {
+    FieldKind kind;
+    google::protobuf::FieldDescriptorProto* field_desc_proto;
+    // kMessage, kMessageList: the message type of the field
+    google::protobuf::DescriptorProto* desc_proto;
+  };
+
+  // 键指向字段的 json_name, 字段建好以后不再改名
+  typedef std::map<base::StringPiece, KeyField> KeyFieldMap;
+
+  struct Frame {
+    FrameType type;
+    google::protobuf::DescriptorProto* desc_proto;
+    std::string name;
+    // kPendingList: the key of the array, empty when the array is itself an
+    // array element
+    std::string json_name;
+    // kMessage: the fields of the keys seen so far
+    KeyFieldMap key_fields;
+  };
+
+  // Works out the name of the next value, |*add_field| is false when the
+  // value does not produce a field. |json_name| is the json key of the value,
+  // left empty for array elements.
+  bool PrepareValue(
+    bool is_container,
+    google::protobuf::FieldDescriptorProto::Type type,
+    bool* add_field,
+    std::string* name,
+    std::string* json_name);
+
+  bool AddScalarField(google::protobuf::FieldDescriptorProto::Type type);
+
+  // The field an earlier value of |key| got in |owner|, nullptr when the key
+  // is new or |owner| is no object.
+  KeyField* FindKeyField(Frame* owner, const std::string& key);
+
+  // Hands the field of a repeated key over to a value of another kind, the
+  // last value wins. |desc_proto| is the message type of a kMessage or
+  // kMessageList value, nullptr for scalars.
+  void RetypeKeyField(
+    KeyField* key_field,
+    FieldKind kind,
+    google::protobuf::FieldDescriptorProto::Type type,
+    const std::string& name,
+    google::protobuf::DescriptorProto* desc_proto);
+
+  void AddKeyField(
+    Frame* owner,
+    FieldKind kind,
+    google::protobuf::FieldDescriptorProto* field_desc_proto,
+    google::protobuf::DescriptorProto* desc_proto);
+
+  // An object frame on the message type of a repeated key, its key_fields
+  // rebuilt from the fields the type already has.
+  void PushReusedMessage(google::protobuf::DescriptorProto* desc_proto);
+
+  google::protobuf::DescriptorProto* FindMessageType(const std::string& name);
+
+  google::protobuf::DescriptorProto* AddMessageType(const std::string& unique_key_name);
+
+  google::protobuf::DescriptorProto* AddMessageField(
+    const std::string& unique_key_name,
+    const std::string& json_name,
+    google::protobuf::DescriptorProto* parent_desc_proto);
+
+  int GenerateIndex();
+  int GenerateNumber();
+
+private:
+  google::protobuf::FileDescriptorProto* file_desc_proto_;
+  std::vector<Frame> stack_;
+  std::string key_name_;
+  int next_index_;
+  int next_number_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonStreamSchemaBuilder);
+};
+
+} // namespace self
+#endif // JSON_STREAM_SCHEMA_BUILDER_H_
@@ -0,0 +1,688 @@
+#include "json_structural_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "base/logging.h"
+#include "build/build_config.h"
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#if defined(COMPILER_MSVC)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// gcc 和 clang 按函数打开指令集, 默认编译参数不变, 不支持的 CPU 上只是不调用;
+// msvc 不需要标记就能生成这些指令
+#if defined(ARCH_CPU_X86_FAMILY) && defined(COMPILER_GCC)
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE42
+#define TARGET_AVX2
+#endif
+
+namespace self {
+
+namespace {
+static const size_t kBlockSize = 64;
+static const uint64_t kEvenBits = 0x5555555555555555ULL;
+static const uint64_t kByteOnes = 0x0101010101010101ULL;
+static const uint64_t kLowBits = 0x7F7F7F7F7F7F7F7FULL;
+static const uint64_t kHighBits = 0x8080808080808080ULL;
+
+// One bit per byte of a 64-byte block.
+struct BlockMasks {
+  uint64_t backslash;
+  uint64_t quote;
+  // '{', '}', '[', ']', ':' and ','.
+  uint64_t op;
+  uint64_t whitespace;
+  // Bytes below 0x20, only allowed outside of strings and only as whitespace.
+  uint64_t control;
+};
+
+// What a block hands over to the next one.
+struct BlockState {
+  // 1 when the block ends in an odd run of backslashes.
+  uint64_t prev_escaped;
+  // All ones when the block ends inside a string.
+  uint64_t prev_in_string;
+  // 1 when the last byte belongs to a number or literal.
+  uint64_t prev_scalar;
+};
+
+static int CountTrailingZeros(uint64_t value) {
+  DCHECK(value);
+#if defined(COMPILER_MSVC) && defined(ARCH_CPU_64_BITS)
+  unsigned long index = 0;
+  _BitScanForward64(&index, value);
+  return static_cast<int>(index);
+#elif defined(COMPILER_MSVC)
+  unsigned long index = 0;
+  if (_BitScanForward(&index, static_cast<uint32_t>(value))) {
+    return static_cast<int>(index);
+  }
+  _BitScanForward(&index, static_cast<uint32_t>(value >> 32));
+  return static_cast<int>(index) + 32;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+// Bit i of the result is the xor of bits 0..i, i.e. whether an odd number of
+// quotes has been seen up to byte i.
+static uint64_t PrefixXor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+// The bytes escaped by a backslash. A run of backslashes escapes the byte
+// after it when the run is odd, which is found per start parity with one
+// addition instead of walking the run.
+static uint64_t FindEscaped(uint64_t backslash, uint64_t* prev_escaped) {
+  const uint64_t start_edges = backslash & ~(backslash << 1);
+  // 上一块以奇数长度的反斜杠串结束时, 这一块开头那串的奇偶要反过来
+  const uint64_t even_start_mask = kEvenBits ^ *prev_escaped;
+  const uint64_t even_starts = start_edges & even_start_mask;
+  const uint64_t odd_starts = start_edges & ~even_start_mask;
+
+  const uint64_t even_carries = backslash + even_starts;
+  uint64_t odd_carries = backslash + odd_starts;
+  // 从奇数位开始的串一直延续到块尾, 进位溢出
+  const uint64_t odd_overflow = odd_carries < backslash ? 1 : 0;
+  odd_carries |= *prev_escaped;
+  *prev_escaped = odd_overflow;
+
+  const uint64_t even_carry_ends = even_carries & ~backslash;
+  const uint64_t odd_carry_ends = odd_carries & ~backslash;
+  const uint64_t even_start_odd_end = even_carry_ends & ~kEvenBits;
+  const uint64_t odd_start_even_end = odd_carry_ends & kEvenBits;
+  return even_start_odd_end | odd_start_even_end;
+}
+
+// Turns the masks of one block into its structural positions and carries the
+// string and scalar state over to the next block.
+static uint64_t FindStructurals(
+  const BlockMasks& masks,
+  BlockState* state,
+  uint64_t* control_in_string) {
+  const uint64_t escaped = FindEscaped(masks.backslash, &state->prev_escaped);
+  const uint64_t quote = masks.quote & ~escaped;
+  // 包含开引号, 不包含闭引号
+  const uint64_t in_string = PrefixXor(quote) ^ state->prev_in_string;
+  state->prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+  *control_in_string = masks.control & in_string;
+
+  // 除了开引号, 字符串里的字节和闭引号都不是位置
+  const uint64_t string_tail = in_string ^ quote;
+  const uint64_t scalar = ~(masks.op | masks.whitespace);
+  const uint64_t nonquote_scalar = scalar & ~quote;
+  const uint64_t follows_scalar = (nonquote_scalar << 1) | state->prev_scalar;
+  state->prev_scalar = nonquote_scalar >> 63;
+  return (masks.op | (scalar & ~follows_scalar)) & ~string_tail;
+}
+
+// Byte-at-a-time utf-8 state machine, rejects overlong forms, surrogates and
+// code points above U+10FFFF.
+class Utf8Checker {
+public:
+  Utf8Checker()
+    : continuation_count_(0),
+      lower_(0x80),
+      upper_(0xBF) {
+  }
+
+  // Returns false on the first byte that cannot continue a valid sequence.
+  bool Feed(uint8_t byte) {
+    if (continuation_count_) {
+      if (byte < lower_ || byte > upper_) {
+        return false;
+      }
+      --continuation_count_;
+      lower_ = 0x80;
+      upper_ = 0xBF;
+      return true;
+    }
+    if (byte < 0x80) {
+      return true;
+    }
+    if (byte >= 0xC2 && byte <= 0xDF) {
+      continuation_count_ = 1;
+    } else if (byte >= 0xE0 && byte <= 0xEF) {
+      continuation_count_ = 2;
+      if (byte == 0xE0) {
+        lower_ = 0xA0;
+      } else if (byte == 0xED) {
+        upper_ = 0x9F;
+      }
+    } else if (byte >= 0xF0 && byte <= 0xF4) {
+      continuation_count_ = 3;
+      if (byte == 0xF0) {
+        lower_ = 0x90;
+      } else if (byte == 0xF4) {
+        upper_ = 0x8F;
+      }
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  bool complete() const { return continuation_count_ == 0; }
+
+private:
+  int continuation_count_;
+  uint8_t lower_;
+  uint8_t upper_;
+};
+
+// The offset of the first byte that makes |data| invalid utf-8, only used to
+// report where a vectorized check failed.
+static size_t FindInvalidUtf8(const uint8_t* data, size_t size) {
+  Utf8Checker checker;
+  size_t sequence_start = 0;
+  for (size_t offset = 0; offset < size; ++offset) {
+    if (checker.complete()) {
+      sequence_start = offset;
+    }
+    if (!checker.Feed(data[offset])) {
+      return offset;
+    }
+  }
+  return checker.complete() ? size : sequence_start;
+}
+
+// Bit 7 of every byte of |word| that is zero. Exact, unlike the usual
+// haszero trick, so it can build masks.
+static uint64_t ZeroBytes(uint64_t word) {
+  return ~(((word & kLowBits) + kLowBits) | word) & kHighBits;
+}
+
+static uint64_t EqualBytes(uint64_t word, uint8_t byte) {
+  return ZeroBytes(word ^ (kByteOnes * byte));
+}
+
+// Moves bit 7 of byte i to bit i.
+static uint64_t PackHighBits(uint64_t high_bits) {
+  return ((high_bits >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+// Classifies eight bytes per step in a general purpose register, for CPUs
+// without SSE4.2.
+class ScalarKernel {
+public:
+  ScalarKernel()
+    : utf8_error_(false) {
+  }
+
+  void Classify(const uint8_t* block, BlockMasks* masks) {
+    uint64_t backslash = 0;
+    uint64_t quote = 0;
+    uint64_t op = 0;
+    uint64_t whitespace = 0;
+    uint64_t control = 0;
+    uint64_t high_bits = 0;
+    for (size_t index = 0; index < kBlockSize; index += 8) {
+      uint64_t word = 0;
+      ::memcpy(&word, block + index, sizeof(word));
+      // '[' ']' 和 '{' '}' 只差 0x20 这一位
+      const uint64_t folded = word | (kByteOnes * 0x20);
+      backslash |= PackHighBits(EqualBytes(word, '\\')) << index;
+      quote |= PackHighBits(EqualBytes(word, '"')) << index;
+      op |= PackHighBits(EqualBytes(folded, '{') | EqualBytes(folded, '}') |
+                         EqualBytes(word, ':') | EqualBytes(word, ',')) << index;
+      whitespace |= PackHighBits(EqualBytes(word, ' ') | EqualBytes(word, '\t') |
+                                 EqualBytes(word, '\n') | EqualBytes(word, '\r')) << index;
+      control |= PackHighBits(ZeroBytes(word & (kByteOnes * 0xE0))) << index;
+      high_bits |= word;
+    }
+    // 纯 ascii 的块不进状态机, 除非上一块停在半个字符上
+    if (((high_bits & kHighBits) || !utf8_checker_.complete()) && !utf8_error_) {
+      for (size_t index = 0; index < kBlockSize && !utf8_error_; ++index) {
+        utf8_error_ = !utf8_checker_.Feed(block[index]);
+      }
+    }
+    masks->backslash = backslash;
+    masks->quote = quote;
+    masks->op = op;
+    masks->whitespace = whitespace;
+    masks->control = control;
+  }
+
+  bool Finish() {
+    return !utf8_error_ && utf8_checker_.complete();
+  }
+
+private:
+  Utf8Checker utf8_checker_;
+  bool utf8_error_;
+};
+
+#if defined(ARCH_CPU_X86_FAMILY)
+// The utf-8 check works on the previous byte and the current one: each
+// classifies the pair by a nibble through a 16-entry table, the three
+// lookups are and-ed and any bit left is an error. The third and fourth
+// bytes of a sequence are checked separately against the lead byte two and
+// three positions back.
+static const uint8_t kTooShort = 1 << 0;
+static const uint8_t kTooLong = 1 << 1;
+static const uint8_t kOverlong3 = 1 << 2;
+static const uint8_t kTooLarge = 1 << 3;
+static const uint8_t kSurrogate = 1 << 4;
+static const uint8_t kOverlong2 = 1 << 5;
+static const uint8_t kTooLarge1000 = 1 << 6;
+static const uint8_t kOverlong4 = 1 << 6;
+static const uint8_t kTwoContinuations = 1 << 7;
+static const uint8_t kCarry = kTooShort | kTooLong | kTwoContinuations;
+
+static const uint8_t kByte1High[16] = {
+  kTooLong, kTooLong, kTooLong, kTooLong,
+  kTooLong, kTooLong, kTooLong, kTooLong,
+  kTwoContinuations, kTwoContinuations, kTwoContinuations, kTwoContinuations,
+  kTooShort | kOverlong2,
+  kTooShort,
+  kTooShort | kOverlong3 | kSurrogate,
+  kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+static const uint8_t kByte1Low[16] = {
+  kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+  kCarry | kOverlong2,
+  kCarry,
+  kCarry,
+  kCarry | kTooLarge,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+};
+
+static const uint8_t kByte2High[16] = {
+  kTooShort, kTooShort, kTooShort, kTooShort,
+  kTooShort, kTooShort, kTooShort, kTooShort,
+  kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge1000 | kOverlong4,
+  kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge,
+  kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+  kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+  kTooShort, kTooShort, kTooShort, kTooShort,
+};
+
+// A block may not end in a lead byte that still wants continuations: the last
+// three bytes are compared against the largest values that are complete.
+static const uint8_t kIncompleteMax[32] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+class Sse42Kernel {
+public:
+  TARGET_SSE42 Sse42Kernel()
+    : prev_input_(_mm_setzero_si128()),
+      prev_incomplete_(_mm_setzero_si128()),
+      error_(_mm_setzero_si128()) {
+  }
+
+  TARGET_SSE42 void Classify(const uint8_t* block, BlockMasks* masks) {
+    __m128i input[4];
+    for (int index = 0; index < 4; ++index) {
+      input[index] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + index * 16));
+    }
+    masks->backslash = EqualMask(input, '\\');
+    masks->quote = EqualMask(input, '"');
+
+    uint64_t op = 0;
+    uint64_t whitespace = 0;
+    uint64_t control = 0;
+    const __m128i control_max = _mm_set1_epi8(0x1F);
+    for (int index = 0; index < 4; ++index) {
+      const __m128i chunk = input[index];
+      // '[' ']' 和 '{' '}' 只差 0x20 这一位
+      const __m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+      const __m128i is_op = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                     _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))));
+      const __m128i is_whitespace = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+      const __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, control_max), chunk);
+      const int shift = index * 16;
+      op |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(is_op))) << shift;
+      whitespace |=
+        static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(is_whitespace))) << shift;
+      control |=
+        static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(is_control))) << shift;
+    }
+    masks->op = op;
+    masks->whitespace = whitespace;
+    masks->control = control;
+
+    const __m128i any = _mm_or_si128(_mm_or_si128(input[0], input[1]),
+                                     _mm_or_si128(input[2], input[3]));
+    if (!_mm_movemask_epi8(any)) {
+      // 纯 ascii 的块只需要确认上一块没有停在半个字符上
+      error_ = _mm_or_si128(error_, prev_incomplete_);
+    } else {
+      CheckUtf8(input[0], prev_input_);
+      CheckUtf8(input[1], input[0]);
+      CheckUtf8(input[2], input[1]);
+      CheckUtf8(input[3], input[2]);
+      prev_incomplete_ = _mm_subs_epu8(input[3],
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(kIncompleteMax + 16)));
+    }
+    prev_input_ = input[3];
+  }
+
+  TARGET_SSE42 bool Finish() {
+    error_ = _mm_or_si128(error_, prev_incomplete_);
+    return _mm_testz_si128(error_, error_) != 0;
+  }
+
+private:
+  TARGET_SSE42 static uint64_t EqualMask(const __m128i* input, char c) {
+    const __m128i value = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (int index = 0; index < 4; ++index) {
+      mask |= static_cast<uint64_t>(static_cast<uint16_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(input[index], value)))) << (index * 16);
+    }
+    return mask;
+  }
+
+  TARGET_SSE42 void CheckUtf8(__m128i input, __m128i prev_input) {
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    const __m128i byte_1_high = _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1High)),
+      _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble_mask));
+    const __m128i byte_1_low = _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1Low)),
+      _mm_and_si128(prev1, nibble_mask));
+    const __m128i byte_2_high = _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte2High)),
+      _mm_and_si128(_mm_srli_epi16(input, 4), nibble_mask));
+    const __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low),
+                                                byte_2_high);
+
+    const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    const __m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+    const __m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+    const __m128i must_be_continuation = _mm_and_si128(
+      _mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8(static_cast<char>(0x80)));
+    error_ = _mm_or_si128(error_, _mm_xor_si128(must_be_continuation, special_cases));
+  }
+
+private:
+  __m128i prev_input_;
+  __m128i prev_incomplete_;
+  __m128i error_;
+};
+
+class Avx2Kernel {
+public:
+  TARGET_AVX2 Avx2Kernel()
+    : prev_input_(_mm256_setzero_si256()),
+      prev_incomplete_(_mm256_setzero_si256()),
+      error_(_mm256_setzero_si256()) {
+  }
+
+  TARGET_AVX2 void Classify(const uint8_t* block, BlockMasks* masks) {
+    const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    masks->backslash = ToMask(_mm256_cmpeq_epi8(low, _mm256_set1_epi8('\\')),
+                              _mm256_cmpeq_epi8(high, _mm256_set1_epi8('\\')));
+    masks->quote = ToMask(_mm256_cmpeq_epi8(low, _mm256_set1_epi8('"')),
+                          _mm256_cmpeq_epi8(high, _mm256_set1_epi8('"')));
+    masks->op = ToMask(IsOp(low), IsOp(high));
+    masks->whitespace = ToMask(IsWhitespace(low), IsWhitespace(high));
+    masks->control = ToMask(IsControl(low), IsControl(high));
+
+    if (!_mm256_movemask_epi8(_mm256_or_si256(low, high))) {
+      error_ = _mm256_or_si256(error_, prev_incomplete_);
+    } else {
+      CheckUtf8(low, prev_input_);
+      CheckUtf8(high, low);
+      prev_incomplete_ = _mm256_subs_epu8(high,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kIncompleteMax)));
+    }
+    prev_input_ = high;
+  }
+
+  TARGET_AVX2 bool Finish() {
+    error_ = _mm256_or_si256(error_, prev_incomplete_);
+    return _mm256_testz_si256(error_, error_) != 0;
+  }
+
+private:
+  TARGET_AVX2 static uint64_t ToMask(__m256i low, __m256i high) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(low))) |
+      (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(high))) << 32);
+  }
+
+  TARGET_AVX2 static __m256i IsOp(__m256i chunk) {
+    const __m256i folded = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                      _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(':')),
+                      _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(','))));
+  }
+
+  TARGET_AVX2 static __m256i IsWhitespace(__m256i chunk) {
+    return _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                      _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')),
+                      _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))));
+  }
+
+  TARGET_AVX2 static __m256i IsControl(__m256i chunk) {
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, _mm256_set1_epi8(0x1F)), chunk);
+  }
+
+  // Lookup tables are per 128-bit lane, so each one is broadcast to both.
+  TARGET_AVX2 static __m256i LoadTable(const uint8_t* table) {
+    return _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(table)));
+  }
+
+  TARGET_AVX2 void CheckUtf8(__m256i input, __m256i prev_input) {
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    // alignr 只在 lane 内移动, 先拼出 [prev 的高 lane, input 的低 lane]
+    const __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+    const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+    const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+    const __m256i byte_1_high = _mm256_shuffle_epi8(LoadTable(kByte1High),
+      _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble_mask));
+    const __m256i byte_1_low = _mm256_shuffle_epi8(LoadTable(kByte1Low),
+      _mm256_and_si256(prev1, nibble_mask));
+    const __m256i byte_2_high = _mm256_shuffle_epi8(LoadTable(kByte2High),
+      _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble_mask));
+    const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low),
+                                                   byte_2_high);
+
+    const __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    const __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    const __m256i must_be_continuation = _mm256_and_si256(
+      _mm256_or_si256(is_third_byte, is_fourth_byte),
+      _mm256_set1_epi8(static_cast<char>(0x80)));
+    error_ = _mm256_or_si256(error_, _mm256_xor_si256(must_be_continuation, special_cases));
+  }
+
+private:
+  __m256i prev_input_;
+  __m256i prev_incomplete_;
+  __m256i error_;
+};
+#endif
+}
+
+JsonStructuralIndex::JsonStructuralIndex()
+  : position_capacity_(0),
+    position_count_(0),
+    error_offset_(0) {
+}
+
+JsonStructuralIndex::~JsonStructuralIndex() {
+}
+
+SimdLevel JsonStructuralIndex::DetectSimdLevel() {
+#if defined(ARCH_CPU_X86_FAMILY) && defined(COMPILER_MSVC)
+  int info[4] = {0};
+  __cpuid(info, 0);
+  const int max_leaf = info[0];
+  __cpuid(info, 1);
+  const bool has_sse42 = (info[2] & (1 << 20)) != 0;
+  // avx 还要操作系统保存 ymm 寄存器
+  const bool has_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+    (_xgetbv(0) & 6) == 6;
+  bool has_avx2 = false;
+  if (has_avx && max_leaf >= 7) {
+    __cpuidex(info, 7, 0);
+    has_avx2 = (info[1] & (1 << 5)) != 0;
+  }
+  if (has_avx2) {
+    return SimdLevel::kAvx2;
+  }
+  if (has_sse42) {
+    return SimdLevel::kSse42;
+  }
+#elif defined(ARCH_CPU_X86_FAMILY)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return SimdLevel::kSse42;
+  }
+#endif
+  return SimdLevel::kScalar;
+}
+
+const char* JsonStructuralIndex::SimdLevelName(SimdLevel simd_level) {
+  switch (simd_level) {
+  case SimdLevel::kAvx2:
+    return "avx2";
+  case SimdLevel::kSse42:
+    return "sse4.2";
+  default:
+    return "scalar";
+  }
+}
+
+bool JsonStructuralIndex::Build(
+  const base::StringPiece& json,
+  SimdLevel simd_level,
+  std::string& error_message) {
+  json_ = json;
+  position_count_ = 0;
+  error_offset_ = 0;
+  if (json.size() >= std::numeric_limits<uint32_t>::max()) {
+    error_message = "input too large for the structural index";
+    return false;
+  }
+  // 一般的 json 每 4 到 8 个字节一个位置, 先按 8 个估计, 不够再翻倍
+  Reserve(json.size() / 8 + kBlockSize);
+
+  switch (simd_level) {
+#if defined(ARCH_CPU_X86_FAMILY)
+  case SimdLevel::kAvx2: {
+    Avx2Kernel kernel;
+    return BuildWith(&kernel, error_message);
+  }
+  case SimdLevel::kSse42: {
+    Sse42Kernel kernel;
+    return BuildWith(&kernel, error_message);
+  }
+#endif
+  default: {
+    ScalarKernel kernel;
+    return BuildWith(&kernel, error_message);
+  }
+  }
+}
+
+uint32_t* JsonStructuralIndex::Reserve(size_t count) {
+  if (position_count_ + count > position_capacity_) {
+    const size_t capacity = std::max(position_capacity_ * 2, position_count_ + count);
+    std::unique_ptr<uint32_t[]> positions(new uint32_t[capacity]);
+    if (position_count_) {
+      ::memcpy(positions.get(), positions_.get(), position_count_ * sizeof(uint32_t));
+    }
+    positions_ = std::move(positions);
+    position_capacity_ = capacity;
+  }
+  return positions_.get() + position_count_;
+}
+
+template <typename Kernel>
+bool JsonStructuralIndex::BuildWith(Kernel* kernel, std::string& error_message) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(json_.data());
+  const size_t size = json_.size();
+  BlockState state = {0, 0, 0};
+  uint8_t tail[kBlockSize];
+  for (size_t offset = 0; offset < size; offset += kBlockSize) {
+    const uint8_t* block = data + offset;
+    if (size - offset < kBlockSize) {
+      // 最后一块补空格, 空格不产生位置, 也不会被当成字符串里的控制字符
+      ::memset(tail, ' ', kBlockSize);
+      ::memcpy(tail, block, size - offset);
+      block = tail;
+    }
+    BlockMasks masks;
+    kernel->Classify(block, &masks);
+    uint64_t control_in_string = 0;
+    uint64_t structurals = FindStructurals(masks, &state, &control_in_string);
+    if (control_in_string) {
+      error_offset_ = offset + CountTrailingZeros(control_in_string);
+      error_message = "control character in string";
+      return false;
+    }
+
+    uint32_t* positions = Reserve(kBlockSize);
+    size_t count = 0;
+    while (structurals) {
+      positions[count++] = static_cast<uint32_t>(offset + CountTrailingZeros(structurals));
+      structurals &= structurals - 1;
+    }
+    position_count_ += count;
+  }
+
+  if (!kernel->Finish()) {
+    error_offset_ = FindInvalidUtf8(data, size);
+    error_message = "invalid utf-8";
+    return false;
+  }
+  if (state.prev_in_string) {
+    error_offset_ = size;
+    error_message = "unterminated string";
+    return false;
+  }
+  return true;
+}
+
+} //namespace self
@@ -0,0 +1,77 @@
+#ifndef JSON_STRUCTURAL_INDEX_H_
+#define JSON_STRUCTURAL_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+
+namespace self {
+
+// The instruction sets the index can be built with, chosen at runtime.
+enum class SimdLevel {
+  kScalar,
+  kSse42,
+  kAvx2
+};
+
+// The first pass of JsonStructuralReader. The input is classified 64 bytes at
+// a time into bitmasks of quotes, backslashes, structural characters and
+// whitespace, from which the strings are masked out with prefix xor and
+// carry bit tricks instead of a branch per byte. What is left is the position of every
+// '{', '}', '[', ']', ':', ',', every opening quote and the first byte of
+// every number and literal, in document order. The same pass validates the
+// utf-8 of the whole input and rejects control characters in strings, so the
+// second pass only has to check the grammar.
+class JsonStructuralIndex {
+public:
+  JsonStructuralIndex();
+
+  ~JsonStructuralIndex();
+
+  // The best level this CPU and OS support.
+  static SimdLevel DetectSimdLevel();
+
+  static const char* SimdLevelName(SimdLevel simd_level);
+
+  // Indexes |json|, which has to outlive the index. |simd_level| must be
+  // supported, kScalar always is. Inputs of 4 GB and more are rejected.
+  bool Build(
+    const base::StringPiece& json,
+    SimdLevel simd_level,
+    std::string& error_message);
+
+  const base::StringPiece& json() const { return json_; }
+
+  size_t position_count() const { return position_count_; }
+
+  // Byte offsets into json(), ascending.
+  const uint32_t* positions() const { return positions_.get(); }
+
+  // The offset of the first byte Build() found wrong, valid after it failed.
+  size_t error_offset() const { return error_offset_; }
+
+private:
+  // Makes room for one more block of positions.
+  uint32_t* Reserve(size_t count);
+
+  template <typename Kernel>
+  bool BuildWith(Kernel* kernel, std::string& error_message);
+
+private:
+  base::StringPiece json_;
+  std::unique_ptr<uint32_t[]> positions_;
+  size_t position_capacity_;
+  size_t position_count_;
+  size_t error_offset_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonStructuralIndex);
+};
+
+} // namespace self
+#endif // JSON_STRUCTURAL_INDEX_H_
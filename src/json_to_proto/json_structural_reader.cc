@@ -0,0 +1,546 @@
+#include "json_structural_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+
+namespace self {
+
+namespace {
+static const char kUtf8Bom[] = "\xEF\xBB\xBF";
+
+static bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool IsWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool IsOp(char c) {
+  return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+}
+
+static int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Reads the four hex digits at |position|, false when |end| comes first.
+static bool ReadHex4(const char* position, const char* end, uint32_t* code_unit) {
+  if (end - position < 4) {
+    return false;
+  }
+  uint32_t result = 0;
+  for (int index = 0; index < 4; index++) {
+    int digit = HexValue(position[index]);
+    if (digit < 0) {
+      return false;
+    }
+    result = (result << 4) | static_cast<uint32_t>(digit);
+  }
+  *code_unit = result;
+  return true;
+}
+
+static void AppendUtf8(uint32_t code_point, std::string* output) {
+  if (code_point < 0x80) {
+    output->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    output->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    output->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    output->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    output->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    output->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    output->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    output->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    output->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    output->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+}
+
+JsonStructuralReader::JsonStructuralReader(JsonInputStream* input_stream)
+  : input_stream_(input_stream),
+    simd_level_(JsonStructuralIndex::DetectSimdLevel()),
+    next_position_(0) {
+  DCHECK(input_stream_);
+}
+
+JsonStructuralReader::~JsonStructuralReader() {
+}
+
+bool JsonStructuralReader::Parse(
+  JsonSaxHandler* handler,
+  std::string& error_message) {
+  DCHECK(handler);
+  next_position_ = 0;
+  stack_.clear();
+  error_message_.clear();
+
+  if (!ReadInput() || !ParseDocument(handler)) {
+    error_message = error_message_;
+    return false;
+  }
+  return true;
+}
+
+bool JsonStructuralReader::ReadInput() {
+  input_buffer_.clear();
+  json_ = base::StringPiece();
+  const char* data = nullptr;
+  size_t size = 0;
+  if (input_stream_->Next(&data, &size)) {
+    // 整个文件一个 chunk 的 (mmap, 内存里的字符串) 直接用, 否则拼起来
+    if (static_cast<int64_t>(size) == input_stream_->GetLength()) {
+      json_.set(data, size);
+    } else {
+      if (input_stream_->GetLength() > 0) {
+        input_buffer_.reserve(static_cast<size_t>(input_stream_->GetLength()));
+      }
+      do {
+        input_buffer_.append(data, size);
+      } while (input_stream_->Next(&data, &size));
+      json_ = input_buffer_;
+    }
+  }
+
+  // bom 不进索引, 之后的行列号也和 JsonSaxReader 一样从 bom 后面算
+  if (json_.size() >= 3 && ::memcmp(json_.data(), kUtf8Bom, 3) == 0) {
+    json_.remove_prefix(3);
+  }
+  std::string index_error;
+  if (!index_.Build(json_, simd_level_, index_error)) {
+    return ReportError(index_.error_offset(), index_error);
+  }
+  return true;
+}
+
+bool JsonStructuralReader::ParseDocument(JsonSaxHandler* handler) {
+  const char* data = json_.data();
+  State state = State::kValue;
+  while (state != State::kDone) {
+    size_t offset = NextOffset();
+    char c = (offset < json_.size()) ? data[offset] : '\0';
+    switch (state) {
+    case State::kValue: {
+      if (!ParseValue(handler, &state)) {
+        return false;
+      }
+    } break;
+    case State::kObjectKeyOrEnd: {
+      if (c == '}') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+        break;
+      }
+      if (!ParseKey(handler)) {
+        return false;
+      }
+      state = State::kValue;
+    } break;
+    case State::kObjectKey: {
+      if (!ParseKey(handler)) {
+        return false;
+      }
+      state = State::kValue;
+    } break;
+    case State::kObjectCommaOrEnd: {
+      if (c == ',') {
+        ++next_position_;
+        state = State::kObjectKey;
+      } else if (c == '}') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+      } else {
+        return ReportError(offset, "expected ',' or '}'");
+      }
+    } break;
+    case State::kArrayValueOrEnd: {
+      if (c == ']') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+      } else {
+        state = State::kValue;
+      }
+    } break;
+    case State::kArrayCommaOrEnd: {
+      if (c == ',') {
+        ++next_position_;
+        state = State::kValue;
+      } else if (c == ']') {
+        if (!EndContainer(handler, &state)) {
+          return false;
+        }
+      } else {
+        return ReportError(offset, "expected ',' or ']'");
+      }
+    } break;
+    default: {
+      NOTREACHED();
+    } break;
+    }
+  }
+
+  if (next_position_ != index_.position_count()) {
+    return ReportError(NextOffset(), "unexpected data after root value");
+  }
+  return true;
+}
+
+bool JsonStructuralReader::ParseValue(JsonSaxHandler* handler, State* state) {
+  const size_t offset = NextOffset();
+  if (offset == json_.size()) {
+    return ReportError(offset, "unexpected end of input");
+  }
+  ++next_position_;
+  const char c = json_[offset];
+  switch (c) {
+  case '{':
+  case '[': {
+    if (stack_.size() >= JsonSaxReader::kStackMaxDepth) {
+      return ReportError(offset, "too much nesting");
+    }
+    stack_.push_back(c);
+    bool result = (c == '{') ? handler->OnStartObject() : handler->OnStartArray();
+    if (!result) {
+      return ReportHandlerError(handler, offset);
+    }
+    *state = (c == '{') ? State::kObjectKeyOrEnd : State::kArrayValueOrEnd;
+    return true;
+  }
+  case '"': {
+    base::StringPiece value;
+    if (!ParseString(offset, &value)) {
+      return false;
+    }
+    if (!handler->OnString(value)) {
+      return ReportHandlerError(handler, offset);
+    }
+  } break;
+  case 't': {
+    if (!ParseLiteral(offset, "true", 4)) {
+      return false;
+    }
+    if (!handler->OnBoolean(true)) {
+      return ReportHandlerError(handler, offset);
+    }
+  } break;
+  case 'f': {
+    if (!ParseLiteral(offset, "false", 5)) {
+      return false;
+    }
+    if (!handler->OnBoolean(false)) {
+      return ReportHandlerError(handler, offset);
+    }
+  } break;
+  case 'n': {
+    if (!ParseLiteral(offset, "null", 4)) {
+      return false;
+    }
+    if (!handler->OnNull()) {
+      return ReportHandlerError(handler, offset);
+    }
+  } break;
+  default: {
+    if (c == '-' || IsDigit(c)) {
+      if (!ParseNumber(handler, offset)) {
+        return false;
+      }
+      break;
+    }
+    return ReportError(offset, "unexpected token");
+  }
+  }
+  *state = StateAfterValue();
+  return true;
+}
+
+bool JsonStructuralReader::ParseKey(JsonSaxHandler* handler) {
+  size_t offset = NextOffset();
+  if (offset == json_.size() || json_[offset] != '"') {
+    return ReportError(offset, "expected object key");
+  }
+  ++next_position_;
+  base::StringPiece key;
+  if (!ParseString(offset, &key)) {
+    return false;
+  }
+  if (!handler->OnKey(key)) {
+    return ReportHandlerError(handler, offset);
+  }
+  offset = NextOffset();
+  if (offset == json_.size() || json_[offset] != ':') {
+    return ReportError(offset, "expected ':'");
+  }
+  ++next_position_;
+  return true;
+}
+
+bool JsonStructuralReader::ParseString(size_t offset, base::StringPiece* value) {
+  // 闭引号和下一个位置之间只可能是空白, 从下一个位置往回找
+  const char* data = json_.data();
+  size_t end = NextOffset();
+  while (end > offset + 1 && IsWhitespace(data[end - 1])) {
+    --end;
+  }
+  if (end <= offset + 1 || data[end - 1] != '"') {
+    return ReportError(offset, "unterminated string");
+  }
+
+  const char* begin = data + offset + 1;
+  const char* close = data + end - 1;
+  if (!::memchr(begin, '\\', close - begin)) {
+    value->set(begin, close - begin);
+    return true;
+  }
+  if (!DecodeString(begin, close)) {
+    return false;
+  }
+  *value = string_buffer_;
+  return true;
+}
+
+bool JsonStructuralReader::DecodeString(const char* begin, const char* end) {
+  // 控制字符和 utf-8 在建索引时已经检查过了, 这里只处理转义
+  string_buffer_.clear();
+  const char* position = begin;
+  while (position < end) {
+    const char* backslash =
+      static_cast<const char*>(::memchr(position, '\\', end - position));
+    if (!backslash) {
+      string_buffer_.append(position, end - position);
+      break;
+    }
+    string_buffer_.append(position, backslash - position);
+    const size_t escape_offset = backslash - json_.data();
+    position = backslash + 1;
+    if (position == end) {
+      return ReportError(escape_offset, "unterminated string");
+    }
+    const char c = *position++;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/': {
+      string_buffer_.push_back(c);
+    } break;
+    case 'b': {
+      string_buffer_.push_back('\b');
+    } break;
+    case 'f': {
+      string_buffer_.push_back('\f');
+    } break;
+    case 'n': {
+      string_buffer_.push_back('\n');
+    } break;
+    case 'r': {
+      string_buffer_.push_back('\r');
+    } break;
+    case 't': {
+      string_buffer_.push_back('\t');
+    } break;
+    case 'u': {
+      uint32_t code_point = 0;
+      if (!ReadHex4(position, end, &code_point)) {
+        return ReportError(escape_offset, "invalid \\u escape");
+      }
+      position += 4;
+      if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        uint32_t low_surrogate = 0;
+        if (end - position < 2 || position[0] != '\\' || position[1] != 'u') {
+          return ReportError(escape_offset, "invalid surrogate pair");
+        }
+        if (!ReadHex4(position + 2, end, &low_surrogate)) {
+          return ReportError(escape_offset, "invalid \\u escape");
+        }
+        if (low_surrogate < 0xDC00 || low_surrogate > 0xDFFF) {
+          return ReportError(escape_offset, "invalid surrogate pair");
+        }
+        position += 6;
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+      } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+        return ReportError(escape_offset, "invalid surrogate pair");
+      }
+      AppendUtf8(code_point, &string_buffer_);
+    } break;
+    default: {
+      return ReportError(escape_offset, "invalid escape sequence");
+    }
+    }
+  }
+  return true;
+}
+
+bool JsonStructuralReader::ParseNumber(JsonSaxHandler* handler, size_t offset) {
+  const char* data = json_.data();
+  const size_t size = json_.size();
+  size_t position = offset;
+  bool is_double = false;
+  // 整数部分边扫边算, 18 位以内不会溢出, 不用再转一遍
+  uint64_t magnitude = 0;
+  const bool negative = data[position] == '-';
+
+  if (negative) {
+    ++position;
+  }
+  if (position < size && data[position] == '0') {
+    ++position;
+    if (position < size && IsDigit(data[position])) {
+      return ReportError(position, "leading zero in number");
+    }
+  } else if (position < size && IsDigit(data[position])) {
+    while (position < size && IsDigit(data[position])) {
+      magnitude = magnitude * 10 + (data[position] - '0');
+      ++position;
+    }
+  } else {
+    return ReportError(position, "invalid number");
+  }
+
+  if (position < size && data[position] == '.') {
+    is_double = true;
+    ++position;
+    if (position == size || !IsDigit(data[position])) {
+      return ReportError(position, "invalid number");
+    }
+    while (position < size && IsDigit(data[position])) {
+      ++position;
+    }
+  }
+
+  if (position < size && (data[position] == 'e' || data[position] == 'E')) {
+    is_double = true;
+    ++position;
+    if (position < size && (data[position] == '+' || data[position] == '-')) {
+      ++position;
+    }
+    if (position == size || !IsDigit(data[position])) {
+      return ReportError(position, "invalid number");
+    }
+    while (position < size && IsDigit(data[position])) {
+      ++position;
+    }
+  }
+
+  // 索引只记了数字的开头, 数字后面紧跟的东西要在这里拒绝
+  if (!IsDelimiter(position)) {
+    return ReportError(position, "invalid number");
+  }
+
+  const base::StringPiece number(data + offset, position - offset);
+  if (!is_double) {
+    // base::JSONReader 只把 int 范围内的整数当整数, 更大的按 double 处理,
+    // 和 JsonSaxReader 一样. 18 位以内的 magnitude 不会溢出
+    const size_t digit_count = number.size() - (negative ? 1 : 0);
+    const int64_t integer_value = negative ?
+      -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude);
+    if (digit_count <= 18 &&
+        integer_value >= std::numeric_limits<int>::min() &&
+        integer_value <= std::numeric_limits<int>::max()) {
+      if (!handler->OnInteger(integer_value)) {
+        return ReportHandlerError(handler, offset);
+      }
+      return true;
+    }
+  }
+  double double_value = 0.0;
+  number_buffer_.assign(number.data(), number.size());
+  if (!base::StringToDouble(number_buffer_, &double_value)) {
+    return ReportError(offset, "invalid number");
+  }
+  if (!handler->OnDouble(double_value)) {
+    return ReportHandlerError(handler, offset);
+  }
+  return true;
+}
+
+bool JsonStructuralReader::ParseLiteral(
+  size_t offset,
+  const char* literal,
+  size_t length) {
+  if (json_.size() - offset < length ||
+      ::memcmp(json_.data() + offset, literal, length) != 0 ||
+      !IsDelimiter(offset + length)) {
+    return ReportError(offset, "unexpected token");
+  }
+  return true;
+}
+
+bool JsonStructuralReader::EndContainer(JsonSaxHandler* handler, State* state) {
+  DCHECK(!stack_.empty());
+  const size_t offset = NextOffset();
+  char open = stack_.back();
+  stack_.pop_back();
+  ++next_position_;
+  bool result = (open == '{') ? handler->OnEndObject() : handler->OnEndArray();
+  if (!result) {
+    return ReportHandlerError(handler, offset);
+  }
+  *state = StateAfterValue();
+  return true;
+}
+
+JsonStructuralReader::State JsonStructuralReader::StateAfterValue() const {
+  if (stack_.empty()) {
+    return State::kDone;
+  }
+  return (stack_.back() == '{') ? State::kObjectCommaOrEnd : State::kArrayCommaOrEnd;
+}
+
+size_t JsonStructuralReader::NextOffset() const {
+  if (next_position_ < index_.position_count()) {
+    return index_.positions()[next_position_];
+  }
+  return json_.size();
+}
+
+bool JsonStructuralReader::IsDelimiter(size_t offset) const {
+  return offset == json_.size() || IsWhitespace(json_[offset]) || IsOp(json_[offset]);
+}
+
+bool JsonStructuralReader::ReportError(size_t offset, const std::string& reason) {
+  // 只在出错时才数行号, 正常解析不用跟踪
+  const char* data = json_.data();
+  const char* end = data + std::min(offset, json_.size());
+  int line = 1;
+  const char* line_start = data;
+  const char* newline = nullptr;
+  while (line_start < end &&
+         (newline = static_cast<const char*>(::memchr(line_start, '\n', end - line_start)))) {
+    ++line;
+    line_start = newline + 1;
+  }
+  error_message_ = reason;
+  error_message_ += ("\n line: " + base::IntToString(line));
+  error_message_ += ("\n column: " + base::IntToString(static_cast<int>(end - line_start) + 1));
+  return false;
+}
+
+bool JsonStructuralReader::ReportHandlerError(JsonSaxHandler* handler, size_t offset) {
+  if (handler->error_message().empty()) {
+    return ReportError(offset, "convert stopped");
+  }
+  return ReportError(offset, handler->error_message());
+}
+
+} //namespace self
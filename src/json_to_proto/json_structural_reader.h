@@ -0,0 +1,86 @@
+#ifndef JSON_STRUCTURAL_READER_H_
+#define JSON_STRUCTURAL_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "json_structural_index.h"
+
+namespace self {
+
+class JsonInputStream;
+class JsonSaxHandler;
+
+// Same events as JsonSaxReader, parsed in two passes: JsonStructuralIndex
+// finds every token with SIMD first, then the reader jumps from token to
+// token, so whitespace and string contents are never walked byte by byte.
+// It needs the whole document in memory; a stream that hands it out as one
+// chunk (mapped file, in-memory string) is used in place, any other is
+// copied once per Parse(). Unlike JsonSaxReader it rejects invalid utf-8.
+class JsonStructuralReader {
+public:
+  explicit JsonStructuralReader(JsonInputStream* input_stream);
+
+  ~JsonStructuralReader();
+
+  // Defaults to JsonStructuralIndex::DetectSimdLevel().
+  void set_simd_level(SimdLevel simd_level) { simd_level_ = simd_level; }
+
+  bool Parse(JsonSaxHandler* handler, std::string& error_message);
+
+private:
+  enum class State {
+    kValue,
+    kObjectKeyOrEnd,
+    kObjectKey,
+    kObjectCommaOrEnd,
+    kArrayValueOrEnd,
+    kArrayCommaOrEnd,
+    kDone
+  };
+
+  bool ReadInput();
+  bool ParseDocument(JsonSaxHandler* handler);
+  bool ParseValue(JsonSaxHandler* handler, State* state);
+  bool ParseKey(JsonSaxHandler* handler);
+  bool ParseString(size_t offset, base::StringPiece* value);
+  bool DecodeString(const char* begin, const char* end);
+  bool ParseNumber(JsonSaxHandler* handler, size_t offset);
+  bool ParseLiteral(size_t offset, const char* literal, size_t length);
+  bool EndContainer(JsonSaxHandler* handler, State* state);
+  State StateAfterValue() const;
+
+  // The offset of the next token, the input size at the end.
+  size_t NextOffset() const;
+  bool IsDelimiter(size_t offset) const;
+
+  bool ReportError(size_t offset, const std::string& reason);
+  bool ReportHandlerError(JsonSaxHandler* handler, size_t offset);
+
+private:
+  JsonInputStream* input_stream_;
+  SimdLevel simd_level_;
+
+  // Holds the input when the stream does not hand it out in one chunk.
+  std::string input_buffer_;
+  base::StringPiece json_;
+  JsonStructuralIndex index_;
+  size_t next_position_;
+
+  // '{' or '[' for every open container.
+  std::vector<char> stack_;
+  std::string string_buffer_;
+  std::string number_buffer_;
+  std::string error_message_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonStructuralReader);
+};
+
+} // namespace self
+#endif // JSON_STRUCTURAL_READER_H_
@@ -0,0 +1,106 @@
+#include "json_structural_reader.h"
+
+#include <stdint.h>
+
+#include <string>
+
+#include "base/macros.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_structural_index.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+// Writes every event into one line, so two parsers can be compared event by
+// event.
+class RecordingJsonSaxHandler : public JsonSaxHandler {
+public:
+  RecordingJsonSaxHandler() {}
+
+  bool OnStartObject() override { return Record("{"); }
+  bool OnKey(const base::StringPiece& key) override { return Record("k:" + key.as_string()); }
+  bool OnEndObject() override { return Record("}"); }
+  bool OnStartArray() override { return Record("["); }
+  bool OnEndArray() override { return Record("]"); }
+  bool OnNull() override { return Record("null"); }
+  bool OnBoolean(bool value) override { return Record(value ? "true" : "false"); }
+  bool OnInteger(int64_t value) override {
+    return Record("i:" + base::Int64ToString(value));
+  }
+  bool OnDouble(double value) override {
+    return Record(base::StringPrintf("d:%.17g", value));
+  }
+  bool OnString(const base::StringPiece& value) override {
+    return Record("s:" + value.as_string());
+  }
+
+  const std::string& events() const { return events_; }
+
+private:
+  bool Record(const std::string& event) {
+    events_ += event;
+    events_.push_back('\n');
+    return true;
+  }
+
+private:
+  std::string events_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(RecordingJsonSaxHandler);
+};
+
+// The streaming parser's events of |json|.
+std::string StreamEvents(const std::string& json) {
+  JsonStringInputStream input_stream(json);
+  JsonSaxReader json_reader(&input_stream);
+  json_reader.set_backend(JsonParserBackend::kStreaming);
+  RecordingJsonSaxHandler handler;
+  std::string error_message;
+  EXPECT_TRUE(json_reader.Parse(&handler, error_message)) << error_message;
+  return handler.events();
+}
+
+// The structural reader has to give the streaming parser's events at every
+// SIMD level this CPU has.
+void ExpectSameEvents(const std::string& json) {
+  const std::string stream_events = StreamEvents(json);
+  ASSERT_FALSE(stream_events.empty());
+  const SimdLevel kSimdLevels[] = {
+    SimdLevel::kScalar,
+    SimdLevel::kSse42,
+    SimdLevel::kAvx2,
+  };
+  const SimdLevel supported_level = JsonStructuralIndex::DetectSimdLevel();
+  for (SimdLevel simd_level : kSimdLevels) {
+    if (simd_level > supported_level) {
+      break;
+    }
+    JsonStringInputStream input_stream(json);
+    JsonStructuralReader json_reader(&input_stream);
+    json_reader.set_simd_level(simd_level);
+    RecordingJsonSaxHandler handler;
+    std::string error_message;
+    ASSERT_TRUE(json_reader.Parse(&handler, error_message)) << error_message;
+    EXPECT_EQ(stream_events, handler.events())
+      << JsonStructuralIndex::SimdLevelName(simd_level);
+  }
+}
+
+} // namespace
+
+TEST(JsonStructuralReaderTest, CorpusLikeStreaming) {
+  ExpectSameEvents(CorpusGenerator(CorpusShape()).Generate());
+}
+
+TEST(JsonStructuralReaderTest, WideArrayLikeStreaming) {
+  ExpectSameEvents(GenerateWideArray(200));
+}
+
+} // namespace self
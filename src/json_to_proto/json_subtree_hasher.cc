@@ -0,0 +1,214 @@
+#include "json_subtree_hasher.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace self {
+
+namespace {
+// FNV-1a 64
+static const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t HashKey(const base::StringPiece& key) {
+  uint64_t hash = kFnvOffsetBasis;
+  for (char c : key) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+}
+
+JsonSubtreeHasher::JsonSubtreeHasher(int64_t min_event_count)
+  : min_event_count_(min_event_count),
+    subtree_depth_(0),
+    object_count_(0),
+    event_count_(0) {
+}
+
+JsonSubtreeHasher::~JsonSubtreeHasher() {
+}
+
+bool JsonSubtreeHasher::OnStartObject() {
+  ++event_count_;
+  const size_t object_ordinal = object_count_++;
+  size_t subtree = kNoParent;
+  // 只有从根一路经过 key 到达的对象单独缓存, 数组里的对象跟着数组一起重新编码
+  if (stack_.empty() || stack_.back().subtree != kNoParent) {
+    const size_t parent = stack_.empty() ? kNoParent : stack_.back().subtree;
+    subtree = subtrees_.size();
+    subtrees_.push_back({object_ordinal, parent,
+      parent == kNoParent ? std::string() : last_key_, 0, 0, true});
+    if (parent != kNoParent) {
+      subtree_stack_[subtree_depth_ - 1].children.push_back(subtree);
+    }
+    if (subtree_stack_.size() == subtree_depth_) {
+      subtree_stack_.emplace_back();
+    }
+    SubtreeFrame& frame = subtree_stack_[subtree_depth_++];
+    frame.first_event = event_count_;
+    frame.key_hashes.clear();
+    frame.children.clear();
+  }
+  StartContainer(subtree);
+  return true;
+}
+
+bool JsonSubtreeHasher::OnKey(const base::StringPiece& key) {
+  ++event_count_;
+  DCHECK(!stack_.empty());
+  const uint64_t key_hash = HashKey(key);
+  Mix('k');
+  Mix(key_hash);
+  if (stack_.back().subtree != kNoParent) {
+    subtree_stack_[subtree_depth_ - 1].key_hashes.push_back(key_hash);
+    last_key_.assign(key.data(), key.size());
+  }
+  return true;
+}
+
+bool JsonSubtreeHasher::OnEndObject() {
+  ++event_count_;
+  DCHECK(!stack_.empty());
+  const size_t subtree = stack_.back().subtree;
+  const uint64_t hash = EndContainer('o');
+  if (subtree != kNoParent) {
+    subtrees_[subtree].content_hash = hash;
+    FinishSubtree(subtree);
+  }
+  return true;
+}
+
+bool JsonSubtreeHasher::OnStartArray() {
+  ++event_count_;
+  StartContainer(kNoParent);
+  return true;
+}
+
+bool JsonSubtreeHasher::OnEndArray() {
+  ++event_count_;
+  DCHECK(!stack_.empty());
+  EndContainer('a');
+  return true;
+}
+
+bool JsonSubtreeHasher::OnNull() {
+  ++event_count_;
+  Mix('n');
+  return true;
+}
+
+bool JsonSubtreeHasher::OnBoolean(bool value) {
+  ++event_count_;
+  Mix(value ? 't' : 'f');
+  return true;
+}
+
+bool JsonSubtreeHasher::OnInteger(int64_t value) {
+  ++event_count_;
+  Mix('i');
+  Mix(static_cast<uint64_t>(value));
+  return true;
+}
+
+bool JsonSubtreeHasher::OnDouble(double value) {
+  ++event_count_;
+  uint64_t bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+  Mix('d');
+  Mix(bits);
+  return true;
+}
+
+bool JsonSubtreeHasher::OnString(const base::StringPiece& value) {
+  ++event_count_;
+  // 带上长度, 相邻的两个字符串不会和拼起来的一个混淆
+  Mix('s');
+  Mix(static_cast<uint64_t>(value.size()));
+  Mix(value);
+  return true;
+}
+
+void JsonSubtreeHasher::StartContainer(size_t subtree) {
+  stack_.push_back({kFnvOffsetBasis, subtree});
+}
+
+uint64_t JsonSubtreeHasher::EndContainer(char tag) {
+  // 容器只把自己的 hash 交给父容器, 每个字节只过一遍 hash
+  const uint64_t hash = stack_.back().hash;
+  stack_.pop_back();
+  if (!stack_.empty()) {
+    Mix(tag);
+    Mix(hash);
+  }
+  return hash;
+}
+
+void JsonSubtreeHasher::FinishSubtree(size_t subtree) {
+  DCHECK_GT(subtree_depth_, 0u);
+  SubtreeFrame& frame = subtree_stack_[--subtree_depth_];
+  Subtree& finished = subtrees_[subtree];
+  finished.event_count = event_count_ - frame.first_event + 1;
+  if (finished.parent != kNoParent && finished.event_count < min_event_count_) {
+    finished.reusable = false;
+  }
+
+  // 同一个 key 出现两次时两个对象会合并进同一个字段, 编码不再只取决于子树自己
+  if (!frame.children.empty()) {
+    std::sort(frame.key_hashes.begin(), frame.key_hashes.end());
+    for (size_t child : frame.children) {
+      auto range = std::equal_range(frame.key_hashes.begin(), frame.key_hashes.end(),
+        HashKey(subtrees_[child].key));
+      if (range.second - range.first > 1) {
+        subtrees_[child].reusable = false;
+      }
+    }
+  }
+
+  if (finished.parent == kNoParent) {
+    // 根结束时子树都齐了, 父对象不能复用的, 下面的也都不能单独复用
+    for (Subtree& each : subtrees_) {
+      if (each.parent != kNoParent && !subtrees_[each.parent].reusable) {
+        each.reusable = false;
+      }
+    }
+  }
+}
+
+void JsonSubtreeHasher::Mix(char tag) {
+  // 根不是对象时没有子树, 什么都不用记
+  if (stack_.empty()) {
+    return;
+  }
+  uint64_t& hash = stack_.back().hash;
+  hash ^= static_cast<uint8_t>(tag);
+  hash *= kFnvPrime;
+}
+
+void JsonSubtreeHasher::Mix(uint64_t value) {
+  if (stack_.empty()) {
+    return;
+  }
+  uint64_t& hash = stack_.back().hash;
+  for (int shift = 0; shift < 64; shift += 8) {
+    hash ^= static_cast<uint8_t>(value >> shift);
+    hash *= kFnvPrime;
+  }
+}
+
+void JsonSubtreeHasher::Mix(const base::StringPiece& data) {
+  if (stack_.empty()) {
+    return;
+  }
+  uint64_t& hash = stack_.back().hash;
+  for (char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= kFnvPrime;
+  }
+}
+
+} //namespace self
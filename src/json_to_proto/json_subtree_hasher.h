@@ -0,0 +1,103 @@
+#ifndef JSON_SUBTREE_HASHER_H_
+#define JSON_SUBTREE_HASHER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "json_sax_reader.h"
+
+namespace self {
+
+// Hashes the content of every object reached from the root through keys
+// alone, like {"a": {"b": {...}}} but nothing inside an array: the subtrees
+// whose encoding IncrementalConverter can reuse. Key names, values and
+// nesting all go into a hash, and a container's hash is built from the hashes
+// of its children, so the whole document is hashed in one walk.
+class JsonSubtreeHasher : public JsonSaxHandler {
+public:
+  static const size_t kNoParent = static_cast<size_t>(-1);
+
+  struct Subtree {
+    // Counts every object of the document in order, the root is 0. A replay
+    // of the same events reaches the object at the same count.
+    size_t object_ordinal;
+    // Index in subtrees(), kNoParent for the root.
+    size_t parent;
+    // The key of the object in its parent, empty for the root.
+    std::string key;
+    uint64_t content_hash;
+    // Events from the start to the end of the object, both included.
+    int64_t event_count;
+    // False for objects of fewer than the minimum events, objects whose key
+    // appears twice in the parent and everything under them. The root is
+    // always reusable.
+    bool reusable;
+  };
+
+  // Objects of fewer than |min_event_count| events are not worth a sidecar
+  // entry, they are encoded again with their parent.
+  explicit JsonSubtreeHasher(int64_t min_event_count);
+
+  ~JsonSubtreeHasher() override;
+
+  // Parents come before their children, the root first. Complete once the
+  // root object ended.
+  const std::vector<Subtree>& subtrees() const { return subtrees_; }
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+private:
+  struct Frame {
+    uint64_t hash;
+    // Index in subtrees_, kNoParent for arrays and other objects.
+    size_t subtree;
+  };
+
+  // Keys and child subtrees of an open subtree, to find duplicate keys.
+  struct SubtreeFrame {
+    int64_t first_event;
+    std::vector<uint64_t> key_hashes;
+    std::vector<size_t> children;
+  };
+
+  void StartContainer(size_t subtree);
+  // Mixes the hash of the container into its parent under |tag| and
+  // returns it.
+  uint64_t EndContainer(char tag);
+
+  void FinishSubtree(size_t subtree);
+
+  void Mix(char tag);
+  void Mix(uint64_t value);
+  void Mix(const base::StringPiece& data);
+
+private:
+  const int64_t min_event_count_;
+  std::vector<Subtree> subtrees_;
+  std::vector<Frame> stack_;
+  // Only as deep as the open subtrees, the vectors keep their capacity.
+  std::vector<SubtreeFrame> subtree_stack_;
+  size_t subtree_depth_;
+  std::string last_key_;
+  size_t object_count_;
+  int64_t event_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonSubtreeHasher);
+};
+
+} // namespace self
+#endif // JSON_SUBTREE_HASHER_H_
@@ -0,0 +1,238 @@
+#include "json_tape.h"
+
+#include <limits>
+
+#include "base/logging.h"
+
+namespace self {
+
+JsonTape::JsonTape(MonotonicArena* arena)
+  : own_arena_(arena ? nullptr : new MonotonicArena()),
+    arena_(arena ? arena : own_arena_.get()),
+    first_chunk_(nullptr),
+    last_chunk_(nullptr),
+    event_count_(0),
+    chunk_count_(0),
+    text_size_(0) {
+}
+
+JsonTape::~JsonTape() {
+}
+
+void JsonTape::Clear() {
+  if (own_arena_) {
+    own_arena_->Reset();
+  }
+  first_chunk_ = nullptr;
+  last_chunk_ = nullptr;
+  event_count_ = 0;
+  chunk_count_ = 0;
+  text_size_ = 0;
+  error_message_.clear();
+}
+
+bool JsonTape::Replay(JsonSaxHandler* handler, std::string& error_message) const {
+  return Replay(handler, 0, event_count_, error_message);
+}
+
+bool JsonTape::Replay(
+  JsonSaxHandler* handler,
+  size_t begin,
+  size_t end,
+  std::string& error_message) const {
+  DCHECK(handler);
+  DCHECK(begin <= end && end <= event_count_);
+  // 除了最后一块, 每块都是满的, 跳过前面整块就到了 |begin|
+  const EventChunk* chunk = first_chunk_;
+  size_t index = begin;
+  while (chunk && index >= kEventsPerChunk) {
+    chunk = chunk->next;
+    index -= kEventsPerChunk;
+  }
+  for (size_t remaining = end - begin; chunk && remaining > 0; chunk = chunk->next) {
+    for (; index < chunk->count && remaining > 0; ++index, --remaining) {
+      if (!ReplayEvent(chunk->events[index], handler)) {
+        error_message = handler->error_message();
+        return false;
+      }
+    }
+    index = 0;
+  }
+  return true;
+}
+
+bool JsonTape::ReplayEvent(const Event& event, JsonSaxHandler* handler) {
+  switch (event.op) {
+  case Op::kStartObject:
+    return handler->OnStartObject();
+  case Op::kEndObject:
+    return handler->OnEndObject();
+  case Op::kStartArray:
+    return handler->OnStartArray();
+  case Op::kEndArray:
+    return handler->OnEndArray();
+  case Op::kKey:
+    return handler->OnKey(base::StringPiece(event.text, event.length));
+  case Op::kNull:
+    return handler->OnNull();
+  case Op::kBoolean:
+    return handler->OnBoolean(event.boolean_value);
+  case Op::kInteger:
+    return handler->OnInteger(event.integer_value);
+  case Op::kDouble:
+    return handler->OnDouble(event.double_value);
+  case Op::kString:
+    return handler->OnString(base::StringPiece(event.text, event.length));
+  }
+  NOTREACHED();
+  return false;
+}
+
+size_t JsonTape::memory_usage() const {
+  return chunk_count_ * sizeof(EventChunk) + text_size_;
+}
+
+bool JsonTape::OnStartObject() {
+  AddEvent(Op::kStartObject);
+  return true;
+}
+
+bool JsonTape::OnKey(const base::StringPiece& key) {
+  return AddText(Op::kKey, key);
+}
+
+bool JsonTape::OnEndObject() {
+  AddEvent(Op::kEndObject);
+  return true;
+}
+
+bool JsonTape::OnStartArray() {
+  AddEvent(Op::kStartArray);
+  return true;
+}
+
+bool JsonTape::OnEndArray() {
+  AddEvent(Op::kEndArray);
+  return true;
+}
+
+bool JsonTape::OnNull() {
+  AddEvent(Op::kNull);
+  return true;
+}
+
+bool JsonTape::OnBoolean(bool value) {
+  AddEvent(Op::kBoolean)->boolean_value = value;
+  return true;
+}
+
+bool JsonTape::OnInteger(int64_t value) {
+  AddEvent(Op::kInteger)->integer_value = value;
+  return true;
+}
+
+bool JsonTape::OnDouble(double value) {
+  AddEvent(Op::kDouble)->double_value = value;
+  return true;
+}
+
+bool JsonTape::OnString(const base::StringPiece& value) {
+  return AddText(Op::kString, value);
+}
+
+JsonTape::Event* JsonTape::AddEvent(Op op) {
+  if (!last_chunk_ || last_chunk_->count == kEventsPerChunk) {
+    EventChunk* chunk = static_cast<EventChunk*>(
+      arena_->Allocate(sizeof(EventChunk), alignof(EventChunk)));
+    chunk->next = nullptr;
+    chunk->count = 0;
+    if (last_chunk_) {
+      last_chunk_->next = chunk;
+    } else {
+      first_chunk_ = chunk;
+    }
+    last_chunk_ = chunk;
+    chunk_count_++;
+  }
+  Event* event = &last_chunk_->events[last_chunk_->count++];
+  event->op = op;
+  event->length = 0;
+  event_count_++;
+  return event;
+}
+
+bool JsonTape::AddText(Op op, const base::StringPiece& text) {
+  if (text.size() > std::numeric_limits<uint32_t>::max()) {
+    error_message_ = "json string is too long";
+    return false;
+  }
+  base::StringPiece copy = arena_->CopyString(text);
+  Event* event = AddEvent(op);
+  event->length = static_cast<uint32_t>(copy.size());
+  event->text = copy.data();
+  text_size_ += copy.size();
+  return true;
+}
+
+JsonSaxTee::JsonSaxTee(JsonSaxHandler* first, JsonSaxHandler* second)
+  : first_(first),
+    second_(second) {
+  DCHECK(first_ && second_);
+}
+
+JsonSaxTee::~JsonSaxTee() {
+}
+
+bool JsonSaxTee::OnStartObject() {
+  return Check(first_->OnStartObject(), second_->OnStartObject());
+}
+
+bool JsonSaxTee::OnKey(const base::StringPiece& key) {
+  return Check(first_->OnKey(key), second_->OnKey(key));
+}
+
+bool JsonSaxTee::OnEndObject() {
+  return Check(first_->OnEndObject(), second_->OnEndObject());
+}
+
+bool JsonSaxTee::OnStartArray() {
+  return Check(first_->OnStartArray(), second_->OnStartArray());
+}
+
+bool JsonSaxTee::OnEndArray() {
+  return Check(first_->OnEndArray(), second_->OnEndArray());
+}
+
+bool JsonSaxTee::OnNull() {
+  return Check(first_->OnNull(), second_->OnNull());
+}
+
+bool JsonSaxTee::OnBoolean(bool value) {
+  return Check(first_->OnBoolean(value), second_->OnBoolean(value));
+}
+
+bool JsonSaxTee::OnInteger(int64_t value) {
+  return Check(first_->OnInteger(value), second_->OnInteger(value));
+}
+
+bool JsonSaxTee::OnDouble(double value) {
+  return Check(first_->OnDouble(value), second_->OnDouble(value));
+}
+
+bool JsonSaxTee::OnString(const base::StringPiece& value) {
+  return Check(first_->OnString(value), second_->OnString(value));
+}
+
+bool JsonSaxTee::Check(bool first_result, bool second_result) {
+  if (!first_result) {
+    error_message_ = first_->error_message();
+    return false;
+  }
+  if (!second_result) {
+    error_message_ = second_->error_message();
+    return false;
+  }
+  return true;
+}
+
+} //namespace self
@@ -0,0 +1,145 @@
+#ifndef JSON_TAPE_H_
+#define JSON_TAPE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "base/macros.h"
+#include "json_sax_reader.h"
+#include "monotonic_arena.h"
+
+namespace self {
+
+// Records parse events into flat chunks, 16 bytes per event, with all keys and
+// strings copied next to them in a MonotonicArena. Replaying the tape is a
+// loop over the chunks, so a document can be walked once and its events
+// consumed again without touching the source. Nothing is ever moved or freed
+// one by one while recording.
+class JsonTape : public JsonSaxHandler {
+public:
+  // Records into |arena| when given, it must outlive the tape and may be
+  // shared with the rest of a conversion. Otherwise the tape has its own.
+  explicit JsonTape(MonotonicArena* arena = nullptr);
+
+  ~JsonTape() override;
+
+  // Drops the events. The tape's own arena keeps its first block, a shared
+  // arena is left as it is.
+  void Clear();
+
+  // Sends the recorded events to |handler| in order.
+  bool Replay(JsonSaxHandler* handler, std::string& error_message) const;
+
+  // Sends events [begin, end) to |handler|, e.g. one subtree. The tape is only
+  // read, disjoint or not, ranges may be replayed on several threads at once.
+  bool Replay(
+    JsonSaxHandler* handler,
+    size_t begin,
+    size_t end,
+    std::string& error_message) const;
+
+  size_t event_count() const { return event_count_; }
+
+  // Bytes taken by the event chunks and the strings.
+  size_t memory_usage() const;
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+private:
+  enum class Op : uint8_t {
+    kStartObject,
+    kEndObject,
+    kStartArray,
+    kEndArray,
+    kKey,
+    kNull,
+    kBoolean,
+    kInteger,
+    kDouble,
+    kString
+  };
+
+  struct Event {
+    Op op;
+    // kKey, kString: length of |text|
+    uint32_t length;
+    union {
+      bool boolean_value;
+      int64_t integer_value;
+      double double_value;
+      // kKey, kString: the text, copied into the arena
+      const char* text;
+    };
+  };
+
+  static const size_t kEventsPerChunk = 2048;
+
+  struct EventChunk {
+    EventChunk* next;
+    size_t count;
+    Event events[kEventsPerChunk];
+  };
+
+  static bool ReplayEvent(const Event& event, JsonSaxHandler* handler);
+
+  Event* AddEvent(Op op);
+
+  bool AddText(Op op, const base::StringPiece& text);
+
+private:
+  std::unique_ptr<MonotonicArena> own_arena_;
+  MonotonicArena* arena_;
+  EventChunk* first_chunk_;
+  EventChunk* last_chunk_;
+  size_t event_count_;
+  size_t chunk_count_;
+  size_t text_size_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonTape);
+};
+
+// Forwards every event to two handlers, e.g. a schema builder and a JsonTape,
+// so one walk feeds both.
+class JsonSaxTee : public JsonSaxHandler {
+public:
+  JsonSaxTee(JsonSaxHandler* first, JsonSaxHandler* second);
+
+  ~JsonSaxTee() override;
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+private:
+  bool Check(bool first_result, bool second_result);
+
+private:
+  JsonSaxHandler* first_;
+  JsonSaxHandler* second_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonSaxTee);
+};
+
+} // namespace self
+#endif // JSON_TAPE_H_
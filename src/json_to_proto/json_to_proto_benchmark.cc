@@ -0,0 +1,311 @@
+#include "json_to_proto_benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "base/command_line.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/macros.h"
+#include "base/process/launch.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/stringprintf.h"
+#include "build/build_config.h"
+#include "convert_json_to_protobuf.h"
+#include "convert_switches.h"
+#include "json_input_generator.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace json_to_proto_benchmark {
+
+extern const char kBenchmarkChild[] = "benchmark-child";
+extern const char kPhasesChild[] = "benchmark-phases-child";
+extern const char kRecordCount[] = "record-count";
+extern const char kCorpusDepth[] = "corpus-depth";
+extern const char kCorpusOutput[] = "corpus-output";
+
+namespace {
+
+// Shape of the corpus generated from superman.json for the phase benchmark:
+// keys per group, steps per permission and characters per string, besides
+// kCorpusDepth.
+const char kCorpusWidth[] = "corpus-width";
+const char kCorpusArrayLength[] = "corpus-array-length";
+const char kCorpusStringLength[] = "corpus-string-length";
+// Weights of integer, double, bool and string values, like "4,2,1,3".
+const char kCorpusTypeMix[] = "corpus-type-mix";
+const char kCorpusSeed[] = "corpus-seed";
+// "parser", "record-stream", "array-schema", "batch", "field-binding",
+// "arena", "reverse", "phases", "compact", "simd", "incremental",
+// "container", "server", "compress", "parallel" or "pipeline", runs all when
+// absent.
+const char kBenchmark[] = "benchmark";
+
+// 每个 record 大约生成 6 个字段, field number 要保持在 19000 以下
+const int kGenerateRecordCount = 2000;
+
+bool WriteString(base::File* file, const std::string& data) {
+  return file->WriteAtCurrentPos(data.data(), static_cast<int>(data.size())) ==
+    static_cast<int>(data.size());
+}
+
+std::map<std::string, std::string> ParseChildOutput(const std::string& output) {
+  std::map<std::string, std::string> values;
+  for (const std::string& line : base::SplitString(
+    output, "\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY)) {
+    size_t separator = line.find('=');
+    if (separator != std::string::npos) {
+      values[line.substr(0, separator)] = line.substr(separator + 1);
+    }
+  }
+  return values;
+}
+
+} // namespace
+
+int64_t GetPeakResidentSetBytes() {
+#if defined(OS_WIN)
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return static_cast<int64_t>(counters.PeakWorkingSetSize);
+#else
+  struct rusage usage = {};
+  if (::getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(OS_MACOSX)
+  return static_cast<int64_t>(usage.ru_maxrss);
+#else
+  return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool GenerateInput(const base::FilePath& file_path, int64_t target_size) {
+  base::File file(file_path, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+  if (!file.IsValid()) {
+    return false;
+  }
+  const int64_t record_size = target_size / kGenerateRecordCount;
+  const int array_length = static_cast<int>(record_size / 12);
+  const std::string describe(static_cast<size_t>(record_size / 4), 'x');
+
+  if (!WriteString(&file, "{\n  \"version\": 2018052116,\n  \"records\": {\n")) {
+    return false;
+  }
+  std::string record;
+  for (int index = 0; index < kGenerateRecordCount; index++) {
+    record.clear();
+    base::StringAppendF(&record,
+      "    \"record_%d\": {\n"
+      "      \"type_id\": %d,\n"
+      "      \"delay_time\": %d.5,\n"
+      "      \"describe\": \"%s\",\n"
+      "      \"intent\": {\"action\": \"android.settings.ACTION_%d\"},\n"
+      "      \"positions\": [",
+      index, index, index * 10, describe.c_str(), index);
+    for (int item = 0; item < array_length; item++) {
+      if (item > 0) {
+        record.push_back(',');
+      }
+      record += base::IntToString(item * 7919 % 1000003);
+    }
+    record += (index + 1 == kGenerateRecordCount) ? "]\n    }\n" : "]\n    },\n";
+    if (!WriteString(&file, record)) {
+      return false;
+    }
+  }
+  return WriteString(&file, "  }\n}\n");
+}
+
+bool ParseCorpusShape(const base::CommandLine* command_line, self::CorpusShape* shape) {
+  *shape = self::CorpusShape();
+  const struct {
+    const char* switch_name;
+    int* value;
+    int min_value;
+  } kIntSwitches[] = {
+    {kCorpusDepth, &shape->depth, 1},
+    {kCorpusWidth, &shape->width, 1},
+    {kCorpusArrayLength, &shape->array_length, 0},
+    {kCorpusStringLength, &shape->string_length, 0},
+  };
+  for (const auto& int_switch : kIntSwitches) {
+    if (command_line->HasSwitch(int_switch.switch_name) &&
+        (!base::StringToInt(command_line->GetSwitchValueASCII(int_switch.switch_name),
+          int_switch.value) || *int_switch.value < int_switch.min_value)) {
+      ::printf("invalid --%s\n", int_switch.switch_name);
+      return false;
+    }
+  }
+  if (command_line->HasSwitch(kCorpusTypeMix)) {
+    std::vector<std::string> weights = base::SplitString(
+      command_line->GetSwitchValueASCII(kCorpusTypeMix), ",",
+      base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+    int weight_sum = 0;
+    bool valid = weights.size() == arraysize(shape->type_weights);
+    for (size_t index = 0; valid && index < weights.size(); index++) {
+      valid = base::StringToInt(weights[index], &shape->type_weights[index]) &&
+        shape->type_weights[index] >= 0;
+      weight_sum += shape->type_weights[index];
+    }
+    if (!valid || weight_sum <= 0) {
+      ::printf("invalid --%s\n", kCorpusTypeMix);
+      return false;
+    }
+  }
+  if (command_line->HasSwitch(kCorpusSeed)) {
+    unsigned seed = 0;
+    if (!base::StringToUint(command_line->GetSwitchValueASCII(kCorpusSeed), &seed)) {
+      ::printf("invalid --%s\n", kCorpusSeed);
+      return false;
+    }
+    shape->seed = seed;
+  }
+  return true;
+}
+
+int RunChild(const base::CommandLine* command_line) {
+  std::unique_ptr<self::ConvertJsonToProtobuf> convert_json_to_protobuf =
+    self::ConvertJsonToProtobuf::New();
+  std::string error_message;
+  base::TimeTicks start = base::TimeTicks::Now();
+  bool result = convert_json_to_protobuf->Convert(command_line, error_message);
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  if (!result) {
+    ::printf("error=%s\n", error_message.c_str());
+    return -1;
+  }
+  ::printf("elapsed_ms=%.3f\npeak_rss=%lld\n",
+    elapsed.InMillisecondsF(),
+    static_cast<long long>(GetPeakResidentSetBytes()));
+  return 0;
+}
+
+bool RunChildCommand(
+  base::CommandLine child_command_line,
+  double* elapsed_ms,
+  int64_t* peak_rss) {
+  child_command_line.AppendSwitch(kBenchmarkChild);
+  std::string output;
+  if (!base::GetAppOutput(child_command_line, &output)) {
+    ::printf("child process fail: %s\n", output.c_str());
+    return false;
+  }
+  std::map<std::string, std::string> values = ParseChildOutput(output);
+  if (!base::StringToDouble(values["elapsed_ms"], elapsed_ms) ||
+      !base::StringToInt64(values["peak_rss"], peak_rss) ||
+      *elapsed_ms <= 0.0) {
+    ::printf("child process fail: %s\n", output.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool RunChildConversion(
+  const base::CommandLine* command_line,
+  const base::FilePath& input_file_path,
+  const std::vector<const char*>& switches,
+  double* elapsed_ms,
+  int64_t* peak_rss) {
+  base::CommandLine child_command_line(command_line->GetProgram());
+  child_command_line.AppendSwitchPath(convert_switches::kInputFilePath, input_file_path);
+  child_command_line.AppendSwitchPath(convert_switches::kOutputFilePath,
+    input_file_path.AddExtension(FILE_PATH_LITERAL("pb")));
+  for (const char* switch_name : switches) {
+    child_command_line.AppendSwitch(switch_name);
+  }
+  return RunChildCommand(child_command_line, elapsed_ms, peak_rss);
+}
+
+namespace {
+
+int RunMain(int argc, char* argv[]) {
+  base::CommandLine::Init(argc, argv);
+  const base::CommandLine* command_line = base::CommandLine::ForCurrentProcess();
+  if (command_line->HasSwitch(kBenchmarkChild)) {
+    return RunChild(command_line);
+  }
+  if (command_line->HasSwitch(kPhasesChild)) {
+    return RunPhasesChild(command_line);
+  }
+
+  base::FilePath temp_dir;
+  if (!base::CreateNewTempDirectory(FILE_PATH_LITERAL("json_to_proto"), &temp_dir)) {
+    ::printf("create temp directory fail\n");
+    return -1;
+  }
+  const std::string benchmark = command_line->GetSwitchValueASCII(kBenchmark);
+  bool result = true;
+  if (benchmark.empty() || benchmark == "parser") {
+    result = RunParserBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "record-stream") {
+    result = RunRecordStreamBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "array-schema") {
+    result = RunArraySchemaBenchmark(command_line) && result;
+  }
+  if (benchmark.empty() || benchmark == "batch") {
+    result = RunBatchBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "field-binding") {
+    result = RunFieldBindingBenchmark(command_line) && result;
+  }
+  if (benchmark.empty() || benchmark == "arena") {
+    result = RunArenaBenchmark(command_line) && result;
+  }
+  if (benchmark.empty() || benchmark == "reverse") {
+    result = RunReverseBenchmark(command_line) && result;
+  }
+  if (benchmark.empty() || benchmark == "phases") {
+    result = RunPhasesBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "compact") {
+    result = RunCompactBenchmark(command_line) && result;
+  }
+  if (benchmark.empty() || benchmark == "simd") {
+    result = RunSimdBenchmark(command_line) && result;
+  }
+  if (benchmark.empty() || benchmark == "incremental") {
+    result = RunIncrementalBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "container") {
+    result = RunContainerBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "server") {
+    result = RunServerBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "compress") {
+    result = RunCompressBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "parallel") {
+    result = RunParallelBenchmark(command_line, temp_dir) && result;
+  }
+  if (benchmark.empty() || benchmark == "pipeline") {
+    result = RunPipelineBenchmark(command_line, temp_dir) && result;
+  }
+  return result ? 0 : -1;
+}
+
+} // namespace
+
+} // namespace json_to_proto_benchmark
+
+int main(int argc, char* argv[]) {
+  return json_to_proto_benchmark::RunMain(argc, argv);
+}
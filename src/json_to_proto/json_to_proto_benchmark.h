@@ -0,0 +1,173 @@
+#ifndef JSON_TO_PROTO_BENCHMARK_H_
+#define JSON_TO_PROTO_BENCHMARK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "allocation_hooks.h"
+#include "base/macros.h"
+#include "base/time/time.h"
+#include "json_unified_schema_builder.h"
+
+namespace base {
+class CommandLine;
+class FilePath;
+}
+
+namespace self {
+struct CorpusShape;
+}
+
+// What the json_to_proto_benchmark_*.cc files share. Every benchmark area has
+// a file of its own; the switches and constants only one area reads stay in
+// that file. Output equality is checked by json_to_proto_unittests, the
+// benchmarks only time.
+namespace json_to_proto_benchmark {
+
+// Runs one conversion in this process and prints its numbers, the parent
+// starts one child per parser so every peak RSS is measured on its own.
+extern const char kBenchmarkChild[];
+// Runs the phases of one conversion in this process and prints a row per
+// phase, started once per schema mode like kBenchmarkChild.
+extern const char kPhasesChild[];
+// Records in the generated record stream, also of the container benchmark.
+extern const char kRecordCount[];
+// Levels of permission groups of the generated corpus, see ParseCorpusShape().
+extern const char kCorpusDepth[];
+// Also keeps the generated corpus at this path.
+extern const char kCorpusOutput[];
+
+const int kDefaultStreamRecordCount = 100000;
+const size_t kDefaultMaxEnumCardinality =
+  self::JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality;
+// 每种写法跑几次取最快的一次, 排除第一次的缺页和 plan 编译
+const int kMeasureRepeatCount = 5;
+
+int64_t GetPeakResidentSetBytes();
+
+// Generates records shaped like one superman.json step, sized by the length
+// of their integer arrays and strings.
+bool GenerateInput(const base::FilePath& file_path, int64_t target_size);
+
+// The shape of the generated corpus, the defaults changed by the corpus
+// switches.
+bool ParseCorpusShape(const base::CommandLine* command_line, self::CorpusShape* shape);
+
+// The kBenchmarkChild side: converts with |command_line| and prints the
+// numbers RunChildCommand() reads back.
+int RunChild(const base::CommandLine* command_line);
+
+// Runs |child_command_line| with --benchmark-child added and reads back the
+// numbers printed by RunChild().
+bool RunChildCommand(
+  base::CommandLine child_command_line,
+  double* elapsed_ms,
+  int64_t* peak_rss);
+
+// Converts |input_file_path| in a child process started with |switches|.
+bool RunChildConversion(
+  const base::CommandLine* command_line,
+  const base::FilePath& input_file_path,
+  const std::vector<const char*>& switches,
+  double* elapsed_ms,
+  int64_t* peak_rss);
+
+// Fastest of kMeasureRepeatCount runs of |run|, zero when a run fails.
+template <typename Run>
+base::TimeDelta MeasureFastest(const Run& run) {
+  base::TimeDelta fastest;
+  for (int repeat = 0; repeat < kMeasureRepeatCount; repeat++) {
+    base::TimeTicks start = base::TimeTicks::Now();
+    if (!run()) {
+      return base::TimeDelta();
+    }
+    base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+    if (repeat == 0 || elapsed < fastest) {
+      fastest = elapsed;
+    }
+  }
+  return fastest;
+}
+
+struct AllocationStats {
+  int64_t allocation_count;
+  int64_t free_count;
+  base::TimeDelta allocation_time;
+  base::TimeDelta elapsed;
+};
+
+// Counts through AllocationHooks, a dispatch of base's allocator shim, so
+// the other benchmarks pay nothing. Timing every malloc slows the phase being
+// measured down, counting alone does not much.
+class AllocationCounter {
+public:
+  explicit AllocationCounter(bool time_allocations = true) {
+    self::AllocationHooks::Reset();
+    start_ = base::TimeTicks::Now();
+    self::AllocationHooks::Enable(time_allocations);
+  }
+
+  AllocationStats Stop() {
+    self::AllocationHooks::Disable();
+    return {self::AllocationHooks::allocation_count(), self::AllocationHooks::free_count(),
+      self::AllocationHooks::allocation_time(), base::TimeTicks::Now() - start_};
+  }
+
+private:
+  base::TimeTicks start_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(AllocationCounter);
+};
+
+// json_to_proto_benchmark_parser.cc
+bool RunParserBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+bool RunRecordStreamBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+bool RunSimdBenchmark(const base::CommandLine* command_line);
+
+// json_to_proto_benchmark_schema.cc
+bool RunArraySchemaBenchmark(const base::CommandLine* command_line);
+bool RunFieldBindingBenchmark(const base::CommandLine* command_line);
+bool RunArenaBenchmark(const base::CommandLine* command_line);
+bool RunPhasesBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+int RunPhasesChild(const base::CommandLine* command_line);
+bool RunCompactBenchmark(const base::CommandLine* command_line);
+
+// json_to_proto_benchmark_output.cc
+bool RunReverseBenchmark(const base::CommandLine* command_line);
+bool RunIncrementalBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+bool RunContainerBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+bool RunCompressBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+
+// json_to_proto_benchmark_batch.cc
+bool RunBatchBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+bool RunParallelBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+bool RunPipelineBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+
+// json_to_proto_benchmark_server.cc
+bool RunServerBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir);
+
+} // namespace json_to_proto_benchmark
+#endif // JSON_TO_PROTO_BENCHMARK_H_
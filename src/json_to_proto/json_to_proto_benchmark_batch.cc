@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/time/time.h"
+#include "convert_switches.h"
+#include "coroutine_pipeline.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_to_proto_benchmark.h"
+#include "json_to_protobuf_serializer.h"
+#include "parallel_document_converter.h"
+
+namespace json_to_proto_benchmark {
+
+namespace {
+
+// Files in the generated batch input directory.
+const char kBatchFileCount[] = "batch-file-count";
+// Size of the generated single document of the parallel benchmark in MB.
+const char kParallelSize[] = "parallel-size-mb";
+// Size of the generated file set of the pipeline benchmark in MB. Larger than
+// the memory of the machine for the case the page cache can not hold.
+const char kPipelineSize[] = "pipeline-size-mb";
+const int kDefaultBatchFileCount = 2000;
+// 每个文件的数组长度在这几个里面轮换, 同形状的文件可以复用 schema
+const int kBatchArrayLengths[] = {5, 10, 20, 40};
+const int kDefaultParallelSizeMb = 64;
+const int kDefaultPipelineSizeMb = 512;
+const int kPipelineFileSizeMb = 8;
+
+} // namespace
+
+// Converts one directory of small files with 1, 2, 4 ... jobs up to the
+// number of processors, each run in its own process.
+bool RunBatchBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  int file_count = kDefaultBatchFileCount;
+  if (command_line->HasSwitch(kBatchFileCount) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kBatchFileCount), &file_count) ||
+       file_count <= 0)) {
+    ::printf("invalid --%s\n", kBatchFileCount);
+    return false;
+  }
+  base::FilePath input_dir = temp_dir.AppendASCII("batch_input");
+  if (!base::CreateDirectory(input_dir)) {
+    ::printf("create batch input directory fail\n");
+    return false;
+  }
+  int64_t input_size = 0;
+  for (int index = 0; index < file_count; index++) {
+    const std::string json = self::GenerateWideArray(
+      kBatchArrayLengths[index % arraysize(kBatchArrayLengths)]);
+    base::FilePath file_path = input_dir.AppendASCII(
+      base::StringPrintf("%06d.json", index));
+    if (base::WriteFile(file_path, json.data(), static_cast<int>(json.size())) !=
+        static_cast<int>(json.size())) {
+      ::printf("generate batch input fail\n");
+      return false;
+    }
+    input_size += json.size();
+  }
+  ::printf("batch input: %d files (%.1f MB)\n", file_count, input_size / (1024.0 * 1024.0));
+
+  const int processor_count = base::SysInfo::NumberOfProcessors();
+  std::vector<int> job_counts;
+  for (int jobs = 1; jobs < processor_count; jobs *= 2) {
+    job_counts.push_back(jobs);
+  }
+  job_counts.push_back(processor_count);
+
+  double single_job_ms = 0.0;
+  for (int jobs : job_counts) {
+    base::CommandLine child_command_line(command_line->GetProgram());
+    child_command_line.AppendSwitchPath(convert_switches::kInputDir, input_dir);
+    child_command_line.AppendSwitchPath(convert_switches::kOutputDir,
+      temp_dir.AppendASCII("batch_output_" + base::IntToString(jobs)));
+    child_command_line.AppendSwitchASCII(convert_switches::kJobs, base::IntToString(jobs));
+    double elapsed_ms = 0.0;
+    int64_t peak_rss = 0;
+    if (!RunChildCommand(child_command_line, &elapsed_ms, &peak_rss)) {
+      ::printf("%3d jobs fail\n", jobs);
+      return false;
+    }
+    if (jobs == 1) {
+      single_job_ms = elapsed_ms;
+    }
+    ::printf("%3d jobs %10.1f ms %10.0f files/s %10.1f MB/s %6.2fx %10.1f MB peak rss\n",
+      jobs,
+      elapsed_ms,
+      file_count / (elapsed_ms / 1000.0),
+      input_size / (1024.0 * 1024.0) / (elapsed_ms / 1000.0),
+      single_job_ms / elapsed_ms,
+      peak_rss / (1024.0 * 1024.0));
+  }
+  return true;
+}
+
+// --parallel-subtrees on one large document with 1, 2, 4... workers up to the
+// number of processors. Parsing and schema inference stay on one thread, so
+// the fill column is the part that scales; the total is against a sequential
+// unified conversion.
+bool RunParallelBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  int parallel_size_mb = kDefaultParallelSizeMb;
+  if (command_line->HasSwitch(kParallelSize) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kParallelSize), &parallel_size_mb) ||
+       parallel_size_mb <= 0)) {
+    ::printf("invalid --%s\n", kParallelSize);
+    return false;
+  }
+  const std::string json =
+    self::GenerateParallelDocument(static_cast<int64_t>(parallel_size_mb) << 20);
+  const base::FilePath sequential_output_path = temp_dir.AppendASCII("parallel_sequential.pb");
+  const base::FilePath output_path = temp_dir.AppendASCII("parallel.pb");
+  const int processor_count = base::SysInfo::NumberOfProcessors();
+  ::printf("parallel input: %.1f MB, %d processors\n",
+    json.size() / (1024.0 * 1024.0), processor_count);
+
+  std::string error_message;
+  const base::TimeDelta sequential_elapsed = MeasureFastest([&]() {
+    self::JsonStringInputStream input_stream(json);
+    self::JsonToProtobufSerializer json_to_protobuf_serializer(sequential_output_path);
+    json_to_protobuf_serializer.set_schema_mode(self::SchemaMode::kUnified);
+    return json_to_protobuf_serializer.SerializeFromStream(&input_stream, error_message);
+  });
+  if (sequential_elapsed.is_zero()) {
+    ::printf("parallel sequential conversion fail: %s\n", error_message.c_str());
+    return false;
+  }
+  ::printf("%-10s %10.1f ms\n", "sequential", sequential_elapsed.InMillisecondsF());
+
+  std::vector<int> job_counts;
+  for (int jobs = 1; jobs < processor_count; jobs *= 2) {
+    job_counts.push_back(jobs);
+  }
+  job_counts.push_back(processor_count);
+
+  base::TimeDelta single_job_fill;
+  for (int jobs : job_counts) {
+    self::ParallelDocumentConverter parallel_converter(self::SchemaMode::kUnified, jobs);
+    base::TimeDelta fill_time;
+    const base::TimeDelta elapsed = MeasureFastest([&]() {
+      self::JsonStringInputStream input_stream(json);
+      if (!parallel_converter.Convert(&input_stream, output_path, error_message)) {
+        return false;
+      }
+      if (fill_time.is_zero() || parallel_converter.fill_time() < fill_time) {
+        fill_time = parallel_converter.fill_time();
+      }
+      return true;
+    });
+    if (elapsed.is_zero()) {
+      ::printf("%3d jobs fail: %s\n", jobs, error_message.c_str());
+      return false;
+    }
+    if (jobs == 1) {
+      single_job_fill = fill_time;
+    }
+    ::printf("%3d jobs %10.1f ms %6.2fx %10.1f ms fill %6.2fx %4llu tasks %4lld steals\n",
+      jobs, elapsed.InMillisecondsF(),
+      sequential_elapsed.InMillisecondsF() / elapsed.InMillisecondsF(),
+      fill_time.InMillisecondsF(),
+      single_job_fill.InMillisecondsF() / fill_time.InMillisecondsF(),
+      static_cast<unsigned long long>(parallel_converter.task_count()),
+      static_cast<long long>(parallel_converter.steal_count()));
+  }
+  return true;
+}
+
+// Converts one generated file set in batch mode, one file per worker at a
+// time, and on the coroutine pipeline, both in child processes.
+bool RunPipelineBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  if (!self::CoroutinePipeline::IsSupported()) {
+    ::printf("pipeline: built without coroutine support, skipped\n");
+    return true;
+  }
+  int pipeline_size_mb = kDefaultPipelineSizeMb;
+  if (command_line->HasSwitch(kPipelineSize) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kPipelineSize), &pipeline_size_mb) ||
+       pipeline_size_mb <= 0)) {
+    ::printf("invalid --%s\n", kPipelineSize);
+    return false;
+  }
+  base::FilePath input_dir = temp_dir.AppendASCII("pipeline_input");
+  if (!base::CreateDirectory(input_dir)) {
+    ::printf("create pipeline input directory fail\n");
+    return false;
+  }
+  const int file_count = std::max(pipeline_size_mb / kPipelineFileSizeMb, 1);
+  int64_t input_size = 0;
+  for (int index = 0; index < file_count; index++) {
+    base::FilePath file_path = input_dir.AppendASCII(base::StringPrintf("%06d.json", index));
+    int64_t file_size = 0;
+    if (!GenerateInput(file_path, static_cast<int64_t>(kPipelineFileSizeMb) << 20) ||
+        !base::GetFileSize(file_path, &file_size)) {
+      ::printf("generate pipeline input fail\n");
+      return false;
+    }
+    input_size += file_size;
+  }
+  const int processor_count = base::SysInfo::NumberOfProcessors();
+  ::printf("pipeline input: %d files (%.1f MB), %d jobs\n",
+    file_count, input_size / (1024.0 * 1024.0), processor_count);
+
+  const char* const modes[] = {"batch", "pipeline"};
+  for (const char* mode : modes) {
+    base::CommandLine child_command_line(command_line->GetProgram());
+    child_command_line.AppendSwitchPath(convert_switches::kInputDir, input_dir);
+    child_command_line.AppendSwitchPath(convert_switches::kOutputDir,
+      temp_dir.AppendASCII(std::string("pipeline_output_") + mode));
+    child_command_line.AppendSwitchASCII(convert_switches::kJobs,
+      base::IntToString(processor_count));
+    child_command_line.AppendSwitch(convert_switches::kUnifyArraySchema);
+    if (mode == modes[1]) {
+      child_command_line.AppendSwitch(convert_switches::kCoroutinePipeline);
+    }
+    double elapsed_ms = 0.0;
+    int64_t peak_rss = 0;
+    if (!RunChildCommand(child_command_line, &elapsed_ms, &peak_rss)) {
+      ::printf("%-10s fail\n", mode);
+      return false;
+    }
+    ::printf("%-10s %10.1f ms %10.1f MB/s %10.1f MB peak rss\n",
+      mode,
+      elapsed_ms,
+      input_size / (1024.0 * 1024.0) / (elapsed_ms / 1000.0),
+      peak_rss / (1024.0 * 1024.0));
+  }
+  return true;
+}
+
+} // namespace json_to_proto_benchmark
@@ -0,0 +1,606 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "build_proto_from_json.h"
+#include "convert_switches.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/util/json_util.h"
+#include "incremental_converter.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_to_proto_benchmark.h"
+#include "json_to_protobuf_serializer.h"
+#include "json_unified_schema_builder.h"
+#include "protobuf_file_output_stream.h"
+#include "protobuf_json_writer.h"
+#include "record_container.h"
+#include "record_stream_converter.h"
+
+namespace json_to_proto_benchmark {
+
+namespace {
+
+// Records in the wide array converted back to json by the reverse benchmark.
+const char kReverseArrayLength[] = "reverse-array-length";
+// Permissions edited between runs in the incremental benchmark, runs a few
+// counts when absent.
+const char kIncrementalEdits[] = "incremental-edits";
+// Size of the generated input of the compress benchmark in MB.
+const char kCompressSize[] = "compress-size-mb";
+const int kDefaultReverseArrayLength = 20000;
+const int kDefaultIncrementalEdits[] = {1, 10, 100};
+// 3 层每层 8 个 key 是 512 个 permission, 大约 2 MB
+const int kDefaultIncrementalCorpusDepth = 3;
+const int kContainerLookupCount = 1000;
+// 过滤的 version 区间覆盖这么多分之一的记录
+const int kContainerFilterFraction = 100;
+const int kDefaultCompressSizeMb = 64;
+const int kCompressionLevels[] = {1, 6, 9};
+const int kCompressChunkKbs[] = {64, 4096};
+
+void PrintReverse(const char* name, base::TimeDelta elapsed, size_t json_size) {
+  if (elapsed.is_zero()) {
+    ::printf("%-18s fail\n", name);
+    return;
+  }
+  ::printf("%-18s %10.2f ms %10.1f MB/s json %10.1f KB\n",
+    name, elapsed.InMillisecondsF(),
+    json_size / (1024.0 * 1024.0) / elapsed.InSecondsF(), json_size / 1024.0);
+}
+
+bool RunIncremental(
+  const std::string& json,
+  const base::FilePath& output_file_path,
+  self::IncrementalConverter* incremental_converter,
+  base::TimeDelta* elapsed) {
+  self::JsonStringInputStream input_stream(json);
+  std::string error_message;
+  base::TimeTicks start = base::TimeTicks::Now();
+  if (!incremental_converter->Convert(&input_stream, output_file_path, error_message)) {
+    ::printf("incremental fail: %s\n", error_message.c_str());
+    return false;
+  }
+  *elapsed = base::TimeTicks::Now() - start;
+  return true;
+}
+
+void PrintIncremental(
+  const std::string& name,
+  base::TimeDelta full_elapsed,
+  base::TimeDelta incremental_elapsed,
+  const self::IncrementalConverter& incremental_converter) {
+  const int64_t output_bytes =
+    incremental_converter.reused_bytes() + incremental_converter.encoded_bytes();
+  ::printf("%-10s %10.2f ms full %10.2f ms incremental %6.2fx %6.1f%% encoded\n",
+    name.c_str(), full_elapsed.InMillisecondsF(), incremental_elapsed.InMillisecondsF(),
+    full_elapsed.InMillisecondsF() / incremental_elapsed.InMillisecondsF(),
+    output_bytes > 0 ? incremental_converter.encoded_bytes() * 100.0 / output_bytes : 0.0);
+}
+
+// The record of a container benchmark field, by json key.
+const google::protobuf::FieldDescriptor* FindJsonField(
+  const google::protobuf::Descriptor* desc,
+  const std::string& json_name) {
+  for (int index = 0; index < desc->field_count(); index++) {
+    if (desc->field(index)->json_name() == json_name) {
+      return desc->field(index);
+    }
+  }
+  return nullptr;
+}
+
+// The next record of plain length delimited output.
+bool NextPlainRecord(const char** data, const char* end, base::StringPiece* record) {
+  uint32_t record_size = 0;
+  for (int shift = 0; ; shift += 7) {
+    if (*data == end || shift > 28) {
+      return false;
+    }
+    const uint8_t byte = static_cast<uint8_t>(*(*data)++);
+    record_size |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+  }
+  if (record_size > static_cast<size_t>(end - *data)) {
+    return false;
+  }
+  *record = base::StringPiece(*data, record_size);
+  *data += record_size;
+  return true;
+}
+
+bool ConvertRecordFile(
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  const self::RecordContainerOptions* container_options,
+  base::TimeDelta* elapsed) {
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::string error_message;
+  self::JsonFileInputStream input_stream;
+  self::RecordStreamConverter record_stream_converter(
+    self::SchemaMode::kUnified, self::JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality);
+  record_stream_converter.set_container_options(container_options);
+  if (!input_stream.Open(input_file_path, error_message) ||
+      !record_stream_converter.Convert(&input_stream, output_file_path, error_message)) {
+    ::printf("container conversion fail: %s\n", error_message.c_str());
+    return false;
+  }
+  *elapsed = base::TimeTicks::Now() - start;
+  return true;
+}
+
+// Converts |input_file_path| in a child process with |switches| and prints
+// the wall time and output size. An empty switch value appends the switch
+// alone.
+bool RunCompressChild(
+  const base::CommandLine* command_line,
+  const char* name,
+  const base::FilePath& input_file_path,
+  const base::FilePath& output_file_path,
+  const std::vector<std::pair<const char*, std::string>>& switches,
+  int64_t plain_size,
+  double* elapsed_ms) {
+  base::CommandLine child_command_line(command_line->GetProgram());
+  child_command_line.AppendSwitchPath(convert_switches::kInputFilePath, input_file_path);
+  child_command_line.AppendSwitchPath(convert_switches::kOutputFilePath, output_file_path);
+  for (const std::pair<const char*, std::string>& child_switch : switches) {
+    if (child_switch.second.empty()) {
+      child_command_line.AppendSwitch(child_switch.first);
+    } else {
+      child_command_line.AppendSwitchASCII(child_switch.first, child_switch.second);
+    }
+  }
+  int64_t peak_rss = 0;
+  int64_t output_size = 0;
+  if (!RunChildCommand(child_command_line, elapsed_ms, &peak_rss) ||
+      !base::GetFileSize(output_file_path, &output_size) || output_size <= 0) {
+    ::printf("%-12s fail\n", name);
+    return false;
+  }
+  ::printf("%-12s %10.1f ms %10.1f MB output %6.2fx smaller\n",
+    name, *elapsed_ms, output_size / (1024.0 * 1024.0),
+    plain_size > 0 ? static_cast<double>(plain_size) / output_size : 1.0);
+  return true;
+}
+
+} // namespace
+
+// Turns the protobuf encoding of a wide array back into json with the writer
+// plans, and with protobuf's reflection based printer on a parsed message.
+bool RunReverseBenchmark(const base::CommandLine* command_line) {
+  int array_length = kDefaultReverseArrayLength;
+  if (command_line->HasSwitch(kReverseArrayLength) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kReverseArrayLength),
+        &array_length) || array_length <= 0)) {
+    ::printf("invalid --%s\n", kReverseArrayLength);
+    return false;
+  }
+  const std::string json = self::GenerateWideArray(array_length);
+  // 每个元素一个类型时数组大了 field number 会超限, 用统一的 schema
+  self::JsonStringInputStream input_stream(json);
+  std::string error_message;
+  self::BuildProtoFromJson build_proto_from_json;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(
+      &input_stream, self::SchemaMode::kUnified, error_message);
+  if (!file_desc_proto) {
+    ::printf("reverse infer fail: %s\n", error_message.c_str());
+    return false;
+  }
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(*file_desc_proto);
+  if (!file_desc) {
+    ::printf("reverse build fail\n");
+    return false;
+  }
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  std::unique_ptr<google::protobuf::Message> root_message(
+    dynamic_message_factory.GetPrototype(root_desc)->New());
+  std::unique_ptr<self::JsonMessageBuilder> message_builder =
+    self::JsonToProtobufSerializer::CreateMessageBuilder(
+      self::SchemaMode::kUnified, root_message.get(), &dynamic_message_factory);
+  input_stream.Rewind();
+  self::JsonSaxReader json_reader(&input_stream);
+  if (!json_reader.Parse(message_builder.get(), error_message)) {
+    ::printf("reverse fill fail: %s\n", error_message.c_str());
+    return false;
+  }
+  const std::string encoded = root_message->SerializeAsString();
+  ::printf("reverse: %d records, %.1f KB json, %.1f KB protobuf\n",
+    array_length, json.size() / 1024.0, encoded.size() / 1024.0);
+
+  self::ProtobufJsonWriter protobuf_json_writer;
+  base::TimeDelta writer_elapsed = MeasureFastest([&]() {
+    protobuf_json_writer.buffer()->clear();
+    return protobuf_json_writer.WriteMessage(
+      root_desc, encoded.data(), encoded.size(), error_message);
+  });
+  PrintReverse("writer-plan", writer_elapsed, protobuf_json_writer.buffer()->size());
+
+  std::string reflection_json;
+  base::TimeDelta reflection_elapsed = MeasureFastest([&]() {
+    reflection_json.clear();
+    return google::protobuf::util::MessageToJsonString(*root_message, &reflection_json).ok();
+  });
+  PrintReverse("reflection", reflection_elapsed, reflection_json.size());
+
+  // 真实的读路径手里只有编码, 反射要先解析成 message
+  std::unique_ptr<google::protobuf::Message> parsed_message(
+    dynamic_message_factory.GetPrototype(root_desc)->New());
+  base::TimeDelta parse_reflection_elapsed = MeasureFastest([&]() {
+    reflection_json.clear();
+    return parsed_message->ParseFromString(encoded) &&
+      google::protobuf::util::MessageToJsonString(*parsed_message, &reflection_json).ok();
+  });
+  PrintReverse("parse+reflection", parse_reflection_elapsed, reflection_json.size());
+  return !writer_elapsed.is_zero() && !reflection_elapsed.is_zero() &&
+    !parse_reflection_elapsed.is_zero();
+}
+
+// --incremental on a corpus from the phase benchmark's generator, three levels
+// deep by default: the first run without a sidecar, a run on the same input,
+// and runs after editing a few permissions, each from the first run's
+// sidecar. "full" is a conversion without a sidecar of the same input.
+bool RunIncrementalBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  std::vector<int> edit_counts(
+    std::begin(kDefaultIncrementalEdits), std::end(kDefaultIncrementalEdits));
+  if (command_line->HasSwitch(kIncrementalEdits)) {
+    int edit_count = 0;
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kIncrementalEdits), &edit_count) ||
+        edit_count <= 0) {
+      ::printf("invalid --%s\n", kIncrementalEdits);
+      return false;
+    }
+    edit_counts.assign(1, edit_count);
+  }
+  self::CorpusShape shape;
+  if (!ParseCorpusShape(command_line, &shape)) {
+    return false;
+  }
+  if (!command_line->HasSwitch(kCorpusDepth)) {
+    shape.depth = kDefaultIncrementalCorpusDepth;
+  }
+  const std::string corpus = self::CorpusGenerator(shape).Generate();
+  const base::FilePath full_output_path = temp_dir.AppendASCII("incremental_full.pb");
+  const base::FilePath output_path = temp_dir.AppendASCII("incremental.pb");
+  const base::FilePath sidecar_path = self::IncrementalConverter::SidecarPath(output_path);
+
+  std::string error_message;
+  auto measure_full = [&](const std::string& json) {
+    return MeasureFastest([&]() {
+      self::JsonStringInputStream input_stream(json);
+      self::JsonToProtobufSerializer json_to_protobuf_serializer(full_output_path);
+      json_to_protobuf_serializer.set_schema_mode(self::SchemaMode::kUnified);
+      return json_to_protobuf_serializer.SerializeFromStream(&input_stream, error_message);
+    });
+  };
+
+  const base::TimeDelta full_elapsed = measure_full(corpus);
+  if (full_elapsed.is_zero()) {
+    ::printf("incremental full conversion fail: %s\n", error_message.c_str());
+    return false;
+  }
+  self::IncrementalConverter incremental_converter(self::SchemaMode::kUnified);
+  base::TimeDelta cold_elapsed;
+  base::DeleteFile(sidecar_path, false);
+  if (!RunIncremental(corpus, output_path, &incremental_converter, &cold_elapsed)) {
+    return false;
+  }
+  std::string sidecar;
+  if (!base::ReadFileToString(sidecar_path, &sidecar)) {
+    ::printf("read incremental sidecar fail\n");
+    return false;
+  }
+  ::printf("incremental: corpus depth %d, width %d (%.1f KB json, %.1f KB sidecar, "
+    "%lld subtrees)\n",
+    shape.depth, shape.width, corpus.size() / 1024.0, sidecar.size() / 1024.0,
+    static_cast<long long>(incremental_converter.subtree_count()));
+  PrintIncremental("cold", full_elapsed, cold_elapsed, incremental_converter);
+
+  base::TimeDelta unchanged_elapsed;
+  for (int repeat = 0; repeat < kMeasureRepeatCount; repeat++) {
+    base::TimeDelta elapsed;
+    if (!RunIncremental(corpus, output_path, &incremental_converter, &elapsed)) {
+      return false;
+    }
+    if (repeat == 0 || elapsed < unchanged_elapsed) {
+      unchanged_elapsed = elapsed;
+    }
+  }
+  PrintIncremental("unchanged", full_elapsed, unchanged_elapsed, incremental_converter);
+
+  for (int edit_count : edit_counts) {
+    const std::string edited = self::EditCorpus(corpus, edit_count);
+    const base::TimeDelta edited_full_elapsed = measure_full(edited);
+    if (edited_full_elapsed.is_zero()) {
+      ::printf("incremental full conversion fail: %s\n", error_message.c_str());
+      return false;
+    }
+    // 每次都从第一次的旁路文件开始, 否则第二次起整个文档都命中
+    base::TimeDelta edited_elapsed;
+    for (int repeat = 0; repeat < kMeasureRepeatCount; repeat++) {
+      base::TimeDelta elapsed;
+      if (base::WriteFile(sidecar_path, sidecar.data(), static_cast<int>(sidecar.size())) !=
+          static_cast<int>(sidecar.size()) ||
+          !RunIncremental(edited, output_path, &incremental_converter, &elapsed)) {
+        ::printf("incremental %d edits fail\n", edit_count);
+        return false;
+      }
+      if (repeat == 0 || elapsed < edited_elapsed) {
+        edited_elapsed = elapsed;
+      }
+    }
+    PrintIncremental(base::StringPrintf("%d edits", edit_count), edited_full_elapsed,
+      edited_elapsed, incremental_converter);
+  }
+  return true;
+}
+
+// The record stream converted to plain length delimited records and to a
+// record container with stats on "version". Fetches kContainerLookupCount
+// records spread over the file, which without an index means skipping every
+// record in front, and keeps the records whose version falls in a range
+// covering 1/kContainerFilterFraction of them, which without stats means
+// decoding all of them.
+bool RunContainerBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  int record_count = kDefaultStreamRecordCount;
+  if (command_line->HasSwitch(kRecordCount) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kRecordCount), &record_count) ||
+       record_count <= 0)) {
+    ::printf("invalid --%s\n", kRecordCount);
+    return false;
+  }
+  const base::FilePath stream_file_path = temp_dir.AppendASCII("container_records.ndjson");
+  const base::FilePath plain_file_path = temp_dir.AppendASCII("container_records.pb");
+  const base::FilePath container_file_path = temp_dir.AppendASCII("container_records.jprc");
+  if (!self::GenerateRecordStream(stream_file_path, record_count)) {
+    ::printf("generate record stream fail\n");
+    return false;
+  }
+  self::RecordContainerOptions container_options;
+  container_options.stat_fields.push_back("version");
+  container_options.stat_fields.push_back("type_id");
+  base::TimeDelta plain_elapsed;
+  base::TimeDelta container_elapsed;
+  std::string plain_data;
+  int64_t container_size = 0;
+  if (!ConvertRecordFile(stream_file_path, plain_file_path, nullptr, &plain_elapsed) ||
+      !ConvertRecordFile(stream_file_path, container_file_path, &container_options,
+        &container_elapsed) ||
+      !base::ReadFileToString(plain_file_path, &plain_data) ||
+      !base::GetFileSize(container_file_path, &container_size)) {
+    return false;
+  }
+
+  std::string error_message;
+  self::RecordContainerReader container_reader;
+  base::TimeTicks open_start = base::TimeTicks::Now();
+  if (!container_reader.Open(container_file_path, error_message)) {
+    ::printf("open container fail: %s\n", error_message.c_str());
+    return false;
+  }
+  const base::TimeDelta open_elapsed = base::TimeTicks::Now() - open_start;
+  const google::protobuf::FieldDescriptor* version_field =
+    FindJsonField(container_reader.record_desc(), "version");
+  if (!version_field || container_reader.record_count() != record_count) {
+    ::printf("unexpected container records\n");
+    return false;
+  }
+  ::printf("container: %d records, %zu blocks of %zu KB, %.1f MB (plain %.1f MB, %+.2f%%)\n",
+    record_count, container_reader.block_count(), container_options.block_size >> 10,
+    container_size / (1024.0 * 1024.0), plain_data.size() / (1024.0 * 1024.0),
+    (container_size - static_cast<double>(plain_data.size())) * 100.0 / plain_data.size());
+  ::printf("%-8s %10.2f ms plain %10.2f ms container\n", "write",
+    plain_elapsed.InMillisecondsF(), container_elapsed.InMillisecondsF());
+  ::printf("%-8s %10.2f ms footer and schema\n", "open", open_elapsed.InMillisecondsF());
+
+  std::unique_ptr<google::protobuf::Message> record = container_reader.NewRecord();
+  std::vector<int64_t> lookups;
+  for (int index = 0; index < kContainerLookupCount; index++) {
+    lookups.push_back(static_cast<int64_t>(index * 2654435761ULL % record_count));
+  }
+  // 没有索引时只能从头跳过前面每一条记录的长度
+  const base::TimeDelta plain_lookup_elapsed = MeasureFastest([&]() {
+    for (int64_t lookup : lookups) {
+      const char* data = plain_data.data();
+      const char* end = data + plain_data.size();
+      base::StringPiece record_data;
+      for (int64_t index = 0; index <= lookup; index++) {
+        if (!NextPlainRecord(&data, end, &record_data)) {
+          return false;
+        }
+      }
+      if (!record->ParseFromArray(record_data.data(), static_cast<int>(record_data.size()))) {
+        return false;
+      }
+    }
+    return true;
+  });
+  const base::TimeDelta container_lookup_elapsed = MeasureFastest([&]() {
+    for (int64_t lookup : lookups) {
+      if (!container_reader.ReadRecord(lookup, record.get(), error_message)) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (plain_lookup_elapsed.is_zero() || container_lookup_elapsed.is_zero()) {
+    ::printf("container lookup fail: %s\n", error_message.c_str());
+    return false;
+  }
+  ::printf("%-8s %10.2f ms plain %10.2f ms container %8.2f us/record\n", "lookup",
+    plain_lookup_elapsed.InMillisecondsF(), container_lookup_elapsed.InMillisecondsF(),
+    container_lookup_elapsed.InMicrosecondsF() / lookups.size());
+
+  // GenerateRecord() 的 version 从 2018052116 起递增
+  self::RecordStatValue min_version;
+  self::RecordStatValue max_version;
+  min_version.signed_value = 2018052116 + record_count / 2;
+  max_version.signed_value =
+    min_version.signed_value + std::max(1, record_count / kContainerFilterFraction) - 1;
+  auto matches = [&](const google::protobuf::Message& message) {
+    const int64_t version = message.GetReflection()->GetInt64(message, version_field);
+    return version >= min_version.signed_value && version <= max_version.signed_value;
+  };
+  int64_t plain_matches = 0;
+  const base::TimeDelta plain_filter_elapsed = MeasureFastest([&]() {
+    plain_matches = 0;
+    const char* data = plain_data.data();
+    const char* end = data + plain_data.size();
+    base::StringPiece record_data;
+    while (data != end) {
+      if (!NextPlainRecord(&data, end, &record_data) ||
+          !record->ParseFromArray(record_data.data(), static_cast<int>(record_data.size()))) {
+        return false;
+      }
+      plain_matches += matches(*record) ? 1 : 0;
+    }
+    return true;
+  });
+  int64_t container_matches = 0;
+  std::vector<size_t> block_indexes;
+  const base::TimeDelta container_filter_elapsed = MeasureFastest([&]() {
+    container_matches = 0;
+    if (!container_reader.FindBlocks("version", min_version, max_version, &block_indexes,
+          error_message)) {
+      return false;
+    }
+    std::vector<base::StringPiece> records;
+    for (size_t block_index : block_indexes) {
+      if (!container_reader.ReadBlock(block_index, &records, error_message)) {
+        return false;
+      }
+      for (const base::StringPiece& record_data : records) {
+        if (!record->ParseFromArray(record_data.data(), static_cast<int>(record_data.size()))) {
+          return false;
+        }
+        container_matches += matches(*record) ? 1 : 0;
+      }
+    }
+    return true;
+  });
+  if (plain_filter_elapsed.is_zero() || container_filter_elapsed.is_zero()) {
+    ::printf("container filter fail: %s\n", error_message.c_str());
+    return false;
+  }
+  ::printf("%-8s %10.2f ms plain %10.2f ms container %zu of %zu blocks, %lld plain %lld "
+    "container matches\n",
+    "filter", plain_filter_elapsed.InMillisecondsF(), container_filter_elapsed.InMillisecondsF(),
+    block_indexes.size(), container_reader.block_count(),
+    static_cast<long long>(plain_matches), static_cast<long long>(container_matches));
+  return true;
+}
+
+// Wall time of converting and then compressing in a second pass, which reads
+// and writes the whole output again, against compressing on the output I/O
+// thread while encoding, with a few levels and chunk sizes.
+bool RunCompressBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  int compress_size_mb = kDefaultCompressSizeMb;
+  if (command_line->HasSwitch(kCompressSize) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kCompressSize), &compress_size_mb) ||
+       compress_size_mb <= 0)) {
+    ::printf("invalid --%s\n", kCompressSize);
+    return false;
+  }
+  const base::FilePath input_file_path = temp_dir.AppendASCII("compress_input.json");
+  if (!GenerateInput(input_file_path, static_cast<int64_t>(compress_size_mb) << 20)) {
+    ::printf("generate compress input fail\n");
+    return false;
+  }
+  ::printf("compress input: %d MB\n", compress_size_mb);
+
+  const base::FilePath plain_file_path = temp_dir.AppendASCII("compress_plain.pb");
+  double plain_ms = 0.0;
+  if (!RunCompressChild(command_line, "plain", input_file_path, plain_file_path, {}, 0,
+        &plain_ms)) {
+    return false;
+  }
+  int64_t plain_size = 0;
+  base::GetFileSize(plain_file_path, &plain_size);
+
+  // 第二遍: 读回整个输出再压缩写出, 和转换完再跑 gzip 一样
+  const base::FilePath then_gzip_file_path = temp_dir.AppendASCII("compress_then.pb.gz");
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::string plain_output;
+  std::string error_message;
+  self::OutputStreamOptions output_options;
+  output_options.compression = self::OutputCompression::kGzip;
+  self::ProtobufFileOutputStream output_stream;
+  output_stream.set_options(output_options);
+  void* data = nullptr;
+  int size = 0;
+  bool result = base::ReadFileToString(plain_file_path, &plain_output) &&
+    output_stream.Open(then_gzip_file_path, false, error_message);
+  for (size_t position = 0; result && position < plain_output.size();) {
+    result = output_stream.Next(&data, &size);
+    const size_t copy_size = std::min(static_cast<size_t>(size), plain_output.size() - position);
+    if (result) {
+      memcpy(data, plain_output.data() + position, copy_size);
+      output_stream.BackUp(size - static_cast<int>(copy_size));
+      position += copy_size;
+    }
+  }
+  result = output_stream.Close(error_message) && result;
+  const double then_gzip_ms = (base::TimeTicks::Now() - start).InMillisecondsF();
+  if (!result) {
+    ::printf("%-12s fail: %s\n", "then-gzip", error_message.c_str());
+    return false;
+  }
+  ::printf("%-12s %10.1f ms %10.1f MB output %6.2fx smaller (%.1f ms convert + %.1f ms gzip)\n",
+    "then-gzip", plain_ms + then_gzip_ms, output_stream.file_bytes() / (1024.0 * 1024.0),
+    static_cast<double>(plain_size) / output_stream.file_bytes(), plain_ms, then_gzip_ms);
+
+  double elapsed_ms = 0.0;
+  for (int level : kCompressionLevels) {
+    const base::FilePath output_file_path =
+      temp_dir.AppendASCII("compress_level_" + base::IntToString(level) + ".pb.gz");
+    if (!RunCompressChild(command_line, base::StringPrintf("level %d", level).c_str(),
+          input_file_path, output_file_path,
+          {{convert_switches::kCompressOutput, "gzip"},
+           {convert_switches::kCompressionLevel, base::IntToString(level)}},
+          plain_size, &elapsed_ms)) {
+      return false;
+    }
+  }
+  for (int chunk_kb : kCompressChunkKbs) {
+    const base::FilePath output_file_path =
+      temp_dir.AppendASCII("compress_chunk_" + base::IntToString(chunk_kb) + ".pb.gz");
+    if (!RunCompressChild(command_line, base::StringPrintf("chunk %dk", chunk_kb).c_str(),
+          input_file_path, output_file_path,
+          {{convert_switches::kCompressOutput, "gzip"},
+           {convert_switches::kOutputChunkKb, base::IntToString(chunk_kb)}},
+          plain_size, &elapsed_ms)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace json_to_proto_benchmark
@@ -0,0 +1,290 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/json/json_reader.h"
+#include "base/macros.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "convert_switches.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_structural_index.h"
+#include "json_structural_reader.h"
+#include "json_to_proto_benchmark.h"
+
+namespace json_to_proto_benchmark {
+
+namespace {
+
+// Size of the generated input in MB, used when --input-file-path is absent.
+const char kGenerateSize[] = "generate-size-mb";
+// Records in the wide array the simd benchmark parses besides the corpus.
+const char kSimdArrayLength[] = "simd-array-length";
+const int kDefaultGenerateSizeMb = 64;
+// 每个文件启动一个进程太慢, 只跑这么多个文件再换算成 records/s
+const int kPerFileRecordCount = 200;
+const int kDefaultSimdArrayLength = 20000;
+
+bool RunParser(
+  const base::CommandLine* command_line,
+  const base::FilePath& input_file_path,
+  int64_t input_size,
+  const char* parser_name,
+  const std::vector<const char*>& switches) {
+  double elapsed_ms = 0.0;
+  int64_t peak_rss = 0;
+  if (!RunChildConversion(command_line, input_file_path, switches, &elapsed_ms, &peak_rss)) {
+    ::printf("%-9s fail\n", parser_name);
+    return false;
+  }
+  const double input_mb = input_size / (1024.0 * 1024.0);
+  ::printf("%-9s %10.1f ms %10.1f MB/s %10.1f MB peak rss %8.2fx input\n",
+    parser_name,
+    elapsed_ms,
+    input_mb / (elapsed_ms / 1000.0),
+    peak_rss / (1024.0 * 1024.0),
+    static_cast<double>(peak_rss) / input_size);
+  return true;
+}
+
+// Takes the events and only counts them, so the simd benchmark times the
+// parser alone.
+class CountingJsonSaxHandler : public self::JsonSaxHandler {
+public:
+  CountingJsonSaxHandler() : event_count_(0) {}
+
+  bool OnStartObject() override { return Count(); }
+  bool OnKey(const base::StringPiece& key) override { return Count(); }
+  bool OnEndObject() override { return Count(); }
+  bool OnStartArray() override { return Count(); }
+  bool OnEndArray() override { return Count(); }
+  bool OnNull() override { return Count(); }
+  bool OnBoolean(bool value) override { return Count(); }
+  bool OnInteger(int64_t value) override { return Count(); }
+  bool OnDouble(double value) override { return Count(); }
+  bool OnString(const base::StringPiece& value) override { return Count(); }
+
+private:
+  bool Count() {
+    ++event_count_;
+    return true;
+  }
+
+private:
+  int64_t event_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(CountingJsonSaxHandler);
+};
+
+void PrintSimd(
+  const char* name,
+  base::TimeDelta elapsed,
+  size_t json_size,
+  base::TimeDelta json_reader_elapsed) {
+  if (elapsed.is_zero()) {
+    ::printf("%-20s fail\n", name);
+    return;
+  }
+  ::printf("%-20s %10.3f ms %8.2f GB/s", name, elapsed.InMillisecondsF(),
+    json_size / elapsed.InSecondsF() / (1024.0 * 1024.0 * 1024.0));
+  if (!json_reader_elapsed.is_zero()) {
+    ::printf(" %8.2fx JSONReader", json_reader_elapsed.InSecondsF() / elapsed.InSecondsF());
+  }
+  ::printf("\n");
+}
+
+// Parse throughput of one input: base::JSONReader building its tree, the
+// streaming JsonSaxReader and the structural index reader at every SIMD level
+// this CPU has, then the index pass alone. Nothing is converted.
+bool RunSimd(const std::string& json, const char* input_name) {
+  ::printf("simd: %s %.1f KB json, cpu supports %s\n", input_name, json.size() / 1024.0,
+    self::JsonStructuralIndex::SimdLevelName(self::JsonStructuralIndex::DetectSimdLevel()));
+  base::TimeDelta json_reader_elapsed = MeasureFastest([&]() {
+    int error_code = 0;
+    std::string error_message;
+    return base::JSONReader::ReadAndReturnError(
+      json, 0, &error_code, &error_message) != nullptr;
+  });
+  PrintSimd("JSONReader", json_reader_elapsed, json.size(), base::TimeDelta());
+
+  base::TimeDelta stream_elapsed = MeasureFastest([&]() {
+    self::JsonStringInputStream input_stream(json);
+    self::JsonSaxReader json_reader(&input_stream);
+    json_reader.set_backend(self::JsonParserBackend::kStreaming);
+    CountingJsonSaxHandler handler;
+    std::string error_message;
+    return json_reader.Parse(&handler, error_message);
+  });
+  PrintSimd("stream", stream_elapsed, json.size(), json_reader_elapsed);
+
+  const self::SimdLevel kSimdLevels[] = {
+    self::SimdLevel::kScalar,
+    self::SimdLevel::kSse42,
+    self::SimdLevel::kAvx2,
+  };
+  const self::SimdLevel supported_level = self::JsonStructuralIndex::DetectSimdLevel();
+  bool result = !stream_elapsed.is_zero();
+  for (self::SimdLevel simd_level : kSimdLevels) {
+    if (simd_level > supported_level) {
+      break;
+    }
+    const std::string level_name = self::JsonStructuralIndex::SimdLevelName(simd_level);
+    self::JsonStringInputStream input_stream(json);
+    self::JsonStructuralReader json_reader(&input_stream);
+    json_reader.set_simd_level(simd_level);
+    base::TimeDelta structural_elapsed = MeasureFastest([&]() {
+      input_stream.Rewind();
+      CountingJsonSaxHandler handler;
+      std::string error_message;
+      return json_reader.Parse(&handler, error_message);
+    });
+    PrintSimd(("structural/" + level_name).c_str(), structural_elapsed, json.size(),
+      json_reader_elapsed);
+
+    self::JsonStructuralIndex index;
+    base::TimeDelta index_elapsed = MeasureFastest([&]() {
+      std::string error_message;
+      return index.Build(json, simd_level, error_message);
+    });
+    PrintSimd(("index/" + level_name).c_str(), index_elapsed, json.size(),
+      json_reader_elapsed);
+    result = result && !structural_elapsed.is_zero() && !index_elapsed.is_zero();
+  }
+  return result;
+}
+
+} // namespace
+
+bool RunParserBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  base::FilePath input_file_path =
+    command_line->GetSwitchValuePath(convert_switches::kInputFilePath);
+  if (input_file_path.empty()) {
+    int generate_size_mb = kDefaultGenerateSizeMb;
+    if (command_line->HasSwitch(kGenerateSize) &&
+        !base::StringToInt(command_line->GetSwitchValueASCII(kGenerateSize), &generate_size_mb)) {
+      ::printf("invalid --%s\n", kGenerateSize);
+      return false;
+    }
+    input_file_path = temp_dir.AppendASCII("benchmark_input.json");
+    if (!GenerateInput(input_file_path, static_cast<int64_t>(generate_size_mb) << 20)) {
+      ::printf("generate benchmark input fail\n");
+      return false;
+    }
+  }
+
+  int64_t input_size = 0;
+  if (!base::GetFileSize(input_file_path, &input_size) || input_size <= 0) {
+    ::printf("invalid input file: %s\n", input_file_path.AsUTF8Unsafe().c_str());
+    return false;
+  }
+  ::printf("parser input: %s (%.1f MB)\n",
+    input_file_path.AsUTF8Unsafe().c_str(), input_size / (1024.0 * 1024.0));
+
+  bool result = RunParser(command_line, input_file_path, input_size,
+    "dom", {convert_switches::kUseDomParser});
+  result = RunParser(command_line, input_file_path, input_size,
+    "stream", {}) && result;
+  result = RunParser(command_line, input_file_path, input_size,
+    "mmap", {convert_switches::kMmapInput}) && result;
+  // 输出文件在后台线程写, 和编码重叠
+  result = RunParser(command_line, input_file_path, input_size,
+    "io-thread", {convert_switches::kOutputIoThread}) && result;
+  return result;
+}
+
+// Compares one record stream conversion with one process per record file,
+// which is how the records are converted without --record-stream.
+bool RunRecordStreamBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  int record_count = kDefaultStreamRecordCount;
+  if (command_line->HasSwitch(kRecordCount) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kRecordCount), &record_count) ||
+       record_count <= 0)) {
+    ::printf("invalid --%s\n", kRecordCount);
+    return false;
+  }
+  base::FilePath stream_file_path = temp_dir.AppendASCII("records.ndjson");
+  if (!self::GenerateRecordStream(stream_file_path, record_count)) {
+    ::printf("generate record stream fail\n");
+    return false;
+  }
+  ::printf("record stream: %d records\n", record_count);
+
+  double elapsed_ms = 0.0;
+  int64_t peak_rss = 0;
+  if (!RunChildConversion(command_line, stream_file_path,
+    {convert_switches::kRecordStream}, &elapsed_ms, &peak_rss)) {
+    ::printf("%-10s fail\n", "stream");
+    return false;
+  }
+  ::printf("%-10s %12.0f records/s %10.1f MB peak rss\n",
+    "stream", record_count / (elapsed_ms / 1000.0), peak_rss / (1024.0 * 1024.0));
+
+  std::vector<base::FilePath> record_file_paths;
+  for (int index = 0; index < kPerFileRecordCount; index++) {
+    base::FilePath record_file_path =
+      temp_dir.AppendASCII("record_" + base::IntToString(index) + ".json");
+    const std::string record = self::GenerateRecord(index);
+    if (base::WriteFile(record_file_path, record.data(), static_cast<int>(record.size())) !=
+        static_cast<int>(record.size())) {
+      ::printf("generate record file fail\n");
+      return false;
+    }
+    record_file_paths.push_back(record_file_path);
+  }
+  // 计时包含进程启动, 这正是一个文件一个进程要付出的代价
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (const base::FilePath& record_file_path : record_file_paths) {
+    if (!RunChildConversion(command_line, record_file_path, {}, &elapsed_ms, &peak_rss)) {
+      ::printf("%-10s fail\n", "per-file");
+      return false;
+    }
+  }
+  base::TimeDelta per_file_elapsed = base::TimeTicks::Now() - start;
+  ::printf("%-10s %12.0f records/s (%d processes)\n",
+    "per-file", kPerFileRecordCount / per_file_elapsed.InSecondsF(), kPerFileRecordCount);
+  return true;
+}
+
+// Parses --input-file-path, or the phase benchmark's corpus and a wide record
+// array, with every parser.
+bool RunSimdBenchmark(const base::CommandLine* command_line) {
+  base::FilePath input_file_path =
+    command_line->GetSwitchValuePath(convert_switches::kInputFilePath);
+  if (!input_file_path.empty()) {
+    std::string json;
+    if (!base::ReadFileToString(input_file_path, &json)) {
+      ::printf("read simd input fail\n");
+      return false;
+    }
+    return RunSimd(json, input_file_path.AsUTF8Unsafe().c_str());
+  }
+
+  int array_length = kDefaultSimdArrayLength;
+  if (command_line->HasSwitch(kSimdArrayLength) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kSimdArrayLength),
+        &array_length) || array_length <= 0)) {
+    ::printf("invalid --%s\n", kSimdArrayLength);
+    return false;
+  }
+  self::CorpusShape shape;
+  if (!ParseCorpusShape(command_line, &shape)) {
+    return false;
+  }
+  bool result = RunSimd(self::CorpusGenerator(shape).Generate(), "corpus");
+  result = RunSimd(self::GenerateWideArray(array_length), "records") && result;
+  return result;
+}
+
+} // namespace json_to_proto_benchmark
@@ -0,0 +1,690 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/macros.h"
+#include "base/process/launch.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "build_proto_from_json.h"
+#include "convert_switches.h"
+#include "field_binding_plan.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/stubs/common.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_stream_message_builder.h"
+#include "json_tape.h"
+#include "json_to_proto_benchmark.h"
+#include "json_to_protobuf_serializer.h"
+#include "monotonic_arena.h"
+
+namespace json_to_proto_benchmark {
+
+namespace {
+
+// Elements in the generated wide array, runs a few sizes when absent.
+const char kArrayLength[] = "array-length";
+// Times every field of the flat object is set in the field binding benchmark.
+const char kBindingRounds[] = "binding-rounds";
+// Depth of the generated tree in the arena benchmark.
+const char kArenaDepth[] = "arena-depth";
+// Records in the wide array the compact benchmark converts besides the corpus.
+const char kCompactArrayLength[] = "compact-array-length";
+const int kDefaultArrayLengths[] = {100, 1000, 10000};
+const int kBindingFieldCount = 64;
+const int kDefaultBindingRounds = 20000;
+// 每层两个子节点, 10 层是 1023 个节点, 每个元素一个类型时 field number 还不超限
+const int kDefaultArenaDepth = 10;
+const int kArenaFanout = 2;
+const int kDefaultCompactArrayLength = 20000;
+
+// A flat object with |field_count| keys, the values cycle through integer,
+// string and double.
+std::string GenerateFlatObject(int field_count) {
+  std::string json = "{";
+  for (int index = 0; index < field_count; index++) {
+    if (index > 0) {
+      json.push_back(',');
+    }
+    switch (index % 3) {
+    case 0:
+      json += base::StringPrintf("\"Field_%d\": %d", index, index);
+      break;
+    case 1:
+      json += base::StringPrintf("\"Field_%d\": \"value %d\"", index, index);
+      break;
+    default:
+      json += base::StringPrintf("\"Field_%d\": %d.5", index, index);
+      break;
+    }
+  }
+  json += "}";
+  return json;
+}
+
+// An object with a few scalar fields and |kArenaFanout| children in an array,
+// nested |depth| levels deep.
+void AppendDeepObject(int depth, int* node_count, std::string* json) {
+  const int node = (*node_count)++;
+  *json += base::StringPrintf(
+    "{\"name\": \"node %d\", \"index\": %d, \"weight\": %d.25, \"leaf\": %s",
+    node, node, node, depth == 1 ? "true" : "false");
+  if (depth > 1) {
+    *json += ", \"children\": [";
+    for (int child = 0; child < kArenaFanout; child++) {
+      if (child > 0) {
+        json->push_back(',');
+      }
+      AppendDeepObject(depth - 1, node_count, json);
+    }
+    json->push_back(']');
+  }
+  json->push_back('}');
+}
+
+// Runs schema inference, BuildFile and message filling in this process for
+// one wide array and one schema mode.
+bool RunArraySchema(
+  const std::string& json,
+  self::SchemaMode schema_mode,
+  const char* mode_name) {
+  self::JsonStringInputStream input_stream(json);
+  std::string error_message;
+  self::BuildProtoFromJson build_proto_from_json;
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(&input_stream, schema_mode, error_message);
+  base::TimeDelta infer_elapsed = base::TimeTicks::Now() - start;
+  if (!file_desc_proto) {
+    ::printf("%-12s infer fail: %s\n", mode_name, error_message.c_str());
+    return false;
+  }
+
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = nullptr;
+  base::TimeDelta build_elapsed;
+  {
+    // 失败时每个非法字段打一行日志, 会淹没结果
+    google::protobuf::LogSilencer log_silencer;
+    start = base::TimeTicks::Now();
+    file_desc = desc_pool.BuildFile(*file_desc_proto);
+    build_elapsed = base::TimeTicks::Now() - start;
+  }
+  if (!file_desc) {
+    // 每个元素一个类型时 field number 全文件递增, 数组大了会超出合法范围
+    ::printf("%-12s %10d descriptors %10.1f ms infer   build fail\n",
+      mode_name, file_desc_proto->message_type_size(), infer_elapsed.InMillisecondsF());
+    return true;
+  }
+
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  std::unique_ptr<google::protobuf::Message> root_message(
+    dynamic_message_factory.GetPrototype(file_desc->FindMessageTypeByName("ROOT"))->New());
+  std::unique_ptr<self::JsonMessageBuilder> message_builder =
+    self::JsonToProtobufSerializer::CreateMessageBuilder(
+      schema_mode, root_message.get(), &dynamic_message_factory);
+  input_stream.Rewind();
+  self::JsonSaxReader json_reader(&input_stream);
+  start = base::TimeTicks::Now();
+  if (!json_reader.Parse(message_builder.get(), error_message)) {
+    ::printf("%-12s fill fail: %s\n", mode_name, error_message.c_str());
+    return false;
+  }
+  base::TimeDelta fill_elapsed = base::TimeTicks::Now() - start;
+
+  ::printf("%-12s %10d descriptors %10.1f ms infer %10.1f ms build %10.1f ms fill "
+    "%10.1f KB output\n",
+    mode_name,
+    file_desc_proto->message_type_size(),
+    infer_elapsed.InMillisecondsF(),
+    build_elapsed.InMillisecondsF(),
+    fill_elapsed.InMillisecondsF(),
+    root_message->ByteSizeLong() / 1024.0);
+  return true;
+}
+
+// Sets the value GenerateFlatObject() wrote for field |index|.
+void SetFlatField(
+  google::protobuf::Message* message,
+  const google::protobuf::FieldDescriptor* field_desc,
+  int index,
+  const std::string& string_value) {
+  const google::protobuf::Reflection* reflection = message->GetReflection();
+  switch (index % 3) {
+  case 0:
+    reflection->SetInt64(message, field_desc, index);
+    break;
+  case 1:
+    reflection->SetString(message, field_desc, string_value);
+    break;
+  default:
+    reflection->SetDouble(message, field_desc, index + 0.5);
+    break;
+  }
+}
+
+void PrintAllocationStats(
+  const char* mode_name,
+  const char* arena_name,
+  const char* phase_name,
+  const AllocationStats& stats) {
+  ::printf("%-12s %-6s %-9s %9lld alloc %9lld free %8.2f ms malloc %8.2f ms total\n",
+    mode_name, arena_name, phase_name,
+    static_cast<long long>(stats.allocation_count),
+    static_cast<long long>(stats.free_count),
+    stats.allocation_time.InMillisecondsF(),
+    stats.elapsed.InMillisecondsF());
+}
+
+// Counts the allocations of recording the tape, filling the message tree and
+// tearing both down, with the messages on the heap and on a protobuf arena.
+bool RunArena(
+  const std::string& json,
+  self::SchemaMode schema_mode,
+  const char* mode_name) {
+  self::JsonStringInputStream input_stream(json);
+  std::string error_message;
+  self::BuildProtoFromJson build_proto_from_json;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(&input_stream, schema_mode, error_message);
+  if (!file_desc_proto) {
+    ::printf("%-12s infer fail: %s\n", mode_name, error_message.c_str());
+    return false;
+  }
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(*file_desc_proto);
+  if (!file_desc) {
+    ::printf("%-12s build fail\n", mode_name);
+    return false;
+  }
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  const google::protobuf::Message* prototype =
+    dynamic_message_factory.GetPrototype(file_desc->FindMessageTypeByName("ROOT"));
+
+  {
+    input_stream.Rewind();
+    AllocationCounter counter;
+    std::unique_ptr<self::JsonTape> tape(new self::JsonTape());
+    self::JsonSaxReader json_reader(&input_stream);
+    if (!json_reader.Parse(tape.get(), error_message)) {
+      ::printf("%-12s record tape fail: %s\n", mode_name, error_message.c_str());
+      return false;
+    }
+    tape.reset();
+    PrintAllocationStats(mode_name, "bump", "tape", counter.Stop());
+  }
+
+  for (bool use_arena : {false, true}) {
+    const char* arena_name = use_arena ? "arena" : "heap";
+    input_stream.Rewind();
+    std::unique_ptr<google::protobuf::Arena> message_arena;
+    google::protobuf::Message* root_message = nullptr;
+    std::unique_ptr<self::JsonMessageBuilder> message_builder;
+    {
+      AllocationCounter counter;
+      if (use_arena) {
+        message_arena.reset(new google::protobuf::Arena());
+      }
+      root_message = prototype->New(message_arena.get());
+      message_builder = self::JsonToProtobufSerializer::CreateMessageBuilder(
+        schema_mode, root_message, &dynamic_message_factory);
+      self::JsonSaxReader json_reader(&input_stream);
+      if (!json_reader.Parse(message_builder.get(), error_message)) {
+        ::printf("%-12s fill fail: %s\n", mode_name, error_message.c_str());
+        return false;
+      }
+      PrintAllocationStats(mode_name, arena_name, "fill", counter.Stop());
+    }
+    {
+      AllocationCounter counter;
+      message_builder.reset();
+      // arena 上的 message 不能单独 delete, 随 arena 一起释放
+      if (!message_arena) {
+        delete root_message;
+      }
+      message_arena.reset();
+      PrintAllocationStats(mode_name, arena_name, "teardown", counter.Stop());
+    }
+  }
+  return true;
+}
+
+void PrintPhase(
+  const char* mode_name,
+  const char* phase_name,
+  const AllocationStats& stats,
+  int64_t input_size) {
+  ::printf("%-12s %-17s %10.2f ms %10.1f MB/s %9lld alloc %10.1f MB peak rss\n",
+    mode_name, phase_name,
+    stats.elapsed.InMillisecondsF(),
+    input_size / (1024.0 * 1024.0) / stats.elapsed.InSecondsF(),
+    static_cast<long long>(stats.allocation_count),
+    GetPeakResidentSetBytes() / (1024.0 * 1024.0));
+}
+
+// Times every phase of a stream conversion on its own. The input is parsed
+// once onto a JsonTape, so inferring the schema and filling the message are
+// measured without parsing again. Throughput is input bytes per second.
+bool RunPhases(
+  const std::string& json,
+  self::SchemaMode schema_mode,
+  const char* mode_name) {
+  const int64_t input_size = static_cast<int64_t>(json.size());
+  std::string error_message;
+  ::printf("%-12s %-17s %58.1f MB peak rss\n", mode_name, "input",
+    GetPeakResidentSetBytes() / (1024.0 * 1024.0));
+
+  self::JsonStringInputStream input_stream(json);
+  self::MonotonicArena tape_arena;
+  self::JsonTape json_tape(&tape_arena);
+  AllocationCounter parse_counter(false);
+  self::JsonSaxReader json_reader(&input_stream);
+  bool result = json_reader.Parse(&json_tape, error_message);
+  const AllocationStats parse_stats = parse_counter.Stop();
+  if (!result) {
+    ::printf("%-12s parse fail: %s\n", mode_name, error_message.c_str());
+    return false;
+  }
+  PrintPhase(mode_name, "parse", parse_stats, input_size);
+
+  AllocationCounter infer_counter(false);
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    self::BuildProtoFromJson::NewProtoFile();
+  std::unique_ptr<self::JsonSchemaBuilder> schema_builder =
+    self::BuildProtoFromJson::CreateSchemaBuilder(
+      schema_mode, kDefaultMaxEnumCardinality, file_desc_proto.get());
+  result = json_tape.Replay(schema_builder.get(), error_message) &&
+    schema_builder->Finish(error_message);
+  schema_builder.reset();
+  const AllocationStats infer_stats = infer_counter.Stop();
+  if (!result) {
+    ::printf("%-12s create proto file fail: %s\n", mode_name, error_message.c_str());
+    return false;
+  }
+  PrintPhase(mode_name, "create-proto-file", infer_stats, input_size);
+
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = nullptr;
+  AllocationStats build_stats;
+  {
+    google::protobuf::LogSilencer log_silencer;
+    AllocationCounter build_counter(false);
+    file_desc = desc_pool.BuildFile(*file_desc_proto);
+    build_stats = build_counter.Stop();
+  }
+  if (!file_desc) {
+    // 每个元素一个类型时 field number 全文件递增, 语料大了会超出合法范围
+    ::printf("%-12s build fail, %d descriptors\n",
+      mode_name, file_desc_proto->message_type_size());
+    return true;
+  }
+  PrintPhase(mode_name, "build-file", build_stats, input_size);
+
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  const google::protobuf::Message* prototype =
+    dynamic_message_factory.GetPrototype(file_desc->FindMessageTypeByName("ROOT"));
+  AllocationCounter fill_counter(false);
+  std::unique_ptr<google::protobuf::Message> root_message(prototype->New());
+  std::unique_ptr<self::JsonMessageBuilder> message_builder =
+    self::JsonToProtobufSerializer::CreateMessageBuilder(
+      schema_mode, root_message.get(), &dynamic_message_factory);
+  result = json_tape.Replay(message_builder.get(), error_message);
+  const AllocationStats fill_stats = fill_counter.Stop();
+  if (!result) {
+    ::printf("%-12s create message fail: %s\n", mode_name, error_message.c_str());
+    return false;
+  }
+  PrintPhase(mode_name, "create-message", fill_stats, input_size);
+
+  std::string output;
+  AllocationCounter serialize_counter(false);
+  result = root_message->SerializeToString(&output);
+  const AllocationStats serialize_stats = serialize_counter.Stop();
+  if (!result) {
+    ::printf("%-12s serialize fail\n", mode_name);
+    return false;
+  }
+  PrintPhase(mode_name, "serialize", serialize_stats, input_size);
+
+  const AllocationStats phase_stats[] = {
+    parse_stats, infer_stats, build_stats, fill_stats, serialize_stats,
+  };
+  AllocationStats total_stats = {};
+  for (const AllocationStats& stats : phase_stats) {
+    total_stats.allocation_count += stats.allocation_count;
+    total_stats.free_count += stats.free_count;
+    total_stats.elapsed += stats.elapsed;
+  }
+  PrintPhase(mode_name, "total", total_stats, input_size);
+  ::printf("%-12s %d descriptors, %.1f KB output\n",
+    mode_name, file_desc_proto->message_type_size(), output.size() / 1024.0);
+  return true;
+}
+
+// Converts |json| with |schema_mode| and times filling plus encoding the
+// message and decoding the encoding again, the consumer's side. Returns the
+// encoded size, 0 on failure.
+size_t RunCompact(
+  const std::string& json,
+  self::SchemaMode schema_mode,
+  size_t max_enum_cardinality,
+  const char* input_name,
+  const char* mode_name,
+  size_t baseline_size) {
+  std::string error_message;
+  self::JsonStringInputStream input_stream(json);
+  self::BuildProtoFromJson build_proto_from_json;
+  build_proto_from_json.set_max_enum_cardinality(max_enum_cardinality);
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(&input_stream, schema_mode, error_message);
+  if (!file_desc_proto) {
+    ::printf("%-8s %-8s infer fail: %s\n", input_name, mode_name, error_message.c_str());
+    return 0;
+  }
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(*file_desc_proto);
+  if (!file_desc) {
+    ::printf("%-8s %-8s build fail\n", input_name, mode_name);
+    return 0;
+  }
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  const google::protobuf::Message* prototype =
+    dynamic_message_factory.GetPrototype(file_desc->FindMessageTypeByName("ROOT"));
+
+  std::string encoded;
+  base::TimeDelta convert_elapsed = MeasureFastest([&]() {
+    std::unique_ptr<google::protobuf::Message> root_message(prototype->New());
+    std::unique_ptr<self::JsonMessageBuilder> message_builder =
+      self::JsonToProtobufSerializer::CreateMessageBuilder(
+        schema_mode, root_message.get(), &dynamic_message_factory);
+    self::JsonSaxReader json_reader(&input_stream);
+    return input_stream.Rewind() &&
+      json_reader.Parse(message_builder.get(), error_message) &&
+      root_message->SerializeToString(&encoded);
+  });
+  std::unique_ptr<google::protobuf::Message> parsed_message(prototype->New());
+  base::TimeDelta decode_elapsed = MeasureFastest([&]() {
+    return parsed_message->ParseFromString(encoded);
+  });
+  if (convert_elapsed.is_zero() || decode_elapsed.is_zero()) {
+    ::printf("%-8s %-8s fail: %s\n", input_name, mode_name, error_message.c_str());
+    return 0;
+  }
+  ::printf("%-8s %-8s %10.1f KB %6.1f%% %10.2f ms convert %10.2f ms decode %8.1f MB/s\n",
+    input_name, mode_name, encoded.size() / 1024.0,
+    baseline_size ? encoded.size() * 100.0 / baseline_size : 100.0,
+    convert_elapsed.InMillisecondsF(), decode_elapsed.InMillisecondsF(),
+    encoded.size() / (1024.0 * 1024.0) / decode_elapsed.InSecondsF());
+  return encoded.size();
+}
+
+} // namespace
+
+// Compares one message type per array element with the unified schema on
+// arrays of growing length.
+bool RunArraySchemaBenchmark(const base::CommandLine* command_line) {
+  std::vector<int> array_lengths(
+    std::begin(kDefaultArrayLengths), std::end(kDefaultArrayLengths));
+  if (command_line->HasSwitch(kArrayLength)) {
+    int array_length = 0;
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kArrayLength), &array_length) ||
+        array_length <= 0) {
+      ::printf("invalid --%s\n", kArrayLength);
+      return false;
+    }
+    array_lengths.assign(1, array_length);
+  }
+
+  bool result = true;
+  for (int array_length : array_lengths) {
+    const std::string json = self::GenerateWideArray(array_length);
+    ::printf("wide array: %d elements (%.1f KB)\n", array_length, json.size() / 1024.0);
+    result = RunArraySchema(json, self::SchemaMode::kPerElement, "per-element") && result;
+    result = RunArraySchema(json, self::SchemaMode::kUnified, "unified") && result;
+  }
+  return result;
+}
+
+// Time per field of finding the field for a json key and setting it: by
+// building the lower case name and asking the descriptor, by the binding
+// plan, and through the whole JsonStreamMessageBuilder replaying a tape.
+bool RunFieldBindingBenchmark(const base::CommandLine* command_line) {
+  int rounds = kDefaultBindingRounds;
+  if (command_line->HasSwitch(kBindingRounds) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kBindingRounds), &rounds) ||
+       rounds <= 0)) {
+    ::printf("invalid --%s\n", kBindingRounds);
+    return false;
+  }
+
+  const std::string json = GenerateFlatObject(kBindingFieldCount);
+  self::JsonStringInputStream input_stream(json);
+  std::string error_message;
+  self::BuildProtoFromJson build_proto_from_json;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(
+      &input_stream, self::SchemaMode::kPerElement, error_message);
+  if (!file_desc_proto) {
+    ::printf("field binding infer fail: %s\n", error_message.c_str());
+    return false;
+  }
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(*file_desc_proto);
+  if (!file_desc) {
+    ::printf("field binding build fail\n");
+    return false;
+  }
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  std::unique_ptr<google::protobuf::Message> root_message(
+    dynamic_message_factory.GetPrototype(root_desc)->New());
+
+  std::vector<std::string> keys;
+  std::vector<std::string> string_values;
+  for (int index = 0; index < kBindingFieldCount; index++) {
+    keys.push_back(base::StringPrintf("Field_%d", index));
+    string_values.push_back(base::StringPrintf("value %d", index));
+  }
+  const double field_count = static_cast<double>(rounds) * kBindingFieldCount;
+  ::printf("field binding: %d fields, %d rounds\n", kBindingFieldCount, rounds);
+
+  // 每个值都拼一次小写 key 再按名字找字段, 没有 binding plan 时的做法
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int round = 0; round < rounds; round++) {
+    for (int index = 0; index < kBindingFieldCount; index++) {
+      const google::protobuf::FieldDescriptor* field_desc =
+        root_desc->FindFieldByLowercaseName(base::ToLowerASCII(keys[index]));
+      if (!field_desc) {
+        ::printf("no field for json key: %s\n", keys[index].c_str());
+        return false;
+      }
+      SetFlatField(root_message.get(), field_desc, index, string_values[index]);
+    }
+  }
+  base::TimeDelta lookup_elapsed = base::TimeTicks::Now() - start;
+
+  self::BindingPlanCache plan_cache(self::SchemaMode::kPerElement);
+  start = base::TimeTicks::Now();
+  const self::MessageBindingPlan* plan = plan_cache.GetPlan(root_desc);
+  base::TimeDelta compile_elapsed = base::TimeTicks::Now() - start;
+  start = base::TimeTicks::Now();
+  for (int round = 0; round < rounds; round++) {
+    size_t hint = 0;
+    for (int index = 0; index < kBindingFieldCount; index++) {
+      const self::FieldBinding* binding = plan->FindBinding(keys[index], &hint);
+      if (!binding) {
+        ::printf("no binding for json key: %s\n", keys[index].c_str());
+        return false;
+      }
+      SetFlatField(root_message.get(), binding->field_desc, index, string_values[index]);
+    }
+  }
+  base::TimeDelta plan_elapsed = base::TimeTicks::Now() - start;
+
+  self::JsonTape tape;
+  input_stream.Rewind();
+  self::JsonSaxReader json_reader(&input_stream);
+  if (!json_reader.Parse(&tape, error_message)) {
+    ::printf("field binding record tape fail: %s\n", error_message.c_str());
+    return false;
+  }
+  self::JsonStreamMessageBuilder message_builder(
+    root_message.get(), &dynamic_message_factory);
+  start = base::TimeTicks::Now();
+  for (int round = 0; round < rounds; round++) {
+    message_builder.Reset(root_message.get());
+    if (!tape.Replay(&message_builder, error_message)) {
+      ::printf("field binding replay fail: %s\n", error_message.c_str());
+      return false;
+    }
+  }
+  base::TimeDelta builder_elapsed = base::TimeTicks::Now() - start;
+
+  ::printf("%-8s %8.1f ns/field\n",
+    "lookup", lookup_elapsed.InNanoseconds() / field_count);
+  ::printf("%-8s %8.1f ns/field %6.2fx %8.1f us compile\n",
+    "plan",
+    plan_elapsed.InNanoseconds() / field_count,
+    lookup_elapsed.InSecondsF() / plan_elapsed.InSecondsF(),
+    compile_elapsed.InMicrosecondsF());
+  ::printf("%-8s %8.1f ns/field\n",
+    "builder", builder_elapsed.InNanoseconds() / field_count);
+  return true;
+}
+
+// Allocations of one conversion of a deep tree, the point of arena mode is
+// that they stop growing with the number of nodes.
+bool RunArenaBenchmark(const base::CommandLine* command_line) {
+  int depth = kDefaultArenaDepth;
+  if (command_line->HasSwitch(kArenaDepth) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kArenaDepth), &depth) ||
+       depth <= 0)) {
+    ::printf("invalid --%s\n", kArenaDepth);
+    return false;
+  }
+  std::string json;
+  int node_count = 0;
+  AppendDeepObject(depth, &node_count, &json);
+  ::printf("arena: %d levels, %d nodes (%.1f KB)\n", depth, node_count, json.size() / 1024.0);
+  if (!self::AllocationHooks::IsSupported()) {
+    ::printf("arena: built without the allocator shim, no allocation counts\n");
+  }
+  bool result = RunArena(json, self::SchemaMode::kPerElement, "per-element");
+  result = RunArena(json, self::SchemaMode::kUnified, "unified") && result;
+  return result;
+}
+
+int RunPhasesChild(const base::CommandLine* command_line) {
+  std::string json;
+  if (!base::ReadFileToString(
+    command_line->GetSwitchValuePath(convert_switches::kInputFilePath), &json)) {
+    ::printf("read phases input fail\n");
+    return -1;
+  }
+  const bool unified = command_line->HasSwitch(convert_switches::kUnifyArraySchema);
+  return RunPhases(json,
+    unified ? self::SchemaMode::kUnified : self::SchemaMode::kPerElement,
+    unified ? "unified" : "per-element") ? 0 : -1;
+}
+
+// Generates the corpus, or takes --input-file-path, and times its phases once
+// per schema mode, each in its own process so the peak RSS is its own.
+bool RunPhasesBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  base::FilePath input_file_path =
+    command_line->GetSwitchValuePath(convert_switches::kInputFilePath);
+  if (input_file_path.empty()) {
+    self::CorpusShape shape;
+    if (!ParseCorpusShape(command_line, &shape)) {
+      return false;
+    }
+    const std::string corpus = self::CorpusGenerator(shape).Generate();
+    input_file_path = command_line->HasSwitch(kCorpusOutput) ?
+      command_line->GetSwitchValuePath(kCorpusOutput) : temp_dir.AppendASCII("corpus.json");
+    if (base::WriteFile(input_file_path, corpus.data(), static_cast<int>(corpus.size())) !=
+        static_cast<int>(corpus.size())) {
+      ::printf("write corpus fail\n");
+      return false;
+    }
+    ::printf("phases corpus: depth %d, width %d, array %d, string %d, "
+      "type mix %d,%d,%d,%d, seed %u (%.1f KB)\n",
+      shape.depth, shape.width, shape.array_length, shape.string_length,
+      shape.type_weights[0], shape.type_weights[1], shape.type_weights[2],
+      shape.type_weights[3], shape.seed, corpus.size() / 1024.0);
+  } else {
+    ::printf("phases input: %s\n", input_file_path.AsUTF8Unsafe().c_str());
+  }
+
+  bool result = true;
+  for (bool unified : {false, true}) {
+    base::CommandLine child_command_line(command_line->GetProgram());
+    child_command_line.AppendSwitch(kPhasesChild);
+    child_command_line.AppendSwitchPath(convert_switches::kInputFilePath, input_file_path);
+    if (unified) {
+      child_command_line.AppendSwitch(convert_switches::kUnifyArraySchema);
+    }
+    std::string output;
+    const bool child_result = base::GetAppOutput(child_command_line, &output);
+    ::printf("%s", output.c_str());
+    if (!child_result) {
+      ::printf("phases child process fail\n");
+      result = false;
+    }
+  }
+  return result;
+}
+
+// Size report of --compact-wire-types against --unify-array-schema, the
+// schema it optimizes, on the phase benchmark's corpus and a wide record
+// array. "narrow" is compact with --max-enum-cardinality=0, the records'
+// class names and click types are what the enums save on. The percentage is
+// of the unified output.
+bool RunCompactBenchmark(const base::CommandLine* command_line) {
+  int array_length = kDefaultCompactArrayLength;
+  if (command_line->HasSwitch(kCompactArrayLength) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kCompactArrayLength),
+        &array_length) || array_length <= 0)) {
+    ::printf("invalid --%s\n", kCompactArrayLength);
+    return false;
+  }
+  self::CorpusShape shape;
+  if (!ParseCorpusShape(command_line, &shape)) {
+    return false;
+  }
+  const struct {
+    const char* name;
+    std::string json;
+  } kInputs[] = {
+    {"corpus", self::CorpusGenerator(shape).Generate()},
+    {"records", self::GenerateWideArray(array_length)},
+  };
+  bool result = true;
+  for (const auto& input : kInputs) {
+    ::printf("compact: %s %.1f KB json\n", input.name, input.json.size() / 1024.0);
+    const size_t unified_size = RunCompact(input.json, self::SchemaMode::kUnified,
+      kDefaultMaxEnumCardinality, input.name, "unified", 0);
+    const size_t narrow_size = RunCompact(input.json, self::SchemaMode::kCompact,
+      0, input.name, "narrow", unified_size);
+    const size_t compact_size = RunCompact(input.json, self::SchemaMode::kCompact,
+      kDefaultMaxEnumCardinality, input.name, "compact", unified_size);
+    result = result && unified_size && narrow_size && compact_size;
+  }
+  return result;
+}
+
+} // namespace json_to_proto_benchmark
@@ -0,0 +1,294 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/macros.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
+#include "conversion_server.h"
+#include "conversion_worker.h"
+#include "json_input_generator.h"
+#include "json_to_proto_benchmark.h"
+
+namespace json_to_proto_benchmark {
+
+namespace {
+
+// Requests per row of the server benchmark, spread over the clients.
+const char kServerRequests[] = "server-requests";
+const int kDefaultServerRequests = 20000;
+// 每个连接一个线程, 请求背靠背地发
+const int kServerClientCounts[] = {1, 4, 16};
+const int kServerFileCount = 64;
+// 每个请求启动一个进程太慢, 只跑这么多个
+const int kServerProcessCount = 100;
+
+// Sorts |latencies_us| and prints its percentiles, a row of the server
+// benchmark.
+void PrintLatencies(
+  const char* name,
+  std::vector<double>* latencies_us,
+  base::TimeDelta elapsed) {
+  std::sort(latencies_us->begin(), latencies_us->end());
+  auto percentile = [latencies_us](double fraction) {
+    size_t index = static_cast<size_t>(fraction * latencies_us->size());
+    return (*latencies_us)[std::min(index, latencies_us->size() - 1)];
+  };
+  ::printf("%-10s %9.1f us p50 %9.1f us p90 %9.1f us p99 %9.1f us max %9.0f requests/s\n",
+    name, percentile(0.5), percentile(0.9), percentile(0.99), latencies_us->back(),
+    latencies_us->size() / elapsed.InSecondsF());
+}
+
+// One connection of the load generator, sending its requests back to back
+// on a thread of its own.
+class LoadClient : public base::DelegateSimpleThread::Delegate {
+public:
+  LoadClient(
+    const base::FilePath& socket_path,
+    std::vector<self::ConversionRequest> requests,
+    int request_count)
+    : socket_path_(socket_path),
+      requests_(std::move(requests)),
+      request_count_(request_count),
+      failed_(false) {
+  }
+
+  void Run() override {
+    if (!client_.Connect(socket_path_, error_message_)) {
+      failed_ = true;
+      return;
+    }
+    self::ConversionResponse response;
+    latencies_us_.reserve(request_count_);
+    for (int index = 0; index < request_count_; index++) {
+      base::TimeTicks start = base::TimeTicks::Now();
+      if (!client_.Send(requests_[index % requests_.size()], &response, error_message_) ||
+          !response.succeeded) {
+        if (error_message_.empty()) {
+          error_message_ = response.error_message;
+        }
+        failed_ = true;
+        return;
+      }
+      latencies_us_.push_back((base::TimeTicks::Now() - start).InMillisecondsF() * 1000.0);
+    }
+  }
+
+  bool failed() const { return failed_; }
+  const std::string& error_message() const { return error_message_; }
+  const std::vector<double>& latencies_us() const { return latencies_us_; }
+
+private:
+  const base::FilePath socket_path_;
+  const std::vector<self::ConversionRequest> requests_;
+  const int request_count_;
+  self::ConversionClient client_;
+  bool failed_;
+  std::string error_message_;
+  std::vector<double> latencies_us_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(LoadClient);
+};
+
+class ServerRunner : public base::DelegateSimpleThread::Delegate {
+public:
+  explicit ServerRunner(self::ConversionServer* server)
+    : server_(server) {
+  }
+
+  void Run() override { server_->Run(); }
+
+private:
+  self::ConversionServer* const server_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ServerRunner);
+};
+
+// Sends |request_count| requests over |client_count| connections at once and
+// prints their latencies. Client |index| sends the requests
+// |new_requests(index)| returns, in turn.
+bool RunServerLoad(
+  const char* name,
+  const base::FilePath& socket_path,
+  int client_count,
+  int request_count,
+  const std::function<std::vector<self::ConversionRequest>(int)>& new_requests) {
+  std::vector<std::unique_ptr<LoadClient>> clients;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (int index = 0; index < client_count; index++) {
+    clients.emplace_back(new LoadClient(socket_path, new_requests(index),
+      request_count / client_count + (index < request_count % client_count ? 1 : 0)));
+    threads.emplace_back(new base::DelegateSimpleThread(clients.back().get(), "load_client"));
+  }
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (const std::unique_ptr<base::DelegateSimpleThread>& thread : threads) {
+    thread->Start();
+  }
+  for (const std::unique_ptr<base::DelegateSimpleThread>& thread : threads) {
+    thread->Join();
+  }
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  std::vector<double> latencies_us;
+  for (const std::unique_ptr<LoadClient>& client : clients) {
+    if (client->failed()) {
+      ::printf("%-10s fail: %s\n", name, client->error_message().c_str());
+      return false;
+    }
+    latencies_us.insert(latencies_us.end(),
+      client->latencies_us().begin(), client->latencies_us().end());
+  }
+  PrintLatencies(name, &latencies_us, elapsed);
+  return true;
+}
+
+} // namespace
+
+// Latencies of small conversions: one process per file, in this process
+// with a cold and a warm ConversionWorker, and through a ConversionServer
+// in this process with a few client counts, by path and inline.
+bool RunServerBenchmark(
+  const base::CommandLine* command_line,
+  const base::FilePath& temp_dir) {
+  int request_count = kDefaultServerRequests;
+  if (command_line->HasSwitch(kServerRequests) &&
+      (!base::StringToInt(command_line->GetSwitchValueASCII(kServerRequests), &request_count) ||
+       request_count <= 0)) {
+    ::printf("invalid --%s\n", kServerRequests);
+    return false;
+  }
+  const base::FilePath input_dir = temp_dir.AppendASCII("server_input");
+  const base::FilePath output_dir = temp_dir.AppendASCII("server_output");
+  if (!base::CreateDirectory(input_dir)) {
+    ::printf("create server input directory fail\n");
+    return false;
+  }
+  std::vector<base::FilePath> input_paths;
+  std::vector<std::string> inputs;
+  for (int index = 0; index < kServerFileCount; index++) {
+    input_paths.push_back(input_dir.AppendASCII(base::IntToString(index) + ".json"));
+    inputs.push_back(self::GenerateRecord(index));
+    if (base::WriteFile(input_paths.back(), inputs.back().data(),
+        static_cast<int>(inputs.back().size())) != static_cast<int>(inputs.back().size())) {
+      ::printf("generate server input fail\n");
+      return false;
+    }
+  }
+  ::printf("server: %d files of about %zu bytes, %d requests per row\n",
+    kServerFileCount, inputs[0].size(), request_count);
+
+  // 计时包含进程启动, 小文件的大头正是这个
+  std::vector<double> latencies_us;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int index = 0; index < kServerProcessCount; index++) {
+    double elapsed_ms = 0.0;
+    int64_t peak_rss = 0;
+    base::TimeTicks process_start = base::TimeTicks::Now();
+    if (!RunChildConversion(command_line, input_paths[index % kServerFileCount], {},
+          &elapsed_ms, &peak_rss)) {
+      ::printf("%-10s fail\n", "process");
+      return false;
+    }
+    latencies_us.push_back((base::TimeTicks::Now() - process_start).InMillisecondsF() * 1000.0);
+  }
+  PrintLatencies("process", &latencies_us, base::TimeTicks::Now() - start);
+
+  // cold 每个请求都推导 schema, 建 descriptor pool, 编译 binding plan
+  std::string output;
+  std::string error_message;
+  for (int warm = 0; warm < 2; warm++) {
+    std::unique_ptr<self::ConversionWorker> worker;
+    latencies_us.clear();
+    start = base::TimeTicks::Now();
+    for (int index = 0; index < request_count; index++) {
+      base::TimeTicks request_start = base::TimeTicks::Now();
+      if (!warm || !worker) {
+        worker.reset(new self::ConversionWorker(
+          self::SchemaMode::kPerElement, kDefaultMaxEnumCardinality));
+      }
+      if (!worker->Convert(inputs[index % kServerFileCount], &output, error_message)) {
+        ::printf("%-10s fail: %s\n", warm ? "warm" : "cold", error_message.c_str());
+        return false;
+      }
+      latencies_us.push_back(
+        (base::TimeTicks::Now() - request_start).InMillisecondsF() * 1000.0);
+    }
+    PrintLatencies(warm ? "warm" : "cold", &latencies_us, base::TimeTicks::Now() - start);
+  }
+
+  const base::FilePath socket_path = temp_dir.AppendASCII("server.sock");
+  self::ConversionServer server(socket_path, base::SysInfo::NumberOfProcessors());
+  if (!server.Start(error_message)) {
+    ::printf("start server fail: %s\n", error_message.c_str());
+    return false;
+  }
+  ServerRunner server_runner(&server);
+  base::DelegateSimpleThread server_thread(&server_runner, "conversion_server");
+  server_thread.Start();
+
+  // 这个连接最后用来关掉 server
+  self::ConversionClient client;
+  bool result = client.Connect(socket_path, error_message);
+  for (size_t client_index = 0; result && client_index < arraysize(kServerClientCounts);
+    client_index++) {
+    const int client_count = kServerClientCounts[client_index];
+    // 每个客户端写自己的输出目录, 并发的请求不会写同一个文件
+    result = RunServerLoad(base::StringPrintf("file x%d", client_count).c_str(), socket_path,
+      client_count, request_count, [&](int index) {
+        const base::FilePath client_dir = output_dir.AppendASCII(base::IntToString(index));
+        std::vector<self::ConversionRequest> requests(kServerFileCount);
+        for (int file_index = 0; file_index < kServerFileCount; file_index++) {
+          requests[file_index].max_enum_cardinality = kDefaultMaxEnumCardinality;
+          requests[file_index].input_path = input_paths[file_index];
+          requests[file_index].output_path =
+            client_dir.AppendASCII(base::IntToString(file_index) + ".pb");
+        }
+        return requests;
+      }) && RunServerLoad(base::StringPrintf("inline x%d", client_count).c_str(),
+      socket_path, client_count, request_count, [&](int index) {
+        std::vector<self::ConversionRequest> requests(kServerFileCount);
+        for (int file_index = 0; file_index < kServerFileCount; file_index++) {
+          requests[file_index].type = self::ConversionRequest::Type::kConvertInline;
+          requests[file_index].max_enum_cardinality = kDefaultMaxEnumCardinality;
+          requests[file_index].input = inputs[file_index];
+        }
+        return requests;
+      });
+  }
+
+  self::ConversionRequest request;
+  request.type = self::ConversionRequest::Type::kShutdown;
+  self::ConversionResponse response;
+  if (!client.Send(request, &response, error_message)) {
+    // 连接坏了也要让 server 线程退出
+    server.Stop();
+  }
+  server_thread.Join();
+  if (!result) {
+    if (!error_message.empty()) {
+      ::printf("server benchmark fail: %s\n", error_message.c_str());
+    }
+    return false;
+  }
+  ::printf("server: %d workers, %lld connections, %lld requests, %lld fail\n",
+    server.worker_count(),
+    static_cast<long long>(server.connection_count()),
+    static_cast<long long>(server.request_count()),
+    static_cast<long long>(server.error_count()));
+  return true;
+}
+
+} // namespace json_to_proto_benchmark
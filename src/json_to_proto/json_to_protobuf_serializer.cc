@@ -12,55 +12,39 @@
 #include "base/strings/string_util.h"
 #include "base/strings/string_number_conversions.h"
 #include "build_proto_from_json.h"
-
+#include "conversion_tracer.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_shape_fingerprint.h"
+#include "json_stream_message_builder.h"
+#include "json_stream_schema_builder.h"
+#include "json_tape.h"
+#include "json_unified_message_builder.h"
+#include "json_unified_schema_builder.h"
+#include "json_value_walker.h"
+#include "monotonic_arena.h"
+#include "protobuf_file_output_stream.h"
+#include "record_container.h"
+#include "schema_cache.h"
+
+#include "google/protobuf/arena.h"
 #include "google/protobuf/descriptor.pb.h"
 #include "google/protobuf/dynamic_message.h"
 #include "google/protobuf/message.h"
 
 namespace self {
 
-namespace {
-static const std::map<base::Value::Type, google::protobuf::FieldDescriptorProto::Type> kTypeConvertMap = {
-  {base::Value::Type::BOOLEAN,    google::protobuf::FieldDescriptorProto::TYPE_BOOL},
-  {base::Value::Type::INTEGER,    google::protobuf::FieldDescriptorProto::TYPE_INT64},
-  {base::Value::Type::DOUBLE,     google::protobuf::FieldDescriptorProto::TYPE_DOUBLE},
-  {base::Value::Type::STRING,     google::protobuf::FieldDescriptorProto::TYPE_STRING},
-  {base::Value::Type::BINARY,     google::protobuf::FieldDescriptorProto::TYPE_BYTES},
-  {base::Value::Type::DICTIONARY, google::protobuf::FieldDescriptorProto::TYPE_MESSAGE}
-};
-
-static google::protobuf::FieldDescriptorProto::Type
-ConvertJsonTypeToProtoType(base::Value::Type type) {
-  auto find = kTypeConvertMap.find(type);
-  return find->second;
-};
-
-/*
-* 用于生成例如
-{
-  "a": [
-    {
-      "a": "1",
-      "b": "2"
-    },
-    {
-      "c": "3",
-      "d": "4"
-    }
-  ]
-}
-  因为数组内的对象很可能是不同对象因此就不能只是用一个简单的map来解决，需要为每个对象生成不同的对象
-  那么对象映射其实会是一个匿名的message那么就需要为他加上一个类型名称，最后就用一个随机数
-*/
-static int GenerateIndex() {
-  static int start = 1;
-  return start++;
-}
-}
-
 JsonToProtobufSerializer::JsonToProtobufSerializer(
   const base::FilePath& output_file_path)
-  : output_file_path_(output_file_path) {
+  : output_file_path_(output_file_path),
+    schema_cache_(nullptr),
+    schema_mode_(SchemaMode::kPerElement),
+    max_enum_cardinality_(JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality),
+    use_arena_(false),
+    use_io_thread_(false),
+    write_descriptor_set_(false),
+    output_options_(nullptr),
+    container_options_(nullptr) {
 }
 
 JsonToProtobufSerializer::~JsonToProtobufSerializer() {
@@ -68,222 +52,297 @@ JsonToProtobufSerializer::~JsonToProtobufSerializer() {
 
 bool JsonToProtobufSerializer::Serialize(
   const base::Value& root) {
-  const base::DictionaryValue* root_dictionary;
-  if (!root.GetAsDictionary(&root_dictionary)) {
+  std::string error_message;
+  if (!SerializeValue(root, error_message)) {
+    LOG(ERROR) << error_message;
     return false;
   }
-  BuildProtoFromJson build_proto_from_json;
-  const base::DictionaryValue* root_dict_value;
-  if (!root.GetAsDictionary(&root_dict_value)) {
-    return false;
-  }
-  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool(new google::protobuf::DescriptorPool());
-  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto 
-    = build_proto_from_json.CreateProtoFile(root_dict_value);
-  const google::protobuf::FileDescriptor*  file_desc = desc_pool->BuildFile(*file_desc_proto.get());
-  std::unique_ptr<google::protobuf::DynamicMessageFactory> dynamic_message_factory(
-    new google::protobuf::DynamicMessageFactory);
-  auto root_message = CreateMessage(root_dict_value, file_desc, dynamic_message_factory.get());
-
-  std::string temp_serialize = root_message->SerializeAsString();
-  const google::protobuf::Reflection* reflection = root_message->GetReflection();
-  //reflection->SetString(message, field, "sfds");
-  std::vector<const google::protobuf::FieldDescriptor*> field_descs;
-  reflection->ListFields(*root_message.get(), &field_descs);
   return true;
 }
 
-std::unique_ptr<google::protobuf::Message> JsonToProtobufSerializer::CreateMessage(
-  const base::DictionaryValue* root_dict,
-  const google::protobuf::FileDescriptor* file_desc,
-  google::protobuf::DynamicMessageFactory* dynamic_message_factory) {
-  
-  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
-  std::unique_ptr<google::protobuf::Message> root_message(dynamic_message_factory->GetPrototype(root_desc)->New());
-  
-  for (base::DictionaryValue::Iterator dict_iterator(*root_dict);
-    !dict_iterator.IsAtEnd(); dict_iterator.Advance()) {
-    AssignDataJudgeType(&dict_iterator.value(), dict_iterator.key(), root_desc, 
-      root_message.get(), file_desc, dynamic_message_factory);
+bool JsonToProtobufSerializer::SerializeValue(
+  const base::Value& root,
+  std::string& error_message) {
+  if (!root.is_dict()) {
+    error_message = "root value is not a json object";
+    return false;
   }
 
-  return std::move(root_message);
-}
+  // 只遍历一次 base::Value 树: schema 边走边推导, 值记到 tape 上,
+  // BuildFile 之后从 tape 回放出 message
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    BuildProtoFromJson::NewProtoFile();
+  // tape 上的事件和字符串都在这一次转换的 arena 里, 转换完一起释放
+  MonotonicArena tape_arena;
+  JsonTape json_tape(&tape_arena);
+  {
+    ScopedTraceSpan span("CreateProtoFile");
+    std::unique_ptr<JsonSchemaBuilder> schema_builder =
+      BuildProtoFromJson::CreateSchemaBuilder(
+        schema_mode_, max_enum_cardinality_, file_desc_proto.get());
+    JsonSaxTee json_sax_tee(schema_builder.get(), &json_tape);
+    std::unique_ptr<TracedJsonSaxHandler> traced_handler;
+    if (!JsonValueWalker::Walk(root, TracedJsonSaxHandler::Wrap(&json_sax_tee, &traced_handler),
+          error_message) ||
+        !schema_builder->Finish(error_message)) {
+      return false;
+    }
+    if (traced_handler) {
+      span.AddArg("nodes", traced_handler->node_count());
+    }
+    span.AddArg("descriptors", file_desc_proto->message_type_size());
+  }
 
-void JsonToProtobufSerializer::AssignDataRecurveDictionaryValue(
-  const base::DictionaryValue* dict_value,
-  const std::string& key_name,
-  const google::protobuf::Descriptor* parent_desc,
-  google::protobuf::Message* parent_message,
-  const google::protobuf::FileDescriptor* file_desc,
-  google::protobuf::DynamicMessageFactory* dynamic_message_factory) {
+  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool;
+  const google::protobuf::FileDescriptor* file_desc =
+    BuildFile(std::move(file_desc_proto), &desc_pool, error_message);
+  if (!file_desc) {
+    return false;
+  }
 
-  std::string unique_key_name = key_name + "_" + base::IntToString(GenerateIndex());
-  const google::protobuf::Descriptor* current_desc = file_desc->FindMessageTypeByName(base::ToUpperASCII(unique_key_name));
-  std::unique_ptr<google::protobuf::Message> current_message(dynamic_message_factory->GetPrototype(current_desc)->New());
-  for (base::DictionaryValue::Iterator dict_iterator(*dict_value);
-    !dict_iterator.IsAtEnd();
-    dict_iterator.Advance()) {
-    AssignDataJudgeType(&dict_iterator.value(), dict_iterator.key(), current_desc, current_message.get(), file_desc, dynamic_message_factory);
+  std::unique_ptr<google::protobuf::DynamicMessageFactory> dynamic_message_factory(
+    new google::protobuf::DynamicMessageFactory(desc_pool.get()));
+  std::unique_ptr<google::protobuf::Arena> message_arena = NewMessageArena();
+  MessagePtr root_message;
+  {
+    ScopedTraceSpan span("CreateMessage");
+    root_message = NewRootMessage(
+      file_desc, dynamic_message_factory.get(), message_arena.get(), error_message);
+    if (!root_message) {
+      return false;
+    }
+    std::unique_ptr<JsonMessageBuilder> message_builder = CreateMessageBuilder(
+      schema_mode_, root_message.get(), dynamic_message_factory.get());
+    std::unique_ptr<TracedJsonSaxHandler> traced_handler;
+    if (!json_tape.Replay(TracedJsonSaxHandler::Wrap(message_builder.get(), &traced_handler),
+          error_message)) {
+      return false;
+    }
+    if (traced_handler) {
+      span.AddArg("nodes", traced_handler->node_count());
+    }
   }
-  const google::protobuf::Reflection* reflection = parent_message->GetReflection();
-  auto field_desc = parent_desc->FindFieldByLowercaseName(unique_key_name);
-  reflection->SetAllocatedMessage(parent_message, current_message.release(), field_desc);
+
+  return WriteOutput(*root_message, error_message);
 }
 
-void JsonToProtobufSerializer::AssignDataRecurveListValue(
-  const base::ListValue* list_value,
-  const std::string& key_name,
-  const google::protobuf::Descriptor* parent_desc,
-  google::protobuf::Message* parent_message,
-  const google::protobuf::FileDescriptor* file_desc,
-  google::protobuf::DynamicMessageFactory* dynamic_message_factory) {
-  DCHECK(list_value);
+bool JsonToProtobufSerializer::SerializeFromStream(
+  JsonInputStream* input_stream,
+  std::string& error_message) {
+  DCHECK(input_stream);
+  uint64_t fingerprint = 0;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto;
+  if (schema_cache_) {
+    // 指纹只看结构, 比推导 schema 和 BuildFile 便宜得多
+    // 模式和 enum 的上限不同, 同一个结构生成的 schema 也不同, 都带进指纹
+    JsonShapeFingerprint shape_fingerprint(schema_mode_, max_enum_cardinality_);
+    JsonSaxReader json_reader(input_stream);
+    if (!json_reader.Parse(&shape_fingerprint, error_message)) {
+      return false;
+    }
+    fingerprint = shape_fingerprint.fingerprint();
+    file_desc_proto = schema_cache_->Load(fingerprint);
+    if (!input_stream->Rewind()) {
+      error_message = "rewind input stream fail";
+      return false;
+    }
+    if (file_desc_proto) {
+      if (SerializeWithProtoFile(input_stream, std::move(file_desc_proto), error_message)) {
+        return true;
+      }
+      // 指纹冲突或者缓存文件过期, 重新推导并覆盖缓存
+      LOG(WARNING) << "cached schema does not fit the input: " << error_message;
+      if (!input_stream->Rewind()) {
+        error_message = "rewind input stream fail";
+        return false;
+      }
+    }
+  }
 
-  //每一个数组里面的子项都会分配一个message,由于json这些子项是不会有name的，所以每个子项的名
-  //字在父项的名字基础上进行数字递增
-  std::string unique_key_name = key_name + "_" + base::IntToString(GenerateIndex());
-  std::string upper_key_name = base::ToUpperASCII(unique_key_name);
-  std::string lower_key_name = base::ToLowerASCII(unique_key_name);
-  const google::protobuf::Descriptor* current_desc = file_desc->FindMessageTypeByName(upper_key_name);
-  std::unique_ptr<google::protobuf::Message> current_message(dynamic_message_factory->GetPrototype(current_desc)->New());
+  BuildProtoFromJson build_proto_from_json;
+  build_proto_from_json.set_max_enum_cardinality(max_enum_cardinality_);
+  file_desc_proto = build_proto_from_json.CreateProtoFileFromStream(
+    input_stream, schema_mode_, error_message);
+  if (!file_desc_proto) {
+    return false;
+  }
+  if (schema_cache_ && !schema_cache_->Store(fingerprint, *file_desc_proto)) {
+    LOG(WARNING) << "store schema cache entry fail";
+  }
+  if (!input_stream->Rewind()) {
+    error_message = "rewind input stream fail";
+    return false;
+  }
+  return SerializeWithProtoFile(input_stream, std::move(file_desc_proto), error_message);
+}
 
-  for (int index = 0; index < list_value->GetSize(); index++) {
-    const base::Value* value;
-    if (!list_value->Get(index, &value)) {
-      continue;
-    }
+bool JsonToProtobufSerializer::SerializeWithProtoFile(
+  JsonInputStream* input_stream,
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto,
+  std::string& error_message) {
+  // schema 已经生成, BuildFile 释放掉 FileDescriptorProto 再读第二遍
+  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool;
+  const google::protobuf::FileDescriptor* file_desc =
+    BuildFile(std::move(file_desc_proto), &desc_pool, error_message);
+  if (!file_desc) {
+    return false;
+  }
 
-    AssignDataJudgeType(value, lower_key_name + "_" + base::IntToString(GenerateIndex()), current_desc, current_message.get(), file_desc, dynamic_message_factory);
+  std::unique_ptr<google::protobuf::DynamicMessageFactory> dynamic_message_factory(
+    new google::protobuf::DynamicMessageFactory(desc_pool.get()));
+  std::unique_ptr<google::protobuf::Arena> message_arena = NewMessageArena();
+  MessagePtr root_message = CreateMessageFromStream(input_stream, file_desc,
+    dynamic_message_factory.get(), message_arena.get(), error_message);
+  if (!root_message) {
+    return false;
   }
 
-  const google::protobuf::Reflection* parent_message_reflection = parent_message->GetReflection();
-  auto filed_desc = parent_desc->FindFieldByLowercaseName(unique_key_name);
-  parent_message_reflection->SetAllocatedMessage(parent_message, current_message.release(), filed_desc);
+  return WriteOutput(*root_message, error_message);
 }
 
-void JsonToProtobufSerializer::AssignDataJudgeType(
-  const base::Value* value,
-  const std::string& key_name,
-  const google::protobuf::Descriptor* parent_desc,
-  google::protobuf::Message* parent_message,
-  const google::protobuf::FileDescriptor* file_desc,
-  google::protobuf::DynamicMessageFactory* dynamic_message_factory) {
-
-  base::Value::Type type = value->GetType();
+const google::protobuf::FileDescriptor* JsonToProtobufSerializer::BuildFile(
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto,
+  std::unique_ptr<google::protobuf::DescriptorPool>* desc_pool,
+  std::string& error_message) {
+  ScopedTraceSpan span("BuildFile");
+  span.AddArg("descriptors", file_desc_proto->message_type_size());
+  desc_pool->reset(new google::protobuf::DescriptorPool());
+  const google::protobuf::FileDescriptor* file_desc = (*desc_pool)->BuildFile(*file_desc_proto);
+  if (!file_desc) {
+    error_message = "build proto file fail";
+  }
+  return file_desc;
+}
 
-  if (base::Value::Type::LIST == type) {
-    AssignDataListValueLogical(value, key_name, parent_desc, parent_message, file_desc, dynamic_message_factory);
+bool JsonToProtobufSerializer::WriteOutput(
+  const google::protobuf::Message& root_message,
+  std::string& error_message) {
+  if (output_file_path_.empty()) {
+    return true;
+  }
+  if (write_descriptor_set_ &&
+      !WriteDescriptorSet(root_message.GetDescriptor()->file(), output_file_path_,
+        error_message)) {
+    return false;
+  }
 
-  } else if (base::Value::Type::DICTIONARY == type) {
-    const base::DictionaryValue* dict_value;
-    if (value->GetAsDictionary(&dict_value)) {
-      AssignDataRecurveDictionaryValue(dict_value, key_name, parent_desc, parent_message, file_desc, dynamic_message_factory);
+  // 直接编码进文件的缓冲, 不在内存里拼出完整的编码
+  ScopedTraceSpan span("WriteOutput");
+  if (container_options_) {
+    RecordContainerWriter container_writer(*container_options_);
+    return container_writer.Open(output_file_path_, use_io_thread_, error_message) &&
+      container_writer.Append(root_message, error_message) &&
+      container_writer.Close(error_message);
+  }
+  ProtobufFileOutputStream output_stream;
+  if (output_options_) {
+    output_stream.set_options(*output_options_);
+  }
+  if (!output_stream.Open(output_file_path_, use_io_thread_, error_message)) {
+    return false;
+  }
+  if (!root_message.SerializeToZeroCopyStream(&output_stream)) {
+    // 写失败时 Close 给出的原因更准确
+    if (output_stream.Close(error_message)) {
+      error_message = "serialize message fail";
     }
-  } else {
-    AssignData(value, key_name, parent_desc, parent_message);
+    return false;
   }
+  span.AddArg("bytes", output_stream.ByteCount());
+  return output_stream.Close(error_message);
 }
 
-void JsonToProtobufSerializer::AssignDataListValueLogical(
-  const base::Value* value,
-  const std::string& key_name,
-  const google::protobuf::Descriptor* parent_desc,
-  google::protobuf::Message* parent_message,
+bool JsonToProtobufSerializer::WriteDescriptorSet(
   const google::protobuf::FileDescriptor* file_desc,
-  google::protobuf::DynamicMessageFactory* dynamic_message_factory) {
-  DCHECK(value && parent_desc && parent_message && file_desc && dynamic_message_factory);
+  const base::FilePath& output_file_path,
+  std::string& error_message) {
+  // 推导出的 schema 不依赖其它 proto 文件, 一个文件就是完整的描述
+  google::protobuf::FileDescriptorSet file_desc_set;
+  file_desc->CopyTo(file_desc_set.add_file());
+  ProtobufFileOutputStream output_stream;
+  if (!output_stream.Open(DescriptorSetPath(output_file_path), false, error_message)) {
+    return false;
+  }
+  if (!file_desc_set.SerializeToZeroCopyStream(&output_stream)) {
+    if (output_stream.Close(error_message)) {
+      error_message = "serialize descriptor set fail";
+    }
+    return false;
+  }
+  return output_stream.Close(error_message);
+}
 
-  const base::ListValue* list_value;
-  if (value->GetAsList(&list_value) && !list_value->empty()) {
-    const base::Value* probe_value;
-    list_value->Get(0, &probe_value);
-    base::Value::Type probe_type = probe_value->GetType();
+base::FilePath JsonToProtobufSerializer::DescriptorSetPath(
+  const base::FilePath& output_file_path) {
+  return output_file_path.AddExtension(FILE_PATH_LITERAL("desc"));
+}
 
-    if ((base::Value::Type::LIST == probe_type) ||
-      (base::Value::Type::DICTIONARY == probe_type)) {
-      //只要是一个key:[] 的格式，那么就为每个子项生成一个message，一位内子项可能不一样
-      AssignDataRecurveListValue(list_value, key_name, parent_desc, parent_message, file_desc, dynamic_message_factory);
+JsonToProtobufSerializer::MessagePtr JsonToProtobufSerializer::CreateMessageFromStream(
+  JsonInputStream* input_stream,
+  const google::protobuf::FileDescriptor* file_desc,
+  google::protobuf::DynamicMessageFactory* dynamic_message_factory,
+  google::protobuf::Arena* message_arena,
+  std::string& error_message) {
+  ScopedTraceSpan span("CreateMessage");
+  span.AddArg("bytes", input_stream->GetLength());
+  MessagePtr root_message =
+    NewRootMessage(file_desc, dynamic_message_factory, message_arena, error_message);
+  if (!root_message) {
+    return nullptr;
+  }
+  std::unique_ptr<JsonMessageBuilder> message_builder =
+    CreateMessageBuilder(schema_mode_, root_message.get(), dynamic_message_factory);
+  std::unique_ptr<TracedJsonSaxHandler> traced_handler;
+  JsonSaxReader json_reader(input_stream);
+  if (!json_reader.Parse(TracedJsonSaxHandler::Wrap(message_builder.get(), &traced_handler),
+        error_message)) {
+    return nullptr;
+  }
+  if (traced_handler) {
+    span.AddArg("nodes", traced_handler->node_count());
+  }
+  return root_message;
+}
 
-    } else {
-      AssignRepeatedData(list_value, key_name, parent_desc, parent_message);
-    }
+JsonToProtobufSerializer::MessagePtr JsonToProtobufSerializer::NewRootMessage(
+  const google::protobuf::FileDescriptor* file_desc,
+  google::protobuf::DynamicMessageFactory* dynamic_message_factory,
+  google::protobuf::Arena* message_arena,
+  std::string& error_message) {
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  if (!root_desc) {
+    error_message = "no ROOT message in proto file";
+    return nullptr;
   }
+  // 子 message 由 reflection 的 MutableMessage 创建, 和父 message 在同一个 arena 上
+  return MessagePtr(dynamic_message_factory->GetPrototype(root_desc)->New(message_arena));
 }
 
-void JsonToProtobufSerializer::AssignData(
-  const base::Value* value,
-  const std::string& key_name,
-  const google::protobuf::Descriptor* parent_desc,
-  google::protobuf::Message* parent_message) {
+std::unique_ptr<google::protobuf::Arena> JsonToProtobufSerializer::NewMessageArena() const {
+  if (!use_arena_) {
+    return nullptr;
+  }
+  return std::unique_ptr<google::protobuf::Arena>(new google::protobuf::Arena());
+}
 
-  base::Value::Type type = value->GetType();
-  auto field_desc = parent_desc->FindFieldByLowercaseName(key_name);
-  auto reflection = parent_message->GetReflection();
-  switch (type) {
-  case base::Value::Type::BOOLEAN: {
-    bool temp = false;
-    value->GetAsBoolean(&temp);
-    reflection->SetBool(parent_message, field_desc, temp);
-  } break;
-  case base::Value::Type::INTEGER: {
-    int temp = 0;
-    value->GetAsInteger(&temp);
-    reflection->SetInt64(parent_message, field_desc, temp);
-  } break;
-  case base::Value::Type::DOUBLE: {
-    double temp = 0.0f;
-    value->GetAsDouble(&temp);
-    reflection->SetDouble(parent_message, field_desc, temp);
-  } break;
-  case base::Value::Type::STRING: {
-    std::string temp;
-    value->GetAsString(&temp);
-    reflection->SetString(parent_message, field_desc, temp);
-  } break;
-  case base::Value::Type::BINARY: {
-  } break;
-  default: {
-  } break;
+void JsonToProtobufSerializer::MessageDeleter::operator()(
+  google::protobuf::Message* message) const {
+  if (!message->GetArena()) {
+    delete message;
   }
 }
 
-void JsonToProtobufSerializer::AssignRepeatedData(
-  const base::ListValue* value,
-  const std::string& key_name,
-  const google::protobuf::Descriptor* parent_desc,
-  google::protobuf::Message* parent_message) {
-  
-  const google::protobuf::FieldDescriptor* field_desc = parent_desc->FindFieldByLowercaseName(key_name);
-  const google::protobuf::Reflection* reflection = parent_message->GetReflection();
-  for (const std::unique_ptr<base::Value>& value_item : *value) {
-    switch (value_item->GetType()) {
-    case base::Value::Type::BOOLEAN: {
-      bool temp = false;
-      value->GetAsBoolean(&temp);
-      reflection->AddBool(parent_message, field_desc, temp);
-    } break;
-    case base::Value::Type::INTEGER: {
-      int temp = 0;
-      value->GetAsInteger(&temp);
-      reflection->AddInt64(parent_message, field_desc, temp);
-    } break;
-    case base::Value::Type::DOUBLE: {
-      double temp = 0.0f;
-      value->GetAsDouble(&temp);
-      reflection->AddDouble(parent_message, field_desc, temp);
-    } break;
-    case base::Value::Type::STRING: {
-      std::string temp;
-      value->GetAsString(&temp);
-      reflection->AddString(parent_message, field_desc, temp);
-    } break;
-    case base::Value::Type::BINARY: {
-    } break;
-    default: {
-    } break;
-    }
+std::unique_ptr<JsonMessageBuilder> JsonToProtobufSerializer::CreateMessageBuilder(
+  SchemaMode schema_mode,
+  google::protobuf::Message* root_message,
+  google::protobuf::MessageFactory* message_factory) {
+  // kCompact 的 schema 结构和 kUnified 一样, 只是类型和字段号不同
+  if (schema_mode != SchemaMode::kPerElement) {
+    return std::unique_ptr<JsonMessageBuilder>(
+      new JsonUnifiedMessageBuilder(root_message, message_factory));
   }
+  return std::unique_ptr<JsonMessageBuilder>(
+    new JsonStreamMessageBuilder(root_message, message_factory));
 }
 
 } //namespace self
\ No newline at end of file
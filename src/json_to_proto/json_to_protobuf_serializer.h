@@ -4,23 +4,31 @@
 #include "base/values.h"
 #include "base/files/file_path.h"
 #include "base/macros.h"
+#include "build_proto_from_json.h"
 
 namespace base {
-class DictionaryValue;
-class ListValue;
 class Value;
 }
 
 namespace google {
 namespace protobuf {
+class Arena;
+class DescriptorPool;
 class DynamicMessageFactory;
 class FileDescriptor;
+class FileDescriptorProto;
 class Message;
-class Descriptor;
+class MessageFactory;
 } //namespace protobuf
 } // google
 
 namespace self {
+class JsonInputStream;
+class JsonMessageBuilder;
+class SchemaCache;
+struct OutputStreamOptions;
+struct RecordContainerOptions;
+
 class JsonToProtobufSerializer : public base::ValueSerializer {
 public:
   JsonToProtobufSerializer() = delete;
@@ -32,57 +40,121 @@ public:
 
   virtual bool Serialize(const base::Value& root) override;
 
-private:
-  std::unique_ptr<google::protobuf::Message> CreateMessage(
-    const base::DictionaryValue* root_dict,
-    const google::protobuf::FileDescriptor* file_desc,
-    google::protobuf::DynamicMessageFactory* dynamic_message_factory);
+  // Walks |root| once, inferring the schema while recording the values on a
+  // JsonTape, then fills the message from the tape.
+  bool SerializeValue(
+    const base::Value& root,
+    std::string& error_message);
 
-  void AssignDataRecurveDictionaryValue(
-    const base::DictionaryValue* dict_value,
-    const std::string& key_name,
-    const google::protobuf::Descriptor* parent_desc,
-    google::protobuf::Message* parent_message,
-    const google::protobuf::FileDescriptor* file_desc,
-    google::protobuf::DynamicMessageFactory* dynamic_message_factory);
+  // Reads |input_stream| twice, once to infer the schema and once to fill the
+  // message, without building a base::Value tree.
+  bool SerializeFromStream(
+    JsonInputStream* input_stream,
+    std::string& error_message);
+
+  // Looks the schema up by the input's shape fingerprint before inferring it.
+  // Not owned, may be null.
+  void set_schema_cache(SchemaCache* schema_cache) { schema_cache_ = schema_cache; }
+
+  // Builds |file_desc_proto| into a new |desc_pool| and frees it.
+  static const google::protobuf::FileDescriptor* BuildFile(
+    std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto,
+    std::unique_ptr<google::protobuf::DescriptorPool>* desc_pool,
+    std::string& error_message);
+
+  // The builder that fills messages of the schema |schema_mode| infers.
+  static std::unique_ptr<JsonMessageBuilder> CreateMessageBuilder(
+    SchemaMode schema_mode,
+    google::protobuf::Message* root_message,
+    google::protobuf::MessageFactory* message_factory);
+
+  // Defaults to SchemaMode::kPerElement.
+  void set_schema_mode(SchemaMode schema_mode) { schema_mode_ = schema_mode; }
+
+  // See BuildProtoFromJson::set_max_enum_cardinality().
+  void set_max_enum_cardinality(size_t max_enum_cardinality) {
+    max_enum_cardinality_ = max_enum_cardinality;
+  }
+
+  // Creates the message tree on a google::protobuf::Arena that is freed in one
+  // go after the conversion, instead of one heap object per sub-message.
+  void set_use_arena(bool use_arena) { use_arena_ = use_arena; }
+
+  // Writes the output file on a background thread while the message is
+  // still being encoded.
+  void set_use_io_thread(bool use_io_thread) { use_io_thread_ = use_io_thread; }
 
-  void AssignDataRecurveListValue(
-    const base::ListValue* list_value,
-    const std::string& key_name,
-    const google::protobuf::Descriptor* parent_desc,
-    google::protobuf::Message* parent_message,
+  // The buffer size and compression of the output file. Not owned, null for
+  // the defaults. Not used with container options.
+  void set_output_options(const OutputStreamOptions* output_options) {
+    output_options_ = output_options;
+  }
+
+  // Also writes the schema as a FileDescriptorSet to DescriptorSetPath().
+  void set_write_descriptor_set(bool write_descriptor_set) {
+    write_descriptor_set_ = write_descriptor_set;
+  }
+
+  // Writes the root message as the only record of a RecordContainerWriter
+  // file instead of its bare encoding. Not owned, null by default.
+  void set_container_options(const RecordContainerOptions* container_options) {
+    container_options_ = container_options;
+  }
+
+  // The output path with ".desc" appended.
+  static base::FilePath DescriptorSetPath(const base::FilePath& output_file_path);
+
+  // Writes |file_desc| as a FileDescriptorSet to DescriptorSetPath().
+  static bool WriteDescriptorSet(
     const google::protobuf::FileDescriptor* file_desc,
-    google::protobuf::DynamicMessageFactory* dynamic_message_factory);
+    const base::FilePath& output_file_path,
+    std::string& error_message);
+
+private:
+  // Deletes heap messages only, arena messages go with their arena.
+  struct MessageDeleter {
+    void operator()(google::protobuf::Message* message) const;
+  };
+  typedef std::unique_ptr<google::protobuf::Message, MessageDeleter> MessagePtr;
+
+  // A new arena when arena mode is on, otherwise null.
+  std::unique_ptr<google::protobuf::Arena> NewMessageArena() const;
+
+  bool SerializeWithProtoFile(
+    JsonInputStream* input_stream,
+    std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto,
+    std::string& error_message);
 
-  void AssignDataJudgeType(
-    const base::Value* value,
-    const std::string& key_name,
-    const google::protobuf::Descriptor* parent_desc,
-    google::protobuf::Message* parent_message,
+  // Encodes |root_message| straight into the output file, or into a record
+  // container. Nothing is written when the output path is empty.
+  bool WriteOutput(
+    const google::protobuf::Message& root_message,
+    std::string& error_message);
+
+  MessagePtr CreateMessageFromStream(
+    JsonInputStream* input_stream,
     const google::protobuf::FileDescriptor* file_desc,
-    google::protobuf::DynamicMessageFactory* dynamic_message_factory);
+    google::protobuf::DynamicMessageFactory* dynamic_message_factory,
+    google::protobuf::Arena* message_arena,
+    std::string& error_message);
 
-  void AssignDataListValueLogical(
-    const base::Value* value,
-    const std::string& key_name,
-    const google::protobuf::Descriptor* parent_desc,
-    google::protobuf::Message* parent_message,
+  // |message_arena| may be null.
+  MessagePtr NewRootMessage(
     const google::protobuf::FileDescriptor* file_desc,
-    google::protobuf::DynamicMessageFactory* dynamic_message_factory);
-
-  void AssignData(
-    const base::Value* value,
-    const std::string& key_name,
-    const google::protobuf::Descriptor* parent_desc,
-    google::protobuf::Message* parent_message);
-
-  void AssignRepeatedData(
-    const base::ListValue* value,
-    const std::string& key_name,
-    const google::protobuf::Descriptor* parent_desc,
-    google::protobuf::Message* parent_message);
+    google::protobuf::DynamicMessageFactory* dynamic_message_factory,
+    google::protobuf::Arena* message_arena,
+    std::string& error_message);
+
 private:
   const base::FilePath output_file_path_;
+  SchemaCache* schema_cache_;
+  SchemaMode schema_mode_;
+  size_t max_enum_cardinality_;
+  bool use_arena_;
+  bool use_io_thread_;
+  bool write_descriptor_set_;
+  const OutputStreamOptions* output_options_;
+  const RecordContainerOptions* container_options_;
 
 private:
   DISALLOW_COPY_AND_ASSIGN(JsonToProtobufSerializer);
@@ -0,0 +1,332 @@
+#include "json_unified_message_builder.h"
+
+#include <limits>
+
+#include "base/logging.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+
+namespace self {
+
+JsonUnifiedMessageBuilder::JsonUnifiedMessageBuilder(
+  google::protobuf::Message* root_message,
+  google::protobuf::MessageFactory* message_factory)
+  : root_message_(root_message),
+    message_factory_(message_factory),
+    plan_cache_(SchemaMode::kUnified) {
+  DCHECK(root_message_ && message_factory_);
+}
+
+JsonUnifiedMessageBuilder::~JsonUnifiedMessageBuilder() {
+}
+
+void JsonUnifiedMessageBuilder::Reset(google::protobuf::Message* root_message) {
+  DCHECK(root_message);
+  root_message_ = root_message;
+  stack_.clear();
+  key_name_.clear();
+  error_message_.clear();
+}
+
+bool JsonUnifiedMessageBuilder::OnStartObject() {
+  if (stack_.empty()) {
+    stack_.push_back({FrameType::kMessage, root_message_,
+      plan_cache_.GetPlan(root_message_->GetDescriptor()), nullptr, 0});
+    return true;
+  }
+  return StartContainer(JsonValueType::kObject);
+}
+
+bool JsonUnifiedMessageBuilder::OnKey(const base::StringPiece& key) {
+  key.CopyToString(&key_name_);
+  return true;
+}
+
+bool JsonUnifiedMessageBuilder::OnEndObject() {
+  DCHECK(!stack_.empty());
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonUnifiedMessageBuilder::OnStartArray() {
+  if (stack_.empty()) {
+    error_message_ = "root value is not a json object";
+    return false;
+  }
+  return StartContainer(JsonValueType::kArray);
+}
+
+bool JsonUnifiedMessageBuilder::OnEndArray() {
+  DCHECK(!stack_.empty());
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonUnifiedMessageBuilder::OnNull() {
+  // null 在 unified schema 里不占位置, 数组里的 null 也直接丢掉;
+  // key 重复时 null 是最后一个值, 前面的值要清掉
+  if (stack_.empty() || stack_.back().type != FrameType::kMessage) {
+    return true;
+  }
+  Frame& frame = stack_.back();
+  const FieldBinding* binding = frame.plan->FindBinding(key_name_, &frame.hint);
+  if (binding) {
+    ClearEarlierValue(frame.message, binding);
+  }
+  return true;
+}
+
+bool JsonUnifiedMessageBuilder::OnBoolean(bool value) {
+  return WriteScalar(JsonValueType::kBoolean, value, 0, 0.0, base::StringPiece());
+}
+
+bool JsonUnifiedMessageBuilder::OnInteger(int64_t value) {
+  return WriteScalar(JsonValueType::kInteger, false, value, 0.0, base::StringPiece());
+}
+
+bool JsonUnifiedMessageBuilder::OnDouble(double value) {
+  return WriteScalar(JsonValueType::kDouble, false, 0, value, base::StringPiece());
+}
+
+bool JsonUnifiedMessageBuilder::OnString(const base::StringPiece& value) {
+  return WriteScalar(JsonValueType::kString, false, 0, 0.0, value);
+}
+
+bool JsonUnifiedMessageBuilder::PrepareSlot(JsonValueType value_type, Slot* slot) {
+  DCHECK(!stack_.empty());
+  Frame& frame = stack_.back();
+  switch (frame.type) {
+  case FrameType::kMessage: {
+    const FieldBinding* binding = frame.plan->FindBinding(key_name_, &frame.hint);
+    if (!binding) {
+      error_message_ = "no field for json key: " + key_name_;
+      return false;
+    }
+    ClearEarlierValue(frame.message, binding);
+    *slot = {frame.message, binding, false};
+  } break;
+  case FrameType::kList: {
+    *slot = {frame.message, frame.binding, true};
+  } break;
+  default: {
+  } return false;
+  }
+
+  // key 对应 repeated 字段时值是整个数组, 元素到了 kList 里再处理
+  const FieldBinding* binding = slot->binding;
+  if (binding->repeated != slot->in_list ||
+      !binding->child_plan || !binding->child_plan->is_variant()) {
+    return true;
+  }
+
+  // 同一个路径上有多种类型, 先进入 variant message, 再按值的类型选 oneof 里的字段
+  const FieldBinding* variant_binding = binding->child_plan->variant_binding(value_type);
+  if (!variant_binding) {
+    error_message_ = "no variant field for json value: " + binding->key.as_string();
+    return false;
+  }
+
+  const google::protobuf::Reflection* reflection = slot->message->GetReflection();
+  google::protobuf::Message* variant_message = slot->in_list ?
+    reflection->AddMessage(slot->message, binding->field_desc, message_factory_) :
+    reflection->MutableMessage(slot->message, binding->field_desc, message_factory_);
+  *slot = {variant_message, variant_binding, false};
+  return true;
+}
+
+void JsonUnifiedMessageBuilder::ClearEarlierValue(
+  google::protobuf::Message* message,
+  const FieldBinding* binding) {
+  // 字段已经有值说明 key 重复了, 最后一个值说了算: 对象不合并, 数组不接着追加
+  const google::protobuf::Reflection* reflection = message->GetReflection();
+  const bool has_value = binding->repeated ?
+    reflection->FieldSize(*message, binding->field_desc) > 0 :
+    reflection->HasField(*message, binding->field_desc);
+  if (has_value) {
+    reflection->ClearField(message, binding->field_desc);
+  }
+}
+
+bool JsonUnifiedMessageBuilder::StartContainer(JsonValueType value_type) {
+  Slot slot;
+  if (!PrepareSlot(value_type, &slot)) {
+    // 空数组在 schema 里没有字段, 不算错误
+    if (!error_message_.empty() && value_type != JsonValueType::kArray) {
+      return false;
+    }
+    error_message_.clear();
+    stack_.push_back({FrameType::kSkip, nullptr, nullptr, nullptr, 0});
+    return true;
+  }
+
+  const FieldBinding* binding = slot.binding;
+  const google::protobuf::Reflection* reflection = slot.message->GetReflection();
+  if (value_type == JsonValueType::kArray && binding->repeated && !slot.in_list) {
+    stack_.push_back({FrameType::kList, slot.message, nullptr, binding, 0});
+    return true;
+  }
+  // 只在别的值旁边见过空数组时字段里没有数组, 和没有字段的空数组一样跳过
+  if (value_type == JsonValueType::kArray && binding->repeated == slot.in_list &&
+      binding->setter_kind != SetterKind::kMessage) {
+    stack_.push_back({FrameType::kSkip, nullptr, nullptr, nullptr, 0});
+    return true;
+  }
+  if (binding->setter_kind != SetterKind::kMessage || binding->repeated != slot.in_list) {
+    error_message_ = "value type does not match field: " + binding->field_desc->name();
+    return false;
+  }
+
+  google::protobuf::Message* message = binding->repeated ?
+    reflection->AddMessage(slot.message, binding->field_desc, message_factory_) :
+    reflection->MutableMessage(slot.message, binding->field_desc, message_factory_);
+  if (value_type == JsonValueType::kObject) {
+    stack_.push_back({FrameType::kMessage, message, binding->child_plan, nullptr, 0});
+    return true;
+  }
+
+  // 数组的数组, 内层数组放在包装 message 的 item 字段里
+  const FieldBinding* item_binding = binding->child_plan->item_binding();
+  if (!item_binding) {
+    stack_.push_back({FrameType::kSkip, nullptr, nullptr, nullptr, 0});
+    return true;
+  }
+  stack_.push_back({FrameType::kList, message, nullptr, item_binding, 0});
+  return true;
+}
+
+bool JsonUnifiedMessageBuilder::WriteScalar(
+  JsonValueType value_type,
+  bool boolean_value,
+  int64_t integer_value,
+  double double_value,
+  const base::StringPiece& string_value) {
+  Slot slot;
+  if (!PrepareSlot(value_type, &slot)) {
+    return error_message_.empty();
+  }
+
+  const FieldBinding* binding = slot.binding;
+  const google::protobuf::FieldDescriptor* field_desc = binding->field_desc;
+  google::protobuf::Message* message = slot.message;
+  const google::protobuf::Reflection* reflection = message->GetReflection();
+  bool repeated = binding->repeated;
+  if (repeated == slot.in_list) {
+    switch (binding->setter_kind) {
+    case SetterKind::kBool: {
+      if (value_type != JsonValueType::kBoolean) {
+        break;
+      }
+      if (repeated) {
+        reflection->AddBool(message, field_desc, boolean_value);
+      } else {
+        reflection->SetBool(message, field_desc, boolean_value);
+      }
+    } return true;
+    case SetterKind::kInt64: {
+      if (value_type != JsonValueType::kInteger) {
+        break;
+      }
+      if (repeated) {
+        reflection->AddInt64(message, field_desc, integer_value);
+      } else {
+        reflection->SetInt64(message, field_desc, integer_value);
+      }
+    } return true;
+    // kCompact 的类型按推导 schema 的那份文档收窄, 放不下的值报错, 不悄悄截断,
+    // 用缓存的 schema 时会重新推导
+    case SetterKind::kInt32: {
+      if (value_type != JsonValueType::kInteger) {
+        break;
+      }
+      if (integer_value < std::numeric_limits<int32_t>::min() ||
+          integer_value > std::numeric_limits<int32_t>::max()) {
+        error_message_ = "value does not fit field: " + field_desc->name();
+        return false;
+      }
+      if (repeated) {
+        reflection->AddInt32(message, field_desc, static_cast<int32_t>(integer_value));
+      } else {
+        reflection->SetInt32(message, field_desc, static_cast<int32_t>(integer_value));
+      }
+    } return true;
+    case SetterKind::kUint32: {
+      if (value_type != JsonValueType::kInteger) {
+        break;
+      }
+      if (integer_value < 0 || integer_value > std::numeric_limits<uint32_t>::max()) {
+        error_message_ = "value does not fit field: " + field_desc->name();
+        return false;
+      }
+      if (repeated) {
+        reflection->AddUInt32(message, field_desc, static_cast<uint32_t>(integer_value));
+      } else {
+        reflection->SetUInt32(message, field_desc, static_cast<uint32_t>(integer_value));
+      }
+    } return true;
+    case SetterKind::kFloat: {
+      if (value_type == JsonValueType::kInteger) {
+        double_value = static_cast<double>(integer_value);
+      } else if (value_type != JsonValueType::kDouble) {
+        break;
+      }
+      const float float_value = static_cast<float>(double_value);
+      if (static_cast<double>(float_value) != double_value) {
+        error_message_ = "value does not fit field: " + field_desc->name();
+        return false;
+      }
+      if (repeated) {
+        reflection->AddFloat(message, field_desc, float_value);
+      } else {
+        reflection->SetFloat(message, field_desc, float_value);
+      }
+    } return true;
+    case SetterKind::kDouble: {
+      if (value_type == JsonValueType::kInteger) {
+        double_value = static_cast<double>(integer_value);
+      } else if (value_type != JsonValueType::kDouble) {
+        break;
+      }
+      if (repeated) {
+        reflection->AddDouble(message, field_desc, double_value);
+      } else {
+        reflection->SetDouble(message, field_desc, double_value);
+      }
+    } return true;
+    case SetterKind::kString: {
+      if (value_type != JsonValueType::kString) {
+        break;
+      }
+      string_value.CopyToString(&string_value_);
+      if (repeated) {
+        reflection->AddString(message, field_desc, string_value_);
+      } else {
+        reflection->SetString(message, field_desc, string_value_);
+      }
+    } return true;
+    case SetterKind::kEnum: {
+      if (value_type != JsonValueType::kString) {
+        break;
+      }
+      // 枚举只有推导 schema 时见过的字符串
+      const google::protobuf::EnumValueDescriptor* value_desc =
+        binding->FindEnumValue(string_value);
+      if (!value_desc) {
+        error_message_ = "value does not fit field: " + field_desc->name();
+        return false;
+      }
+      if (repeated) {
+        reflection->AddEnum(message, field_desc, value_desc);
+      } else {
+        reflection->SetEnum(message, field_desc, value_desc);
+      }
+    } return true;
+    default: {
+    } break;
+    }
+  }
+
+  error_message_ = "value type does not match field: " + field_desc->name();
+  return false;
+}
+
+} //namespace self
@@ -0,0 +1,106 @@
+#ifndef JSON_UNIFIED_MESSAGE_BUILDER_H_
+#define JSON_UNIFIED_MESSAGE_BUILDER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "field_binding_plan.h"
+#include "json_sax_reader.h"
+#include "json_stream_message_builder.h"
+
+namespace google {
+namespace protobuf {
+class Message;
+class MessageFactory;
+} // namespace protobuf
+} // google
+
+namespace self {
+
+// Fills |root_message| from parse events using the message types written by
+// JsonUnifiedSchemaBuilder. Keys are matched against the fields' json_name
+// through the binding plans of the message types, every element of an array
+// is appended to the one repeated field.
+class JsonUnifiedMessageBuilder : public JsonMessageBuilder {
+public:
+  JsonUnifiedMessageBuilder(
+    google::protobuf::Message* root_message,
+    google::protobuf::MessageFactory* message_factory);
+
+  ~JsonUnifiedMessageBuilder() override;
+
+  // Starts over with another root message, keeps the binding plans.
+  void Reset(google::protobuf::Message* root_message) override;
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+private:
+  enum class FrameType {
+    kMessage,
+    kList,
+    kSkip
+  };
+
+  struct Frame {
+    FrameType type;
+    google::protobuf::Message* message;
+    // kMessage: the plan of |message|
+    const MessageBindingPlan* plan;
+    // kList: the repeated field every element goes to
+    const FieldBinding* binding;
+    // kMessage: where the plan looks for the next key first
+    size_t hint;
+  };
+
+  // Where the next value goes. |in_list| is true for array elements, which
+  // are added to the field instead of set.
+  struct Slot {
+    google::protobuf::Message* message;
+    const FieldBinding* binding;
+    bool in_list;
+  };
+
+  // Returns false when the value has no field, it is dropped then.
+  bool PrepareSlot(JsonValueType value_type, Slot* slot);
+
+  // Clears |binding|'s field of |message| when a repeated key set it before.
+  void ClearEarlierValue(
+    google::protobuf::Message* message,
+    const FieldBinding* binding);
+
+  bool StartContainer(JsonValueType value_type);
+
+  bool WriteScalar(
+    JsonValueType value_type,
+    bool boolean_value,
+    int64_t integer_value,
+    double double_value,
+    const base::StringPiece& string_value);
+
+private:
+  google::protobuf::Message* root_message_;
+  google::protobuf::MessageFactory* message_factory_;
+  BindingPlanCache plan_cache_;
+  std::vector<Frame> stack_;
+  std::string key_name_;
+  // 反射的 SetString 只收 std::string, 复用同一个, 不用每个值构造一次
+  std::string string_value_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonUnifiedMessageBuilder);
+};
+
+} // namespace self
+#endif // JSON_UNIFIED_MESSAGE_BUILDER_H_
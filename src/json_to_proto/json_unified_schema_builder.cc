@@ -0,0 +1,621 @@
+#include "json_unified_schema_builder.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+
+namespace self {
+
+namespace {
+static const char kRootName[] = "root";
+static const char kListSuffix[] = "_LIST";
+static const char kItemSuffix[] = "_ITEM";
+static const char kValueSuffix[] = "_VALUE";
+static const char kObjectSuffix[] = "_OBJECT";
+static const char kEnumSuffix[] = "_ENUM";
+// varint 编码 2^21 以上的数要 4 字节以上, fixed32 不会更长, 解码也更快
+static const int64_t kMinFixed32Value = 1 << 21;
+static const int64_t kMinPackedAverageLength = 2;
+// 平均每个字符串出现不到两次时, 枚举定义比省下来的还多
+static const int64_t kMinEnumAverageRepeat = 2;
+static const char kHexDigits[] = "0123456789ABCDEF";
+
+bool FitsFloat(double value) {
+  return static_cast<double>(static_cast<float>(value)) == value;
+}
+
+int HexDigitValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+}
+
+const char JsonUnifiedSchemaBuilder::kItemFieldName[] = "item";
+const char JsonUnifiedSchemaBuilder::kVariantOneofName[] = "value";
+const char JsonUnifiedSchemaBuilder::kBoolValueFieldName[] = "bool_value";
+const char JsonUnifiedSchemaBuilder::kIntValueFieldName[] = "int_value";
+const char JsonUnifiedSchemaBuilder::kDoubleValueFieldName[] = "double_value";
+const char JsonUnifiedSchemaBuilder::kStringValueFieldName[] = "string_value";
+const char JsonUnifiedSchemaBuilder::kObjectValueFieldName[] = "object_value";
+const char JsonUnifiedSchemaBuilder::kListValueFieldName[] = "list_value";
+
+JsonUnifiedSchemaBuilder::SchemaNode::SchemaNode(MonotonicArena* arena)
+  : kinds(0),
+    value_count(0),
+    min_integer(std::numeric_limits<int64_t>::max()),
+    max_integer(std::numeric_limits<int64_t>::min()),
+    fits_float(true),
+    strings(MonotonicArenaAllocator<base::StringPiece>(arena)),
+    string_set(std::less<base::StringPiece>(),
+      MonotonicArenaAllocator<base::StringPiece>(arena)),
+    too_many_strings(false),
+    fields(MonotonicArenaAllocator<SchemaField>(arena)),
+    field_index(std::less<base::StringPiece>(),
+      MonotonicArenaAllocator<std::pair<const base::StringPiece, size_t>>(arena)),
+    element(nullptr) {
+}
+
+JsonUnifiedSchemaBuilder::SchemaNode* JsonUnifiedSchemaBuilder::SchemaNode::GetField(
+  const base::StringPiece& key,
+  MonotonicArena* arena) {
+  auto iter = field_index.find(key);
+  if (iter != field_index.end()) {
+    return fields[iter->second].second;
+  }
+  base::StringPiece arena_key = arena->CopyString(key);
+  field_index[arena_key] = fields.size();
+  fields.emplace_back(arena_key, arena->New<SchemaNode>(arena));
+  return fields.back().second;
+}
+
+JsonUnifiedSchemaBuilder::SchemaNode* JsonUnifiedSchemaBuilder::SchemaNode::GetElement(
+  MonotonicArena* arena) {
+  if (!element) {
+    element = arena->New<SchemaNode>(arena);
+  }
+  return element;
+}
+
+JsonUnifiedSchemaBuilder::JsonUnifiedSchemaBuilder(
+  google::protobuf::FileDescriptorProto* file_desc_proto,
+  bool compact)
+  : file_desc_proto_(file_desc_proto),
+    compact_(compact),
+    max_enum_cardinality_(kDefaultMaxEnumCardinality),
+    fold_root_objects_(false),
+    root_(nullptr) {
+  DCHECK(file_desc_proto_);
+}
+
+JsonUnifiedSchemaBuilder::~JsonUnifiedSchemaBuilder() {
+}
+
+bool JsonUnifiedSchemaBuilder::Finish(std::string& error_message) {
+  if (!root_ || !stack_.empty()) {
+    error_message = "json document is not complete";
+    return false;
+  }
+  std::string root_name = base::ToUpperASCII(kRootName);
+  type_names_.insert(root_name);
+  EmitMessage(*root_, root_name);
+  return true;
+}
+
+void JsonUnifiedSchemaBuilder::AbandonRootObject() {
+  stack_.clear();
+  error_message_.clear();
+}
+
+bool JsonUnifiedSchemaBuilder::OnStartObject() {
+  if (stack_.empty()) {
+    if (root_ && !fold_root_objects_) {
+      error_message_ = "more than one root value";
+      return false;
+    }
+    if (!root_) {
+      root_ = arena_.New<SchemaNode>(&arena_);
+      root_->kinds = kObject;
+    }
+    stack_.push_back({root_, false});
+    return true;
+  }
+
+  SchemaNode* node = NextValueNode();
+  node->kinds |= kObject;
+  stack_.push_back({node, false});
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnKey(const base::StringPiece& key) {
+  key.CopyToString(&key_name_);
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnEndObject() {
+  DCHECK(!stack_.empty());
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnStartArray() {
+  if (stack_.empty()) {
+    error_message_ = "root value is not a json object";
+    return false;
+  }
+
+  SchemaNode* node = NextValueNode();
+  node->kinds |= kArray;
+  stack_.push_back({node, true});
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnEndArray() {
+  DCHECK(!stack_.empty());
+  stack_.pop_back();
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnNull() {
+  // null 不带类型, 只登记 key, 没有其它类型的路径最后不生成字段
+  NextValueNode();
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnBoolean(bool value) {
+  return AddKind(kBool) != nullptr;
+}
+
+bool JsonUnifiedSchemaBuilder::OnInteger(int64_t value) {
+  SchemaNode* node = AddKind(kInt);
+  if (!node) {
+    return false;
+  }
+  node->min_integer = std::min(node->min_integer, value);
+  node->max_integer = std::max(node->max_integer, value);
+  // 整数和小数混在一起时整数也存成浮点数
+  node->fits_float = node->fits_float && FitsFloat(static_cast<double>(value));
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnDouble(double value) {
+  SchemaNode* node = AddKind(kDouble);
+  if (!node) {
+    return false;
+  }
+  node->fits_float = node->fits_float && FitsFloat(value);
+  return true;
+}
+
+bool JsonUnifiedSchemaBuilder::OnString(const base::StringPiece& value) {
+  SchemaNode* node = AddKind(kString);
+  if (!node) {
+    return false;
+  }
+  if (!compact_ || node->too_many_strings || node->string_set.count(value)) {
+    return true;
+  }
+  // 超过上限就不再记, 集合不会跟着文档变大
+  if (node->strings.size() >= max_enum_cardinality_) {
+    node->too_many_strings = true;
+    return true;
+  }
+  base::StringPiece arena_value = arena_.CopyString(value);
+  node->strings.push_back(arena_value);
+  node->string_set.insert(arena_value);
+  return true;
+}
+
+JsonUnifiedSchemaBuilder::SchemaNode* JsonUnifiedSchemaBuilder::NextValueNode() {
+  DCHECK(!stack_.empty());
+  const Frame& frame = stack_.back();
+  SchemaNode* node = frame.is_array ?
+    frame.node->GetElement(&arena_) : frame.node->GetField(key_name_, &arena_);
+  ++node->value_count;
+  return node;
+}
+
+JsonUnifiedSchemaBuilder::SchemaNode* JsonUnifiedSchemaBuilder::AddKind(uint32_t kind) {
+  if (stack_.empty()) {
+    error_message_ = "root value is not a json object";
+    return nullptr;
+  }
+  SchemaNode* node = NextValueNode();
+  node->kinds |= kind;
+  return node;
+}
+
+void JsonUnifiedSchemaBuilder::EmitMessage(
+  const SchemaNode& node,
+  const std::string& type_name) {
+  google::protobuf::DescriptorProto* desc_proto = file_desc_proto_->add_message_type();
+  desc_proto->set_name(type_name);
+  std::vector<int64_t> field_counts;
+  for (const auto& field : node.fields) {
+    const std::string json_key = field.first.as_string();
+    EmitField(desc_proto, json_key, *field.second,
+      type_name + "_" + base::ToUpperASCII(SanitizeName(json_key)));
+    // 只有 null 的 key 不生成字段
+    if (compact_ && field_counts.size() < static_cast<size_t>(desc_proto->field_size())) {
+      field_counts.push_back(field.second->value_count);
+    }
+  }
+  if (compact_) {
+    NumberFieldsByFrequency(desc_proto, field_counts);
+  }
+}
+
+void JsonUnifiedSchemaBuilder::EmitField(
+  google::protobuf::DescriptorProto* desc_proto,
+  const std::string& json_key,
+  const SchemaNode& node,
+  const std::string& type_base) {
+  uint32_t kinds = NormalizeKinds(node);
+  if (!kinds) {
+    return;
+  }
+
+  // 同一个 message 里 sanitize 之后可能重名, 加数字后缀区分, 取值时按 json_name 查找
+  std::string field_name = SanitizeName(json_key);
+  std::string unique_field_name = field_name;
+  for (int suffix = 2; ; ++suffix) {
+    bool used = false;
+    for (const auto& field_desc_proto : desc_proto->field()) {
+      if (field_desc_proto.name() == unique_field_name) {
+        used = true;
+        break;
+      }
+    }
+    if (!used) {
+      break;
+    }
+    unique_field_name = field_name + "_" + base::IntToString(suffix);
+  }
+
+  if (!IsSingleKind(kinds)) {
+    std::string type_name = EmitVariant(node, kinds, type_base + kValueSuffix);
+    AddField(desc_proto, unique_field_name, json_key,
+      google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL,
+      google::protobuf::FieldDescriptorProto::TYPE_MESSAGE)->set_type_name(type_name);
+    return;
+  }
+  if (kinds == kArray) {
+    EmitArrayField(desc_proto, unique_field_name, json_key, node, type_base);
+    return;
+  }
+  EmitValueField(desc_proto, unique_field_name, json_key,
+    google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL, node, kinds, type_base);
+}
+
+void JsonUnifiedSchemaBuilder::EmitValueField(
+  google::protobuf::DescriptorProto* desc_proto,
+  const std::string& field_name,
+  const std::string& json_name,
+  google::protobuf::FieldDescriptorProto::Label label,
+  const SchemaNode& node,
+  uint32_t kinds,
+  const std::string& type_base) {
+  if (kinds == kString && compact_) {
+    std::string enum_name = EmitStringEnum(node, type_base);
+    if (!enum_name.empty()) {
+      AddField(desc_proto, field_name, json_name, label,
+        google::protobuf::FieldDescriptorProto::TYPE_ENUM)->set_type_name(enum_name);
+      return;
+    }
+  }
+  if (kinds != kObject) {
+    AddField(desc_proto, field_name, json_name, label, ScalarType(node, kinds));
+    return;
+  }
+  std::string type_name = UniqueTypeName(type_base);
+  // EmitMessage 会往 file 里追加 message, 先把字段加好
+  AddField(desc_proto, field_name, json_name, label,
+    google::protobuf::FieldDescriptorProto::TYPE_MESSAGE)->set_type_name(type_name);
+  EmitMessage(node, type_name);
+}
+
+void JsonUnifiedSchemaBuilder::EmitArrayField(
+  google::protobuf::DescriptorProto* desc_proto,
+  const std::string& field_name,
+  const std::string& json_name,
+  const SchemaNode& array_node,
+  const std::string& type_base) {
+  // 空数组或者只有 null 的数组没有元素类型
+  const SchemaNode* element_node = array_node.element;
+  uint32_t kinds = element_node ? NormalizeKinds(*element_node) : 0;
+  if (!kinds) {
+    return;
+  }
+
+  std::string type_name;
+  if (!IsSingleKind(kinds)) {
+    type_name = EmitVariant(*element_node, kinds, type_base + kValueSuffix);
+  } else if (kinds == kArray) {
+    type_name = EmitListWrapper(*element_node, type_base + kListSuffix);
+  } else {
+    EmitValueField(desc_proto, field_name, json_name,
+      google::protobuf::FieldDescriptorProto::LABEL_REPEATED, *element_node, kinds, type_base);
+    // packed 省掉每个元素的 tag, 但多一个长度, 平均不到两个元素的数组反而变长.
+    // 字符串不能 packed, 变成枚举的可以
+    google::protobuf::FieldDescriptorProto* field_desc_proto =
+      desc_proto->mutable_field(desc_proto->field_size() - 1);
+    if (compact_ &&
+        field_desc_proto->type() != google::protobuf::FieldDescriptorProto::TYPE_MESSAGE &&
+        field_desc_proto->type() != google::protobuf::FieldDescriptorProto::TYPE_STRING &&
+        element_node->value_count >= kMinPackedAverageLength * array_node.value_count) {
+      field_desc_proto->mutable_options()->set_packed(true);
+    }
+    return;
+  }
+  AddField(desc_proto, field_name, json_name,
+    google::protobuf::FieldDescriptorProto::LABEL_REPEATED,
+    google::protobuf::FieldDescriptorProto::TYPE_MESSAGE)->set_type_name(type_name);
+}
+
+std::string JsonUnifiedSchemaBuilder::EmitListWrapper(
+  const SchemaNode& array_node,
+  const std::string& type_base) {
+  // 数组的数组: repeated 不能嵌套, 内层数组包成只有一个 item 字段的 message.
+  // item 不是 json 的 key, 不设 json_name, 和 key 恰好是 "item" 的对象区分开
+  std::string type_name = UniqueTypeName(type_base);
+  google::protobuf::DescriptorProto* desc_proto = file_desc_proto_->add_message_type();
+  desc_proto->set_name(type_name);
+  EmitArrayField(desc_proto, kItemFieldName, kItemFieldName, array_node, type_base + kItemSuffix);
+  if (desc_proto->field_size() > 0) {
+    desc_proto->mutable_field(0)->clear_json_name();
+  }
+  return type_name;
+}
+
+std::string JsonUnifiedSchemaBuilder::EmitVariant(
+  const SchemaNode& node,
+  uint32_t kinds,
+  const std::string& type_base) {
+  // 同一个路径上出现了多种 json 类型, 生成一个带 oneof 的 message, 每种类型一个字段.
+  // 字段号按类型固定, 和出现的顺序无关
+  std::string type_name = UniqueTypeName(type_base);
+  google::protobuf::DescriptorProto* desc_proto = file_desc_proto_->add_message_type();
+  desc_proto->set_name(type_name);
+  desc_proto->add_oneof_decl()->set_name(kVariantOneofName);
+
+  struct VariantField {
+    Kind kind;
+    const char* name;
+    int number;
+  };
+  static const VariantField kVariantFields[] = {
+    {kBool, kBoolValueFieldName, 1},
+    {kInt, kIntValueFieldName, 2},
+    {kDouble, kDoubleValueFieldName, 3},
+    {kString, kStringValueFieldName, 4},
+    {kObject, kObjectValueFieldName, 5},
+    {kArray, kListValueFieldName, 6},
+  };
+  for (const VariantField& variant_field : kVariantFields) {
+    if (!(kinds & variant_field.kind)) {
+      continue;
+    }
+    google::protobuf::FieldDescriptorProto::Type type =
+      google::protobuf::FieldDescriptorProto::TYPE_MESSAGE;
+    std::string field_type_name;
+    if (variant_field.kind == kObject) {
+      field_type_name = UniqueTypeName(type_name + kObjectSuffix);
+      EmitMessage(node, field_type_name);
+    } else if (variant_field.kind == kArray) {
+      field_type_name = EmitListWrapper(node, type_name + kListSuffix);
+    } else {
+      type = ScalarType(node, variant_field.kind);
+    }
+    google::protobuf::FieldDescriptorProto* field_desc_proto = desc_proto->add_field();
+    field_desc_proto->set_label(google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL);
+    field_desc_proto->set_type(type);
+    field_desc_proto->set_name(variant_field.name);
+    field_desc_proto->set_number(variant_field.number);
+    field_desc_proto->set_oneof_index(0);
+    if (!field_type_name.empty()) {
+      field_desc_proto->set_type_name(field_type_name);
+    }
+  }
+  return type_name;
+}
+
+google::protobuf::FieldDescriptorProto* JsonUnifiedSchemaBuilder::AddField(
+  google::protobuf::DescriptorProto* desc_proto,
+  const std::string& field_name,
+  const std::string& json_name,
+  google::protobuf::FieldDescriptorProto::Label label,
+  google::protobuf::FieldDescriptorProto::Type type) {
+  // 字段号在每个 message 内部从 1 开始, 不会再撞到 19000 开始的保留区间
+  google::protobuf::FieldDescriptorProto* field_desc_proto = desc_proto->add_field();
+  field_desc_proto->set_label(label);
+  field_desc_proto->set_type(type);
+  field_desc_proto->set_name(field_name);
+  field_desc_proto->set_json_name(json_name);
+  field_desc_proto->set_number(desc_proto->field_size());
+  return field_desc_proto;
+}
+
+std::string JsonUnifiedSchemaBuilder::UniqueTypeName(const std::string& base) {
+  std::string type_name = base;
+  for (int suffix = 2; !type_names_.insert(type_name).second; ++suffix) {
+    type_name = base + "_" + base::IntToString(suffix);
+  }
+  return type_name;
+}
+
+std::string JsonUnifiedSchemaBuilder::EmitStringEnum(
+  const SchemaNode& node,
+  const std::string& type_base) {
+  const int64_t string_count = static_cast<int64_t>(node.strings.size());
+  if (node.too_many_strings || string_count == 0 ||
+      node.value_count < kMinEnumAverageRepeat * string_count) {
+    return std::string();
+  }
+
+  // 枚举值和 message 一样在文件这一层, 名字要和所有类型名区分开.
+  // 值名不能加后缀, 否则读不回原来的字符串, 撞名了就还用字符串
+  std::string enum_name = UniqueTypeName(type_base + kEnumSuffix);
+  std::vector<std::string> value_names;
+  value_names.reserve(node.strings.size());
+  for (const base::StringPiece& value : node.strings) {
+    value_names.push_back(EnumValueName(enum_name, value));
+    if (!type_names_.insert(value_names.back()).second) {
+      for (size_t index = 0; index + 1 < value_names.size(); ++index) {
+        type_names_.erase(value_names[index]);
+      }
+      type_names_.erase(enum_name);
+      return std::string();
+    }
+  }
+
+  // 按第一次出现的顺序从 0 开始编号
+  google::protobuf::EnumDescriptorProto* enum_desc_proto = file_desc_proto_->add_enum_type();
+  enum_desc_proto->set_name(enum_name);
+  for (size_t index = 0; index < value_names.size(); ++index) {
+    google::protobuf::EnumValueDescriptorProto* value_desc_proto = enum_desc_proto->add_value();
+    value_desc_proto->set_name(value_names[index]);
+    value_desc_proto->set_number(static_cast<int>(index));
+  }
+  return enum_name;
+}
+
+std::string JsonUnifiedSchemaBuilder::EnumValueName(
+  const std::string& enum_name,
+  const base::StringPiece& value) {
+  std::string value_name;
+  value_name.reserve(enum_name.size() + 1 + value.size());
+  value_name.append(enum_name);
+  value_name.push_back('_');
+  for (char c : value) {
+    if (base::IsAsciiAlpha(c) || base::IsAsciiDigit(c)) {
+      value_name.push_back(c);
+      continue;
+    }
+    // '_' 自己也转义, 这样 '_' 后面总是两位十六进制, 能原样读回来
+    const uint8_t byte = static_cast<uint8_t>(c);
+    value_name.push_back('_');
+    value_name.push_back(kHexDigits[byte >> 4]);
+    value_name.push_back(kHexDigits[byte & 0xf]);
+  }
+  return value_name;
+}
+
+bool JsonUnifiedSchemaBuilder::EnumValueString(
+  const std::string& enum_name,
+  const std::string& value_name,
+  std::string* value) {
+  if (value_name.size() <= enum_name.size() ||
+      value_name.compare(0, enum_name.size(), enum_name) != 0 ||
+      value_name[enum_name.size()] != '_') {
+    return false;
+  }
+  value->clear();
+  for (size_t index = enum_name.size() + 1; index < value_name.size(); ++index) {
+    const char c = value_name[index];
+    if (c != '_') {
+      value->push_back(c);
+      continue;
+    }
+    if (index + 2 >= value_name.size()) {
+      return false;
+    }
+    const int high = HexDigitValue(value_name[index + 1]);
+    const int low = HexDigitValue(value_name[index + 2]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    value->push_back(static_cast<char>((high << 4) | low));
+    index += 2;
+  }
+  return true;
+}
+
+uint32_t JsonUnifiedSchemaBuilder::NormalizeKinds(const SchemaNode& node) {
+  // 整数和小数混在一起时统一成 double
+  uint32_t kinds = node.kinds;
+  if ((kinds & kInt) && (kinds & kDouble)) {
+    kinds &= ~kInt;
+  }
+  // 只见过空数组时数组没有字段, 和别的类型混在一起也一样, variant 里不留空的 list_value
+  if ((kinds & kArray) && (!node.element || !NormalizeKinds(*node.element))) {
+    kinds &= ~kArray;
+  }
+  return kinds;
+}
+
+bool JsonUnifiedSchemaBuilder::IsSingleKind(uint32_t kinds) {
+  return kinds && !(kinds & (kinds - 1));
+}
+
+google::protobuf::FieldDescriptorProto::Type JsonUnifiedSchemaBuilder::NarrowIntegerType(
+  int64_t min_integer,
+  int64_t max_integer) {
+  // OnInteger() 只收到 int 范围内的整数, 更大的数按 double 推导, 不需要 64 位类型
+  DCHECK(min_integer >= std::numeric_limits<int32_t>::min() &&
+         max_integer <= std::numeric_limits<int32_t>::max());
+  if (min_integer >= 0) {
+    return min_integer >= kMinFixed32Value ?
+      google::protobuf::FieldDescriptorProto::TYPE_FIXED32 :
+      google::protobuf::FieldDescriptorProto::TYPE_UINT32;
+  }
+  // 负数用 int32 编码固定 10 字节, zigzag 之后按绝对值变长
+  return google::protobuf::FieldDescriptorProto::TYPE_SINT32;
+}
+
+google::protobuf::FieldDescriptorProto::Type JsonUnifiedSchemaBuilder::ScalarType(
+  const SchemaNode& node,
+  uint32_t kind) const {
+  switch (kind) {
+  case kBool:
+    return google::protobuf::FieldDescriptorProto::TYPE_BOOL;
+  case kInt:
+    return compact_ ? NarrowIntegerType(node.min_integer, node.max_integer) :
+      google::protobuf::FieldDescriptorProto::TYPE_INT64;
+  case kDouble:
+    return compact_ && node.fits_float ? google::protobuf::FieldDescriptorProto::TYPE_FLOAT :
+      google::protobuf::FieldDescriptorProto::TYPE_DOUBLE;
+  default:
+    DCHECK_EQ(kind, static_cast<uint32_t>(kString));
+    return google::protobuf::FieldDescriptorProto::TYPE_STRING;
+  }
+}
+
+void JsonUnifiedSchemaBuilder::NumberFieldsByFrequency(
+  google::protobuf::DescriptorProto* desc_proto,
+  const std::vector<int64_t>& field_counts) {
+  DCHECK_EQ(field_counts.size(), static_cast<size_t>(desc_proto->field_size()));
+  // 1 到 15 号字段的 tag 只占 1 字节, 给出现最多的 key.
+  // 次数相同时保持 key 的顺序, 同样的文档总是得到同样的字段号
+  std::vector<int> order(field_counts.size());
+  for (size_t index = 0; index < order.size(); ++index) {
+    order[index] = static_cast<int>(index);
+  }
+  std::stable_sort(order.begin(), order.end(), [&field_counts](int left, int right) {
+    return field_counts[left] > field_counts[right];
+  });
+  for (size_t rank = 0; rank < order.size(); ++rank) {
+    desc_proto->mutable_field(order[rank])->set_number(static_cast<int>(rank) + 1);
+  }
+}
+
+std::string JsonUnifiedSchemaBuilder::SanitizeName(const std::string& name) {
+  // proto 的名字只能是字母数字下划线, 而且不能以数字开头
+  std::string sanitized_name;
+  sanitized_name.reserve(name.size() + 1);
+  if (name.empty() || base::IsAsciiDigit(name[0])) {
+    sanitized_name.push_back('_');
+  }
+  for (char c : name) {
+    sanitized_name.push_back(base::IsAsciiAlpha(c) || base::IsAsciiDigit(c) ? c : '_');
+  }
+  return sanitized_name;
+}
+
+} //namespace self
@@ -0,0 +1,247 @@
+#ifndef JSON_UNIFIED_SCHEMA_BUILDER_H_
+#define JSON_UNIFIED_SCHEMA_BUILDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "json_sax_reader.h"
+#include "json_stream_schema_builder.h"
+#include "monotonic_arena.h"
+
+namespace self {
+
+// Infers one schema for all elements of an array instead of one message type
+// per element. The document is first folded into a tree holding the union of
+// everything seen at each path, so 100k identical objects in an array become
+// one repeated message field. A path that holds more than one json type gets
+// a variant message with a oneof, which keeps heterogeneous arrays lossless.
+//
+// Every field of a json key carries the original key as json_name,
+// JsonUnifiedMessageBuilder looks fields up by it. The item field of a nested
+// array wrapper and the fields of a variant have none.
+//
+// In compact mode (SchemaMode::kCompact) the tree also keeps the range of the
+// integers and whether every number is exact as a float, so a field gets the
+// narrowest type that holds all its values: uint32 or fixed32, sint32,
+// float. Integers past the int range arrive as doubles, so no integer field
+// needs 64 bits. Repeated numbers are packed where the arrays average two
+// elements or more. Each message numbers its fields by how often their key
+// occurred, so the 15 most frequent keys get one byte tags. The declaration
+// order stays the key order, which is what the binding plans expect;
+// --to-json writes the keys in field number order.
+//
+// Compact mode also turns string fields with few distinct values into enums,
+// one value per string, so a string repeated thousands of times is encoded
+// as a one or two byte varint. The value names keep the string, see
+// EnumValueName(), which is how the message builder and --to-json map
+// between the two. Fields with more than max_enum_cardinality() distinct
+// strings, or whose strings rarely repeat, stay strings.
+class JsonUnifiedSchemaBuilder : public JsonSchemaBuilder {
+public:
+  // Field of the wrapper message used for nested arrays.
+  static const char kItemFieldName[];
+  // Name of the oneof in a variant message.
+  static const char kVariantOneofName[];
+  static const char kBoolValueFieldName[];
+  static const char kIntValueFieldName[];
+  static const char kDoubleValueFieldName[];
+  static const char kStringValueFieldName[];
+  static const char kObjectValueFieldName[];
+  static const char kListValueFieldName[];
+
+  static const size_t kDefaultMaxEnumCardinality = 256;
+
+  JsonUnifiedSchemaBuilder(
+    google::protobuf::FileDescriptorProto* file_desc_proto,
+    bool compact);
+
+  ~JsonUnifiedSchemaBuilder() override;
+
+  // Writes the message types into the FileDescriptorProto, nothing is written
+  // before the whole document has been seen.
+  bool Finish(std::string& error_message) override;
+
+  bool OnStartObject() override;
+  bool OnKey(const base::StringPiece& key) override;
+  bool OnEndObject() override;
+  bool OnStartArray() override;
+  bool OnEndArray() override;
+  bool OnNull() override;
+  bool OnBoolean(bool value) override;
+  bool OnInteger(int64_t value) override;
+  bool OnDouble(double value) override;
+  bool OnString(const base::StringPiece& value) override;
+
+  // Compact mode only, 0 keeps every string field a string.
+  void set_max_enum_cardinality(size_t max_enum_cardinality) {
+    max_enum_cardinality_ = max_enum_cardinality;
+  }
+  size_t max_enum_cardinality() const { return max_enum_cardinality_; }
+
+  // Folds every root object after the first into the root of the first
+  // instead of failing, so one schema covers all records of a record stream.
+  void set_fold_root_objects(bool fold_root_objects) {
+    fold_root_objects_ = fold_root_objects;
+  }
+
+  // Drops the rest of a root object the parser gave up on, the next root
+  // object can start. What was folded in before the error stays.
+  void AbandonRootObject();
+
+  // The name of the value of enum |enum_name| that stands for the json string
+  // |value|: the enum name, '_', then the string with every byte that is not
+  // an ascii letter or digit written as '_' and two hex digits.
+  static std::string EnumValueName(
+    const std::string& enum_name,
+    const base::StringPiece& value);
+
+  // The json string back from a value name of EnumValueName(), false for
+  // enums this builder did not generate.
+  static bool EnumValueString(
+    const std::string& enum_name,
+    const std::string& value_name,
+    std::string* value);
+
+private:
+  enum Kind : uint32_t {
+    kBool = 1 << 0,
+    kInt = 1 << 1,
+    kDouble = 1 << 2,
+    kString = 1 << 3,
+    kObject = 1 << 4,
+    kArray = 1 << 5,
+  };
+
+  struct SchemaNode;
+
+  typedef std::pair<base::StringPiece, SchemaNode*> SchemaField;
+
+  // Union of all values seen at one json path. Nodes, keys and containers are
+  // all in |arena_|, the tree is freed in one go with the builder.
+  struct SchemaNode {
+    explicit SchemaNode(MonotonicArena* arena);
+
+    SchemaNode* GetField(const base::StringPiece& key, MonotonicArena* arena);
+    SchemaNode* GetElement(MonotonicArena* arena);
+
+    uint32_t kinds;
+    // Values seen at the path, nulls included.
+    int64_t value_count;
+    int64_t min_integer;
+    int64_t max_integer;
+    // Every integer and double converts to float and back unchanged.
+    bool fits_float;
+    // Compact mode: the distinct strings in the order they first occurred,
+    // given up on once there are more than max_enum_cardinality_.
+    std::vector<base::StringPiece, MonotonicArenaAllocator<base::StringPiece>> strings;
+    std::set<base::StringPiece, std::less<base::StringPiece>,
+      MonotonicArenaAllocator<base::StringPiece>> string_set;
+    bool too_many_strings;
+    std::vector<SchemaField, MonotonicArenaAllocator<SchemaField>> fields;
+    std::map<base::StringPiece, size_t, std::less<base::StringPiece>,
+      MonotonicArenaAllocator<std::pair<const base::StringPiece, size_t>>> field_index;
+    SchemaNode* element;
+  };
+
+  // 一个路径可能既是 object 又是 array, 所以要记住当前打开的是哪一种
+  struct Frame {
+    SchemaNode* node;
+    bool is_array;
+  };
+
+  SchemaNode* NextValueNode();
+
+  // Null when the value has no place in the document.
+  SchemaNode* AddKind(uint32_t kind);
+
+  void EmitMessage(const SchemaNode& node, const std::string& type_name);
+
+  void EmitField(
+    google::protobuf::DescriptorProto* desc_proto,
+    const std::string& json_key,
+    const SchemaNode& node,
+    const std::string& type_base);
+
+  void EmitValueField(
+    google::protobuf::DescriptorProto* desc_proto,
+    const std::string& field_name,
+    const std::string& json_name,
+    google::protobuf::FieldDescriptorProto::Label label,
+    const SchemaNode& node,
+    uint32_t kinds,
+    const std::string& type_base);
+
+  void EmitArrayField(
+    google::protobuf::DescriptorProto* desc_proto,
+    const std::string& field_name,
+    const std::string& json_name,
+    const SchemaNode& array_node,
+    const std::string& type_base);
+
+  std::string EmitListWrapper(
+    const SchemaNode& array_node,
+    const std::string& type_base);
+
+  std::string EmitVariant(
+    const SchemaNode& node,
+    uint32_t kinds,
+    const std::string& type_base);
+
+  google::protobuf::FieldDescriptorProto* AddField(
+    google::protobuf::DescriptorProto* desc_proto,
+    const std::string& field_name,
+    const std::string& json_name,
+    google::protobuf::FieldDescriptorProto::Label label,
+    google::protobuf::FieldDescriptorProto::Type type);
+
+  std::string UniqueTypeName(const std::string& base);
+
+  // Compact mode: an enum for the strings of |node|, or an empty name when
+  // the field should stay a string.
+  std::string EmitStringEnum(const SchemaNode& node, const std::string& type_base);
+
+  // The type of the values of |kind| at |node|, narrowed in compact mode.
+  google::protobuf::FieldDescriptorProto::Type ScalarType(
+    const SchemaNode& node,
+    uint32_t kind) const;
+
+  // Compact mode: numbers the fields by the value counts in |field_counts|,
+  // one per field of |desc_proto|, the most frequent first.
+  static void NumberFieldsByFrequency(
+    google::protobuf::DescriptorProto* desc_proto,
+    const std::vector<int64_t>& field_counts);
+
+  static uint32_t NormalizeKinds(const SchemaNode& node);
+  static bool IsSingleKind(uint32_t kinds);
+  static google::protobuf::FieldDescriptorProto::Type NarrowIntegerType(
+    int64_t min_integer,
+    int64_t max_integer);
+  static std::string SanitizeName(const std::string& name);
+
+private:
+  google::protobuf::FileDescriptorProto* file_desc_proto_;
+  const bool compact_;
+  size_t max_enum_cardinality_;
+  bool fold_root_objects_;
+  MonotonicArena arena_;
+  SchemaNode* root_;
+  std::vector<Frame> stack_;
+  std::string key_name_;
+  std::set<std::string> type_names_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(JsonUnifiedSchemaBuilder);
+};
+
+} // namespace self
+#endif // JSON_UNIFIED_SCHEMA_BUILDER_H_
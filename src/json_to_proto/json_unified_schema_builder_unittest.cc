@@ -0,0 +1,290 @@
+#include "json_unified_schema_builder.h"
+
+#include <memory>
+#include <string>
+
+#include "build_proto_from_json.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "json_input_stream.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+// Infers the schema of |json| into |desc_pool| and returns its ROOT message.
+const google::protobuf::Descriptor* InferRoot(
+  const std::string& json,
+  SchemaMode schema_mode,
+  size_t max_enum_cardinality,
+  google::protobuf::DescriptorPool* desc_pool) {
+  JsonStringInputStream input_stream(json);
+  BuildProtoFromJson build_proto_from_json;
+  build_proto_from_json.set_max_enum_cardinality(max_enum_cardinality);
+  std::string error_message;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(&input_stream, schema_mode, error_message);
+  EXPECT_TRUE(file_desc_proto) << error_message;
+  if (!file_desc_proto) {
+    return nullptr;
+  }
+  const google::protobuf::FileDescriptor* file_desc = desc_pool->BuildFile(*file_desc_proto);
+  EXPECT_TRUE(file_desc);
+  return file_desc ? file_desc->FindMessageTypeByName("ROOT") : nullptr;
+}
+
+const google::protobuf::Descriptor* InferRoot(
+  const std::string& json,
+  SchemaMode schema_mode,
+  google::protobuf::DescriptorPool* desc_pool) {
+  return InferRoot(
+    json, schema_mode, JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality, desc_pool);
+}
+
+} // namespace
+
+// Every element of an array shares one repeated message type holding the
+// union of their keys.
+TEST(JsonUnifiedSchemaBuilderTest, ArrayElementsShareOneType) {
+  std::string json = "{\"a\":[";
+  for (int index = 0; index < 100; ++index) {
+    json += index ? ",{\"x\":1}" : "{\"x\":1}";
+  }
+  json += ",{\"y\":\"s\"}]}";
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc =
+    InferRoot(json, SchemaMode::kUnified, &desc_pool);
+  ASSERT_TRUE(root_desc);
+  EXPECT_EQ(2, root_desc->file()->message_type_count());
+
+  const google::protobuf::FieldDescriptor* a_desc = root_desc->FindFieldByName("a");
+  ASSERT_TRUE(a_desc);
+  EXPECT_TRUE(a_desc->is_repeated());
+  ASSERT_EQ(google::protobuf::FieldDescriptor::TYPE_MESSAGE, a_desc->type());
+  const google::protobuf::Descriptor* element_desc = a_desc->message_type();
+  ASSERT_EQ(2, element_desc->field_count());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_INT64,
+            element_desc->FindFieldByName("x")->type());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_STRING,
+            element_desc->FindFieldByName("y")->type());
+  EXPECT_EQ("y", element_desc->FindFieldByName("y")->json_name());
+}
+
+// Integers and doubles at one path become doubles, any other mix a variant
+// message with one oneof field per json type.
+TEST(JsonUnifiedSchemaBuilderTest, MixedKindsGetVariant) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc = InferRoot(
+    "{\"n\":[1,2.5],\"v\":[1,\"s\",{\"b\":true},[2]]}", SchemaMode::kUnified, &desc_pool);
+  ASSERT_TRUE(root_desc);
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_DOUBLE,
+            root_desc->FindFieldByName("n")->type());
+
+  const google::protobuf::FieldDescriptor* v_desc = root_desc->FindFieldByName("v");
+  ASSERT_TRUE(v_desc);
+  EXPECT_TRUE(v_desc->is_repeated());
+  const google::protobuf::Descriptor* variant_desc = v_desc->message_type();
+  ASSERT_TRUE(variant_desc);
+  ASSERT_EQ(1, variant_desc->oneof_decl_count());
+  EXPECT_EQ(JsonUnifiedSchemaBuilder::kVariantOneofName, variant_desc->oneof_decl(0)->name());
+  EXPECT_EQ(4, variant_desc->field_count());
+  for (const char* field_name : {
+         JsonUnifiedSchemaBuilder::kIntValueFieldName,
+         JsonUnifiedSchemaBuilder::kStringValueFieldName,
+         JsonUnifiedSchemaBuilder::kObjectValueFieldName,
+         JsonUnifiedSchemaBuilder::kListValueFieldName}) {
+    const google::protobuf::FieldDescriptor* field_desc =
+      variant_desc->FindFieldByName(field_name);
+    ASSERT_TRUE(field_desc) << field_name;
+    EXPECT_EQ(variant_desc->oneof_decl(0), field_desc->containing_oneof());
+  }
+}
+
+// An array of arrays wraps the inner array in a message with an item field,
+// which has no json_name.
+TEST(JsonUnifiedSchemaBuilderTest, NestedArraysUseItemWrapper) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc =
+    InferRoot("{\"a\":[[1,2],[3],[]]}", SchemaMode::kUnified, &desc_pool);
+  ASSERT_TRUE(root_desc);
+  const google::protobuf::FieldDescriptor* a_desc = root_desc->FindFieldByName("a");
+  ASSERT_TRUE(a_desc);
+  EXPECT_TRUE(a_desc->is_repeated());
+  const google::protobuf::Descriptor* wrapper_desc = a_desc->message_type();
+  ASSERT_TRUE(wrapper_desc);
+  ASSERT_EQ(1, wrapper_desc->field_count());
+  const google::protobuf::FieldDescriptor* item_desc = wrapper_desc->field(0);
+  EXPECT_EQ(JsonUnifiedSchemaBuilder::kItemFieldName, item_desc->name());
+  EXPECT_TRUE(item_desc->is_repeated());
+  EXPECT_FALSE(item_desc->has_json_name());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_INT64, item_desc->type());
+}
+
+// Empty arrays and nulls alone have no field.
+TEST(JsonUnifiedSchemaBuilderTest, EmptyValuesHaveNoField) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc = InferRoot(
+    "{\"e\":[],\"n\":null,\"l\":[null],\"s\":\"x\",\"m\":[1,[]]}", SchemaMode::kUnified,
+    &desc_pool);
+  ASSERT_TRUE(root_desc);
+  ASSERT_EQ(2, root_desc->field_count());
+  EXPECT_TRUE(root_desc->FindFieldByName("s"));
+  const google::protobuf::FieldDescriptor* m_desc = root_desc->FindFieldByName("m");
+  ASSERT_TRUE(m_desc);
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_INT64, m_desc->type());
+}
+
+// Compact mode gives every number field the narrowest type holding all its
+// values. Integers past the int range arrive as doubles.
+TEST(JsonUnifiedSchemaBuilderTest, CompactNarrowsNumbers) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc = InferRoot(
+    "{\"u\":[0,5],\"f\":[2097152,2147483647],\"s\":[-2147483648,5],"
+    "\"r\":[0.5,1.25,3],\"d\":[0.1],\"big\":3000000001}",
+    SchemaMode::kCompact, &desc_pool);
+  ASSERT_TRUE(root_desc);
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_UINT32,
+            root_desc->FindFieldByName("u")->type());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_FIXED32,
+            root_desc->FindFieldByName("f")->type());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_SINT32,
+            root_desc->FindFieldByName("s")->type());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_FLOAT,
+            root_desc->FindFieldByName("r")->type());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_DOUBLE,
+            root_desc->FindFieldByName("d")->type());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_DOUBLE,
+            root_desc->FindFieldByName("big")->type());
+
+  // 不是紧凑模式时不收窄
+  google::protobuf::DescriptorPool unified_desc_pool;
+  const google::protobuf::Descriptor* unified_root_desc =
+    InferRoot("{\"u\":[0,5],\"r\":[0.5]}", SchemaMode::kUnified, &unified_desc_pool);
+  ASSERT_TRUE(unified_root_desc);
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_INT64,
+            unified_root_desc->FindFieldByName("u")->type());
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_DOUBLE,
+            unified_root_desc->FindFieldByName("r")->type());
+}
+
+// Repeated numbers are packed where the arrays average two elements or
+// more, strings never.
+TEST(JsonUnifiedSchemaBuilderTest, CompactPacksLongNumberArrays) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc = InferRoot(
+    "{\"p\":[1,2,3],\"s\":[\"a\",\"b\",\"c\"],"
+    "\"o\":[{\"x\":[1]},{\"x\":[2]},{\"x\":[3,4]}],"
+    "\"q\":[{\"y\":[1,2]},{\"y\":[3]},{\"y\":[4,5,6]}]}",
+    SchemaMode::kCompact, &desc_pool);
+  ASSERT_TRUE(root_desc);
+  EXPECT_TRUE(root_desc->FindFieldByName("p")->is_packed());
+  EXPECT_FALSE(root_desc->FindFieldByName("s")->is_packed());
+  const google::protobuf::Descriptor* o_desc = root_desc->FindFieldByName("o")->message_type();
+  EXPECT_FALSE(o_desc->FindFieldByName("x")->is_packed());
+  const google::protobuf::Descriptor* q_desc = root_desc->FindFieldByName("q")->message_type();
+  EXPECT_TRUE(q_desc->FindFieldByName("y")->is_packed());
+}
+
+// The most frequent keys get the lowest field numbers, ties keep the key
+// order. The declaration order stays the key order.
+TEST(JsonUnifiedSchemaBuilderTest, CompactNumbersFieldsByFrequency) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc = InferRoot(
+    "{\"list\":[{\"a\":1,\"b\":2},{\"b\":3},{\"b\":4,\"c\":5,\"d\":6},"
+    "{\"d\":7}]}",
+    SchemaMode::kCompact, &desc_pool);
+  ASSERT_TRUE(root_desc);
+  const google::protobuf::Descriptor* element_desc =
+    root_desc->FindFieldByName("list")->message_type();
+  ASSERT_EQ(4, element_desc->field_count());
+  EXPECT_EQ("a", element_desc->field(0)->name());
+  EXPECT_EQ("b", element_desc->field(1)->name());
+  EXPECT_EQ("c", element_desc->field(2)->name());
+  EXPECT_EQ("d", element_desc->field(3)->name());
+  EXPECT_EQ(1, element_desc->FindFieldByName("b")->number());
+  EXPECT_EQ(2, element_desc->FindFieldByName("d")->number());
+  EXPECT_EQ(3, element_desc->FindFieldByName("a")->number());
+  EXPECT_EQ(4, element_desc->FindFieldByName("c")->number());
+
+  google::protobuf::DescriptorPool unified_desc_pool;
+  const google::protobuf::Descriptor* unified_root_desc = InferRoot(
+    "{\"list\":[{\"a\":1,\"b\":2},{\"b\":3}]}", SchemaMode::kUnified,
+    &unified_desc_pool);
+  ASSERT_TRUE(unified_root_desc);
+  const google::protobuf::Descriptor* unified_element_desc =
+    unified_root_desc->FindFieldByName("list")->message_type();
+  EXPECT_EQ(1, unified_element_desc->FindFieldByName("a")->number());
+  EXPECT_EQ(2, unified_element_desc->FindFieldByName("b")->number());
+}
+
+// Compact mode turns strings that repeat into an enum numbered by first
+// occurrence, the value names keep the strings.
+TEST(JsonUnifiedSchemaBuilderTest, CompactRepeatedStringsBecomeEnum) {
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::Descriptor* root_desc = InferRoot(
+    "{\"e\":[\"on\",\"off\",\"on\",\"off\",\"a b\",\"on\"],"
+    "\"s\":[\"x\",\"y\",\"z\"]}",
+    SchemaMode::kCompact, &desc_pool);
+  ASSERT_TRUE(root_desc);
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_STRING,
+            root_desc->FindFieldByName("s")->type());
+  const google::protobuf::FieldDescriptor* e_desc = root_desc->FindFieldByName("e");
+  ASSERT_EQ(google::protobuf::FieldDescriptor::TYPE_ENUM, e_desc->type());
+  const google::protobuf::EnumDescriptor* enum_desc = e_desc->enum_type();
+  ASSERT_EQ(3, enum_desc->value_count());
+  const char* const kStrings[] = {"on", "off", "a b"};
+  for (int index = 0; index < enum_desc->value_count(); ++index) {
+    const google::protobuf::EnumValueDescriptor* value_desc = enum_desc->value(index);
+    EXPECT_EQ(index, value_desc->number());
+    EXPECT_EQ(JsonUnifiedSchemaBuilder::EnumValueName(enum_desc->name(), kStrings[index]),
+              value_desc->name());
+    std::string value;
+    ASSERT_TRUE(JsonUnifiedSchemaBuilder::EnumValueString(
+      enum_desc->name(), value_desc->name(), &value));
+    EXPECT_EQ(kStrings[index], value);
+  }
+
+  google::protobuf::DescriptorPool unified_desc_pool;
+  const google::protobuf::Descriptor* unified_root_desc =
+    InferRoot("{\"e\":[\"on\",\"on\",\"on\"]}", SchemaMode::kUnified, &unified_desc_pool);
+  ASSERT_TRUE(unified_root_desc);
+  EXPECT_EQ(google::protobuf::FieldDescriptor::TYPE_STRING,
+            unified_root_desc->FindFieldByName("e")->type());
+}
+
+// More distinct strings than max_enum_cardinality keep the field a string,
+// 0 turns enums off.
+TEST(JsonUnifiedSchemaBuilderTest, CompactEnumCardinality) {
+  const std::string json =
+    "{\"e\":[\"a\",\"b\",\"c\",\"a\",\"b\",\"c\",\"a\",\"b\",\"c\"]}";
+  for (size_t max_enum_cardinality : {0, 2, 3}) {
+    google::protobuf::DescriptorPool desc_pool;
+    const google::protobuf::Descriptor* root_desc =
+      InferRoot(json, SchemaMode::kCompact, max_enum_cardinality, &desc_pool);
+    ASSERT_TRUE(root_desc);
+    EXPECT_EQ(max_enum_cardinality >= 3 ?
+                google::protobuf::FieldDescriptor::TYPE_ENUM :
+                google::protobuf::FieldDescriptor::TYPE_STRING,
+              root_desc->FindFieldByName("e")->type())
+      << max_enum_cardinality;
+  }
+}
+
+// Every byte that is not an ascii letter or digit is escaped, '_' too, so
+// the string reads back unchanged.
+TEST(JsonUnifiedSchemaBuilderTest, EnumValueNameRoundTrip) {
+  EXPECT_EQ("E_a_5Fb_20c", JsonUnifiedSchemaBuilder::EnumValueName("E", "a_b c"));
+  for (const char* string : {"", "plain", "a_b c", "\xe4\xb8\xad", "_"}) {
+    std::string value;
+    ASSERT_TRUE(JsonUnifiedSchemaBuilder::EnumValueString(
+      "E", JsonUnifiedSchemaBuilder::EnumValueName("E", string), &value)) << string;
+    EXPECT_EQ(string, value);
+  }
+  std::string value;
+  EXPECT_FALSE(JsonUnifiedSchemaBuilder::EnumValueString("E", "F_a", &value));
+  EXPECT_FALSE(JsonUnifiedSchemaBuilder::EnumValueString("E", "E_a_4", &value));
+  EXPECT_FALSE(JsonUnifiedSchemaBuilder::EnumValueString("E", "E_a_zz", &value));
+}
+
+} // namespace self
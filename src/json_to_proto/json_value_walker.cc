@@ -0,0 +1,79 @@
+#include "json_value_walker.h"
+
+#include "base/logging.h"
+#include "base/values.h"
+#include "json_sax_reader.h"
+
+namespace self {
+
+bool JsonValueWalker::Walk(
+  const base::Value& value,
+  JsonSaxHandler* handler,
+  std::string& error_message) {
+  DCHECK(handler);
+  if (!WalkValue(value, handler)) {
+    error_message = handler->error_message();
+    return false;
+  }
+  return true;
+}
+
+bool JsonValueWalker::WalkValue(const base::Value& value, JsonSaxHandler* handler) {
+  // base::JSONReader 限制了嵌套深度, 这里直接递归
+  switch (value.GetType()) {
+  case base::Value::Type::NONE: {
+  } return handler->OnNull();
+  case base::Value::Type::BOOLEAN: {
+    bool boolean_value = false;
+    value.GetAsBoolean(&boolean_value);
+    return handler->OnBoolean(boolean_value);
+  }
+  case base::Value::Type::INTEGER: {
+    int integer_value = 0;
+    value.GetAsInteger(&integer_value);
+    return handler->OnInteger(integer_value);
+  }
+  case base::Value::Type::DOUBLE: {
+    double double_value = 0.0;
+    value.GetAsDouble(&double_value);
+    return handler->OnDouble(double_value);
+  }
+  case base::Value::Type::STRING: {
+    base::StringPiece string_value;
+    value.GetAsString(&string_value);
+    return handler->OnString(string_value);
+  }
+  case base::Value::Type::DICTIONARY: {
+    const base::DictionaryValue* dict_value = nullptr;
+    value.GetAsDictionary(&dict_value);
+    if (!handler->OnStartObject()) {
+      return false;
+    }
+    for (base::DictionaryValue::Iterator dict_iterator(*dict_value);
+      !dict_iterator.IsAtEnd(); dict_iterator.Advance()) {
+      if (!handler->OnKey(dict_iterator.key()) ||
+          !WalkValue(dict_iterator.value(), handler)) {
+        return false;
+      }
+    }
+  } return handler->OnEndObject();
+  case base::Value::Type::LIST: {
+    const base::ListValue* list_value = nullptr;
+    value.GetAsList(&list_value);
+    if (!handler->OnStartArray()) {
+      return false;
+    }
+    for (size_t index = 0; index < list_value->GetSize(); index++) {
+      const base::Value* item_value = nullptr;
+      if (list_value->Get(index, &item_value) && !WalkValue(*item_value, handler)) {
+        return false;
+      }
+    }
+  } return handler->OnEndArray();
+  default: {
+    // json 里不会出现 BINARY
+  } return true;
+  }
+}
+
+} //namespace self
@@ -0,0 +1,33 @@
+#ifndef JSON_VALUE_WALKER_H_
+#define JSON_VALUE_WALKER_H_
+
+#include <string>
+
+#include "base/macros.h"
+
+namespace base {
+class Value;
+}
+
+namespace self {
+
+class JsonSaxHandler;
+
+// Turns a base::Value tree back into parse events, so the handlers written
+// for JsonSaxReader also serve the dom parser. Dictionary keys come out in
+// base::DictionaryValue order.
+class JsonValueWalker {
+public:
+  static bool Walk(
+    const base::Value& value,
+    JsonSaxHandler* handler,
+    std::string& error_message);
+
+private:
+  static bool WalkValue(const base::Value& value, JsonSaxHandler* handler);
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(JsonValueWalker);
+};
+
+} // namespace self
+#endif // JSON_VALUE_WALKER_H_
@@ -0,0 +1,149 @@
+#include "json_writer_plan.h"
+
+#include <algorithm>
+#include <string>
+
+#include "base/logging.h"
+#include "json_unified_schema_builder.h"
+#include "protobuf_json_writer.h"
+
+namespace self {
+
+namespace {
+
+MessageWriterKind GetMessageWriterKind(const google::protobuf::Descriptor* desc) {
+  // JsonUnifiedSchemaBuilder 只在 variant message 里用 oneof
+  if (desc->oneof_decl_count() == 1 &&
+      desc->oneof_decl(0)->name() == JsonUnifiedSchemaBuilder::kVariantOneofName) {
+    return MessageWriterKind::kVariant;
+  }
+  if (desc->field_count() == 0) {
+    return MessageWriterKind::kObject;
+  }
+  // 两种 schema 都只给 json key 对应的字段设 json_name. 每个元素一个字段时
+  // 字段名总带着 "_数字" 后缀, 不会和 item 混淆
+  const google::protobuf::FieldDescriptor* first_field_desc = desc->field(0);
+  if (desc->field_count() == 1 && first_field_desc->is_repeated() &&
+      !first_field_desc->has_json_name() &&
+      first_field_desc->name() == JsonUnifiedSchemaBuilder::kItemFieldName) {
+    return MessageWriterKind::kItemList;
+  }
+  for (int i = 0; i < desc->field_count(); ++i) {
+    if (desc->field(i)->has_json_name()) {
+      return MessageWriterKind::kObject;
+    }
+  }
+  return MessageWriterKind::kElementList;
+}
+
+}
+
+MessageWriterPlan::MessageWriterPlan(const google::protobuf::Descriptor* desc)
+  : desc_(desc),
+    kind_(MessageWriterKind::kObject),
+    fields_(nullptr),
+    field_count_(0) {
+  DCHECK(desc_);
+}
+
+const FieldWriter* MessageWriterPlan::FindField(int number, size_t* hint) const {
+  // repeated 字段没有 pack 时每个元素一个 tag, 先看是不是还在上一个字段
+  if (*hint > 0 && fields_[*hint - 1].number == number) {
+    return &fields_[*hint - 1];
+  }
+  if (*hint < field_count_ && fields_[*hint].number == number) {
+    return &fields_[(*hint)++];
+  }
+  const FieldWriter* fields_begin = fields_;
+  const FieldWriter* fields_end = fields_ + field_count_;
+  const FieldWriter* iter = std::lower_bound(fields_begin, fields_end, number,
+    [](const FieldWriter& field, int number) {
+      return field.number < number;
+    });
+  if (iter == fields_end || iter->number != number) {
+    return nullptr;
+  }
+  *hint = (iter - fields_begin) + 1;
+  return iter;
+}
+
+WriterPlanCache::WriterPlanCache()
+  : plans_(0, std::hash<const google::protobuf::Descriptor*>(),
+      std::equal_to<const google::protobuf::Descriptor*>(),
+      MonotonicArenaAllocator<PlanEntry>(&arena_)) {
+}
+
+WriterPlanCache::~WriterPlanCache() {
+}
+
+const MessageWriterPlan* WriterPlanCache::GetPlan(
+  const google::protobuf::Descriptor* desc) {
+  auto iter = plans_.find(desc);
+  if (iter != plans_.end()) {
+    return iter->second;
+  }
+  return Compile(desc);
+}
+
+MessageWriterPlan* WriterPlanCache::Compile(const google::protobuf::Descriptor* desc) {
+  // 先放进表里再编译子类型, 自引用的类型也只编译一次
+  MessageWriterPlan* plan = arena_.New<MessageWriterPlan>(desc);
+  plans_[desc] = plan;
+  plan->kind_ = GetMessageWriterKind(desc);
+
+  const size_t field_count = desc->field_count();
+  plan->fields_ = arena_.NewArray<FieldWriter>(field_count);
+  plan->field_count_ = field_count;
+  std::string key;
+  for (size_t i = 0; i < field_count; ++i) {
+    const google::protobuf::FieldDescriptor* field_desc = desc->field(static_cast<int>(i));
+    FieldWriter& field = plan->fields_[i];
+    field.number = field_desc->number();
+    if (plan->kind_ == MessageWriterKind::kObject) {
+      key.clear();
+      AppendJsonString(field_desc->json_name(), &key);
+      key.push_back(':');
+      field.key = arena_.CopyString(key);
+    }
+    field.type = field_desc->type();
+    field.repeated = field_desc->is_repeated();
+    field.child_plan = field.type == google::protobuf::FieldDescriptor::TYPE_MESSAGE ?
+      GetPlan(field_desc->message_type()) : nullptr;
+    field.enum_strings = nullptr;
+    field.enum_string_count = 0;
+    if (field.type == google::protobuf::FieldDescriptor::TYPE_ENUM) {
+      CompileEnumStrings(field_desc->enum_type(), &field);
+    }
+  }
+  std::sort(plan->fields_, plan->fields_ + field_count,
+    [](const FieldWriter& left, const FieldWriter& right) {
+      return left.number < right.number;
+    });
+  return plan;
+}
+
+void WriterPlanCache::CompileEnumStrings(
+  const google::protobuf::EnumDescriptor* enum_desc,
+  FieldWriter* field) {
+  // JsonUnifiedSchemaBuilder 的枚举值从 0 开始连续编号, 直接按编号取
+  const size_t value_count = enum_desc->value_count();
+  base::StringPiece* enum_strings = arena_.NewArray<base::StringPiece>(value_count);
+  std::string string;
+  std::string json_string;
+  for (size_t i = 0; i < value_count; ++i) {
+    const google::protobuf::EnumValueDescriptor* value_desc =
+      enum_desc->value(static_cast<int>(i));
+    if (value_desc->number() != static_cast<int>(i) ||
+        !JsonUnifiedSchemaBuilder::EnumValueString(
+          enum_desc->name(), value_desc->name(), &string)) {
+      return;
+    }
+    json_string.clear();
+    AppendJsonString(string, &json_string);
+    enum_strings[i] = arena_.CopyString(json_string);
+  }
+  field->enum_strings = enum_strings;
+  field->enum_string_count = value_count;
+}
+
+} //namespace self
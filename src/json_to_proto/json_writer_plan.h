@@ -0,0 +1,115 @@
+#ifndef JSON_WRITER_PLAN_H_
+#define JSON_WRITER_PLAN_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "google/protobuf/descriptor.h"
+#include "monotonic_arena.h"
+
+namespace self {
+
+// What json value a message of an inferred schema stands for, told from the
+// descriptor alone so both schema modes share one writer.
+enum class MessageWriterKind {
+  // A json object, every field is written under its json_name.
+  kObject,
+  // JsonStreamSchemaBuilder array message: the fields have no json_name and
+  // each one is an element, in field number order.
+  kElementList,
+  // JsonUnifiedSchemaBuilder nested array wrapper: the repeated item field is
+  // the array.
+  kItemList,
+  // JsonUnifiedSchemaBuilder variant: the one field set in the oneof is the
+  // value.
+  kVariant
+};
+
+class MessageWriterPlan;
+
+struct FieldWriter {
+  int number;
+  // |"key":| with the key already escaped, empty unless the field belongs to
+  // a kObject message. Points into the plan cache's arena.
+  base::StringPiece key;
+  google::protobuf::FieldDescriptor::Type type;
+  bool repeated;
+  // TYPE_MESSAGE: the plan of the field's message type.
+  const MessageWriterPlan* child_plan;
+  // TYPE_ENUM of a JsonUnifiedSchemaBuilder enum: the json string of each
+  // value, quoted and escaped, indexed by value number. Other enums have
+  // none and are written as numbers.
+  const base::StringPiece* enum_strings;
+  size_t enum_string_count;
+};
+
+// Every field of one message type sorted by field number, which is also the
+// order protobuf encodes them in, so looking up the field of the next tag is
+// nearly always a compare with the field after the previous match.
+class MessageWriterPlan {
+public:
+  explicit MessageWriterPlan(const google::protobuf::Descriptor* desc);
+
+  const google::protobuf::Descriptor* descriptor() const { return desc_; }
+
+  MessageWriterKind kind() const { return kind_; }
+
+  size_t field_count() const { return field_count_; }
+
+  const FieldWriter& field(size_t index) const { return fields_[index]; }
+
+  // |hint| is the position expected next, it is moved past the match.
+  // Returns nullptr for field numbers the type does not have.
+  const FieldWriter* FindField(int number, size_t* hint) const;
+
+private:
+  friend class WriterPlanCache;
+
+  const google::protobuf::Descriptor* desc_;
+  MessageWriterKind kind_;
+  FieldWriter* fields_;
+  size_t field_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(MessageWriterPlan);
+};
+
+// Compiles a message type and every type reachable from it into writer plans,
+// once. Like BindingPlanCache the plans live in the cache's arena.
+class WriterPlanCache {
+public:
+  WriterPlanCache();
+
+  ~WriterPlanCache();
+
+  const MessageWriterPlan* GetPlan(const google::protobuf::Descriptor* desc);
+
+  size_t plan_count() const { return plans_.size(); }
+
+private:
+  typedef std::pair<const google::protobuf::Descriptor* const, MessageWriterPlan*> PlanEntry;
+
+  MessageWriterPlan* Compile(const google::protobuf::Descriptor* desc);
+
+  void CompileEnumStrings(
+    const google::protobuf::EnumDescriptor* enum_desc,
+    FieldWriter* field);
+
+private:
+  MonotonicArena arena_;
+  std::unordered_map<const google::protobuf::Descriptor*, MessageWriterPlan*,
+    std::hash<const google::protobuf::Descriptor*>,
+    std::equal_to<const google::protobuf::Descriptor*>,
+    MonotonicArenaAllocator<PlanEntry>> plans_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(WriterPlanCache);
+};
+
+} // namespace self
+#endif // JSON_WRITER_PLAN_H_
@@ -6,17 +6,82 @@
 
 static const char kHelpContent[] = "\
 format like this \n\
-input-filepath=xxx.json output-filepath=xxx\n";
+input-filepath=xxx.json output-filepath=xxx\n\
+optional:\n\
+  use-dom-parser  parse the whole json into base::Value before converting\n\
+  mmap-input      map the input file and parse straight from the mapping\n\
+  json-parser=xxx  streaming (default) or structural, a SIMD structural\n\
+                      index of the whole input (sse4.2/avx2 when available)\n\
+  record-stream   newline delimited json in, length delimited protobuf out\n\
+                      with the unify-array-schema schema, or the\n\
+                      compact-wire-types one inferred again for records\n\
+                      that do not fit\n\
+  schema-cache-dir=xxx  reuse the schema of inputs with a known json shape\n\
+  incremental     keep the encoded subtrees in the output path + .subtrees\n\
+                      and copy the unchanged ones on the next run,\n\
+                      implies unify-array-schema\n\
+  parallel-subtrees  fill the large objects and arrays under the root's keys\n\
+                      on a thread pool, implies unify-array-schema\n\
+  jobs=n          parallel-subtrees threads, the number of processors\n\
+                      by default\n\
+  unify-array-schema  one repeated message type for all elements of an array\n\
+  compact-wire-types  unify-array-schema with narrow types, packed arrays,\n\
+                      enums for repeating strings and one byte tags for\n\
+                      the most frequent keys\n\
+  max-enum-cardinality  strings with more distinct values stay strings,\n\
+                      default 256, 0 for no enums\n\
+  use-arena       allocate the message tree on one arena, freed at once\n\
+  output-io-thread  write the output on a background thread while encoding\n\
+  compress-output=xxx  gzip or zlib, compressed on the output thread\n\
+  compression-level=n  0 to 9, 6 by default\n\
+  output-chunk-kb=n  output bytes per write or compression chunk, 1024\n\
+                      by default\n\
+  write-descriptor-set  write the schema to the output path + .desc\n\
+  container-output  blocks of records with the schema and a block index\n\
+                      at the end, for reading single records\n\
+  container-block-kb=n  bytes of records per container block, 64 by default\n\
+  container-stat-fields=a,b.c  keys whose min and max each block keeps\n\
+reverse mode, protobuf back to json:\n\
+to-json input-filepath=xxx output-filepath=xxx.json\n\
+optional:\n\
+  descriptor-set-file-path=xxx  the schema, the input path + .desc by default\n\
+  mmap-input      map the input file instead of reading it\n\
+batch mode, many files in one process:\n\
+input-dir=xxx | input-glob=xxx/*.json | input-manifest=xxx output-dir=xxx\n\
+optional:\n\
+  jobs=n               worker threads, the number of processors by default\n\
+  memory-budget-mb=n   memory for the files in flight, 1024 by default\n\
+  coroutine-pipeline   stream the files through read, convert and write\n\
+                       coroutines, keeps the disk busy on large sets\n\
+server mode, warm schemas for many small conversions:\n\
+serve=xxx.sock       convert for the clients of a unix domain socket\n\
+optional:\n\
+  jobs=n               worker threads, the number of processors by default\n\
+client mode, the usual switches plus:\n\
+  server=xxx.sock      have the server convert input-filepath to output-filepath\n\
+  server-inline        send the input and receive the output over the socket\n\
+stop-server=xxx.sock   stop the server\n\
+tracing, any mode:\n\
+  trace-file=xxx.json  write the phases as chrome trace events\n\
+  trace-min-nodes=n    objects and arrays this big get a span, 10000 by default\n";
 void PrintHelp() {
   ::printf("%s", kHelpContent);
 }
-int main() {
-  // Initialize the CommandLine singleton from the environment
-  base::CommandLine::Init(0, nullptr);
+
+int main(int argc, char* argv[]) {
+  // Initialize the CommandLine singleton, from GetCommandLineW() on Windows
+  // and from argv everywhere else
+  base::CommandLine::Init(argc, argv);
   const base::CommandLine* command_line =
     base::CommandLine::ForCurrentProcess();
-  if (!command_line->HasSwitch(convert_switches::kInputFilePath) ||
-      !command_line->HasSwitch(convert_switches::kOutputFilePath)) {
+  bool batch_mode = command_line->HasSwitch(convert_switches::kInputDir) ||
+    command_line->HasSwitch(convert_switches::kInputGlob) ||
+    command_line->HasSwitch(convert_switches::kInputManifest);
+  bool server_mode = command_line->HasSwitch(convert_switches::kServe) ||
+    command_line->HasSwitch(convert_switches::kStopServer);
+  if (!server_mode && (batch_mode ? !command_line->HasSwitch(convert_switches::kOutputDir) :
+      (!command_line->HasSwitch(convert_switches::kInputFilePath) ||
+       !command_line->HasSwitch(convert_switches::kOutputFilePath)))) {
       PrintHelp();
       return -1;
   }
@@ -25,7 +90,7 @@ int main() {
   std::string error_message;
   if (!convert_json_to_protobuf->Convert(command_line, error_message)) {
     ::printf("error reason is: %s\n", error_message.c_str());
-    //::system("pause");
+    return -1;
   }
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "monotonic_arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cstddef>
+
+#include "base/logging.h"
+
+namespace self {
+
+namespace {
+// block 头之后的第一个字节按这个对齐
+static const size_t kBlockAlignment = alignof(std::max_align_t);
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+}
+
+MonotonicArena::MonotonicArena(size_t block_size)
+  : block_size_(block_size),
+    blocks_(nullptr),
+    position_(nullptr),
+    limit_(nullptr),
+    block_count_(0),
+    memory_usage_(0) {
+  DCHECK_GT(block_size_, 0u);
+}
+
+MonotonicArena::~MonotonicArena() {
+  while (blocks_) {
+    Block* next = blocks_->next;
+    ::operator delete(blocks_);
+    blocks_ = next;
+  }
+}
+
+void* MonotonicArena::Allocate(size_t size, size_t alignment) {
+  DCHECK(alignment > 0 && (alignment & (alignment - 1)) == 0);
+  char* result = reinterpret_cast<char*>(
+    AlignUp(reinterpret_cast<uintptr_t>(position_), alignment));
+  if (!position_ || result + size > limit_) {
+    AddBlock(size + alignment);
+    result = reinterpret_cast<char*>(
+      AlignUp(reinterpret_cast<uintptr_t>(position_), alignment));
+  }
+  position_ = result + size;
+  return result;
+}
+
+base::StringPiece MonotonicArena::CopyString(const base::StringPiece& text) {
+  if (text.empty()) {
+    return base::StringPiece();
+  }
+  char* data = static_cast<char*>(Allocate(text.size(), 1));
+  ::memcpy(data, text.data(), text.size());
+  return base::StringPiece(data, text.size());
+}
+
+void MonotonicArena::Reset() {
+  if (!blocks_) {
+    return;
+  }
+  // 链表尾是最早的 block, 只留它
+  while (blocks_->next) {
+    Block* next = blocks_->next;
+    memory_usage_ -= blocks_->size;
+    ::operator delete(blocks_);
+    blocks_ = next;
+  }
+  block_count_ = 1;
+  position_ = reinterpret_cast<char*>(blocks_) + AlignUp(sizeof(Block), kBlockAlignment);
+  limit_ = reinterpret_cast<char*>(blocks_) + blocks_->size;
+}
+
+void MonotonicArena::AddBlock(size_t min_size) {
+  const size_t header_size = AlignUp(sizeof(Block), kBlockAlignment);
+  // 比 block 还大的对象按自己的大小单独分配
+  const size_t size = header_size + std::max(block_size_, min_size);
+  Block* block = static_cast<Block*>(::operator new(size));
+  block->next = blocks_;
+  block->size = size;
+  blocks_ = block;
+  position_ = reinterpret_cast<char*>(block) + header_size;
+  limit_ = reinterpret_cast<char*>(block) + size;
+  block_count_++;
+  memory_usage_ += size;
+}
+
+} //namespace self
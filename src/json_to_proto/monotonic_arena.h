@@ -0,0 +1,105 @@
+#ifndef MONOTONIC_ARENA_H_
+#define MONOTONIC_ARENA_H_
+
+#include <stddef.h>
+
+#include <new>
+#include <utility>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+
+namespace self {
+
+// Hands out memory from large blocks by bumping a pointer and frees it all at
+// once. Nothing placed here is destroyed one by one, so it may only hold
+// objects whose memory is all in the arena, e.g. containers that use
+// MonotonicArenaAllocator.
+class MonotonicArena {
+public:
+  static const size_t kDefaultBlockSize = 64 << 10;
+
+  explicit MonotonicArena(size_t block_size = kDefaultBlockSize);
+
+  ~MonotonicArena();
+
+  void* Allocate(size_t size, size_t alignment);
+
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Value initialized, for trivially destructible types.
+  template <typename T>
+  T* NewArray(size_t count) {
+    return new (Allocate(sizeof(T) * count, alignof(T))) T[count]();
+  }
+
+  base::StringPiece CopyString(const base::StringPiece& text);
+
+  // Frees every block but the first, which is kept for the next use.
+  void Reset();
+
+  size_t block_count() const { return block_count_; }
+
+  // Bytes held in blocks.
+  size_t memory_usage() const { return memory_usage_; }
+
+private:
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  void AddBlock(size_t min_size);
+
+private:
+  const size_t block_size_;
+  // 最新的 block 在链表头
+  Block* blocks_;
+  char* position_;
+  char* limit_;
+  size_t block_count_;
+  size_t memory_usage_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(MonotonicArena);
+};
+
+// Lets standard containers allocate from a MonotonicArena. Deallocation does
+// nothing, the memory comes back when the arena is reset or destroyed.
+template <typename T>
+class MonotonicArenaAllocator {
+public:
+  typedef T value_type;
+
+  explicit MonotonicArenaAllocator(MonotonicArena* arena) : arena_(arena) {}
+
+  template <typename U>
+  MonotonicArenaAllocator(const MonotonicArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(arena_->Allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  void deallocate(T* pointer, size_t count) {}
+
+  MonotonicArena* arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const MonotonicArenaAllocator<U>& other) const {
+    return arena_ == other.arena();
+  }
+
+  template <typename U>
+  bool operator!=(const MonotonicArenaAllocator<U>& other) const {
+    return arena_ != other.arena();
+  }
+
+private:
+  MonotonicArena* arena_;
+};
+
+} // namespace self
+#endif // MONOTONIC_ARENA_H_
@@ -0,0 +1,120 @@
+#include "monotonic_arena.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+TEST(MonotonicArenaTest, AllocationsAlignedAndDisjoint) {
+  MonotonicArena arena(256);
+  struct Allocation {
+    char* data;
+    size_t size;
+  };
+  std::vector<Allocation> allocations;
+  for (int i = 0; i < 200; ++i) {
+    const size_t alignment = static_cast<size_t>(1) << (i % 5);
+    const size_t size = 1 + i % 37;
+    char* data = static_cast<char*>(arena.Allocate(size, alignment));
+    ASSERT_TRUE(data);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(data) % alignment);
+    ::memset(data, i, size);
+    allocations.push_back({data, size});
+  }
+  // 后面的分配没有覆盖前面的
+  for (size_t i = 0; i < allocations.size(); ++i) {
+    for (size_t j = 0; j < allocations[i].size; ++j) {
+      ASSERT_EQ(static_cast<char>(i), allocations[i].data[j]) << i;
+    }
+  }
+  EXPECT_GT(arena.block_count(), 1u);
+}
+
+// An allocation larger than a block gets a block of its own size.
+TEST(MonotonicArenaTest, LargeAllocationGetsOwnBlock) {
+  MonotonicArena arena(128);
+  EXPECT_EQ(0u, arena.block_count());
+  EXPECT_EQ(0u, arena.memory_usage());
+  arena.Allocate(16, 8);
+  EXPECT_EQ(1u, arena.block_count());
+  const size_t first_block_usage = arena.memory_usage();
+
+  char* data = static_cast<char*>(arena.Allocate(1000, 16));
+  ::memset(data, 1, 1000);
+  EXPECT_EQ(2u, arena.block_count());
+  EXPECT_GE(arena.memory_usage(), first_block_usage + 1000);
+}
+
+// Reset keeps the first block and hands its memory out again.
+TEST(MonotonicArenaTest, ResetKeepsFirstBlock) {
+  MonotonicArena arena(256);
+  void* first = arena.Allocate(8, 8);
+  const size_t first_block_usage = arena.memory_usage();
+  for (int i = 0; i < 100; ++i) {
+    arena.Allocate(64, 8);
+  }
+  EXPECT_GT(arena.block_count(), 1u);
+
+  arena.Reset();
+  EXPECT_EQ(1u, arena.block_count());
+  EXPECT_EQ(first_block_usage, arena.memory_usage());
+  EXPECT_EQ(first, arena.Allocate(8, 8));
+
+  MonotonicArena empty_arena;
+  empty_arena.Reset();
+  EXPECT_EQ(0u, empty_arena.block_count());
+}
+
+TEST(MonotonicArenaTest, NewArrayAndCopyString) {
+  MonotonicArena arena(64);
+  int64_t* values = arena.NewArray<int64_t>(100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(0, values[i]);
+  }
+
+  std::string text = "json key";
+  base::StringPiece copy = arena.CopyString(text);
+  text[0] = 'J';
+  EXPECT_EQ("json key", copy.as_string());
+  EXPECT_TRUE(arena.CopyString(base::StringPiece()).empty());
+
+  std::pair<int, double>* pair = arena.New<std::pair<int, double>>(3, 0.5);
+  EXPECT_EQ(3, pair->first);
+  EXPECT_EQ(0.5, pair->second);
+}
+
+TEST(MonotonicArenaAllocatorTest, StandardContainers) {
+  MonotonicArena arena(512);
+  std::vector<int, MonotonicArenaAllocator<int>> values{MonotonicArenaAllocator<int>(&arena)};
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(i);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(i, values[i]);
+  }
+
+  typedef std::pair<const int, int> Entry;
+  std::map<int, int, std::less<int>, MonotonicArenaAllocator<Entry>> squares{
+    std::less<int>(), MonotonicArenaAllocator<Entry>(&arena)};
+  for (int i = 0; i < 100; ++i) {
+    squares[i] = i * i;
+  }
+  EXPECT_EQ(100u, squares.size());
+  EXPECT_EQ(81, squares[9]);
+
+  EXPECT_TRUE(MonotonicArenaAllocator<int>(&arena) == MonotonicArenaAllocator<Entry>(&arena));
+  MonotonicArena other_arena;
+  EXPECT_TRUE(MonotonicArenaAllocator<int>(&arena) !=
+              MonotonicArenaAllocator<int>(&other_arena));
+}
+
+} // namespace self
@@ -0,0 +1,595 @@
+#include "parallel_document_converter.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "conversion_tracer.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_stream_message_builder.h"
+#include "json_stream_schema_builder.h"
+#include "json_tape.h"
+#include "json_to_protobuf_serializer.h"
+#include "json_unified_schema_builder.h"
+#include "monotonic_arena.h"
+#include "protobuf_file_output_stream.h"
+
+#include "google/protobuf/arena.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/wire_format_lite.h"
+
+namespace self {
+
+namespace {
+// 每个 worker 分几个任务, 大小不一的任务靠偷来摊平
+static const int kTasksPerWorker = 4;
+// 数组元素的起点最多每这么多事件记一个, 切任务只在记下的起点上切
+static const size_t kElementCutEvents = 1024;
+
+void WriteLengthDelimited(
+  int field_number,
+  const google::protobuf::Message& message,
+  google::protobuf::io::CodedOutputStream* coded_output) {
+  const size_t size = message.ByteSizeLong();
+  coded_output->WriteTag(google::protobuf::internal::WireFormatLite::MakeTag(
+    field_number, google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+  coded_output->WriteVarint64(size);
+  message.SerializeWithCachedSizes(coded_output);
+}
+
+// Fills every top level object of the events into |message| in turn and
+// encodes it as an element of |field_number| once it ends.
+class ElementEncoder : public JsonSaxHandler {
+public:
+  ElementEncoder(
+    JsonMessageBuilder* message_builder,
+    google::protobuf::Message* message,
+    int field_number,
+    google::protobuf::io::CodedOutputStream* coded_output)
+    : message_builder_(message_builder),
+      message_(message),
+      field_number_(field_number),
+      coded_output_(coded_output),
+      depth_(0) {
+  }
+
+  bool OnStartObject() override {
+    if (depth_++ == 0) {
+      // 同一个 message 清空了接着用, arena 上的子 message 也留着复用
+      message_->Clear();
+      message_builder_->Reset(message_);
+    }
+    return Forward(message_builder_->OnStartObject());
+  }
+
+  bool OnKey(const base::StringPiece& key) override {
+    return Forward(message_builder_->OnKey(key));
+  }
+
+  bool OnEndObject() override {
+    if (!Forward(message_builder_->OnEndObject())) {
+      return false;
+    }
+    if (--depth_ == 0) {
+      WriteLengthDelimited(field_number_, *message_, coded_output_);
+    }
+    return true;
+  }
+
+  bool OnStartArray() override {
+    ++depth_;
+    return Forward(message_builder_->OnStartArray());
+  }
+
+  bool OnEndArray() override {
+    --depth_;
+    return Forward(message_builder_->OnEndArray());
+  }
+
+  bool OnNull() override {
+    return Forward(message_builder_->OnNull());
+  }
+
+  bool OnBoolean(bool value) override {
+    return Forward(message_builder_->OnBoolean(value));
+  }
+
+  bool OnInteger(int64_t value) override {
+    return Forward(message_builder_->OnInteger(value));
+  }
+
+  bool OnDouble(double value) override {
+    return Forward(message_builder_->OnDouble(value));
+  }
+
+  bool OnString(const base::StringPiece& value) override {
+    return Forward(message_builder_->OnString(value));
+  }
+
+private:
+  bool Forward(bool result) {
+    if (!result) {
+      error_message_ = message_builder_->error_message();
+    }
+    return result;
+  }
+
+private:
+  JsonMessageBuilder* message_builder_;
+  google::protobuf::Message* message_;
+  const int field_number_;
+  google::protobuf::io::CodedOutputStream* coded_output_;
+  int depth_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ElementEncoder);
+};
+}
+
+// Counts the events like a JsonTape recording the same parse and notes where
+// every value under the root's keys starts and ends.
+class ParallelDocumentConverter::TopLevelSplitter : public JsonSaxHandler {
+public:
+  struct Member {
+    std::string key;
+    size_t key_event;
+    // The value's first event and one past its last.
+    size_t begin;
+    size_t end;
+    bool is_object;
+    // An array whose elements are all objects.
+    bool is_object_array;
+    // Where elements of an object array start, the first one and then at
+    // most one every kElementCutEvents events.
+    std::vector<size_t> element_cuts;
+  };
+
+  TopLevelSplitter()
+    : event_count_(0),
+      depth_(0) {
+  }
+
+  ~TopLevelSplitter() override {
+  }
+
+  const std::vector<Member>& members() const { return members_; }
+  size_t event_count() const { return event_count_; }
+
+  bool OnStartObject() override {
+    const size_t event = event_count_++;
+    if (depth_ == 1) {
+      StartMember(event).is_object = true;
+    } else if (depth_ == 2 && members_.back().is_object_array) {
+      std::vector<size_t>& element_cuts = members_.back().element_cuts;
+      if (element_cuts.empty() || event - element_cuts.back() >= kElementCutEvents) {
+        element_cuts.push_back(event);
+      }
+    }
+    ++depth_;
+    return true;
+  }
+
+  bool OnKey(const base::StringPiece& key) override {
+    const size_t event = event_count_++;
+    if (depth_ == 1) {
+      Member member;
+      key.CopyToString(&member.key);
+      member.key_event = event;
+      member.begin = member.end = event + 1;
+      member.is_object = false;
+      member.is_object_array = false;
+      members_.push_back(std::move(member));
+    }
+    return true;
+  }
+
+  bool OnEndObject() override {
+    ++event_count_;
+    return EndContainer();
+  }
+
+  bool OnStartArray() override {
+    const size_t event = event_count_++;
+    if (!OnValue()) {
+      return false;
+    }
+    if (depth_ == 1) {
+      StartMember(event).is_object_array = true;
+    }
+    ++depth_;
+    return true;
+  }
+
+  bool OnEndArray() override {
+    ++event_count_;
+    return EndContainer();
+  }
+
+  bool OnNull() override {
+    return OnScalar();
+  }
+
+  bool OnBoolean(bool value) override {
+    return OnScalar();
+  }
+
+  bool OnInteger(int64_t value) override {
+    return OnScalar();
+  }
+
+  bool OnDouble(double value) override {
+    return OnScalar();
+  }
+
+  bool OnString(const base::StringPiece& value) override {
+    return OnScalar();
+  }
+
+private:
+  Member& StartMember(size_t event) {
+    Member& member = members_.back();
+    member.begin = event;
+    return member;
+  }
+
+  // Anything but an object under an array member spoils it.
+  bool OnValue() {
+    if (depth_ == 0) {
+      error_message_ = "root value is not a json object";
+      return false;
+    }
+    if (depth_ == 2 && members_.back().is_object_array) {
+      members_.back().is_object_array = false;
+      members_.back().element_cuts.clear();
+    }
+    return true;
+  }
+
+  bool OnScalar() {
+    const size_t event = event_count_++;
+    if (!OnValue()) {
+      return false;
+    }
+    if (depth_ == 1) {
+      StartMember(event).end = event + 1;
+    }
+    return true;
+  }
+
+  bool EndContainer() {
+    DCHECK_GT(depth_, 0u);
+    if (--depth_ == 1) {
+      members_.back().end = event_count_;
+    }
+    return true;
+  }
+
+private:
+  std::vector<Member> members_;
+  size_t event_count_;
+  size_t depth_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(TopLevelSplitter);
+};
+
+ParallelDocumentConverter::Task::Task()
+  : field_number(0),
+    message_desc(nullptr),
+    events(0, 0),
+    elements(false),
+    succeeded(false) {
+}
+
+ParallelDocumentConverter::ParallelDocumentConverter(
+  SchemaMode schema_mode,
+  int worker_count)
+  : schema_mode_(schema_mode),
+    worker_count_(worker_count),
+    max_enum_cardinality_(JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality),
+    min_task_events_(kDefaultMinTaskEvents),
+    use_io_thread_(false),
+    output_options_(nullptr),
+    write_descriptor_set_(false),
+    json_tape_(nullptr),
+    message_factory_(nullptr),
+    event_count_(0),
+    split_event_count_(0),
+    steal_count_(0) {
+  DCHECK(schema_mode_ != SchemaMode::kPerElement);
+  DCHECK_GT(worker_count_, 0);
+}
+
+ParallelDocumentConverter::~ParallelDocumentConverter() {
+}
+
+bool ParallelDocumentConverter::Convert(
+  JsonInputStream* input_stream,
+  const base::FilePath& output_file_path,
+  std::string& error_message) {
+  DCHECK(input_stream);
+  tasks_.clear();
+  root_ranges_.clear();
+  event_count_ = 0;
+  split_event_count_ = 0;
+  steal_count_ = 0;
+  fill_time_ = base::TimeDelta();
+
+  // 推导 schema, 记 tape 和找切分点共用一遍解析
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    BuildProtoFromJson::NewProtoFile();
+  MonotonicArena tape_arena;
+  JsonTape json_tape(&tape_arena);
+  TopLevelSplitter splitter;
+  {
+    ScopedTraceSpan span("CreateProtoFile");
+    span.AddArg("bytes", input_stream->GetLength());
+    std::unique_ptr<JsonSchemaBuilder> schema_builder =
+      BuildProtoFromJson::CreateSchemaBuilder(
+        schema_mode_, max_enum_cardinality_, file_desc_proto.get());
+    JsonSaxTee schema_tee(schema_builder.get(), &json_tape);
+    JsonSaxTee split_tee(&schema_tee, &splitter);
+    std::unique_ptr<TracedJsonSaxHandler> traced_handler;
+    JsonSaxReader json_reader(input_stream);
+    if (!json_reader.Parse(TracedJsonSaxHandler::Wrap(&split_tee, &traced_handler),
+          error_message) ||
+        !schema_builder->Finish(error_message)) {
+      return false;
+    }
+    if (traced_handler) {
+      span.AddArg("nodes", traced_handler->node_count());
+    }
+    span.AddArg("descriptors", file_desc_proto->message_type_size());
+  }
+  DCHECK_EQ(splitter.event_count(), json_tape.event_count());
+  event_count_ = static_cast<int64_t>(json_tape.event_count());
+
+  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = JsonToProtobufSerializer::BuildFile(
+    std::move(file_desc_proto), &desc_pool, error_message);
+  if (!file_desc) {
+    return false;
+  }
+  if (write_descriptor_set_ && !output_file_path.empty() &&
+      !JsonToProtobufSerializer::WriteDescriptorSet(file_desc, output_file_path,
+        error_message)) {
+    return false;
+  }
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  if (!root_desc) {
+    error_message = "no ROOT message in proto file";
+    return false;
+  }
+
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(desc_pool.get());
+  // 取 ROOT 的原型时所有类型的原型都建好了, worker 上只是查表
+  dynamic_message_factory.GetPrototype(root_desc);
+  PlanTasks(root_desc, splitter);
+  {
+    ScopedTraceSpan span("CreateMessage");
+    span.AddArg("tasks", tasks_.size());
+    span.AddArg("split_events", split_event_count_);
+    json_tape_ = &json_tape;
+    message_factory_ = &dynamic_message_factory;
+    const base::TimeTicks start = base::TimeTicks::Now();
+    WorkStealingThreadPool thread_pool(worker_count_);
+    thread_pool.Run(tasks_.size(), this);
+    fill_time_ = base::TimeTicks::Now() - start;
+    steal_count_ = thread_pool.steal_count();
+    json_tape_ = nullptr;
+    message_factory_ = nullptr;
+  }
+  // 报文档里最靠前的错误, 和顺序转换报的一样
+  for (const Task& task : tasks_) {
+    if (!task.succeeded) {
+      error_message = task.error_message;
+      return false;
+    }
+  }
+  return WriteOutput(output_file_path, error_message);
+}
+
+void ParallelDocumentConverter::RunTask(size_t task_index, int worker_index) {
+  Task& task = tasks_[task_index];
+  ScopedTraceSpan span("FillTask");
+  span.AddArg("field", task.field_number);
+
+  // message 建在任务自己的 arena 上, 编码完一起释放, worker 之间不抢分配器
+  google::protobuf::Arena arena;
+  google::protobuf::Message* message =
+    message_factory_->GetPrototype(task.message_desc)->New(&arena);
+  std::unique_ptr<JsonMessageBuilder> message_builder =
+    JsonToProtobufSerializer::CreateMessageBuilder(schema_mode_, message, message_factory_);
+  int64_t event_count = 0;
+  if (task.field_number == 0) {
+    // 根对象被切掉的 key 连同值一起跳过, 剩下的还是一个完整的对象
+    task.succeeded = true;
+    for (const EventRange& range : root_ranges_) {
+      event_count += range.second - range.first;
+      if (!json_tape_->Replay(message_builder.get(), range.first, range.second,
+            task.error_message)) {
+        task.succeeded = false;
+        break;
+      }
+    }
+    if (task.succeeded) {
+      message->SerializeToString(&task.output);
+    }
+  } else {
+    event_count = task.events.second - task.events.first;
+    google::protobuf::io::StringOutputStream string_output(&task.output);
+    google::protobuf::io::CodedOutputStream coded_output(&string_output);
+    if (task.elements) {
+      ElementEncoder element_encoder(message_builder.get(), message, task.field_number,
+        &coded_output);
+      task.succeeded = json_tape_->Replay(&element_encoder, task.events.first,
+        task.events.second, task.error_message);
+    } else {
+      task.succeeded = json_tape_->Replay(message_builder.get(), task.events.first,
+        task.events.second, task.error_message);
+      if (task.succeeded) {
+        WriteLengthDelimited(task.field_number, *message, &coded_output);
+      }
+    }
+  }
+  if (!task.succeeded) {
+    task.output.clear();
+  }
+  span.AddArg("events", event_count);
+  span.AddArg("bytes", task.output.size());
+}
+
+void ParallelDocumentConverter::PlanTasks(
+  const google::protobuf::Descriptor* root_desc,
+  const TopLevelSplitter& splitter) {
+  const std::vector<TopLevelSplitter::Member>& members = splitter.members();
+  std::map<std::string, size_t> key_counts;
+  for (const TopLevelSplitter::Member& member : members) {
+    ++key_counts[member.key];
+  }
+  std::map<std::string, const google::protobuf::FieldDescriptor*> root_fields;
+  for (int index = 0; index < root_desc->field_count(); ++index) {
+    const google::protobuf::FieldDescriptor* field_desc = root_desc->field(index);
+    root_fields[field_desc->json_name()] = field_desc;
+  }
+
+  // 只切单独成一个字段的大值: 对象对 message 字段, 全是对象的数组对 repeated message
+  // 字段. 出现两次的 key 和 variant 字段留给根, 它们要和别的值合在一起填
+  std::vector<std::pair<const TopLevelSplitter::Member*,
+    const google::protobuf::FieldDescriptor*>> split_members;
+  for (const TopLevelSplitter::Member& member : members) {
+    if (member.end - member.begin < static_cast<size_t>(min_task_events_) ||
+        key_counts[member.key] > 1 ||
+        !(member.is_object || (member.is_object_array && !member.element_cuts.empty()))) {
+      continue;
+    }
+    auto field = root_fields.find(member.key);
+    if (field == root_fields.end()) {
+      continue;
+    }
+    const google::protobuf::FieldDescriptor* field_desc = field->second;
+    if (field_desc->type() != google::protobuf::FieldDescriptor::TYPE_MESSAGE ||
+        field_desc->is_repeated() != member.is_object_array ||
+        field_desc->message_type()->oneof_decl_count() > 0) {
+      continue;
+    }
+    split_members.push_back(std::make_pair(&member, field_desc));
+    split_event_count_ += member.end - member.begin;
+  }
+
+  tasks_.emplace_back();
+  tasks_.back().message_desc = root_desc;
+  const size_t task_events = std::max(static_cast<size_t>(min_task_events_),
+    static_cast<size_t>(split_event_count_) / (worker_count_ * kTasksPerWorker));
+  size_t root_position = 0;
+  for (const auto& split_member : split_members) {
+    const TopLevelSplitter::Member& member = *split_member.first;
+    root_ranges_.push_back(EventRange(root_position, member.key_event));
+    root_position = member.end;
+
+    Task task;
+    task.field_number = split_member.second->number();
+    task.message_desc = split_member.second->message_type();
+    if (member.is_object) {
+      task.events = EventRange(member.begin, member.end);
+      tasks_.push_back(std::move(task));
+      continue;
+    }
+    // 在元素起点上切, 数组自己的开始和结束事件不要
+    task.elements = true;
+    const std::vector<size_t>& element_cuts = member.element_cuts;
+    const size_t elements_end = member.end - 1;
+    size_t task_begin = element_cuts.empty() ? elements_end : element_cuts.front();
+    for (size_t index = 1; index <= element_cuts.size(); ++index) {
+      const size_t cut = index < element_cuts.size() ? element_cuts[index] : elements_end;
+      if (cut - task_begin < task_events && index < element_cuts.size()) {
+        continue;
+      }
+      task.events = EventRange(task_begin, cut);
+      tasks_.push_back(task);
+      task_begin = cut;
+    }
+  }
+  root_ranges_.push_back(EventRange(root_position, splitter.event_count()));
+}
+
+bool ParallelDocumentConverter::WriteOutput(
+  const base::FilePath& output_file_path,
+  std::string& error_message) {
+  if (output_file_path.empty()) {
+    return true;
+  }
+  ScopedTraceSpan span("WriteOutput");
+  // 同一个字段的任务保持文档里的顺序
+  std::vector<size_t> split_tasks;
+  for (size_t index = 1; index < tasks_.size(); ++index) {
+    split_tasks.push_back(index);
+  }
+  std::stable_sort(split_tasks.begin(), split_tasks.end(),
+    [this](size_t left, size_t right) {
+      return tasks_[left].field_number < tasks_[right].field_number;
+    });
+
+  ProtobufFileOutputStream output_stream;
+  if (output_options_) {
+    output_stream.set_options(*output_options_);
+  }
+  if (!output_stream.Open(output_file_path, use_io_thread_, error_message)) {
+    return false;
+  }
+  bool written = false;
+  {
+    // 序列化按字段号从小到大写, 任务的字段插在根里第一个字段号更大的字段前面,
+    // 拼出来的和整个 message 一起序列化的结果一样
+    const std::string& own_bytes = tasks_.front().output;
+    google::protobuf::io::CodedInputStream coded_input(
+      reinterpret_cast<const uint8_t*>(own_bytes.data()), static_cast<int>(own_bytes.size()));
+    google::protobuf::io::CodedOutputStream coded_output(&output_stream);
+    size_t own_written = 0;
+    size_t next_task = 0;
+    while (next_task < split_tasks.size()) {
+      const size_t offset = static_cast<size_t>(coded_input.CurrentPosition());
+      const uint32_t tag = coded_input.ReadTag();
+      const int field_number = tag == 0 ? std::numeric_limits<int>::max() :
+        static_cast<int>(google::protobuf::internal::WireFormatLite::GetTagFieldNumber(tag));
+      if (tasks_[split_tasks[next_task]].field_number < field_number) {
+        coded_output.WriteRaw(own_bytes.data() + own_written,
+          static_cast<int>(offset - own_written));
+        own_written = offset;
+        while (next_task < split_tasks.size() &&
+               tasks_[split_tasks[next_task]].field_number < field_number) {
+          coded_output.WriteString(tasks_[split_tasks[next_task++]].output);
+        }
+      }
+      if (tag == 0) {
+        break;
+      }
+      if (!google::protobuf::internal::WireFormatLite::SkipField(&coded_input, tag)) {
+        NOTREACHED() << "broken message encoding";
+        break;
+      }
+    }
+    coded_output.WriteRaw(own_bytes.data() + own_written,
+      static_cast<int>(own_bytes.size() - own_written));
+    written = !coded_output.HadError();
+  }
+  if (!written) {
+    // 写失败时 Close 给出的原因更准确
+    if (output_stream.Close(error_message)) {
+      error_message = "write output fail";
+    }
+    return false;
+  }
+  span.AddArg("bytes", output_stream.ByteCount());
+  return output_stream.Close(error_message);
+}
+
+} //namespace self
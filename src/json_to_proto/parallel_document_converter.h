@@ -0,0 +1,158 @@
+#ifndef PARALLEL_DOCUMENT_CONVERTER_H_
+#define PARALLEL_DOCUMENT_CONVERTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/time/time.h"
+#include "build_proto_from_json.h"
+#include "work_stealing_thread_pool.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace google {
+namespace protobuf {
+class Descriptor;
+class DynamicMessageFactory;
+} // namespace protobuf
+} // google
+
+namespace self {
+
+class JsonInputStream;
+class JsonTape;
+struct OutputStreamOptions;
+
+// Converts one document like JsonToProtobufSerializer, but fills the message
+// on a WorkStealingThreadPool. The large objects and arrays of objects under
+// the root's keys are cut into tasks: an object is one task, an array is cut
+// between elements into runs of about the same number of events. Every task
+// replays its part of the JsonTape into messages on an arena of its own and
+// encodes them, the root's other keys are a task too. The encodings are
+// spliced by field number, so the output is byte for byte what a sequential
+// conversion writes, whatever the number of workers.
+//
+// Parsing and schema inference stay on the calling thread. Only
+// SchemaMode::kUnified and kCompact are supported: their message types and
+// field numbers follow the json path of a value, kPerElement names the types
+// of array elements with a counter running across the whole document, so a
+// subtree can not be filled without the ones before it.
+class ParallelDocumentConverter : public WorkStealingThreadPool::Delegate {
+public:
+  // Objects and arrays of fewer events stay with the root.
+  static const int64_t kDefaultMinTaskEvents = 16384;
+
+  ParallelDocumentConverter(SchemaMode schema_mode, int worker_count);
+
+  ~ParallelDocumentConverter() override;
+
+  // See BuildProtoFromJson::set_max_enum_cardinality().
+  void set_max_enum_cardinality(size_t max_enum_cardinality) {
+    max_enum_cardinality_ = max_enum_cardinality;
+  }
+
+  void set_min_task_events(int64_t min_task_events) {
+    min_task_events_ = min_task_events;
+  }
+
+  // See JsonToProtobufSerializer::set_use_io_thread().
+  void set_use_io_thread(bool use_io_thread) { use_io_thread_ = use_io_thread; }
+
+  // See JsonToProtobufSerializer::set_output_options().
+  void set_output_options(const OutputStreamOptions* output_options) {
+    output_options_ = output_options;
+  }
+
+  // See JsonToProtobufSerializer::set_write_descriptor_set().
+  void set_write_descriptor_set(bool write_descriptor_set) {
+    write_descriptor_set_ = write_descriptor_set;
+  }
+
+  // Nothing is written when |output_file_path| is empty.
+  bool Convert(
+    JsonInputStream* input_stream,
+    const base::FilePath& output_file_path,
+    std::string& error_message);
+
+  // Of the last Convert(): the tasks including the root's, the events of the
+  // document and those filled outside the root's task, and the tasks that ran
+  // on another worker than the one they were queued on.
+  size_t task_count() const { return tasks_.size(); }
+  int64_t event_count() const { return event_count_; }
+  int64_t split_event_count() const { return split_event_count_; }
+  int64_t steal_count() const { return steal_count_; }
+  // Filling and encoding the tasks, parsing and writing left out.
+  base::TimeDelta fill_time() const { return fill_time_; }
+
+  void RunTask(size_t task_index, int worker_index) override;
+
+private:
+  typedef std::pair<size_t, size_t> EventRange;
+
+  struct Task {
+    Task();
+
+    // The field of the root the task fills, 0 for the root's own task.
+    int field_number;
+    const google::protobuf::Descriptor* message_desc;
+    // The events of one object, or of whole elements of an array. The root's
+    // task replays root_ranges_ instead.
+    EventRange events;
+    bool elements;
+    // The root's task: the root's encoding without the split fields. The
+    // others: their fields with tag and length.
+    std::string output;
+    bool succeeded;
+    std::string error_message;
+  };
+
+  class TopLevelSplitter;
+
+  // Cuts the document between the root's keys and the elements of its
+  // arrays, the root's task first.
+  void PlanTasks(
+    const google::protobuf::Descriptor* root_desc,
+    const TopLevelSplitter& splitter);
+
+  // Writes the root's own bytes with the tasks' fields spliced in before the
+  // first field of a larger number.
+  bool WriteOutput(
+    const base::FilePath& output_file_path,
+    std::string& error_message);
+
+private:
+  const SchemaMode schema_mode_;
+  const int worker_count_;
+  size_t max_enum_cardinality_;
+  int64_t min_task_events_;
+  bool use_io_thread_;
+  const OutputStreamOptions* output_options_;
+  bool write_descriptor_set_;
+
+  // Valid during Convert().
+  const JsonTape* json_tape_;
+  google::protobuf::DynamicMessageFactory* message_factory_;
+
+  std::vector<Task> tasks_;
+  // The events of the root left after the split keys are cut out.
+  std::vector<EventRange> root_ranges_;
+
+  int64_t event_count_;
+  int64_t split_event_count_;
+  int64_t steal_count_;
+  base::TimeDelta fill_time_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ParallelDocumentConverter);
+};
+
+} // namespace self
+#endif // PARALLEL_DOCUMENT_CONVERTER_H_
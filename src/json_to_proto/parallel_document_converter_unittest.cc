@@ -0,0 +1,88 @@
+#include "parallel_document_converter.h"
+
+#include <string>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "convert_json_to_protobuf.h"
+#include "convert_switches.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_to_protobuf_serializer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+// 文档不大, 任务的下限调低才能切出多个任务
+const int64_t kMinTaskEvents = 256;
+
+// With any number of workers the output is the sequential conversion's.
+void ExpectSameAsSequential(SchemaMode schema_mode) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath sequential_output_path =
+    temp_dir.GetPath().AppendASCII("sequential.pb");
+  const base::FilePath output_path = temp_dir.GetPath().AppendASCII("parallel.pb");
+  const std::string json = GenerateParallelDocument(512 * 1024);
+
+  std::string error_message;
+  JsonStringInputStream sequential_input_stream(json);
+  JsonToProtobufSerializer json_to_protobuf_serializer(sequential_output_path);
+  json_to_protobuf_serializer.set_schema_mode(schema_mode);
+  ASSERT_TRUE(json_to_protobuf_serializer.SerializeFromStream(
+    &sequential_input_stream, error_message)) << error_message;
+  std::string sequential_output;
+  ASSERT_TRUE(base::ReadFileToString(sequential_output_path, &sequential_output));
+
+  for (int jobs : {1, 2, 4}) {
+    ParallelDocumentConverter parallel_converter(schema_mode, jobs);
+    parallel_converter.set_min_task_events(kMinTaskEvents);
+    JsonStringInputStream input_stream(json);
+    ASSERT_TRUE(parallel_converter.Convert(&input_stream, output_path, error_message))
+      << error_message;
+    EXPECT_GT(parallel_converter.task_count(), 1u);
+    std::string output;
+    ASSERT_TRUE(base::ReadFileToString(output_path, &output));
+    EXPECT_EQ(sequential_output, output) << jobs << " jobs";
+  }
+}
+
+} // namespace
+
+TEST(ParallelDocumentConverterTest, UnifiedSameAsSequential) {
+  ExpectSameAsSequential(SchemaMode::kUnified);
+}
+
+TEST(ParallelDocumentConverterTest, CompactSameAsSequential) {
+  ExpectSameAsSequential(SchemaMode::kCompact);
+}
+
+// Switches parallel conversion has no use for fail instead of being ignored.
+TEST(ParallelDocumentConverterTest, UnusedSwitchesRejected) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath input_path = temp_dir.GetPath().AppendASCII("input.json");
+  const base::FilePath output_path = temp_dir.GetPath().AppendASCII("parallel.pb");
+  ASSERT_EQ(7, base::WriteFile(input_path, "{\"a\":1}", 7));
+  for (const char* switch_name : {convert_switches::kUseDomParser,
+                                  convert_switches::kSchemaCacheDir,
+                                  convert_switches::kUseArena,
+                                  convert_switches::kContainerOutput}) {
+    base::CommandLine command_line(base::CommandLine::NO_PROGRAM);
+    command_line.AppendSwitchPath(convert_switches::kInputFilePath, input_path);
+    command_line.AppendSwitchPath(convert_switches::kOutputFilePath, output_path);
+    command_line.AppendSwitch(convert_switches::kParallelSubtrees);
+    command_line.AppendSwitch(switch_name);
+    std::string error_message;
+    EXPECT_FALSE(ConvertJsonToProtobuf::New()->Convert(&command_line, error_message));
+    EXPECT_EQ(std::string(switch_name) + " can not be used with parallel-subtrees",
+              error_message);
+  }
+  EXPECT_FALSE(base::PathExists(output_path));
+}
+
+} // namespace self
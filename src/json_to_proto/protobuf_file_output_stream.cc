@@ -0,0 +1,254 @@
+#include "protobuf_file_output_stream.h"
+
+#include <string.h>
+
+#include "base/logging.h"
+#include "base/threading/simple_thread.h"
+#include "third_party/zlib/zlib.h"
+
+namespace self {
+
+namespace {
+// 一个在填, 一个在写, 一个排队, 再多只是占内存
+static const size_t kIoThreadBufferCount = 3;
+static const size_t kCompressedBufferSize = 256 << 10;
+// deflate 的 window bits, 加 16 写 gzip 头
+static const int kZlibWindowBits = 15;
+static const int kGzipWindowBits = 15 + 16;
+static const int kZlibMemoryLevel = 8;
+}
+
+OutputStreamOptions::OutputStreamOptions()
+  : buffer_size(kDefaultBufferSize),
+    compression(OutputCompression::kNone),
+    compression_level(kDefaultCompressionLevel) {
+}
+
+class ProtobufFileOutputStream::Writer : public base::DelegateSimpleThread::Delegate {
+public:
+  explicit Writer(ProtobufFileOutputStream* output_stream)
+    : output_stream_(output_stream) {
+  }
+
+  void Run() override {
+    output_stream_->RunWriter();
+  }
+
+private:
+  ProtobufFileOutputStream* output_stream_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(Writer);
+};
+
+ProtobufFileOutputStream::ProtobufFileOutputStream(size_t buffer_size)
+  : buffer_size_(buffer_size),
+    compression_(OutputCompression::kNone),
+    compression_level_(OutputStreamOptions::kDefaultCompressionLevel),
+    current_buffer_(nullptr),
+    position_(0),
+    submitted_bytes_(0),
+    file_bytes_(0),
+    buffer_ready_(&lock_),
+    buffer_free_(&lock_),
+    closing_(false),
+    write_failed_(false) {
+  DCHECK_GT(buffer_size_, 0u);
+}
+
+ProtobufFileOutputStream::~ProtobufFileOutputStream() {
+  if (file_.IsValid()) {
+    std::string error_message;
+    Close(error_message);
+  }
+}
+
+void ProtobufFileOutputStream::set_options(const OutputStreamOptions& options) {
+  DCHECK(!file_.IsValid());
+  DCHECK_GT(options.buffer_size, 0u);
+  buffer_size_ = options.buffer_size;
+  compression_ = options.compression;
+  compression_level_ = options.compression_level;
+}
+
+bool ProtobufFileOutputStream::Open(
+  const base::FilePath& file_path,
+  bool use_io_thread,
+  std::string& error_message) {
+  DCHECK(!file_.IsValid());
+  file_path_ = file_path;
+  file_ = base::File(file_path, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+  if (!file_.IsValid()) {
+    error_message = "open output file fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  if (compression_ != OutputCompression::kNone) {
+    zlib_stream_.reset(new z_stream_s());
+    memset(zlib_stream_.get(), 0, sizeof(z_stream_s));
+    if (deflateInit2(zlib_stream_.get(), compression_level_, Z_DEFLATED,
+          compression_ == OutputCompression::kGzip ? kGzipWindowBits : kZlibWindowBits,
+          kZlibMemoryLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+      zlib_stream_.reset();
+      file_.Close();
+      error_message = "init compression fail";
+      return false;
+    }
+    compressed_buffer_.reset(new char[kCompressedBufferSize]);
+  }
+
+  const size_t buffer_count = use_io_thread ? kIoThreadBufferCount : 1;
+  buffers_.clear();
+  for (size_t index = 0; index < buffer_count; index++) {
+    buffers_.emplace_back(new char[buffer_size_]);
+  }
+  current_buffer_ = buffers_[0].get();
+  position_ = 0;
+  submitted_bytes_ = 0;
+  file_bytes_ = 0;
+  closing_ = false;
+  write_failed_ = false;
+  if (use_io_thread) {
+    for (size_t index = 1; index < buffer_count; index++) {
+      free_buffers_.push_back(buffers_[index].get());
+    }
+    writer_.reset(new Writer(this));
+    io_thread_.reset(new base::DelegateSimpleThread(writer_.get(), "json_to_proto_output"));
+    io_thread_->Start();
+  }
+  return true;
+}
+
+bool ProtobufFileOutputStream::Close(std::string& error_message) {
+  DCHECK(file_.IsValid());
+  SubmitBuffer();
+  if (io_thread_) {
+    {
+      base::AutoLock auto_lock(lock_);
+      closing_ = true;
+      buffer_ready_.Signal();
+    }
+    io_thread_->Join();
+    io_thread_.reset();
+    writer_.reset();
+    free_buffers_.clear();
+  }
+  if (zlib_stream_) {
+    // 写失败之后不用再收尾
+    write_failed_ = write_failed_ || !Compress(nullptr, 0, Z_FINISH);
+    deflateEnd(zlib_stream_.get());
+    zlib_stream_.reset();
+    compressed_buffer_.reset();
+  }
+  file_.Close();
+  buffers_.clear();
+  current_buffer_ = nullptr;
+  if (write_failed_) {
+    error_message = "write output file fail: " + file_path_.AsUTF8Unsafe();
+    return false;
+  }
+  return true;
+}
+
+bool ProtobufFileOutputStream::Next(void** data, int* size) {
+  // I/O 线程写失败之后不再有缓冲可用
+  if (!current_buffer_ || (position_ == buffer_size_ && !SubmitBuffer())) {
+    return false;
+  }
+  *data = current_buffer_ + position_;
+  *size = static_cast<int>(buffer_size_ - position_);
+  position_ = buffer_size_;
+  return true;
+}
+
+void ProtobufFileOutputStream::BackUp(int count) {
+  DCHECK_LE(static_cast<size_t>(count), position_);
+  position_ -= count;
+}
+
+int64_t ProtobufFileOutputStream::ByteCount() const {
+  return submitted_bytes_ + static_cast<int64_t>(position_);
+}
+
+bool ProtobufFileOutputStream::SubmitBuffer() {
+  if (position_ == 0) {
+    return true;
+  }
+  submitted_bytes_ += position_;
+  if (!io_thread_) {
+    bool result = WriteBuffer(current_buffer_, position_);
+    position_ = 0;
+    write_failed_ = write_failed_ || !result;
+    return result;
+  }
+
+  base::AutoLock auto_lock(lock_);
+  ready_buffers_.push_back({current_buffer_, position_});
+  buffer_ready_.Signal();
+  // 写得比编码慢时在这里等, 内存不会超过 kIoThreadBufferCount 个缓冲
+  while (free_buffers_.empty() && !write_failed_) {
+    buffer_free_.Wait();
+  }
+  position_ = 0;
+  if (write_failed_) {
+    current_buffer_ = nullptr;
+    return false;
+  }
+  current_buffer_ = free_buffers_.front();
+  free_buffers_.pop_front();
+  return true;
+}
+
+bool ProtobufFileOutputStream::WriteBuffer(const char* data, size_t size) {
+  return zlib_stream_ ? Compress(data, size, Z_NO_FLUSH) : WriteToFile(data, size);
+}
+
+bool ProtobufFileOutputStream::Compress(const char* data, size_t size, int flush) {
+  zlib_stream_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zlib_stream_->avail_in = static_cast<uInt>(size);
+  // 输出缓冲写满就说明还有没吐出来的, Z_FINISH 要一直做到 Z_STREAM_END
+  int result = Z_OK;
+  do {
+    zlib_stream_->next_out = reinterpret_cast<Bytef*>(compressed_buffer_.get());
+    zlib_stream_->avail_out = static_cast<uInt>(kCompressedBufferSize);
+    result = deflate(zlib_stream_.get(), flush);
+    if (result == Z_STREAM_ERROR) {
+      return false;
+    }
+    const size_t compressed_size = kCompressedBufferSize - zlib_stream_->avail_out;
+    if (compressed_size > 0 && !WriteToFile(compressed_buffer_.get(), compressed_size)) {
+      return false;
+    }
+  } while (zlib_stream_->avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+  return true;
+}
+
+bool ProtobufFileOutputStream::WriteToFile(const char* data, size_t size) {
+  int written = file_.WriteAtCurrentPos(data, static_cast<int>(size));
+  file_bytes_ += size;
+  return written == static_cast<int>(size);
+}
+
+void ProtobufFileOutputStream::RunWriter() {
+  while (true) {
+    Buffer buffer = {nullptr, 0};
+    {
+      base::AutoLock auto_lock(lock_);
+      while (ready_buffers_.empty() && !closing_) {
+        buffer_ready_.Wait();
+      }
+      if (ready_buffers_.empty()) {
+        return;
+      }
+      buffer = ready_buffers_.front();
+      ready_buffers_.pop_front();
+    }
+    // 写失败之后后面的缓冲只回收不再写
+    bool result = !write_failed_ && WriteBuffer(buffer.data, buffer.size);
+    base::AutoLock auto_lock(lock_);
+    write_failed_ = write_failed_ || !result;
+    free_buffers_.push_back(buffer.data);
+    buffer_free_.Signal();
+  }
+}
+
+} //namespace self
@@ -0,0 +1,139 @@
+#ifndef PROTOBUF_FILE_OUTPUT_STREAM_H_
+#define PROTOBUF_FILE_OUTPUT_STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/macros.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+
+struct z_stream_s;
+
+namespace base {
+class DelegateSimpleThread;
+}
+
+namespace self {
+
+enum class OutputCompression {
+  kNone,
+  // Deflate with a gzip header, what gzip and zcat read.
+  kGzip,
+  // Deflate with a zlib header.
+  kZlib,
+};
+
+struct OutputStreamOptions {
+  static const size_t kDefaultBufferSize = 1 << 20;
+  // zlib 的默认级别
+  static const int kDefaultCompressionLevel = 6;
+
+  OutputStreamOptions();
+
+  // Bytes encoded before a buffer is written, or handed to the I/O thread.
+  size_t buffer_size;
+  OutputCompression compression;
+  // 0 (store) to 9 (smallest).
+  int compression_level;
+};
+
+// Lets protobuf encode straight into large buffers that are written to a file
+// when full, so the whole encoding is never held in memory. With an I/O thread
+// a full buffer is written in the background while the next one is filled.
+// Compression runs where the writes run, so with an I/O thread the encoder
+// and the compressor overlap, at most a few buffers apart.
+class ProtobufFileOutputStream : public google::protobuf::io::ZeroCopyOutputStream {
+public:
+  static const size_t kDefaultBufferSize = OutputStreamOptions::kDefaultBufferSize;
+
+  explicit ProtobufFileOutputStream(size_t buffer_size = kDefaultBufferSize);
+
+  // Closes the file if Close() was not called, errors are lost.
+  ~ProtobufFileOutputStream() override;
+
+  // The buffer size and compression of the next Open().
+  void set_options(const OutputStreamOptions& options);
+
+  bool Open(
+    const base::FilePath& file_path,
+    bool use_io_thread,
+    std::string& error_message);
+
+  // Writes what is buffered, stops the I/O thread and closes the file.
+  // Returns false if any write failed.
+  bool Close(std::string& error_message);
+
+  bool Next(void** data, int* size) override;
+
+  void BackUp(int count) override;
+
+  // The encoded bytes, before compression.
+  int64_t ByteCount() const override;
+
+  // Bytes written to the file, valid after Close().
+  int64_t file_bytes() const { return file_bytes_; }
+
+private:
+  class Writer;
+
+  struct Buffer {
+    char* data;
+    size_t size;
+  };
+
+  // Hands the filled part of the current buffer over and takes an empty one.
+  bool SubmitBuffer();
+
+  // Compresses |data| first when compressing. On the I/O thread when there
+  // is one.
+  bool WriteBuffer(const char* data, size_t size);
+
+  // Deflates |data| into the file, |flush| is zlib's.
+  bool Compress(const char* data, size_t size, int flush);
+
+  bool WriteToFile(const char* data, size_t size);
+
+  // I/O thread only.
+  void RunWriter();
+
+private:
+  size_t buffer_size_;
+  OutputCompression compression_;
+  int compression_level_;
+  base::FilePath file_path_;
+  base::File file_;
+  std::vector<std::unique_ptr<char[]>> buffers_;
+  char* current_buffer_;
+  size_t position_;
+  int64_t submitted_bytes_;
+  int64_t file_bytes_;
+  // 压缩只在写文件的线程上用
+  std::unique_ptr<z_stream_s> zlib_stream_;
+  std::unique_ptr<char[]> compressed_buffer_;
+
+  // 以下都用 lock_ 保护, 只在开了 I/O 线程时使用
+  base::Lock lock_;
+  base::ConditionVariable buffer_ready_;
+  base::ConditionVariable buffer_free_;
+  std::deque<Buffer> ready_buffers_;
+  std::deque<char*> free_buffers_;
+  bool closing_;
+  bool write_failed_;
+  std::unique_ptr<Writer> writer_;
+  std::unique_ptr<base::DelegateSimpleThread> io_thread_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ProtobufFileOutputStream);
+};
+
+} // namespace self
+#endif // PROTOBUF_FILE_OUTPUT_STREAM_H_
@@ -0,0 +1,105 @@
+#include "protobuf_file_output_stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "json_input_generator.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/zlib/zlib.h"
+
+namespace self {
+
+namespace {
+
+// 缓冲区小一些, 一份输出要经过很多次写和压缩
+const size_t kBufferSize = 64 << 10;
+
+// Inflates a gzip or zlib file.
+bool InflateFile(const base::FilePath& file_path, std::string* output) {
+  std::string input;
+  if (!base::ReadFileToString(file_path, &input)) {
+    return false;
+  }
+  z_stream zlib_stream;
+  memset(&zlib_stream, 0, sizeof(zlib_stream));
+  // 加 32 自动识别 gzip 和 zlib 头
+  if (inflateInit2(&zlib_stream, 15 + 32) != Z_OK) {
+    return false;
+  }
+  zlib_stream.next_in = reinterpret_cast<Bytef*>(&input[0]);
+  zlib_stream.avail_in = static_cast<uInt>(input.size());
+  output->clear();
+  char buffer[64 << 10];
+  int result = Z_OK;
+  while (result == Z_OK) {
+    zlib_stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    zlib_stream.avail_out = sizeof(buffer);
+    result = inflate(&zlib_stream, Z_NO_FLUSH);
+    output->append(buffer, sizeof(buffer) - zlib_stream.avail_out);
+  }
+  inflateEnd(&zlib_stream);
+  return result == Z_STREAM_END;
+}
+
+// Writes |data| through the stream the way protobuf does, filling a part of
+// every buffer and backing up the rest at the end, and reads the file back,
+// inflated when compressed.
+void ExpectWrittenData(OutputCompression compression, bool use_io_thread) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath file_path = temp_dir.GetPath().AppendASCII("output.pb");
+  const std::string data = GenerateWideArray(4000);
+
+  OutputStreamOptions options;
+  options.buffer_size = kBufferSize;
+  options.compression = compression;
+  ProtobufFileOutputStream output_stream;
+  output_stream.set_options(options);
+  std::string error_message;
+  ASSERT_TRUE(output_stream.Open(file_path, use_io_thread, error_message)) << error_message;
+  size_t offset = 0;
+  while (offset < data.size()) {
+    void* buffer = nullptr;
+    int size = 0;
+    ASSERT_TRUE(output_stream.Next(&buffer, &size));
+    const size_t copy_size = std::min(static_cast<size_t>(size), data.size() - offset);
+    memcpy(buffer, data.data() + offset, copy_size);
+    offset += copy_size;
+    output_stream.BackUp(size - static_cast<int>(copy_size));
+  }
+  ASSERT_TRUE(output_stream.Close(error_message)) << error_message;
+  EXPECT_EQ(static_cast<int64_t>(data.size()), output_stream.ByteCount());
+
+  std::string output;
+  if (compression == OutputCompression::kNone) {
+    ASSERT_TRUE(base::ReadFileToString(file_path, &output));
+  } else {
+    ASSERT_TRUE(InflateFile(file_path, &output));
+    EXPECT_LT(output_stream.file_bytes(), static_cast<int64_t>(data.size()));
+  }
+  EXPECT_EQ(data, output);
+}
+
+} // namespace
+
+TEST(ProtobufFileOutputStreamTest, Plain) {
+  ExpectWrittenData(OutputCompression::kNone, false);
+  ExpectWrittenData(OutputCompression::kNone, true);
+}
+
+TEST(ProtobufFileOutputStreamTest, Gzip) {
+  ExpectWrittenData(OutputCompression::kGzip, false);
+  ExpectWrittenData(OutputCompression::kGzip, true);
+}
+
+TEST(ProtobufFileOutputStreamTest, Zlib) {
+  ExpectWrittenData(OutputCompression::kZlib, false);
+  ExpectWrittenData(OutputCompression::kZlib, true);
+}
+
+} // namespace self
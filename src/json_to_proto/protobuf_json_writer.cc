@@ -0,0 +1,548 @@
+#include "protobuf_json_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base/base64.h"
+#include "base/logging.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/io/coded_stream.h"
+
+namespace self {
+
+namespace {
+static const int kWireTypeVarint = 0;
+static const int kWireTypeFixed64 = 1;
+static const int kWireTypeLengthDelimited = 2;
+static const int kWireTypeFixed32 = 5;
+static const int kWireTypeNone = -1;
+
+// json 最多 200 层, 一层 json 在 variant 里最多对应两层 message
+static const int kMaxDepth = 400;
+
+// 2^53, 绝对值比它小的整数 double 都能精确表示
+static const double kMaxExactInteger = 9007199254740992.0;
+// 放大成整数格式化的小数位数上限, 再多就走 snprintf
+static const int kMaxScaledFractionDigits = 8;
+
+static const char kDigitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+// 0 表示原样输出, 'u' 表示 \u00XX, 其它是 '\' 后面跟的字符
+static const char kEscapeTable[256] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+// 写出 |value| 的十进制, 返回第一个字符, 数字在 |buffer_end| 之前
+char* FormatUint64(uint64_t value, char* buffer_end) {
+  char* position = buffer_end;
+  while (value >= 100) {
+    const size_t pair_index = static_cast<size_t>(value % 100) * 2;
+    value /= 100;
+    position -= 2;
+    ::memcpy(position, kDigitPairs + pair_index, 2);
+  }
+  if (value >= 10) {
+    position -= 2;
+    ::memcpy(position, kDigitPairs + value * 2, 2);
+  } else {
+    *--position = static_cast<char>('0' + value);
+  }
+  return position;
+}
+
+// 没有小数点和指数的数字读回来会是整数, 补上 ".0"
+void AppendFormattedNumber(const char* text, std::string* output) {
+  output->append(text);
+  if (!::strpbrk(text, ".eE")) {
+    output->append(".0");
+  }
+}
+
+int ScalarWireType(google::protobuf::FieldDescriptor::Type type) {
+  switch (type) {
+  case google::protobuf::FieldDescriptor::TYPE_INT64:
+  case google::protobuf::FieldDescriptor::TYPE_UINT64:
+  case google::protobuf::FieldDescriptor::TYPE_INT32:
+  case google::protobuf::FieldDescriptor::TYPE_UINT32:
+  case google::protobuf::FieldDescriptor::TYPE_SINT32:
+  case google::protobuf::FieldDescriptor::TYPE_SINT64:
+  case google::protobuf::FieldDescriptor::TYPE_BOOL:
+  case google::protobuf::FieldDescriptor::TYPE_ENUM:
+    return kWireTypeVarint;
+  case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED64:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
+    return kWireTypeFixed64;
+  case google::protobuf::FieldDescriptor::TYPE_FLOAT:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED32:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
+    return kWireTypeFixed32;
+  default:
+    return kWireTypeNone;
+  }
+}
+
+inline bool ReadVarint(const uint8_t** data, const uint8_t* end, uint64_t* value) {
+  const uint8_t* position = *data;
+  // 字段号和短字符串长度几乎都是一个字节
+  if (position < end && *position < 0x80) {
+    *value = *position;
+    *data = position + 1;
+    return true;
+  }
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && position < end; shift += 7) {
+    const uint8_t byte = *position++;
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      *data = position;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadScalar(
+  int wire_type,
+  const uint8_t** data,
+  const uint8_t* end,
+  uint64_t* value) {
+  switch (wire_type) {
+  case kWireTypeVarint:
+    return ReadVarint(data, end, value);
+  case kWireTypeFixed64: {
+    if (end - *data < 8) {
+      return false;
+    }
+    *data = google::protobuf::io::CodedInputStream::ReadLittleEndian64FromArray(*data, value);
+  } return true;
+  case kWireTypeFixed32: {
+    if (end - *data < 4) {
+      return false;
+    }
+    uint32_t value32 = 0;
+    *data = google::protobuf::io::CodedInputStream::ReadLittleEndian32FromArray(*data, &value32);
+    *value = value32;
+  } return true;
+  default:
+    return false;
+  }
+}
+
+bool ReadLength(const uint8_t** data, const uint8_t* end, size_t* length) {
+  uint64_t value = 0;
+  if (!ReadVarint(data, end, &value) || value > static_cast<uint64_t>(end - *data)) {
+    return false;
+  }
+  *length = static_cast<size_t>(value);
+  return true;
+}
+
+bool SkipField(int wire_type, const uint8_t** data, const uint8_t* end) {
+  if (wire_type != kWireTypeLengthDelimited) {
+    uint64_t value = 0;
+    return ReadScalar(wire_type, data, end, &value);
+  }
+  size_t length = 0;
+  if (!ReadLength(data, end, &length)) {
+    return false;
+  }
+  *data += length;
+  return true;
+}
+
+void AppendScalar(
+  google::protobuf::FieldDescriptor::Type type,
+  uint64_t value,
+  std::string* output) {
+  switch (type) {
+  case google::protobuf::FieldDescriptor::TYPE_INT64:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED64: {
+    AppendJsonInt64(static_cast<int64_t>(value), output);
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_INT32:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
+  case google::protobuf::FieldDescriptor::TYPE_ENUM: {
+    AppendJsonInt64(static_cast<int32_t>(value), output);
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_UINT64:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED64: {
+    AppendJsonUint64(value, output);
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_UINT32:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED32: {
+    AppendJsonUint64(static_cast<uint32_t>(value), output);
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_SINT32: {
+    const uint32_t value32 = static_cast<uint32_t>(value);
+    AppendJsonInt64(static_cast<int32_t>((value32 >> 1) ^ (0u - (value32 & 1))), output);
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_SINT64: {
+    AppendJsonInt64(static_cast<int64_t>((value >> 1) ^ (0ull - (value & 1))), output);
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_BOOL: {
+    output->append(value ? "true" : "false");
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_DOUBLE: {
+    double double_value = 0;
+    ::memcpy(&double_value, &value, sizeof(double_value));
+    AppendJsonDouble(double_value, output);
+  } break;
+  case google::protobuf::FieldDescriptor::TYPE_FLOAT: {
+    const uint32_t value32 = static_cast<uint32_t>(value);
+    float float_value = 0;
+    ::memcpy(&float_value, &value32, sizeof(float_value));
+    AppendJsonFloat(float_value, output);
+  } break;
+  default: {
+    NOTREACHED();
+  } break;
+  }
+}
+
+}
+
+void AppendJsonString(const base::StringPiece& text, std::string* output) {
+  output->push_back('"');
+  const char* run_start = text.data();
+  const char* end = text.data() + text.size();
+  for (const char* position = run_start; position < end; ++position) {
+    const char escape = kEscapeTable[static_cast<uint8_t>(*position)];
+    if (!escape) {
+      continue;
+    }
+    // 不用转义的一段整段拷贝
+    output->append(run_start, position - run_start);
+    run_start = position + 1;
+    output->push_back('\\');
+    output->push_back(escape);
+    if (escape == 'u') {
+      const uint8_t byte = static_cast<uint8_t>(*position);
+      output->append("00");
+      output->push_back(kHexDigits[byte >> 4]);
+      output->push_back(kHexDigits[byte & 0xf]);
+    }
+  }
+  output->append(run_start, end - run_start);
+  output->push_back('"');
+}
+
+void AppendJsonInt64(int64_t value, std::string* output) {
+  if (value < 0) {
+    output->push_back('-');
+    AppendJsonUint64(0 - static_cast<uint64_t>(value), output);
+    return;
+  }
+  AppendJsonUint64(static_cast<uint64_t>(value), output);
+}
+
+void AppendJsonUint64(uint64_t value, std::string* output) {
+  char buffer[20];
+  char* buffer_end = buffer + sizeof(buffer);
+  const char* digits = FormatUint64(value, buffer_end);
+  output->append(digits, buffer_end - digits);
+}
+
+void AppendJsonDouble(double value, std::string* output) {
+  // json 里没有 NaN 和无穷
+  if (!isfinite(value)) {
+    output->append("null");
+    return;
+  }
+  const double magnitude = fabs(value);
+  char buffer[32];
+  char* buffer_end = buffer + sizeof(buffer);
+  if (magnitude == floor(magnitude) && magnitude < kMaxExactInteger) {
+    char* text = FormatUint64(static_cast<uint64_t>(magnitude), buffer_end - 2);
+    ::memcpy(buffer_end - 2, ".0", 2);
+    if (signbit(value)) {
+      *--text = '-';
+    }
+    output->append(text, buffer_end);
+    return;
+  }
+
+  // 小数位不多时放大成整数来格式化. 除回去和原值相等, 这段十进制读回来就是原值
+  double scale = 10;
+  for (int fraction_digits = 1; fraction_digits <= kMaxScaledFractionDigits;
+       ++fraction_digits, scale *= 10) {
+    const double scaled = magnitude * scale;
+    if (scaled >= kMaxExactInteger) {
+      break;
+    }
+    if (scaled != floor(scaled) || scaled / scale != magnitude) {
+      continue;
+    }
+    uint64_t digits_value = static_cast<uint64_t>(scaled);
+    while (fraction_digits > 1 && digits_value % 10 == 0) {
+      digits_value /= 10;
+      --fraction_digits;
+    }
+    char* text = FormatUint64(digits_value, buffer_end);
+    while (buffer_end - text <= fraction_digits) {
+      *--text = '0';
+    }
+    // 整数部分前移一位, 空出小数点的位置
+    char* point = buffer_end - fraction_digits;
+    ::memmove(text - 1, text, point - text);
+    --text;
+    point[-1] = '.';
+    if (signbit(value)) {
+      *--text = '-';
+    }
+    output->append(text, buffer_end);
+    return;
+  }
+
+  // 和 protobuf 的 SimpleDtoa 一样, 先试 15 位有效数字, 读不回原值再用 17 位
+  ::snprintf(buffer, sizeof(buffer), "%.15g", value);
+  if (::strtod(buffer, nullptr) != value) {
+    ::snprintf(buffer, sizeof(buffer), "%.17g", value);
+  }
+  AppendFormattedNumber(buffer, output);
+}
+
+void AppendJsonFloat(float value, std::string* output) {
+  if (!isfinite(value)) {
+    output->append("null");
+    return;
+  }
+  char buffer[32];
+  ::snprintf(buffer, sizeof(buffer), "%.6g", value);
+  if (::strtof(buffer, nullptr) != value) {
+    ::snprintf(buffer, sizeof(buffer), "%.9g", value);
+  }
+  AppendFormattedNumber(buffer, output);
+}
+
+ProtobufJsonWriter::ProtobufJsonWriter()
+  : write_failed_(false) {
+}
+
+ProtobufJsonWriter::~ProtobufJsonWriter() {
+  if (file_.IsValid()) {
+    std::string error_message;
+    Close(error_message);
+  }
+}
+
+bool ProtobufJsonWriter::Open(
+  const base::FilePath& output_file_path,
+  std::string& error_message) {
+  DCHECK(!file_.IsValid());
+  output_file_path_ = output_file_path;
+  file_ = base::File(output_file_path,
+    base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+  if (!file_.IsValid()) {
+    error_message = "open output file fail: " + output_file_path.AsUTF8Unsafe();
+    return false;
+  }
+  write_failed_ = false;
+  buffer_.clear();
+  buffer_.reserve(kFlushSize + kFlushSize / 4);
+  return true;
+}
+
+bool ProtobufJsonWriter::Close(std::string& error_message) {
+  DCHECK(file_.IsValid());
+  if (!write_failed_ && !buffer_.empty()) {
+    const int size = static_cast<int>(buffer_.size());
+    write_failed_ = file_.WriteAtCurrentPos(buffer_.data(), size) != size;
+  }
+  buffer_.clear();
+  file_.Close();
+  if (write_failed_) {
+    error_message = "write output file fail: " + output_file_path_.AsUTF8Unsafe();
+    return false;
+  }
+  return true;
+}
+
+bool ProtobufJsonWriter::WriteMessage(
+  const google::protobuf::Descriptor* desc,
+  const char* data,
+  size_t size,
+  std::string& error_message) {
+  const MessageWriterPlan* plan = plan_cache_.GetPlan(desc);
+  const uint8_t* begin = reinterpret_cast<const uint8_t*>(data);
+  if (!WriteFields(plan, begin, begin + size, 0)) {
+    error_message = write_failed_ ?
+      "write output file fail: " + output_file_path_.AsUTF8Unsafe() :
+      "malformed protobuf input";
+    return false;
+  }
+  return true;
+}
+
+bool ProtobufJsonWriter::WriteFields(
+  const MessageWriterPlan* plan,
+  const uint8_t* data,
+  const uint8_t* end,
+  int depth) {
+  if (depth > kMaxDepth) {
+    return false;
+  }
+  const MessageWriterKind kind = plan->kind();
+  if (kind != MessageWriterKind::kVariant) {
+    buffer_.push_back(kind == MessageWriterKind::kObject ? '{' : '[');
+  }
+
+  const FieldWriter* last_field = nullptr;
+  bool array_open = false;
+  bool empty = true;
+  size_t hint = 0;
+  while (data < end) {
+    uint64_t tag = 0;
+    if (!ReadVarint(&data, end, &tag)) {
+      return false;
+    }
+    const int wire_type = static_cast<int>(tag & 7);
+    const FieldWriter* field = plan->FindField(static_cast<int>(tag >> 3), &hint);
+    if (!field || field->type == google::protobuf::FieldDescriptor::TYPE_GROUP) {
+      if (!SkipField(wire_type, &data, end)) {
+        return false;
+      }
+      continue;
+    }
+
+    if (field == last_field && field->repeated) {
+      // 同一个 repeated 字段的下一个元素
+      buffer_.push_back(',');
+    } else {
+      if (array_open) {
+        buffer_.push_back(']');
+      }
+      if (!empty) {
+        buffer_.push_back(',');
+      }
+      empty = false;
+      buffer_.append(field->key.data(), field->key.size());
+      // item 字段本身就是外层的数组, 其它 repeated 字段是一个数组值
+      array_open = field->repeated && kind != MessageWriterKind::kItemList;
+      if (array_open) {
+        buffer_.push_back('[');
+      }
+    }
+    last_field = field;
+    if (!WriteValue(*field, wire_type, &data, end, depth) || !FlushIfFull()) {
+      return false;
+    }
+  }
+
+  if (array_open) {
+    buffer_.push_back(']');
+  }
+  if (kind == MessageWriterKind::kVariant) {
+    if (empty) {
+      buffer_.append("null");
+    }
+  } else {
+    buffer_.push_back(kind == MessageWriterKind::kObject ? '}' : ']');
+  }
+  return true;
+}
+
+bool ProtobufJsonWriter::WriteValue(
+  const FieldWriter& field,
+  int wire_type,
+  const uint8_t** data,
+  const uint8_t* end,
+  int depth) {
+  const int scalar_wire_type = ScalarWireType(field.type);
+  if (scalar_wire_type != kWireTypeNone && wire_type == scalar_wire_type) {
+    uint64_t value = 0;
+    if (!ReadScalar(wire_type, data, end, &value)) {
+      return false;
+    }
+    AppendFieldScalar(field, value);
+    return true;
+  }
+  if (wire_type != kWireTypeLengthDelimited) {
+    return false;
+  }
+
+  size_t length = 0;
+  if (!ReadLength(data, end, &length)) {
+    return false;
+  }
+  const uint8_t* value_begin = *data;
+  const uint8_t* value_end = value_begin + length;
+  *data = value_end;
+  switch (field.type) {
+  case google::protobuf::FieldDescriptor::TYPE_STRING: {
+    AppendJsonString(
+      base::StringPiece(reinterpret_cast<const char*>(value_begin), length), &buffer_);
+  } return true;
+  case google::protobuf::FieldDescriptor::TYPE_BYTES: {
+    // 和 protobuf 的 json 格式一样用 base64
+    std::string encoded;
+    base::Base64Encode(
+      base::StringPiece(reinterpret_cast<const char*>(value_begin), length), &encoded);
+    AppendJsonString(encoded, &buffer_);
+  } return true;
+  case google::protobuf::FieldDescriptor::TYPE_MESSAGE: {
+    return WriteFields(field.child_plan, value_begin, value_end, depth + 1);
+  }
+  default:
+    break;
+  }
+
+  // packed 的 repeated 标量, 一个 tag 下面是连续的多个值
+  if (!field.repeated || scalar_wire_type == kWireTypeNone) {
+    return false;
+  }
+  for (const uint8_t* position = value_begin; position < value_end; ) {
+    if (position != value_begin) {
+      buffer_.push_back(',');
+    }
+    uint64_t value = 0;
+    if (!ReadScalar(scalar_wire_type, &position, value_end, &value)) {
+      return false;
+    }
+    AppendFieldScalar(field, value);
+  }
+  return true;
+}
+
+void ProtobufJsonWriter::AppendFieldScalar(const FieldWriter& field, uint64_t value) {
+  // 编号超出范围的枚举值是别的 schema 写的, 照旧写成数字
+  if (field.enum_strings && value < field.enum_string_count) {
+    const base::StringPiece& enum_string = field.enum_strings[value];
+    buffer_.append(enum_string.data(), enum_string.size());
+    return;
+  }
+  AppendScalar(field.type, value, &buffer_);
+}
+
+bool ProtobufJsonWriter::FlushIfFull() {
+  if (!file_.IsValid() || buffer_.size() < kFlushSize) {
+    return true;
+  }
+  // 写出去之后 buffer 的容量还在, 之后不再重新分配
+  const int size = static_cast<int>(buffer_.size());
+  write_failed_ = file_.WriteAtCurrentPos(buffer_.data(), size) != size;
+  buffer_.clear();
+  return !write_failed_;
+}
+
+} //namespace self
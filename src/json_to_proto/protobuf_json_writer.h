@@ -0,0 +1,105 @@
+#ifndef PROTOBUF_JSON_WRITER_H_
+#define PROTOBUF_JSON_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "json_writer_plan.h"
+
+namespace google {
+namespace protobuf {
+class Descriptor;
+} // namespace protobuf
+} // google
+
+namespace self {
+
+// Appends |text| as a quoted json string.
+void AppendJsonString(const base::StringPiece& text, std::string* output);
+
+void AppendJsonInt64(int64_t value, std::string* output);
+
+void AppendJsonUint64(uint64_t value, std::string* output);
+
+// The shortest text that reads back as the same double in the common cases,
+// and always a text that reads back as a double: integral values keep a
+// ".0", so converting the json again infers a double field again.
+void AppendJsonDouble(double value, std::string* output);
+
+void AppendJsonFloat(float value, std::string* output);
+
+// Turns messages of the schemas BuildProtoFromJson infers back into json with
+// the original keys, straight from the protobuf encoding: the bytes are read
+// once, no message is parsed. Everything is written into one growable buffer.
+// With an output file the buffer is written out whenever it passes
+// kFlushSize, so the json is never held whole.
+//
+// The fields must come in field number order, as protobuf serializes them.
+// Null values and empty arrays have no field, they do not come back.
+class ProtobufJsonWriter {
+public:
+  static const size_t kFlushSize = 1 << 20;
+
+  ProtobufJsonWriter();
+
+  // Closes the file if Close() was not called, errors are lost.
+  ~ProtobufJsonWriter();
+
+  // Without Open() the json stays in buffer().
+  bool Open(
+    const base::FilePath& output_file_path,
+    std::string& error_message);
+
+  // Writes what is buffered and closes the file.
+  bool Close(std::string& error_message);
+
+  // Writes the json of the |desc| message encoded in |data|.
+  bool WriteMessage(
+    const google::protobuf::Descriptor* desc,
+    const char* data,
+    size_t size,
+    std::string& error_message);
+
+  std::string* buffer() { return &buffer_; }
+
+  size_t plan_count() const { return plan_cache_.plan_count(); }
+
+private:
+  bool WriteFields(
+    const MessageWriterPlan* plan,
+    const uint8_t* data,
+    const uint8_t* end,
+    int depth);
+
+  // Writes one value of |field|, or every element of a packed repeated field.
+  bool WriteValue(
+    const FieldWriter& field,
+    int wire_type,
+    const uint8_t** data,
+    const uint8_t* end,
+    int depth);
+
+  // A scalar of |field|, the string an enum value stands for where it has one.
+  void AppendFieldScalar(const FieldWriter& field, uint64_t value);
+
+  bool FlushIfFull();
+
+private:
+  WriterPlanCache plan_cache_;
+  std::string buffer_;
+  base::FilePath output_file_path_;
+  base::File file_;
+  bool write_failed_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(ProtobufJsonWriter);
+};
+
+} // namespace self
+#endif // PROTOBUF_JSON_WRITER_H_
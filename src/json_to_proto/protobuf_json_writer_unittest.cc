@@ -0,0 +1,83 @@
+#include "protobuf_json_writer.h"
+
+#include <memory>
+#include <string>
+
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "build_proto_from_json.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "json_stream_message_builder.h"
+#include "json_to_protobuf_serializer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+// Converts |json| in |schema_mode| and writes the encoding back to json.
+void ConvertAndWriteJson(
+  const std::string& json,
+  SchemaMode schema_mode,
+  std::string* output) {
+  JsonStringInputStream input_stream(json);
+  std::string error_message;
+  BuildProtoFromJson build_proto_from_json;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(&input_stream, schema_mode, error_message);
+  ASSERT_TRUE(file_desc_proto) << error_message;
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(*file_desc_proto);
+  ASSERT_TRUE(file_desc);
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  ASSERT_TRUE(root_desc);
+  google::protobuf::DynamicMessageFactory dynamic_message_factory(&desc_pool);
+  std::unique_ptr<google::protobuf::Message> root_message(
+    dynamic_message_factory.GetPrototype(root_desc)->New());
+  std::unique_ptr<JsonMessageBuilder> message_builder =
+    JsonToProtobufSerializer::CreateMessageBuilder(
+      schema_mode, root_message.get(), &dynamic_message_factory);
+  input_stream.Rewind();
+  JsonSaxReader json_reader(&input_stream);
+  ASSERT_TRUE(json_reader.Parse(message_builder.get(), error_message)) << error_message;
+  const std::string encoded = root_message->SerializeAsString();
+  ProtobufJsonWriter protobuf_json_writer;
+  ASSERT_TRUE(protobuf_json_writer.WriteMessage(
+    root_desc, encoded.data(), encoded.size(), error_message)) << error_message;
+  output->swap(*protobuf_json_writer.buffer());
+}
+
+// The wide array keeps the kind of every key, so --to-json gives back the
+// input in every schema mode. Nulls and empty arrays would not come back.
+void ExpectRoundTrip(SchemaMode schema_mode) {
+  const std::string json = GenerateWideArray(50);
+  std::string output;
+  ConvertAndWriteJson(json, schema_mode, &output);
+  std::unique_ptr<base::Value> input_value = base::JSONReader::Read(json);
+  std::unique_ptr<base::Value> output_value = base::JSONReader::Read(output);
+  ASSERT_TRUE(input_value);
+  ASSERT_TRUE(output_value) << output;
+  EXPECT_TRUE(input_value->Equals(output_value.get())) << output;
+}
+
+} // namespace
+
+TEST(ProtobufJsonWriterTest, RoundTripPerElement) {
+  ExpectRoundTrip(SchemaMode::kPerElement);
+}
+
+TEST(ProtobufJsonWriterTest, RoundTripUnified) {
+  ExpectRoundTrip(SchemaMode::kUnified);
+}
+
+TEST(ProtobufJsonWriterTest, RoundTripCompact) {
+  ExpectRoundTrip(SchemaMode::kCompact);
+}
+
+} // namespace self
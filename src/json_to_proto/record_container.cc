@@ -0,0 +1,651 @@
+#include "record_container.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "base/strings/string_split.h"
+#include "build/build_config.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/wire_format_lite.h"
+
+#if defined(OS_POSIX)
+#include <sys/mman.h>
+#endif
+
+namespace self {
+
+namespace {
+static const char kMagic[] = "JPRC";
+static const size_t kMagicSize = 4;
+static const uint32_t kVersion = 1;
+// 文件头的 magic, 文件尾的 footer 偏移和 magic
+static const size_t kTrailerSize = 8 + kMagicSize;
+
+void WriteBytes(
+  google::protobuf::io::CodedOutputStream* coded_output,
+  const std::string& data) {
+  coded_output->WriteVarint32(static_cast<uint32_t>(data.size()));
+  coded_output->WriteString(data);
+}
+
+bool ReadBytes(google::protobuf::io::CodedInputStream* coded_input, std::string* data) {
+  uint32_t size = 0;
+  return coded_input->ReadVarint32(&size) &&
+    coded_input->ReadString(data, static_cast<int>(size));
+}
+
+void WriteStatValue(
+  google::protobuf::io::CodedOutputStream* coded_output,
+  RecordStatKind kind,
+  const RecordStatValue& value) {
+  switch (kind) {
+  case RecordStatKind::kSigned:
+    coded_output->WriteVarint64(
+      google::protobuf::internal::WireFormatLite::ZigZagEncode64(value.signed_value));
+    break;
+  case RecordStatKind::kUnsigned:
+    coded_output->WriteVarint64(value.unsigned_value);
+    break;
+  case RecordStatKind::kDouble: {
+    uint64_t bits = 0;
+    memcpy(&bits, &value.double_value, sizeof(bits));
+    coded_output->WriteLittleEndian64(bits);
+  } break;
+  case RecordStatKind::kString:
+    WriteBytes(coded_output, value.string_value);
+    break;
+  }
+}
+
+bool ReadStatValue(
+  google::protobuf::io::CodedInputStream* coded_input,
+  RecordStatKind kind,
+  RecordStatValue* value) {
+  uint64_t bits = 0;
+  switch (kind) {
+  case RecordStatKind::kSigned:
+    if (!coded_input->ReadVarint64(&bits)) {
+      return false;
+    }
+    value->signed_value = google::protobuf::internal::WireFormatLite::ZigZagDecode64(bits);
+    return true;
+  case RecordStatKind::kUnsigned:
+    return coded_input->ReadVarint64(&value->unsigned_value);
+  case RecordStatKind::kDouble:
+    if (!coded_input->ReadLittleEndian64(&bits)) {
+      return false;
+    }
+    memcpy(&value->double_value, &bits, sizeof(bits));
+    return true;
+  case RecordStatKind::kString:
+    return ReadBytes(coded_input, &value->string_value);
+  }
+  return false;
+}
+
+bool GetStatKind(const google::protobuf::FieldDescriptor* field_desc, RecordStatKind* kind) {
+  switch (field_desc->cpp_type()) {
+  case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+  case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+  case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+    *kind = RecordStatKind::kSigned;
+    return true;
+  case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+  case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+  case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+    *kind = RecordStatKind::kUnsigned;
+    return true;
+  case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+  case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+    *kind = RecordStatKind::kDouble;
+    return true;
+  case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+    *kind = RecordStatKind::kString;
+    return true;
+  default:
+    return false;
+  }
+}
+
+void GetStatValue(
+  const google::protobuf::Message& message,
+  const google::protobuf::FieldDescriptor* field_desc,
+  RecordStatValue* value) {
+  const google::protobuf::Reflection* reflection = message.GetReflection();
+  switch (field_desc->cpp_type()) {
+  case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+    value->signed_value = reflection->GetInt32(message, field_desc);
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+    value->signed_value = reflection->GetInt64(message, field_desc);
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+    value->signed_value = reflection->GetEnumValue(message, field_desc);
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+    value->unsigned_value = reflection->GetUInt32(message, field_desc);
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+    value->unsigned_value = reflection->GetUInt64(message, field_desc);
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+    value->unsigned_value = reflection->GetBool(message, field_desc) ? 1 : 0;
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+    value->double_value = reflection->GetFloat(message, field_desc);
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+    value->double_value = reflection->GetDouble(message, field_desc);
+    break;
+  case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+    value->string_value = reflection->GetString(message, field_desc);
+    break;
+  default:
+    NOTREACHED();
+    break;
+  }
+}
+
+// The next record of a block, pointing into |data|.
+bool NextRecord(
+  google::protobuf::io::CodedInputStream* coded_input,
+  const uint8_t* data,
+  size_t size,
+  base::StringPiece* record) {
+  uint32_t record_size = 0;
+  if (!coded_input->ReadVarint32(&record_size)) {
+    return false;
+  }
+  const size_t position = static_cast<size_t>(coded_input->CurrentPosition());
+  if (record_size > size - position || !coded_input->Skip(static_cast<int>(record_size))) {
+    return false;
+  }
+  *record = base::StringPiece(reinterpret_cast<const char*>(data + position), record_size);
+  return true;
+}
+}
+
+RecordStatValue::RecordStatValue()
+  : signed_value(0),
+    unsigned_value(0),
+    double_value(0.0) {
+}
+
+int CompareRecordStatValues(
+  RecordStatKind kind,
+  const RecordStatValue& left,
+  const RecordStatValue& right) {
+  switch (kind) {
+  case RecordStatKind::kSigned:
+    return left.signed_value < right.signed_value ? -1 :
+      (left.signed_value > right.signed_value ? 1 : 0);
+  case RecordStatKind::kUnsigned:
+    return left.unsigned_value < right.unsigned_value ? -1 :
+      (left.unsigned_value > right.unsigned_value ? 1 : 0);
+  case RecordStatKind::kDouble:
+    return left.double_value < right.double_value ? -1 :
+      (left.double_value > right.double_value ? 1 : 0);
+  case RecordStatKind::kString:
+    return left.string_value.compare(right.string_value);
+  }
+  return 0;
+}
+
+RecordBlockStats::RecordBlockStats()
+  : has_values(false) {
+}
+
+RecordBlock::RecordBlock()
+  : offset(0),
+    size(0),
+    first_record(0),
+    record_count(0) {
+}
+
+RecordContainerOptions::RecordContainerOptions()
+  : block_size(kDefaultBlockSize) {
+}
+
+RecordContainerOptions::~RecordContainerOptions() {
+}
+
+RecordContainerWriter::RecordContainerWriter(const RecordContainerOptions& options)
+  : options_(options),
+    record_desc_(nullptr),
+    record_count_(0) {
+  DCHECK(options_.block_size > 0);
+}
+
+RecordContainerWriter::~RecordContainerWriter() {
+}
+
+bool RecordContainerWriter::Open(
+  const base::FilePath& file_path,
+  bool use_io_thread,
+  std::string& error_message) {
+  if (!output_stream_.Open(file_path, use_io_thread, error_message)) {
+    return false;
+  }
+  coded_output_.reset(new google::protobuf::io::CodedOutputStream(&output_stream_));
+  coded_output_->WriteRaw(kMagic, static_cast<int>(kMagicSize));
+  current_block_.offset = coded_output_->ByteCount();
+  return true;
+}
+
+bool RecordContainerWriter::Append(
+  const google::protobuf::Message& record,
+  std::string& error_message) {
+  DCHECK(coded_output_);
+  if (!record_desc_) {
+    if (!ResolveStatFields(record.GetDescriptor(), error_message)) {
+      return false;
+    }
+    record_desc_ = record.GetDescriptor();
+    current_block_.stats.resize(stat_field_paths_.size());
+  } else if (record.GetDescriptor() != record_desc_) {
+    error_message = "record type changed: " + record.GetDescriptor()->full_name();
+    return false;
+  }
+
+  const size_t record_size = record.ByteSizeLong();
+  if (record_size > INT32_MAX) {
+    error_message = "record too large";
+    return false;
+  }
+  coded_output_->WriteVarint32(static_cast<uint32_t>(record_size));
+  record.SerializeWithCachedSizes(coded_output_.get());
+  if (coded_output_->HadError()) {
+    error_message = "write output file fail";
+    return false;
+  }
+  UpdateStats(record);
+  ++current_block_.record_count;
+  ++record_count_;
+  // 块写满了就结束, 一条记录不会拆到两个块里
+  if (static_cast<uint64_t>(coded_output_->ByteCount()) - current_block_.offset >=
+      options_.block_size) {
+    FinishBlock();
+  }
+  return true;
+}
+
+bool RecordContainerWriter::Close(std::string& error_message) {
+  DCHECK(coded_output_);
+  FinishBlock();
+  WriteFooter();
+  const bool written = !coded_output_->HadError();
+  // CodedOutputStream 析构时才把没用完的缓冲还给 output_stream_
+  coded_output_.reset();
+  if (!written) {
+    // 写失败时 Close 给出的原因更准确
+    if (output_stream_.Close(error_message)) {
+      error_message = "write output file fail";
+    }
+    return false;
+  }
+  return output_stream_.Close(error_message);
+}
+
+bool RecordContainerWriter::ResolveStatFields(
+  const google::protobuf::Descriptor* record_desc,
+  std::string& error_message) {
+  for (const std::string& stat_field : options_.stat_fields) {
+    std::vector<const google::protobuf::FieldDescriptor*> field_path;
+    const google::protobuf::Descriptor* desc = record_desc;
+    for (const std::string& key : base::SplitString(
+           stat_field, ".", base::KEEP_WHITESPACE, base::SPLIT_WANT_ALL)) {
+      const google::protobuf::FieldDescriptor* field_desc = nullptr;
+      if (desc) {
+        for (int index = 0; index < desc->field_count(); ++index) {
+          if (desc->field(index)->json_name() == key) {
+            field_desc = desc->field(index);
+            break;
+          }
+        }
+      }
+      if (!field_desc || field_desc->is_repeated()) {
+        error_message = "stat field is not a singular field of the record: " + stat_field;
+        return false;
+      }
+      field_path.push_back(field_desc);
+      desc = field_desc->message_type();
+    }
+    RecordStatKind kind = RecordStatKind::kSigned;
+    if (!GetStatKind(field_path.back(), &kind)) {
+      error_message = "stat field is not a scalar: " + stat_field;
+      return false;
+    }
+    stat_field_paths_.push_back(std::move(field_path));
+    stat_kinds_.push_back(kind);
+  }
+  return true;
+}
+
+void RecordContainerWriter::UpdateStats(const google::protobuf::Message& record) {
+  RecordStatValue value;
+  for (size_t stat_index = 0; stat_index < stat_field_paths_.size(); ++stat_index) {
+    const std::vector<const google::protobuf::FieldDescriptor*>& field_path =
+      stat_field_paths_[stat_index];
+    // 路径上哪一级没有设置, 这条记录就不算进这个字段的统计
+    const google::protobuf::Message* message = &record;
+    for (const google::protobuf::FieldDescriptor* field_desc : field_path) {
+      if (!message->GetReflection()->HasField(*message, field_desc)) {
+        message = nullptr;
+        break;
+      }
+      if (field_desc != field_path.back()) {
+        message = &message->GetReflection()->GetMessage(*message, field_desc);
+      }
+    }
+    if (!message) {
+      continue;
+    }
+    GetStatValue(*message, field_path.back(), &value);
+    const RecordStatKind kind = stat_kinds_[stat_index];
+    RecordBlockStats& stats = current_block_.stats[stat_index];
+    if (!stats.has_values) {
+      stats.has_values = true;
+      stats.min = value;
+      stats.max = value;
+    } else if (CompareRecordStatValues(kind, value, stats.min) < 0) {
+      stats.min = value;
+    } else if (CompareRecordStatValues(kind, value, stats.max) > 0) {
+      stats.max = value;
+    }
+  }
+}
+
+void RecordContainerWriter::FinishBlock() {
+  if (current_block_.record_count == 0) {
+    return;
+  }
+  const uint64_t end = coded_output_->ByteCount();
+  current_block_.size = end - current_block_.offset;
+  blocks_.push_back(std::move(current_block_));
+  current_block_ = RecordBlock();
+  current_block_.offset = end;
+  current_block_.first_record = record_count_;
+  current_block_.stats.resize(stat_field_paths_.size());
+}
+
+void RecordContainerWriter::WriteFooter() {
+  const uint64_t footer_offset = coded_output_->ByteCount();
+  // 推导出的 schema 不依赖其它 proto 文件, 一个文件就是完整的描述
+  std::string desc_set_data;
+  if (record_desc_) {
+    google::protobuf::FileDescriptorSet file_desc_set;
+    record_desc_->file()->CopyTo(file_desc_set.add_file());
+    file_desc_set.SerializeToString(&desc_set_data);
+  }
+  coded_output_->WriteVarint32(kVersion);
+  WriteBytes(coded_output_.get(), desc_set_data);
+  WriteBytes(coded_output_.get(), record_desc_ ? record_desc_->full_name() : std::string());
+  // 没有记录时字段解析不出来, 统计也就没有
+  coded_output_->WriteVarint32(static_cast<uint32_t>(stat_kinds_.size()));
+  for (size_t stat_index = 0; stat_index < stat_kinds_.size(); ++stat_index) {
+    WriteBytes(coded_output_.get(), options_.stat_fields[stat_index]);
+    coded_output_->WriteVarint32(static_cast<uint32_t>(stat_kinds_[stat_index]));
+  }
+  coded_output_->WriteVarint64(blocks_.size());
+  for (const RecordBlock& block : blocks_) {
+    coded_output_->WriteVarint64(block.offset);
+    coded_output_->WriteVarint64(block.size);
+    coded_output_->WriteVarint64(static_cast<uint64_t>(block.record_count));
+    for (size_t stat_index = 0; stat_index < stat_kinds_.size(); ++stat_index) {
+      const RecordBlockStats& stats = block.stats[stat_index];
+      coded_output_->WriteVarint32(stats.has_values ? 1 : 0);
+      if (stats.has_values) {
+        WriteStatValue(coded_output_.get(), stat_kinds_[stat_index], stats.min);
+        WriteStatValue(coded_output_.get(), stat_kinds_[stat_index], stats.max);
+      }
+    }
+  }
+  coded_output_->WriteLittleEndian64(footer_offset);
+  coded_output_->WriteRaw(kMagic, static_cast<int>(kMagicSize));
+}
+
+RecordContainerReader::RecordContainerReader()
+  : record_desc_(nullptr),
+    record_count_(0) {
+}
+
+RecordContainerReader::~RecordContainerReader() {
+}
+
+bool RecordContainerReader::Open(
+  const base::FilePath& file_path,
+  std::string& error_message) {
+  if (!mapped_file_.Initialize(file_path)) {
+    error_message = "map container file fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  const uint8_t* data = mapped_file_.data();
+  const size_t size = mapped_file_.length();
+  if (size < kMagicSize + kTrailerSize ||
+      memcmp(data, kMagic, kMagicSize) != 0 ||
+      memcmp(data + size - kMagicSize, kMagic, kMagicSize) != 0) {
+    error_message = "not a record container: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+#if defined(OS_POSIX)
+  // 按记录和块随机读, 不要预读用不到的块
+  if (::madvise(const_cast<uint8_t*>(data), size, MADV_RANDOM) != 0) {
+    DPLOG(WARNING) << "madvise MADV_RANDOM fail";
+  }
+#endif
+
+  uint64_t footer_offset = 0;
+  google::protobuf::io::CodedInputStream::ReadLittleEndian64FromArray(
+    data + size - kTrailerSize, &footer_offset);
+  if (footer_offset < kMagicSize || footer_offset > size - kTrailerSize ||
+      !ParseFooter(data + footer_offset, size - kTrailerSize - footer_offset, error_message)) {
+    if (error_message.empty()) {
+      error_message = "broken record container";
+    }
+    error_message += ": " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  // 块都在 footer 前面
+  for (const RecordBlock& block : blocks_) {
+    if (block.offset < kMagicSize || block.size > footer_offset ||
+        block.offset > footer_offset - block.size) {
+      error_message = "broken record container: " + file_path.AsUTF8Unsafe();
+      return false;
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<google::protobuf::Message> RecordContainerReader::NewRecord() const {
+  if (!record_desc_) {
+    return nullptr;
+  }
+  return std::unique_ptr<google::protobuf::Message>(
+    dynamic_message_factory_->GetPrototype(record_desc_)->New());
+}
+
+bool RecordContainerReader::ReadRecord(
+  int64_t record_index,
+  google::protobuf::Message* record,
+  std::string& error_message) {
+  DCHECK(record);
+  if (record_index < 0 || record_index >= record_count_) {
+    error_message = "record index out of range";
+    return false;
+  }
+  // 第一个起点大于 record_index 的块的前一个
+  auto iter = std::upper_bound(blocks_.begin(), blocks_.end(), record_index,
+    [](int64_t index, const RecordBlock& block) {
+      return index < block.first_record;
+    });
+  DCHECK(iter != blocks_.begin());
+  const RecordBlock& block = *(iter - 1);
+
+  const uint8_t* data = mapped_file_.data() + block.offset;
+  google::protobuf::io::CodedInputStream coded_input(data, static_cast<int>(block.size));
+  base::StringPiece record_data;
+  for (int64_t index = block.first_record; index <= record_index; ++index) {
+    if (!NextRecord(&coded_input, data, block.size, &record_data)) {
+      error_message = "broken record block";
+      return false;
+    }
+  }
+  if (!record->ParseFromArray(record_data.data(), static_cast<int>(record_data.size()))) {
+    error_message = "parse record fail";
+    return false;
+  }
+  return true;
+}
+
+bool RecordContainerReader::ReadBlock(
+  size_t block_index,
+  std::vector<base::StringPiece>* records,
+  std::string& error_message) const {
+  DCHECK(records);
+  DCHECK_LT(block_index, blocks_.size());
+  const RecordBlock& block = blocks_[block_index];
+  const uint8_t* data = mapped_file_.data() + block.offset;
+  google::protobuf::io::CodedInputStream coded_input(data, static_cast<int>(block.size));
+  records->resize(static_cast<size_t>(block.record_count));
+  for (base::StringPiece& record_data : *records) {
+    if (!NextRecord(&coded_input, data, block.size, &record_data)) {
+      error_message = "broken record block";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RecordContainerReader::FindBlocks(
+  const std::string& stat_field,
+  const RecordStatValue& min,
+  const RecordStatValue& max,
+  std::vector<size_t>* block_indexes,
+  std::string& error_message) const {
+  DCHECK(block_indexes);
+  auto iter = std::find(stat_fields_.begin(), stat_fields_.end(), stat_field);
+  if (iter == stat_fields_.end()) {
+    error_message = "not a stat field of the container: " + stat_field;
+    return false;
+  }
+  const size_t stat_index = iter - stat_fields_.begin();
+  const RecordStatKind kind = stat_kinds_[stat_index];
+  block_indexes->clear();
+  for (size_t block_index = 0; block_index < blocks_.size(); ++block_index) {
+    const RecordBlockStats& stats = blocks_[block_index].stats[stat_index];
+    if (stats.has_values &&
+        CompareRecordStatValues(kind, stats.max, min) >= 0 &&
+        CompareRecordStatValues(kind, stats.min, max) <= 0) {
+      block_indexes->push_back(block_index);
+    }
+  }
+  return true;
+}
+
+bool RecordContainerReader::ParseFooter(
+  const uint8_t* data,
+  size_t size,
+  std::string& error_message) {
+  google::protobuf::io::CodedInputStream coded_input(data, static_cast<int>(size));
+  uint32_t version = 0;
+  if (!coded_input.ReadVarint32(&version) || version != kVersion) {
+    error_message = "unknown record container version";
+    return false;
+  }
+  std::string desc_set_data;
+  std::string type_name;
+  uint32_t stat_count = 0;
+  if (!ReadBytes(&coded_input, &desc_set_data) ||
+      !ReadBytes(&coded_input, &type_name) ||
+      !coded_input.ReadVarint32(&stat_count) ||
+      stat_count > size) {
+    return false;
+  }
+  stat_fields_.resize(stat_count);
+  stat_kinds_.resize(stat_count);
+  for (uint32_t stat_index = 0; stat_index < stat_count; ++stat_index) {
+    uint32_t kind = 0;
+    if (!ReadBytes(&coded_input, &stat_fields_[stat_index]) ||
+        !coded_input.ReadVarint32(&kind) ||
+        kind > static_cast<uint32_t>(RecordStatKind::kString)) {
+      return false;
+    }
+    stat_kinds_[stat_index] = static_cast<RecordStatKind>(kind);
+  }
+
+  // 每个块至少 3 个字节, 块数不可能比这更多
+  uint64_t block_count = 0;
+  if (!coded_input.ReadVarint64(&block_count) || block_count > size / 3) {
+    return false;
+  }
+  blocks_.resize(static_cast<size_t>(block_count));
+  record_count_ = 0;
+  for (RecordBlock& block : blocks_) {
+    uint64_t record_count = 0;
+    if (!coded_input.ReadVarint64(&block.offset) ||
+        !coded_input.ReadVarint64(&block.size) ||
+        !coded_input.ReadVarint64(&record_count) ||
+        record_count == 0 || record_count > block.size ||
+        !ReadStats(&coded_input, &block)) {
+      return false;
+    }
+    block.first_record = record_count_;
+    block.record_count = static_cast<int64_t>(record_count);
+    record_count_ += block.record_count;
+  }
+  if (static_cast<size_t>(coded_input.CurrentPosition()) != size) {
+    return false;
+  }
+
+  if (type_name.empty()) {
+    return blocks_.empty();
+  }
+  google::protobuf::FileDescriptorSet file_desc_set;
+  if (!file_desc_set.ParseFromString(desc_set_data)) {
+    return false;
+  }
+  desc_pool_.reset(new google::protobuf::DescriptorPool());
+  for (const google::protobuf::FileDescriptorProto& file_desc_proto : file_desc_set.file()) {
+    if (!desc_pool_->BuildFile(file_desc_proto)) {
+      error_message = "build proto file fail";
+      return false;
+    }
+  }
+  record_desc_ = desc_pool_->FindMessageTypeByName(type_name);
+  if (!record_desc_) {
+    error_message = "no " + type_name + " message in the container";
+    return false;
+  }
+  dynamic_message_factory_.reset(
+    new google::protobuf::DynamicMessageFactory(desc_pool_.get()));
+  return true;
+}
+
+bool RecordContainerReader::ReadStats(
+  google::protobuf::io::CodedInputStream* coded_input,
+  RecordBlock* block) {
+  block->stats.resize(stat_kinds_.size());
+  for (size_t stat_index = 0; stat_index < stat_kinds_.size(); ++stat_index) {
+    RecordBlockStats& stats = block->stats[stat_index];
+    uint32_t has_values = 0;
+    if (!coded_input->ReadVarint32(&has_values) || has_values > 1) {
+      return false;
+    }
+    stats.has_values = has_values != 0;
+    if (stats.has_values &&
+        (!ReadStatValue(coded_input, stat_kinds_[stat_index], &stats.min) ||
+         !ReadStatValue(coded_input, stat_kinds_[stat_index], &stats.max))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} //namespace self
@@ -0,0 +1,228 @@
+#ifndef RECORD_CONTAINER_H_
+#define RECORD_CONTAINER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/memory_mapped_file.h"
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "protobuf_file_output_stream.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace google {
+namespace protobuf {
+class Descriptor;
+class DescriptorPool;
+class DynamicMessageFactory;
+class FieldDescriptor;
+class Message;
+namespace io {
+class CodedInputStream;
+class CodedOutputStream;
+} // namespace io
+} // namespace protobuf
+} // google
+
+namespace self {
+
+// A file of converted records that can be read without decoding all of it:
+//
+//   "JPRC"
+//   blocks     length delimited records, a block is closed once it holds
+//              RecordContainerOptions::block_size bytes
+//   footer     the FileDescriptorSet and full name of the record type, the
+//              offset, size and record count of every block and, per block,
+//              the min and max of the stat fields
+//   fixed64    offset of the footer
+//   "JPRC"
+//
+// A reader maps the file, reads the footer and touches only the blocks it
+// decodes.
+
+// How the values of a stat field compare, from the field's C++ type.
+enum class RecordStatKind {
+  // int32, int64 and enum.
+  kSigned,
+  // uint32, uint64 and bool.
+  kUnsigned,
+  // float and double.
+  kDouble,
+  // string and bytes, compared bytewise.
+  kString,
+};
+
+// A value of a stat field, only the member of its kind is used.
+struct RecordStatValue {
+  RecordStatValue();
+
+  int64_t signed_value;
+  uint64_t unsigned_value;
+  double double_value;
+  std::string string_value;
+};
+
+// Negative, zero or positive like strcmp.
+int CompareRecordStatValues(
+  RecordStatKind kind,
+  const RecordStatValue& left,
+  const RecordStatValue& right);
+
+struct RecordBlockStats {
+  RecordBlockStats();
+
+  // False when no record of the block sets the field.
+  bool has_values;
+  RecordStatValue min;
+  RecordStatValue max;
+};
+
+struct RecordBlock {
+  RecordBlock();
+
+  uint64_t offset;
+  uint64_t size;
+  // Index of the block's first record in the file.
+  int64_t first_record;
+  int64_t record_count;
+  // One per stat field.
+  std::vector<RecordBlockStats> stats;
+};
+
+struct RecordContainerOptions {
+  static const size_t kDefaultBlockSize = 64 << 10;
+
+  RecordContainerOptions();
+  ~RecordContainerOptions();
+
+  size_t block_size;
+  // Singular scalar fields of the record, by json key, nested ones with dots
+  // like "intent.action".
+  std::vector<std::string> stat_fields;
+};
+
+// Writes a container through a ProtobufFileOutputStream. The record type and
+// the stat fields are taken from the first record.
+class RecordContainerWriter {
+public:
+  explicit RecordContainerWriter(const RecordContainerOptions& options);
+
+  ~RecordContainerWriter();
+
+  bool Open(
+    const base::FilePath& file_path,
+    bool use_io_thread,
+    std::string& error_message);
+
+  // Every record has to be of the first record's type.
+  bool Append(const google::protobuf::Message& record, std::string& error_message);
+
+  // Closes the last block and writes the footer.
+  bool Close(std::string& error_message);
+
+  int64_t record_count() const { return record_count_; }
+  size_t block_count() const { return blocks_.size(); }
+
+private:
+  bool ResolveStatFields(
+    const google::protobuf::Descriptor* record_desc,
+    std::string& error_message);
+
+  void UpdateStats(const google::protobuf::Message& record);
+
+  void FinishBlock();
+
+  void WriteFooter();
+
+private:
+  const RecordContainerOptions options_;
+  ProtobufFileOutputStream output_stream_;
+  std::unique_ptr<google::protobuf::io::CodedOutputStream> coded_output_;
+
+  const google::protobuf::Descriptor* record_desc_;
+  // The fields from the record down to each stat field.
+  std::vector<std::vector<const google::protobuf::FieldDescriptor*>> stat_field_paths_;
+  std::vector<RecordStatKind> stat_kinds_;
+
+  std::vector<RecordBlock> blocks_;
+  RecordBlock current_block_;
+  int64_t record_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(RecordContainerWriter);
+};
+
+class RecordContainerReader {
+public:
+  RecordContainerReader();
+
+  ~RecordContainerReader();
+
+  // Maps |file_path| and reads the footer, no block is touched.
+  bool Open(const base::FilePath& file_path, std::string& error_message);
+
+  // Null when the container holds no record.
+  const google::protobuf::Descriptor* record_desc() const { return record_desc_; }
+
+  // A new empty record, null when the container holds no record.
+  std::unique_ptr<google::protobuf::Message> NewRecord() const;
+
+  int64_t record_count() const { return record_count_; }
+  size_t block_count() const { return blocks_.size(); }
+  const RecordBlock& block(size_t index) const { return blocks_[index]; }
+
+  const std::vector<std::string>& stat_fields() const { return stat_fields_; }
+  RecordStatKind stat_kind(size_t index) const { return stat_kinds_[index]; }
+
+  // Parses record |record_index| into |record|, only its block is read.
+  bool ReadRecord(
+    int64_t record_index,
+    google::protobuf::Message* record,
+    std::string& error_message);
+
+  // The encodings of the records of block |block_index|, pointing into the
+  // mapping.
+  bool ReadBlock(
+    size_t block_index,
+    std::vector<base::StringPiece>* records,
+    std::string& error_message) const;
+
+  // The blocks that may hold a record whose |stat_field| is within [min, max].
+  bool FindBlocks(
+    const std::string& stat_field,
+    const RecordStatValue& min,
+    const RecordStatValue& max,
+    std::vector<size_t>* block_indexes,
+    std::string& error_message) const;
+
+private:
+  bool ParseFooter(const uint8_t* data, size_t size, std::string& error_message);
+
+  bool ReadStats(
+    google::protobuf::io::CodedInputStream* coded_input,
+    RecordBlock* block);
+
+private:
+  base::MemoryMappedFile mapped_file_;
+  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool_;
+  std::unique_ptr<google::protobuf::DynamicMessageFactory> dynamic_message_factory_;
+  const google::protobuf::Descriptor* record_desc_;
+
+  std::vector<std::string> stat_fields_;
+  std::vector<RecordStatKind> stat_kinds_;
+  std::vector<RecordBlock> blocks_;
+  int64_t record_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(RecordContainerReader);
+};
+
+} // namespace self
+#endif // RECORD_CONTAINER_H_
@@ -0,0 +1,168 @@
+#include "record_container.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_piece.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "json_input_generator.h"
+#include "json_input_stream.h"
+#include "json_unified_schema_builder.h"
+#include "record_stream_converter.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+const int kRecordCount = 2000;
+// 块小一些, 2000 条记录也能分成很多块
+const size_t kBlockSize = 4 << 10;
+// GenerateRecord() 的 version 从这里起递增
+const int64_t kFirstVersion = 2018052116;
+
+// The next record of plain length delimited output.
+bool NextPlainRecord(const char** data, const char* end, base::StringPiece* record) {
+  uint32_t record_size = 0;
+  for (int shift = 0; ; shift += 7) {
+    if (*data == end || shift > 28) {
+      return false;
+    }
+    const uint8_t byte = static_cast<uint8_t>(*(*data)++);
+    record_size |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+  }
+  if (record_size > static_cast<size_t>(end - *data)) {
+    return false;
+  }
+  *record = base::StringPiece(*data, record_size);
+  *data += record_size;
+  return true;
+}
+
+class RecordContainerTest : public testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    const base::FilePath stream_file_path = temp_dir_.GetPath().AppendASCII("records.ndjson");
+    const base::FilePath plain_file_path = temp_dir_.GetPath().AppendASCII("records.pb");
+    container_file_path_ = temp_dir_.GetPath().AppendASCII("records.jprc");
+    ASSERT_TRUE(GenerateRecordStream(stream_file_path, kRecordCount));
+    RecordContainerOptions container_options;
+    container_options.block_size = kBlockSize;
+    container_options.stat_fields.push_back("version");
+    container_options.stat_fields.push_back("type_id");
+    ASSERT_NO_FATAL_FAILURE(ConvertRecordFile(stream_file_path, plain_file_path, nullptr));
+    ASSERT_NO_FATAL_FAILURE(
+      ConvertRecordFile(stream_file_path, container_file_path_, &container_options));
+
+    std::string plain_data;
+    ASSERT_TRUE(base::ReadFileToString(plain_file_path, &plain_data));
+    const char* data = plain_data.data();
+    const char* end = data + plain_data.size();
+    base::StringPiece record;
+    while (data != end) {
+      ASSERT_TRUE(NextPlainRecord(&data, end, &record));
+      plain_records_.push_back(record.as_string());
+    }
+    ASSERT_EQ(static_cast<size_t>(kRecordCount), plain_records_.size());
+  }
+
+  void ConvertRecordFile(
+    const base::FilePath& input_file_path,
+    const base::FilePath& output_file_path,
+    const RecordContainerOptions* container_options) {
+    std::string error_message;
+    JsonFileInputStream input_stream;
+    RecordStreamConverter record_stream_converter(
+      SchemaMode::kUnified, JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality);
+    record_stream_converter.set_container_options(container_options);
+    ASSERT_TRUE(input_stream.Open(input_file_path, error_message)) << error_message;
+    ASSERT_TRUE(record_stream_converter.Convert(&input_stream, output_file_path, error_message))
+      << error_message;
+  }
+
+  // The version of an encoded record.
+  int64_t Version(const base::StringPiece& record_data, google::protobuf::Message* record) {
+    EXPECT_TRUE(
+      record->ParseFromArray(record_data.data(), static_cast<int>(record_data.size())));
+    const google::protobuf::Descriptor* desc = record->GetDescriptor();
+    for (int index = 0; index < desc->field_count(); index++) {
+      if (desc->field(index)->json_name() == "version") {
+        return record->GetReflection()->GetInt64(*record, desc->field(index));
+      }
+    }
+    return -1;
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath container_file_path_;
+  std::vector<std::string> plain_records_;
+};
+
+} // namespace
+
+// Every record read through the index is the plain output's record.
+TEST_F(RecordContainerTest, ReadRecordLikePlain) {
+  RecordContainerReader container_reader;
+  std::string error_message;
+  ASSERT_TRUE(container_reader.Open(container_file_path_, error_message)) << error_message;
+  ASSERT_EQ(kRecordCount, container_reader.record_count());
+  EXPECT_GT(container_reader.block_count(), 1u);
+  std::unique_ptr<google::protobuf::Message> record = container_reader.NewRecord();
+  std::unique_ptr<google::protobuf::Message> plain_record = container_reader.NewRecord();
+  for (int64_t index = 0; index < kRecordCount; index++) {
+    ASSERT_TRUE(container_reader.ReadRecord(index, record.get(), error_message))
+      << error_message;
+    ASSERT_TRUE(plain_record->ParseFromString(plain_records_[index]));
+    EXPECT_EQ(plain_record->SerializeAsString(), record->SerializeAsString()) << index;
+  }
+}
+
+// The blocks the stats pick hold every record a scan of the plain output
+// finds.
+TEST_F(RecordContainerTest, FindBlocksLikeScan) {
+  RecordContainerReader container_reader;
+  std::string error_message;
+  ASSERT_TRUE(container_reader.Open(container_file_path_, error_message)) << error_message;
+  std::unique_ptr<google::protobuf::Message> record = container_reader.NewRecord();
+  RecordStatValue min_version;
+  RecordStatValue max_version;
+  min_version.signed_value = kFirstVersion + kRecordCount / 2;
+  max_version.signed_value = min_version.signed_value + kRecordCount / 10 - 1;
+  auto matches = [&](const base::StringPiece& record_data) {
+    const int64_t version = Version(record_data, record.get());
+    return version >= min_version.signed_value && version <= max_version.signed_value;
+  };
+
+  int64_t plain_matches = 0;
+  for (const std::string& record_data : plain_records_) {
+    plain_matches += matches(record_data) ? 1 : 0;
+  }
+  std::vector<size_t> block_indexes;
+  ASSERT_TRUE(container_reader.FindBlocks(
+    "version", min_version, max_version, &block_indexes, error_message)) << error_message;
+  EXPECT_LT(block_indexes.size(), container_reader.block_count());
+  int64_t container_matches = 0;
+  std::vector<base::StringPiece> records;
+  for (size_t block_index : block_indexes) {
+    ASSERT_TRUE(container_reader.ReadBlock(block_index, &records, error_message))
+      << error_message;
+    for (const base::StringPiece& record_data : records) {
+      container_matches += matches(record_data) ? 1 : 0;
+    }
+  }
+  EXPECT_EQ(kRecordCount / 10, plain_matches);
+  EXPECT_EQ(plain_matches, container_matches);
+}
+
+} // namespace self
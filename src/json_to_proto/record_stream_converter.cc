@@ -0,0 +1,275 @@
+#include "record_stream_converter.h"
+
+#include <string.h>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "build_proto_from_json.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/message.h"
+#include "json_stream_message_builder.h"
+#include "json_to_protobuf_serializer.h"
+#include "json_unified_schema_builder.h"
+
+namespace self {
+
+namespace {
+static bool IsBlankLine(base::StringPiece line) {
+  for (char c : line) {
+    if (c != ' ' && c != '\t' && c != '\r') {
+      return false;
+    }
+  }
+  return true;
+}
+}
+
+RecordStreamConverter::RecordStreamConverter(
+  SchemaMode schema_mode,
+  size_t max_enum_cardinality)
+  : schema_mode_(schema_mode),
+    max_enum_cardinality_(max_enum_cardinality),
+    file_desc_(nullptr),
+    json_reader_(&record_stream_),
+    use_io_thread_(false),
+    write_descriptor_set_(false),
+    output_options_(nullptr),
+    container_options_(nullptr),
+    line_number_(0),
+    record_count_(0),
+    error_count_(0) {
+}
+
+RecordStreamConverter::~RecordStreamConverter() {
+}
+
+bool RecordStreamConverter::Convert(
+  JsonInputStream* input_stream,
+  const base::FilePath& output_file_path,
+  std::string& error_message) {
+  DCHECK(input_stream);
+  // 每条记录的 key 和值的范围都可能不同, 先把所有记录合并成一个 schema,
+  // 后面的记录有新 key 也有字段, 整个输出也只有一个 schema
+  if (schema_mode_ != SchemaMode::kPerElement &&
+      !InferStreamSchema(input_stream, error_message)) {
+    return false;
+  }
+  if (container_options_) {
+    container_writer_.reset(new RecordContainerWriter(*container_options_));
+    if (!container_writer_->Open(output_file_path, use_io_thread_, error_message)) {
+      return false;
+    }
+  } else {
+    if (output_options_) {
+      output_stream_.set_options(*output_options_);
+    }
+    if (!output_stream_.Open(output_file_path, use_io_thread_, error_message)) {
+      return false;
+    }
+    coded_output_.reset(new google::protobuf::io::CodedOutputStream(&output_stream_));
+  }
+
+  if (!ReadLines(input_stream, nullptr, error_message)) {
+    return false;
+  }
+  if (container_writer_) {
+    if (!container_writer_->Close(error_message)) {
+      return false;
+    }
+  } else {
+    // CodedOutputStream 析构时才把没用完的缓冲还给 output_stream_
+    coded_output_.reset();
+    if (!output_stream_.Close(error_message)) {
+      return false;
+    }
+  }
+
+  if (write_descriptor_set_ && file_desc_ &&
+      !JsonToProtobufSerializer::WriteDescriptorSet(file_desc_, output_file_path, error_message)) {
+    return false;
+  }
+
+  if (error_count_ > 0) {
+    error_message = base::Int64ToString(error_count_) + " of " +
+      base::Int64ToString(record_count_ + error_count_) + " records fail, first error:\n" +
+      first_record_error_;
+    return false;
+  }
+  return true;
+}
+
+bool RecordStreamConverter::ReadLines(
+  JsonInputStream* input_stream,
+  JsonUnifiedSchemaBuilder* schema_builder,
+  std::string& error_message) {
+  line_number_ = 0;
+  // 一行可能跨越多个 chunk, 只有这种情况才拷贝到 pending_line
+  std::string pending_line;
+  const char* data = nullptr;
+  size_t size = 0;
+  while (input_stream->Next(&data, &size)) {
+    const char* position = data;
+    const char* end = data + size;
+    while (position < end) {
+      const char* newline = static_cast<const char*>(
+        ::memchr(position, '\n', end - position));
+      if (!newline) {
+        pending_line.append(position, end - position);
+        break;
+      }
+      base::StringPiece line(position, newline - position);
+      if (!pending_line.empty()) {
+        pending_line.append(position, newline - position);
+        line = pending_line;
+      }
+      if (schema_builder) {
+        InferLine(line, schema_builder);
+      } else if (!ConvertLine(line, error_message)) {
+        return false;
+      }
+      pending_line.clear();
+      position = newline + 1;
+    }
+  }
+  if (pending_line.empty()) {
+    return true;
+  }
+  if (schema_builder) {
+    InferLine(pending_line, schema_builder);
+    return true;
+  }
+  return ConvertLine(pending_line, error_message);
+}
+
+void RecordStreamConverter::InferLine(
+  base::StringPiece line,
+  JsonUnifiedSchemaBuilder* schema_builder) {
+  ++line_number_;
+  if (IsBlankLine(line)) {
+    return;
+  }
+  record_stream_.Reset(line);
+  std::string record_error;
+  if (!json_reader_.Parse(schema_builder, record_error)) {
+    schema_builder->AbandonRootObject();
+  }
+}
+
+bool RecordStreamConverter::ConvertLine(
+  base::StringPiece line,
+  std::string& error_message) {
+  ++line_number_;
+  if (IsBlankLine(line)) {
+    return true;
+  }
+  record_stream_.Reset(line);
+
+  if (!record_message_) {
+    // kPerElement 由第一条记录决定 schema, 之后的记录只做填充
+    if (!BuildSchema(error_message)) {
+      error_message = "record " + base::Int64ToString(line_number_) + ": " + error_message;
+      return false;
+    }
+    record_stream_.Rewind();
+  }
+
+  std::string record_error;
+  if (!FillRecord(record_error)) {
+    if (error_count_ == 0) {
+      first_record_error_ = "record " + base::Int64ToString(line_number_) + ": " + record_error;
+    }
+    ++error_count_;
+    return true;
+  }
+  ++record_count_;
+  return AppendRecord(error_message);
+}
+
+bool RecordStreamConverter::FillRecord(std::string& error_message) {
+  record_message_->Clear();
+  message_builder_->Reset(record_message_.get());
+  return json_reader_.Parse(message_builder_.get(), error_message);
+}
+
+bool RecordStreamConverter::InferStreamSchema(
+  JsonInputStream* input_stream,
+  std::string& error_message) {
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    BuildProtoFromJson::NewProtoFile();
+  JsonUnifiedSchemaBuilder schema_builder(
+    file_desc_proto.get(), schema_mode_ == SchemaMode::kCompact);
+  schema_builder.set_max_enum_cardinality(max_enum_cardinality_);
+  schema_builder.set_fold_root_objects(true);
+  if (!ReadLines(input_stream, &schema_builder, error_message)) {
+    return false;
+  }
+  if (!input_stream->Rewind()) {
+    error_message = "rewind input fail";
+    return false;
+  }
+  // 一条能解析的记录都没有时这里不报错, 第二遍推导第一条记录时报出它的错误
+  std::string schema_error;
+  if (!schema_builder.Finish(schema_error)) {
+    return true;
+  }
+  return UseSchema(std::move(file_desc_proto), error_message);
+}
+
+bool RecordStreamConverter::BuildSchema(std::string& error_message) {
+  BuildProtoFromJson build_proto_from_json;
+  build_proto_from_json.set_max_enum_cardinality(max_enum_cardinality_);
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto =
+    build_proto_from_json.CreateProtoFileFromStream(
+      &record_stream_, schema_mode_, error_message);
+  if (!file_desc_proto) {
+    return false;
+  }
+  return UseSchema(std::move(file_desc_proto), error_message);
+}
+
+bool RecordStreamConverter::UseSchema(
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto,
+  std::string& error_message) {
+  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = JsonToProtobufSerializer::BuildFile(
+    std::move(file_desc_proto), &desc_pool, error_message);
+  if (!file_desc) {
+    return false;
+  }
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  if (!root_desc) {
+    error_message = "no ROOT message in proto file";
+    return false;
+  }
+  dynamic_message_factory_.reset(new google::protobuf::DynamicMessageFactory(desc_pool.get()));
+  desc_pool_ = std::move(desc_pool);
+  file_desc_ = file_desc;
+  record_message_.reset(dynamic_message_factory_->GetPrototype(root_desc)->New());
+  message_builder_ = JsonToProtobufSerializer::CreateMessageBuilder(
+    schema_mode_, record_message_.get(), dynamic_message_factory_.get());
+  return true;
+}
+
+bool RecordStreamConverter::AppendRecord(std::string& error_message) {
+  if (container_writer_) {
+    return container_writer_->Append(*record_message_, error_message);
+  }
+  const size_t record_size = record_message_->ByteSizeLong();
+  if (record_size > INT32_MAX) {
+    error_message = "record too large: " + base::Int64ToString(line_number_);
+    return false;
+  }
+  coded_output_->WriteVarint32(static_cast<uint32_t>(record_size));
+  record_message_->SerializeWithCachedSizes(coded_output_.get());
+  if (coded_output_->HadError()) {
+    error_message = "write output file fail";
+    return false;
+  }
+  return true;
+}
+
+} //namespace self
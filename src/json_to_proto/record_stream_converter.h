@@ -0,0 +1,139 @@
+#ifndef RECORD_STREAM_CONVERTER_H_
+#define RECORD_STREAM_CONVERTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "build_proto_from_json.h"
+#include "json_input_stream.h"
+#include "json_sax_reader.h"
+#include "protobuf_file_output_stream.h"
+#include "record_container.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace google {
+namespace protobuf {
+class DescriptorPool;
+class DynamicMessageFactory;
+class FileDescriptor;
+class FileDescriptorProto;
+class Message;
+namespace io {
+class CodedOutputStream;
+} // namespace io
+} // namespace protobuf
+} // google
+
+namespace self {
+class JsonMessageBuilder;
+class JsonUnifiedSchemaBuilder;
+
+// Converts newline delimited json, one record per line, into length delimited
+// protobuf records. With SchemaMode::kUnified and SchemaMode::kCompact a first
+// pass over the input folds every record into one schema, so a key or a wider
+// value that only shows up in a later record still has a field. The input is
+// read twice then. SchemaMode::kPerElement can not merge records, its schema
+// is inferred from the first record. The descriptor pool, message factory and
+// message object are reused for every record.
+class RecordStreamConverter {
+public:
+  RecordStreamConverter(SchemaMode schema_mode, size_t max_enum_cardinality);
+
+  ~RecordStreamConverter();
+
+  bool Convert(
+    JsonInputStream* input_stream,
+    const base::FilePath& output_file_path,
+    std::string& error_message);
+
+  // Writes the output on a background thread while the next records are
+  // converted.
+  void set_use_io_thread(bool use_io_thread) { use_io_thread_ = use_io_thread; }
+
+  // See JsonToProtobufSerializer::set_output_options().
+  void set_output_options(const OutputStreamOptions* output_options) {
+    output_options_ = output_options;
+  }
+
+  // Also writes the schema of the records as a FileDescriptorSet to
+  // JsonToProtobufSerializer::DescriptorSetPath().
+  void set_write_descriptor_set(bool write_descriptor_set) {
+    write_descriptor_set_ = write_descriptor_set;
+  }
+
+  // Writes the records into a RecordContainerWriter file instead of one
+  // length delimited stream. Not owned, null by default.
+  void set_container_options(const RecordContainerOptions* container_options) {
+    container_options_ = container_options;
+  }
+
+  int64_t record_count() const { return record_count_; }
+  int64_t error_count() const { return error_count_; }
+
+private:
+  // Calls ConvertLine(), or InferLine() when |schema_builder| is given, for
+  // every line of |input_stream|.
+  bool ReadLines(
+    JsonInputStream* input_stream,
+    JsonUnifiedSchemaBuilder* schema_builder,
+    std::string& error_message);
+
+  // First pass: folds the record into |schema_builder|. A record that does
+  // not parse is left out, the second pass counts it as an error.
+  void InferLine(base::StringPiece line, JsonUnifiedSchemaBuilder* schema_builder);
+
+  bool ConvertLine(base::StringPiece line, std::string& error_message);
+
+  bool FillRecord(std::string& error_message);
+
+  // Infers the schema of every record from |input_stream| and rewinds it.
+  bool InferStreamSchema(JsonInputStream* input_stream, std::string& error_message);
+
+  // Infers the schema from the record in |record_stream_|.
+  bool BuildSchema(std::string& error_message);
+
+  bool UseSchema(
+    std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto,
+    std::string& error_message);
+
+  bool AppendRecord(std::string& error_message);
+
+private:
+  const SchemaMode schema_mode_;
+  const size_t max_enum_cardinality_;
+  std::unique_ptr<google::protobuf::DescriptorPool> desc_pool_;
+  const google::protobuf::FileDescriptor* file_desc_;
+  std::unique_ptr<google::protobuf::DynamicMessageFactory> dynamic_message_factory_;
+  std::unique_ptr<google::protobuf::Message> record_message_;
+
+  JsonStringInputStream record_stream_;
+  JsonSaxReader json_reader_;
+  std::unique_ptr<JsonMessageBuilder> message_builder_;
+
+  bool use_io_thread_;
+  bool write_descriptor_set_;
+  const OutputStreamOptions* output_options_;
+  const RecordContainerOptions* container_options_;
+  ProtobufFileOutputStream output_stream_;
+  std::unique_ptr<google::protobuf::io::CodedOutputStream> coded_output_;
+  std::unique_ptr<RecordContainerWriter> container_writer_;
+
+  int64_t line_number_;
+  int64_t record_count_;
+  int64_t error_count_;
+  std::string first_record_error_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(RecordStreamConverter);
+};
+
+} // namespace self
+#endif // RECORD_STREAM_CONVERTER_H_
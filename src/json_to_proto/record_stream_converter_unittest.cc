@@ -0,0 +1,116 @@
+#include "record_stream_converter.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/strings/string_split.h"
+#include "base/values.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "json_input_stream.h"
+#include "json_to_protobuf_serializer.h"
+#include "json_unified_schema_builder.h"
+#include "protobuf_json_writer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+// 后面的记录才有的 key, 更宽的数, 换了类型的值, 都要有字段
+const char kRecordStream[] =
+  "{\"id\":1,\"name\":\"a\",\"tags\":[1,2],\"value\":1}\n"
+  "{\"id\":2,\"extra\":{\"x\":1.5,\"y\":[\"s\"]}}\n"
+  "\n"
+  "{\"id\":-70000,\"name\":\"b\",\"tags\":[3],\"value\":\"x\"}\n"
+  "{\"id\":3,\"size\":3000000000,\"name\":\"a\",\"flag\":true,\"extra\":{\"z\":2}}\n"
+  "{\"id\":4,\"value\":{\"deep\":[[1],[2,3]]}}";
+
+// Converts kRecordStream with the descriptor set written and checks that
+// every record written back to json equals its line.
+void ExpectRecordsLikeLines(SchemaMode schema_mode) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath output_file_path = temp_dir.GetPath().AppendASCII("records.pb");
+  JsonStringInputStream input_stream(kRecordStream);
+  RecordStreamConverter record_stream_converter(
+    schema_mode, JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality);
+  record_stream_converter.set_write_descriptor_set(true);
+  std::string error_message;
+  ASSERT_TRUE(record_stream_converter.Convert(&input_stream, output_file_path, error_message))
+    << error_message;
+
+  std::string descriptor_set_data;
+  google::protobuf::FileDescriptorSet file_desc_set;
+  ASSERT_TRUE(base::ReadFileToString(
+    JsonToProtobufSerializer::DescriptorSetPath(output_file_path), &descriptor_set_data));
+  ASSERT_TRUE(file_desc_set.ParseFromString(descriptor_set_data));
+  ASSERT_EQ(1, file_desc_set.file_size());
+  google::protobuf::DescriptorPool desc_pool;
+  const google::protobuf::FileDescriptor* file_desc = desc_pool.BuildFile(file_desc_set.file(0));
+  ASSERT_TRUE(file_desc);
+  const google::protobuf::Descriptor* root_desc = file_desc->FindMessageTypeByName("ROOT");
+  ASSERT_TRUE(root_desc);
+
+  std::vector<std::string> lines = base::SplitString(
+    kRecordStream, "\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  ASSERT_EQ(lines.size(), static_cast<size_t>(record_stream_converter.record_count()));
+  std::string output_data;
+  ASSERT_TRUE(base::ReadFileToString(output_file_path, &output_data));
+  google::protobuf::io::CodedInputStream coded_input(
+    reinterpret_cast<const uint8_t*>(output_data.data()), static_cast<int>(output_data.size()));
+  for (const std::string& line : lines) {
+    SCOPED_TRACE(line);
+    uint32_t record_size = 0;
+    std::string record;
+    ASSERT_TRUE(coded_input.ReadVarint32(&record_size));
+    ASSERT_TRUE(coded_input.ReadString(&record, static_cast<int>(record_size)));
+    ProtobufJsonWriter protobuf_json_writer;
+    ASSERT_TRUE(protobuf_json_writer.WriteMessage(
+      root_desc, record.data(), record.size(), error_message)) << error_message;
+    std::unique_ptr<base::Value> record_value =
+      base::JSONReader::Read(*protobuf_json_writer.buffer());
+    std::unique_ptr<base::Value> line_value = base::JSONReader::Read(line);
+    ASSERT_TRUE(record_value);
+    ASSERT_TRUE(line_value);
+    EXPECT_TRUE(record_value->Equals(line_value.get())) << *protobuf_json_writer.buffer();
+  }
+  EXPECT_EQ(coded_input.CurrentPosition(), static_cast<int>(output_data.size()));
+}
+
+} // namespace
+
+// The schema comes from every record, not only from the first one.
+TEST(RecordStreamConverterTest, LaterRecordsUnified) {
+  ExpectRecordsLikeLines(SchemaMode::kUnified);
+}
+
+// The narrowed types and enums hold the values of every record, so all
+// records share the one schema of the descriptor set.
+TEST(RecordStreamConverterTest, LaterRecordsCompact) {
+  ExpectRecordsLikeLines(SchemaMode::kCompact);
+}
+
+// A record that does not parse is counted, the others are still written.
+TEST(RecordStreamConverterTest, BadRecordCounted) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  JsonStringInputStream input_stream("{\"a\":1}\n{\"a\":\n{\"a\":2,\"b\":\"s\"}\n");
+  RecordStreamConverter record_stream_converter(
+    SchemaMode::kUnified, JsonUnifiedSchemaBuilder::kDefaultMaxEnumCardinality);
+  std::string error_message;
+  EXPECT_FALSE(record_stream_converter.Convert(
+    &input_stream, temp_dir.GetPath().AppendASCII("records.pb"), error_message));
+  EXPECT_EQ(2, record_stream_converter.record_count());
+  EXPECT_EQ(1, record_stream_converter.error_count());
+}
+
+} // namespace self
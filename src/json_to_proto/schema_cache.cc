@@ -0,0 +1,123 @@
+#include "schema_cache.h"
+
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/stringprintf.h"
+#include "google/protobuf/descriptor.pb.h"
+
+namespace self {
+
+namespace {
+static const char kEntryExtension[] = ".desc";
+static const char kCountersFileName[] = "counters";
+static const char kHitKey[] = "hit";
+static const char kMissKey[] = "miss";
+}
+
+SchemaCache::SchemaCache(const base::FilePath& cache_dir)
+  : cache_dir_(cache_dir),
+    hit_count_(0),
+    miss_count_(0) {
+}
+
+SchemaCache::~SchemaCache() {
+}
+
+std::unique_ptr<google::protobuf::FileDescriptorProto> SchemaCache::Load(
+  uint64_t fingerprint) {
+  std::string data;
+  if (!base::ReadFileToString(GetEntryPath(fingerprint), &data)) {
+    ++miss_count_;
+    return nullptr;
+  }
+  google::protobuf::FileDescriptorSet file_desc_set;
+  if (!file_desc_set.ParseFromString(data) || file_desc_set.file_size() != 1) {
+    LOG(WARNING) << "ignore broken schema cache entry: "
+      << GetEntryPath(fingerprint).AsUTF8Unsafe();
+    ++miss_count_;
+    return nullptr;
+  }
+  ++hit_count_;
+  std::unique_ptr<google::protobuf::FileDescriptorProto> file_desc_proto(
+    new google::protobuf::FileDescriptorProto());
+  file_desc_proto->Swap(file_desc_set.mutable_file(0));
+  return file_desc_proto;
+}
+
+bool SchemaCache::Store(
+  uint64_t fingerprint,
+  const google::protobuf::FileDescriptorProto& file_desc_proto) {
+  if (!base::DirectoryExists(cache_dir_) && !base::CreateDirectory(cache_dir_)) {
+    return false;
+  }
+  google::protobuf::FileDescriptorSet file_desc_set;
+  *file_desc_set.add_file() = file_desc_proto;
+  std::string data;
+  if (!file_desc_set.SerializeToString(&data)) {
+    return false;
+  }
+  return WriteFileAtomically(GetEntryPath(fingerprint), data);
+}
+
+bool SchemaCache::UpdateTotalCounters(
+  int64_t* total_hit_count,
+  int64_t* total_miss_count) {
+  DCHECK(total_hit_count && total_miss_count);
+  *total_hit_count = hit_count_;
+  *total_miss_count = miss_count_;
+
+  // 格式是 "hit=N\nmiss=M\n", 多个进程同时更新时可能丢计数, 只用于观察
+  const base::FilePath counters_path = cache_dir_.AppendASCII(kCountersFileName);
+  std::string data;
+  if (base::ReadFileToString(counters_path, &data)) {
+    for (const std::string& line : base::SplitString(
+      data, "\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY)) {
+      std::vector<std::string> pair = base::SplitString(
+        line, "=", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+      int64_t count = 0;
+      if (pair.size() != 2 || !base::StringToInt64(pair[1], &count)) {
+        continue;
+      }
+      if (pair[0] == kHitKey) {
+        *total_hit_count += count;
+      } else if (pair[0] == kMissKey) {
+        *total_miss_count += count;
+      }
+    }
+  }
+  if (!base::DirectoryExists(cache_dir_) && !base::CreateDirectory(cache_dir_)) {
+    return false;
+  }
+  return WriteFileAtomically(counters_path, base::StringPrintf("%s=%lld\n%s=%lld\n",
+    kHitKey, static_cast<long long>(*total_hit_count),
+    kMissKey, static_cast<long long>(*total_miss_count)));
+}
+
+base::FilePath SchemaCache::GetEntryPath(uint64_t fingerprint) const {
+  return cache_dir_.AppendASCII(base::StringPrintf("%016llx%s",
+    static_cast<unsigned long long>(fingerprint), kEntryExtension));
+}
+
+bool SchemaCache::WriteFileAtomically(
+  const base::FilePath& file_path,
+  const std::string& data) {
+  // 先写临时文件再替换, 其他进程不会读到写了一半的文件
+  base::FilePath temp_file_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_file_path)) {
+    return false;
+  }
+  if (base::WriteFile(temp_file_path, data.data(), static_cast<int>(data.size())) !=
+      static_cast<int>(data.size())) {
+    base::DeleteFile(temp_file_path, false);
+    return false;
+  }
+  if (!base::ReplaceFile(temp_file_path, file_path, nullptr)) {
+    base::DeleteFile(temp_file_path, false);
+    return false;
+  }
+  return true;
+}
+
+} //namespace self
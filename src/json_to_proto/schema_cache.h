@@ -0,0 +1,59 @@
+#ifndef SCHEMA_CACHE_H_
+#define SCHEMA_CACHE_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/macros.h"
+
+namespace google {
+namespace protobuf {
+class FileDescriptorProto;
+} // namespace protobuf
+} // google
+
+namespace self {
+
+// On-disk cache of inferred schemas keyed by JsonShapeFingerprint. Every
+// entry is a serialized FileDescriptorSet named after the fingerprint. Hit
+// and miss counters are kept for this process and summed up across runs in
+// the cache directory.
+class SchemaCache {
+public:
+  explicit SchemaCache(const base::FilePath& cache_dir);
+
+  ~SchemaCache();
+
+  // Returns nullptr on a miss.
+  std::unique_ptr<google::protobuf::FileDescriptorProto> Load(uint64_t fingerprint);
+
+  bool Store(
+    uint64_t fingerprint,
+    const google::protobuf::FileDescriptorProto& file_desc_proto);
+
+  // Adds this process's counters to the totals stored in the cache directory
+  // and returns the new totals.
+  bool UpdateTotalCounters(int64_t* total_hit_count, int64_t* total_miss_count);
+
+  int64_t hit_count() const { return hit_count_; }
+  int64_t miss_count() const { return miss_count_; }
+
+private:
+  base::FilePath GetEntryPath(uint64_t fingerprint) const;
+
+  bool WriteFileAtomically(const base::FilePath& file_path, const std::string& data);
+
+private:
+  const base::FilePath cache_dir_;
+  int64_t hit_count_;
+  int64_t miss_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(SchemaCache);
+};
+
+} // namespace self
+#endif // SCHEMA_CACHE_H_
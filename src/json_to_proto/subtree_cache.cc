@@ -0,0 +1,319 @@
+#include "subtree_cache.h"
+
+#include <algorithm>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+
+namespace self {
+
+namespace {
+// "STC1"
+static const uint32_t kMagic = 0x31435453;
+static const uint32_t kVersion = 1;
+
+static const int kWireTypeVarint = 0;
+static const int kWireTypeFixed64 = 1;
+static const int kWireTypeLengthDelimited = 2;
+static const int kWireTypeFixed32 = 5;
+
+bool ReadVarint(const uint8_t** data, const uint8_t* end, uint64_t* value) {
+  const uint8_t* position = *data;
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && position < end; shift += 7) {
+    const uint8_t byte = *position++;
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      *data = position;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadFixed64(const uint8_t** data, const uint8_t* end, uint64_t* value) {
+  if (end - *data < 8) {
+    return false;
+  }
+  *data = google::protobuf::io::CodedInputStream::ReadLittleEndian64FromArray(*data, value);
+  return true;
+}
+
+bool ReadSize(const uint8_t** data, const uint8_t* end, size_t limit, size_t* size) {
+  uint64_t value = 0;
+  if (!ReadVarint(data, end, &value) || value > limit) {
+    return false;
+  }
+  *size = static_cast<size_t>(value);
+  return true;
+}
+
+// Skips the value of one field of an encoded message.
+bool SkipValue(int wire_type, const uint8_t** data, const uint8_t* end) {
+  uint64_t value = 0;
+  switch (wire_type) {
+  case kWireTypeVarint:
+    return ReadVarint(data, end, &value);
+  case kWireTypeFixed64:
+    return ReadFixed64(data, end, &value);
+  case kWireTypeLengthDelimited: {
+    size_t length = 0;
+    if (!ReadSize(data, end, end - *data, &length)) {
+      return false;
+    }
+    *data += length;
+  } return true;
+  case kWireTypeFixed32:
+    if (end - *data < 4) {
+      return false;
+    }
+    *data += 4;
+    return true;
+  default:
+    return false;
+  }
+}
+}
+
+SubtreeCache::SubtreeCache() {
+}
+
+SubtreeCache::~SubtreeCache() {
+}
+
+bool SubtreeCache::Load(const base::FilePath& file_path, std::string& error_message) {
+  Clear();
+  if (!base::PathExists(file_path)) {
+    return true;
+  }
+  if (!base::ReadFileToString(file_path, &file_data_)) {
+    error_message = "read subtree cache fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  if (!Parse(error_message)) {
+    Clear();
+    error_message += ": " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  return true;
+}
+
+bool SubtreeCache::Parse(std::string& error_message) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(file_data_.data());
+  const uint8_t* const begin = data;
+  const uint8_t* const end = data + file_data_.size();
+  uint32_t magic = 0;
+  uint64_t version = 0;
+  size_t entry_count = 0;
+  if (end - data < 4) {
+    error_message = "not a subtree cache";
+    return false;
+  }
+  data = google::protobuf::io::CodedInputStream::ReadLittleEndian32FromArray(data, &magic);
+  if (magic != kMagic) {
+    error_message = "not a subtree cache";
+    return false;
+  }
+  if (!ReadVarint(&data, end, &version) || version != kVersion) {
+    error_message = "unknown subtree cache version";
+    return false;
+  }
+  // 每个条目至少 18 个字节, 条目数不可能比这更多
+  if (!ReadSize(&data, end, (end - data) / 18, &entry_count)) {
+    error_message = "broken subtree cache";
+    return false;
+  }
+  entries_.reserve(entry_count);
+  for (size_t index = 0; index < entry_count; ++index) {
+    Entry entry;
+    size_t own_size = 0;
+    size_t child_count = 0;
+    if (!ReadFixed64(&data, end, &entry.content_hash) ||
+        !ReadFixed64(&data, end, &entry.shape_hash) ||
+        !ReadSize(&data, end, end - data, &own_size)) {
+      error_message = "broken subtree cache";
+      return false;
+    }
+    entry.own_bytes = base::StringPiece(
+      file_data_.data() + (data - begin), own_size);
+    data += own_size;
+    if (!ReadSize(&data, end, end - data, &child_count)) {
+      error_message = "broken subtree cache";
+      return false;
+    }
+    entry.children.resize(child_count);
+    size_t last_offset = 0;
+    int last_field_number = 0;
+    for (ChildRef& child : entry.children) {
+      size_t field_number = 0;
+      // 子条目总是写在父条目前面
+      if (entries_.empty() ||
+          !ReadSize(&data, end, own_size, &child.offset) ||
+          !ReadSize(&data, end, 0x1fffffff, &field_number) ||
+          !ReadSize(&data, end, entries_.size() - 1, &child.entry) ||
+          child.offset < last_offset ||
+          static_cast<int>(field_number) <= last_field_number) {
+        error_message = "broken subtree cache";
+        return false;
+      }
+      child.field_number = static_cast<int>(field_number);
+      last_offset = child.offset;
+      last_field_number = child.field_number;
+    }
+    AddEntry(std::move(entry));
+  }
+  if (data != end) {
+    error_message = "broken subtree cache";
+    return false;
+  }
+  return true;
+}
+
+bool SubtreeCache::Store(const base::FilePath& file_path, std::string& error_message) const {
+  std::string data;
+  {
+    google::protobuf::io::StringOutputStream string_output(&data);
+    google::protobuf::io::CodedOutputStream coded_output(&string_output);
+    coded_output.WriteLittleEndian32(kMagic);
+    coded_output.WriteVarint32(kVersion);
+    coded_output.WriteVarint64(entries_.size());
+    for (const Entry& entry : entries_) {
+      coded_output.WriteLittleEndian64(entry.content_hash);
+      coded_output.WriteLittleEndian64(entry.shape_hash);
+      coded_output.WriteVarint64(entry.own_bytes.size());
+      coded_output.WriteRaw(entry.own_bytes.data(), static_cast<int>(entry.own_bytes.size()));
+      coded_output.WriteVarint64(entry.children.size());
+      for (const ChildRef& child : entry.children) {
+        coded_output.WriteVarint64(child.offset);
+        coded_output.WriteVarint32(static_cast<uint32_t>(child.field_number));
+        coded_output.WriteVarint64(child.entry);
+      }
+    }
+  }
+
+  // 先写临时文件再替换, 中途失败时上一次的旁路文件还在
+  base::FilePath temp_file_path;
+  if (!base::CreateTemporaryFileInDir(file_path.DirName(), &temp_file_path)) {
+    error_message = "create temporary file fail: " + file_path.DirName().AsUTF8Unsafe();
+    return false;
+  }
+  if (base::WriteFile(temp_file_path, data.data(), static_cast<int>(data.size())) !=
+      static_cast<int>(data.size()) ||
+      !base::ReplaceFile(temp_file_path, file_path, nullptr)) {
+    base::DeleteFile(temp_file_path, false);
+    error_message = "write subtree cache fail: " + file_path.AsUTF8Unsafe();
+    return false;
+  }
+  return true;
+}
+
+size_t SubtreeCache::Find(uint64_t content_hash, uint64_t shape_hash) const {
+  auto iter = entry_index_.find(Key(content_hash, shape_hash));
+  return iter == entry_index_.end() ? kNotFound : iter->second;
+}
+
+size_t SubtreeCache::Add(
+  uint64_t content_hash,
+  uint64_t shape_hash,
+  std::string own_bytes,
+  std::vector<ChildRef> children) {
+  size_t index = Find(content_hash, shape_hash);
+  if (index != kNotFound) {
+    return index;
+  }
+
+  // 序列化按字段号从小到大写, 子树插在第一个字段号更大的字段前面,
+  // 拼出来的和整个 message 一起序列化的结果一样
+  const uint8_t* const begin = reinterpret_cast<const uint8_t*>(own_bytes.data());
+  const uint8_t* const end = begin + own_bytes.size();
+  const uint8_t* data = begin;
+  size_t child = 0;
+  while (child < children.size() && data < end) {
+    const size_t offset = data - begin;
+    uint64_t tag = 0;
+    if (!ReadVarint(&data, end, &tag) ||
+        !SkipValue(static_cast<int>(tag & 7), &data, end)) {
+      NOTREACHED() << "broken message encoding";
+      break;
+    }
+    const uint64_t field_number = tag >> 3;
+    while (child < children.size() &&
+           static_cast<uint64_t>(children[child].field_number) < field_number) {
+      children[child++].offset = offset;
+    }
+  }
+  for (; child < children.size(); ++child) {
+    children[child].offset = own_bytes.size();
+  }
+
+  own_bytes_.push_back(std::move(own_bytes));
+  Entry entry;
+  entry.content_hash = content_hash;
+  entry.shape_hash = shape_hash;
+  entry.own_bytes = own_bytes_.back();
+  entry.children = std::move(children);
+  return AddEntry(std::move(entry));
+}
+
+size_t SubtreeCache::CopyFrom(const SubtreeCache& other, size_t index) {
+  const Entry& other_entry = other.entries_[index];
+  size_t copied_index = Find(other_entry.content_hash, other_entry.shape_hash);
+  if (copied_index != kNotFound) {
+    return copied_index;
+  }
+  Entry entry;
+  entry.content_hash = other_entry.content_hash;
+  entry.shape_hash = other_entry.shape_hash;
+  entry.own_bytes = other_entry.own_bytes;
+  entry.children = other_entry.children;
+  for (ChildRef& child : entry.children) {
+    child.entry = CopyFrom(other, child.entry);
+  }
+  return AddEntry(std::move(entry));
+}
+
+void SubtreeCache::WriteBody(
+  size_t index,
+  google::protobuf::io::CodedOutputStream* coded_output) const {
+  const Entry& entry = entries_[index];
+  size_t written = 0;
+  for (const ChildRef& child : entry.children) {
+    coded_output->WriteRaw(entry.own_bytes.data() + written,
+      static_cast<int>(child.offset - written));
+    written = child.offset;
+    coded_output->WriteTag(static_cast<uint32_t>(child.field_number) << 3 |
+      kWireTypeLengthDelimited);
+    coded_output->WriteVarint64(entries_[child.entry].body_size);
+    WriteBody(child.entry, coded_output);
+  }
+  coded_output->WriteRaw(entry.own_bytes.data() + written,
+    static_cast<int>(entry.own_bytes.size() - written));
+}
+
+size_t SubtreeCache::AddEntry(Entry entry) {
+  entry.body_size = entry.own_bytes.size();
+  for (const ChildRef& child : entry.children) {
+    const uint64_t child_size = entries_[child.entry].body_size;
+    entry.body_size += google::protobuf::io::CodedOutputStream::VarintSize32(
+      static_cast<uint32_t>(child.field_number) << 3 | kWireTypeLengthDelimited);
+    entry.body_size +=
+      google::protobuf::io::CodedOutputStream::VarintSize64(child_size) + child_size;
+  }
+  const size_t index = entries_.size();
+  entry_index_[Key(entry.content_hash, entry.shape_hash)] = index;
+  entries_.push_back(std::move(entry));
+  return index;
+}
+
+void SubtreeCache::Clear() {
+  entries_.clear();
+  entry_index_.clear();
+  own_bytes_.clear();
+  file_data_.clear();
+}
+
+} //namespace self
@@ -0,0 +1,114 @@
+#ifndef SUBTREE_CACHE_H_
+#define SUBTREE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace google {
+namespace protobuf {
+namespace io {
+class CodedOutputStream;
+} // namespace io
+} // namespace protobuf
+} // google
+
+namespace self {
+
+// The sidecar IncrementalConverter keeps next to its output: the encoded
+// message of json subtrees, keyed by the hash of the subtree's content and
+// the hash of its message type. An entry holds only the bytes of its own
+// fields plus where the encodings of its child subtrees go, so a subtree
+// nested in another is stored once.
+class SubtreeCache {
+public:
+  static const size_t kNotFound = static_cast<size_t>(-1);
+
+  struct ChildRef {
+    // Where the child goes in the parent's own bytes.
+    size_t offset;
+    int field_number;
+    // Index of the child's entry in the same cache.
+    size_t entry;
+  };
+
+  struct Entry {
+    uint64_t content_hash;
+    uint64_t shape_hash;
+    base::StringPiece own_bytes;
+    // Ascending by field number and offset.
+    std::vector<ChildRef> children;
+    // The size of the message with its children filled in.
+    uint64_t body_size;
+  };
+
+  SubtreeCache();
+
+  ~SubtreeCache();
+
+  // Replaces the entries with the ones stored at |file_path|. A missing file
+  // gives an empty cache. A damaged one too, but Load() fails.
+  bool Load(const base::FilePath& file_path, std::string& error_message);
+
+  // Writes a temporary file next to |file_path| and moves it over, readers
+  // never see half a cache.
+  bool Store(const base::FilePath& file_path, std::string& error_message) const;
+
+  // Returns kNotFound on a miss.
+  size_t Find(uint64_t content_hash, uint64_t shape_hash) const;
+
+  // |children| are entries of this cache, ascending by field number. Returns
+  // the index of the entry, an existing one when the key is already there.
+  size_t Add(
+    uint64_t content_hash,
+    uint64_t shape_hash,
+    std::string own_bytes,
+    std::vector<ChildRef> children);
+
+  // Copies entry |index| of |other| and every entry under it, the bytes stay
+  // where they are so |other| has to outlive this cache.
+  size_t CopyFrom(const SubtreeCache& other, size_t index);
+
+  // Writes the encoding of entry |index| with its children filled in, no tag
+  // or length in front.
+  void WriteBody(size_t index, google::protobuf::io::CodedOutputStream* coded_output) const;
+
+  const Entry& entry(size_t index) const { return entries_[index]; }
+  size_t entry_count() const { return entries_.size(); }
+
+private:
+  typedef std::pair<uint64_t, uint64_t> Key;
+
+  size_t AddEntry(Entry entry);
+
+  void Clear();
+
+  bool Parse(std::string& error_message);
+
+private:
+  // The loaded file, the entries of a loaded cache point into it.
+  std::string file_data_;
+  // Bytes of added entries. A deque never moves what it holds.
+  std::deque<std::string> own_bytes_;
+  // Children come before their parents.
+  std::vector<Entry> entries_;
+  std::map<Key, size_t> entry_index_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(SubtreeCache);
+};
+
+} // namespace self
+#endif // SUBTREE_CACHE_H_
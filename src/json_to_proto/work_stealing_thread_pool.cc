@@ -0,0 +1,99 @@
+#include "work_stealing_thread_pool.h"
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/threading/simple_thread.h"
+
+namespace self {
+
+class WorkStealingThreadPool::Worker : public base::DelegateSimpleThread::Delegate {
+public:
+  Worker(
+    WorkStealingThreadPool* thread_pool,
+    int worker_index,
+    WorkStealingThreadPool::Delegate* delegate)
+    : thread_pool_(thread_pool),
+      worker_index_(worker_index),
+      delegate_(delegate) {
+  }
+
+  void Run() override {
+    size_t task_index = 0;
+    while (thread_pool_->PopTask(worker_index_, &task_index)) {
+      delegate_->RunTask(task_index, worker_index_);
+    }
+  }
+
+private:
+  WorkStealingThreadPool* thread_pool_;
+  const int worker_index_;
+  WorkStealingThreadPool::Delegate* delegate_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
+WorkStealingThreadPool::WorkStealingThreadPool(int worker_count)
+  : worker_count_(worker_count > 0 ? worker_count : 1),
+    steal_count_(0) {
+  for (int index = 0; index < worker_count_; index++) {
+    task_queues_.emplace_back(new TaskQueue());
+  }
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+}
+
+void WorkStealingThreadPool::Run(size_t task_count, Delegate* delegate) {
+  DCHECK(delegate);
+  steal_count_ = 0;
+  // 连续的任务分给同一个 worker, 输入通常按目录排好, 相邻的文件结构相近
+  for (int index = 0; index < worker_count_; index++) {
+    size_t begin = task_count * index / worker_count_;
+    size_t end = task_count * (index + 1) / worker_count_;
+    base::AutoLock auto_lock(task_queues_[index]->lock);
+    for (size_t task_index = begin; task_index < end; task_index++) {
+      task_queues_[index]->task_indexes.push_back(task_index);
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (int index = 0; index < worker_count_; index++) {
+    workers.emplace_back(new Worker(this, index, delegate));
+    threads.emplace_back(new base::DelegateSimpleThread(
+      workers.back().get(), "json_to_proto_worker_" + base::IntToString(index)));
+    threads.back()->Start();
+  }
+  for (auto& thread : threads) {
+    thread->Join();
+  }
+}
+
+bool WorkStealingThreadPool::PopTask(int worker_index, size_t* task_index) {
+  {
+    TaskQueue* task_queue = task_queues_[worker_index].get();
+    base::AutoLock auto_lock(task_queue->lock);
+    if (!task_queue->task_indexes.empty()) {
+      *task_index = task_queue->task_indexes.front();
+      task_queue->task_indexes.pop_front();
+      return true;
+    }
+  }
+
+  // 任务在 Run() 开始前就全部入队了, 所有队列都空说明没有活了
+  for (int offset = 1; offset < worker_count_; offset++) {
+    TaskQueue* task_queue = task_queues_[(worker_index + offset) % worker_count_].get();
+    base::AutoLock auto_lock(task_queue->lock);
+    if (!task_queue->task_indexes.empty()) {
+      *task_index = task_queue->task_indexes.back();
+      task_queue->task_indexes.pop_back();
+      base::AutoLock steal_count_auto_lock(steal_count_lock_);
+      steal_count_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+} //namespace self
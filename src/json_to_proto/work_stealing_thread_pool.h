@@ -0,0 +1,66 @@
+#ifndef WORK_STEALING_THREAD_POOL_H_
+#define WORK_STEALING_THREAD_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+
+namespace self {
+
+// Runs a fixed set of tasks on |worker_count| threads. Every worker starts
+// with a contiguous block of task indexes and takes them from the front of
+// its own queue. A worker whose queue is empty steals from the back of the
+// other queues, so a few slow tasks do not leave the other cores idle.
+class WorkStealingThreadPool {
+public:
+  class Delegate {
+  public:
+    virtual ~Delegate() {}
+
+    // Called on worker |worker_index| once for every task index. Tasks on
+    // different workers run concurrently.
+    virtual void RunTask(size_t task_index, int worker_index) = 0;
+  };
+
+  explicit WorkStealingThreadPool(int worker_count);
+
+  ~WorkStealingThreadPool();
+
+  // Runs tasks [0, task_count) and returns when all of them are done.
+  void Run(size_t task_count, Delegate* delegate);
+
+  int worker_count() const { return worker_count_; }
+
+  // Tasks that ran on another worker than the one they were queued on, in
+  // the last Run().
+  int64_t steal_count() const { return steal_count_; }
+
+private:
+  class Worker;
+
+  struct TaskQueue {
+    base::Lock lock;
+    std::deque<size_t> task_indexes;
+  };
+
+  bool PopTask(int worker_index, size_t* task_index);
+
+private:
+  const int worker_count_;
+  std::vector<std::unique_ptr<TaskQueue>> task_queues_;
+
+  base::Lock steal_count_lock_;
+  int64_t steal_count_;
+
+private:
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingThreadPool);
+};
+
+} // namespace self
+#endif // WORK_STEALING_THREAD_POOL_H_
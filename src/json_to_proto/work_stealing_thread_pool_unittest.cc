@@ -0,0 +1,127 @@
+#include "work_stealing_thread_pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace self {
+
+namespace {
+
+class CountingDelegate : public WorkStealingThreadPool::Delegate {
+public:
+  CountingDelegate(size_t task_count, int worker_count)
+    : run_counts_(new std::atomic<int>[task_count]),
+      worker_count_(worker_count),
+      bad_worker_index_(false) {
+    for (size_t i = 0; i < task_count; ++i) {
+      run_counts_[i] = 0;
+    }
+  }
+
+  void RunTask(size_t task_index, int worker_index) override {
+    ++run_counts_[task_index];
+    if (worker_index < 0 || worker_index >= worker_count_) {
+      bad_worker_index_ = true;
+    }
+  }
+
+  int run_count(size_t task_index) const { return run_counts_[task_index]; }
+  bool bad_worker_index() const { return bad_worker_index_; }
+
+private:
+  std::unique_ptr<std::atomic<int>[]> run_counts_;
+  const int worker_count_;
+  std::atomic<bool> bad_worker_index_;
+};
+
+// 第一个任务等到其它任务都做完才返回, 和它同一个队列的任务只能被偷走
+class BlockingDelegate : public WorkStealingThreadPool::Delegate {
+public:
+  explicit BlockingDelegate(size_t task_count)
+    : task_count_(task_count),
+      done_count_(0),
+      done_cond_(&lock_),
+      timed_out_(false) {
+  }
+
+  void RunTask(size_t task_index, int worker_index) override {
+    base::AutoLock auto_lock(lock_);
+    if (task_index != 0) {
+      ++done_count_;
+      done_cond_.Signal();
+      return;
+    }
+    const base::TimeTicks deadline =
+      base::TimeTicks::Now() + base::TimeDelta::FromMilliseconds(10000);
+    while (done_count_ + 1 < task_count_) {
+      const base::TimeTicks now = base::TimeTicks::Now();
+      if (now >= deadline) {
+        timed_out_ = true;
+        return;
+      }
+      done_cond_.TimedWait(deadline - now);
+    }
+  }
+
+  size_t done_count() {
+    base::AutoLock auto_lock(lock_);
+    return done_count_;
+  }
+
+  bool timed_out() {
+    base::AutoLock auto_lock(lock_);
+    return timed_out_;
+  }
+
+private:
+  const size_t task_count_;
+  base::Lock lock_;
+  size_t done_count_;
+  base::ConditionVariable done_cond_;
+  bool timed_out_;
+};
+
+} // namespace
+
+TEST(WorkStealingThreadPoolTest, EveryTaskRunsOnce) {
+  for (int worker_count : {1, 2, 4, 7}) {
+    WorkStealingThreadPool thread_pool(worker_count);
+    EXPECT_EQ(worker_count, thread_pool.worker_count());
+    for (size_t task_count : {0, 1, 3, 100}) {
+      SCOPED_TRACE(testing::Message() << worker_count << " workers, "
+                                      << task_count << " tasks");
+      // 同一个 pool 可以 Run 多次
+      for (int run = 0; run < 2; ++run) {
+        CountingDelegate delegate(task_count, worker_count);
+        thread_pool.Run(task_count, &delegate);
+        for (size_t i = 0; i < task_count; ++i) {
+          EXPECT_EQ(1, delegate.run_count(i)) << "task " << i;
+        }
+        EXPECT_FALSE(delegate.bad_worker_index());
+      }
+    }
+  }
+}
+
+// A worker held up by a slow task does not hold up the rest of its queue.
+TEST(WorkStealingThreadPoolTest, IdleWorkerSteals) {
+  const size_t kTaskCount = 8;
+  WorkStealingThreadPool thread_pool(2);
+  BlockingDelegate delegate(kTaskCount);
+  thread_pool.Run(kTaskCount, &delegate);
+  EXPECT_FALSE(delegate.timed_out());
+  EXPECT_EQ(kTaskCount - 1, delegate.done_count());
+  // 任务 1 到 3 和任务 0 排在同一个队列里
+  EXPECT_GE(thread_pool.steal_count(), 3);
+}
+
+} // namespace self
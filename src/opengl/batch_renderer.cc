@@ -0,0 +1,207 @@
+#include "batch_renderer.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "frame_profiler.h"
+
+namespace self {
+
+namespace {
+const size_t kQuadVertexCount = 4;
+const size_t kQuadIndexCount = 6;
+const GLuint kQuadIndices[kQuadIndexCount] = {0, 1, 2, 2, 3, 0};
+}
+
+BatchRenderer::BatchRenderer(StreamingBuffer::Mode mode)
+  : vertex_buffer_(GL_ARRAY_BUFFER, sizeof(BatchVertex), mode),
+    index_buffer_(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint), mode),
+    vertex_array_(0),
+    draw_per_object_(false),
+    last_group_(0) {
+}
+
+BatchRenderer::~BatchRenderer() {
+  if (vertex_array_) {
+    glDeleteVertexArrays(1, &vertex_array_);
+  }
+}
+
+void BatchRenderer::Initialize(size_t quads_per_frame) {
+  glGenVertexArrays(1, &vertex_array_);
+  glBindVertexArray(vertex_array_);
+  vertex_buffer_.Initialize(quads_per_frame * kQuadVertexCount * sizeof(BatchVertex));
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex),
+    reinterpret_cast<void*>(offsetof(BatchVertex, position)));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(BatchVertex),
+    reinterpret_cast<void*>(offsetof(BatchVertex, color)));
+  glEnableVertexAttribArray(1);
+  // element array buffer 的绑定是 vertex array 的状态
+  index_buffer_.Initialize(quads_per_frame * kQuadIndexCount * sizeof(GLuint));
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void BatchRenderer::AddGeometry(
+  GLuint program,
+  const BatchVertex* vertices,
+  size_t vertex_count,
+  const GLuint* indices,
+  size_t index_count) {
+  Group* group = FindOrAddGroup(program);
+  const GLuint first_vertex = static_cast<GLuint>(group->vertices.size());
+  group->vertices.insert(group->vertices.end(), vertices, vertices + vertex_count);
+  for (size_t index = 0; index < index_count; index++) {
+    group->indices.push_back(first_vertex + indices[index]);
+  }
+  group->object_index_counts.push_back(static_cast<GLsizei>(index_count));
+}
+
+void BatchRenderer::AddQuad(
+  GLuint program,
+  float x,
+  float y,
+  float width,
+  float height,
+  const unsigned char color[4]) {
+  BatchVertex vertices[kQuadVertexCount] = {
+    {{x, y}, {color[0], color[1], color[2], color[3]}},
+    {{x + width, y}, {color[0], color[1], color[2], color[3]}},
+    {{x + width, y + height}, {color[0], color[1], color[2], color[3]}},
+    {{x, y + height}, {color[0], color[1], color[2], color[3]}},
+  };
+  AddGeometry(program, vertices, kQuadVertexCount, kQuadIndices, kQuadIndexCount);
+}
+
+bool BatchRenderer::Flush(FrameProfiler* profiler, std::string& error_message) {
+  draw_order_.clear();
+  size_t vertex_count = 0;
+  size_t index_count = 0;
+  for (size_t index = 0; index < groups_.size(); index++) {
+    if (!groups_[index].indices.empty()) {
+      draw_order_.push_back(index);
+      vertex_count += groups_[index].vertices.size();
+      index_count += groups_[index].indices.size();
+    }
+  }
+  if (draw_order_.empty()) {
+    return true;
+  }
+  // 同一个 program 和 vertex array 的排在一起, 每种状态只切换一次
+  std::sort(draw_order_.begin(), draw_order_.end(), [this](size_t left, size_t right) {
+    const Group& left_group = groups_[left];
+    const Group& right_group = groups_[right];
+    if (left_group.program != right_group.program) {
+      return left_group.program < right_group.program;
+    }
+    return left_group.vertex_array < right_group.vertex_array;
+  });
+
+  // 整帧的顶点和索引各映射一次
+  glBindVertexArray(vertex_array_);
+  size_t vertex_offset = 0;
+  size_t index_offset = 0;
+  BatchVertex* vertex_data = static_cast<BatchVertex*>(
+    vertex_buffer_.Map(vertex_count * sizeof(BatchVertex), &vertex_offset));
+  bool result = vertex_data != nullptr;
+  if (result) {
+    for (size_t group_index : draw_order_) {
+      const Group& group = groups_[group_index];
+      memcpy(vertex_data, group.vertices.data(), group.vertices.size() * sizeof(BatchVertex));
+      vertex_data += group.vertices.size();
+    }
+    result = vertex_buffer_.Unmap();
+  }
+  GLuint* index_data = result ? static_cast<GLuint*>(
+    index_buffer_.Map(index_count * sizeof(GLuint), &index_offset)) : nullptr;
+  result = index_data != nullptr;
+  if (result) {
+    for (size_t group_index : draw_order_) {
+      const Group& group = groups_[group_index];
+      memcpy(index_data, group.indices.data(), group.indices.size() * sizeof(GLuint));
+      index_data += group.indices.size();
+    }
+    result = index_buffer_.Unmap();
+  }
+  if (!result) {
+    error_message = "map streaming buffer fail";
+  }
+
+  GLuint current_program = 0;
+  GLuint current_vertex_array = vertex_array_;
+  if (profiler) {
+    profiler->CountStateChange();
+  }
+  GLint base_vertex = static_cast<GLint>(vertex_offset / sizeof(BatchVertex));
+  size_t first_index = index_offset / sizeof(GLuint);
+  for (size_t group_index : draw_order_) {
+    Group& group = groups_[group_index];
+    if (result) {
+      if (group.program != current_program) {
+        glUseProgram(group.program);
+        current_program = group.program;
+        if (profiler) {
+          profiler->CountStateChange();
+        }
+      }
+      if (group.vertex_array != current_vertex_array) {
+        glBindVertexArray(group.vertex_array);
+        current_vertex_array = group.vertex_array;
+        if (profiler) {
+          profiler->CountStateChange();
+        }
+      }
+      if (draw_per_object_) {
+        size_t object_first_index = first_index;
+        for (GLsizei object_index_count : group.object_index_counts) {
+          glDrawElementsBaseVertex(GL_TRIANGLES, object_index_count, GL_UNSIGNED_INT,
+            reinterpret_cast<void*>(object_first_index * sizeof(GLuint)), base_vertex);
+          object_first_index += object_index_count;
+        }
+        if (profiler) {
+          for (size_t index = 0; index < group.object_index_counts.size(); index++) {
+            profiler->CountDrawCall();
+          }
+        }
+      } else {
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(group.indices.size()),
+          GL_UNSIGNED_INT, reinterpret_cast<void*>(first_index * sizeof(GLuint)), base_vertex);
+        if (profiler) {
+          profiler->CountDrawCall();
+        }
+      }
+    }
+    base_vertex += static_cast<GLint>(group.vertices.size());
+    first_index += group.indices.size();
+    // 留着容量, 下一帧不用再分配
+    group.vertices.clear();
+    group.indices.clear();
+    group.object_index_counts.clear();
+  }
+  glBindVertexArray(0);
+  vertex_buffer_.EndFrame();
+  index_buffer_.EndFrame();
+  return result;
+}
+
+BatchRenderer::Group* BatchRenderer::FindOrAddGroup(GLuint program) {
+  if (last_group_ < groups_.size() && groups_[last_group_].program == program) {
+    return &groups_[last_group_];
+  }
+  for (size_t index = 0; index < groups_.size(); index++) {
+    if (groups_[index].program == program) {
+      last_group_ = index;
+      return &groups_[index];
+    }
+  }
+  groups_.emplace_back();
+  groups_.back().program = program;
+  groups_.back().vertex_array = vertex_array_;
+  last_group_ = groups_.size() - 1;
+  return &groups_.back();
+}
+
+} //namespace self
@@ -0,0 +1,102 @@
+#ifndef BATCH_RENDERER_H_
+#define BATCH_RENDERER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "streaming_buffer.h"
+#include "third_party/glad/include/glad/glad.h"
+
+namespace self {
+
+class FrameProfiler;
+
+struct BatchVertex {
+  float position[2];
+  // Normalized to 0..1 in the shader.
+  unsigned char color[4];
+};
+
+// Collects the geometry of a frame, often many small quads, and draws it
+// with as few draw calls as there are distinct programs and vertex arrays.
+// The geometry is grouped by program and vertex array as it is added,
+// the groups are sorted so each state change happens once, then the whole
+// frame is copied into a streaming vertex and index buffer with one mapping
+// each and drawn with one glDrawElementsBaseVertex() per group.
+//
+// The vertex array has BatchVertex positions at attribute 0 and colors at
+// attribute 1, the programs have to use those locations.
+class BatchRenderer {
+public:
+  explicit BatchRenderer(StreamingBuffer::Mode mode);
+
+  ~BatchRenderer();
+
+  // |quads_per_frame| sizes the streaming buffers, they grow when a frame
+  // has more.
+  void Initialize(size_t quads_per_frame);
+
+  // One draw call per AddGeometry() instead of per group, the unbatched
+  // baseline. Off by default.
+  void set_draw_per_object(bool draw_per_object) { draw_per_object_ = draw_per_object; }
+
+  // Triangles of |program|, |indices| count from the first of |vertices|.
+  void AddGeometry(
+    GLuint program,
+    const BatchVertex* vertices,
+    size_t vertex_count,
+    const GLuint* indices,
+    size_t index_count);
+
+  // Two triangles from (x, y) to (x + width, y + height).
+  void AddQuad(
+    GLuint program,
+    float x,
+    float y,
+    float width,
+    float height,
+    const unsigned char color[4]);
+
+  // Draws the geometry added since the last Flush() and forgets it. Counts
+  // the draw calls and the state changes on |profiler|, which may be null.
+  bool Flush(FrameProfiler* profiler, std::string& error_message);
+
+  GLuint vertex_array() const { return vertex_array_; }
+  const StreamingBuffer& vertex_buffer() const { return vertex_buffer_; }
+  const StreamingBuffer& index_buffer() const { return index_buffer_; }
+
+private:
+  // The geometry of one program and vertex array in a frame, the order it
+  // was added in is kept within the group.
+  struct Group {
+    GLuint program;
+    GLuint vertex_array;
+    std::vector<BatchVertex> vertices;
+    std::vector<GLuint> indices;
+    // The index count of every AddGeometry(), for draw_per_object_.
+    std::vector<GLsizei> object_index_counts;
+  };
+
+  Group* FindOrAddGroup(GLuint program);
+
+private:
+  StreamingBuffer vertex_buffer_;
+  StreamingBuffer index_buffer_;
+  GLuint vertex_array_;
+  bool draw_per_object_;
+
+  // Kept across frames with their capacity, empty ones are skipped.
+  std::vector<Group> groups_;
+  // The group of the last AddGeometry(), quads usually come in runs.
+  size_t last_group_;
+  std::vector<size_t> draw_order_;
+
+private:
+  BatchRenderer(const BatchRenderer&) = delete;
+  BatchRenderer& operator=(const BatchRenderer&) = delete;
+};
+
+} // namespace self
+#endif // BATCH_RENDERER_H_
@@ -0,0 +1,159 @@
+#include "batch_scene.h"
+
+#include <math.h>
+
+#include "frame_profiler.h"
+
+namespace self {
+
+namespace {
+const char kVertexShaderSource[] =
+    "#version 330 core\n"
+    "layout (location = 0) in vec2 aPos;\n"
+    "layout (location = 1) in vec4 aColor;\n"
+    "out vec4 vertexColor;\n"
+    "void main()\n"
+    "{\n"
+    "   gl_Position = vec4(aPos, 0.0, 1.0);\n"
+    "   vertexColor = aColor;\n"
+    "}\n";
+const char* const kFragmentShaderSources[] = {
+    "#version 330 core\n"
+    "in vec4 vertexColor;\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "   FragColor = vertexColor;\n"
+    "}\n",
+    // 第二个 program 只是换一下颜色, 让排序有东西可排
+    "#version 330 core\n"
+    "in vec4 vertexColor;\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "   FragColor = vec4(vertexColor.bgr, 1.0);\n"
+    "}\n",
+};
+// quad 的边长, 以 NDC 计, 800x600 上两三个像素
+const float kQuadSize = 0.006f;
+const float kDriftDistance = 0.02f;
+const float kDriftSpeed = 0.05f;
+
+GLuint CompileShader(GLenum type, const char* source, std::string& error_message) {
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+  GLint success = 0;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success) {
+    char info_log[512] = {0};
+    glGetShaderInfoLog(shader, sizeof(info_log), nullptr, info_log);
+    error_message = std::string("shader compilation failed: ") + info_log;
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+GLuint LinkProgram(const char* fragment_shader_source, std::string& error_message) {
+  GLuint vertex_shader = CompileShader(GL_VERTEX_SHADER, kVertexShaderSource, error_message);
+  if (!vertex_shader) {
+    return 0;
+  }
+  GLuint fragment_shader =
+    CompileShader(GL_FRAGMENT_SHADER, fragment_shader_source, error_message);
+  if (!fragment_shader) {
+    glDeleteShader(vertex_shader);
+    return 0;
+  }
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  glLinkProgram(program);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+  GLint success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    char info_log[512] = {0};
+    glGetProgramInfoLog(program, sizeof(info_log), nullptr, info_log);
+    error_message = std::string("program linking failed: ") + info_log;
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+// 固定种子, 每次跑的场景一样, 最后一帧可以当 golden image
+unsigned int NextRandom(unsigned int* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+float RandomFloat(unsigned int* state) {
+  return (NextRandom(state) & 0xffff) / 65535.0f;
+}
+}
+
+BatchScene::BatchScene(StreamingBuffer::Mode mode)
+  : renderer_(mode) {
+  programs_[0] = 0;
+  programs_[1] = 0;
+}
+
+BatchScene::~BatchScene() {
+  for (GLuint program : programs_) {
+    if (program) {
+      glDeleteProgram(program);
+    }
+  }
+}
+
+bool BatchScene::Initialize(int quad_count, bool draw_per_object, std::string& error_message) {
+  for (int index = 0; index < 2; index++) {
+    programs_[index] = LinkProgram(kFragmentShaderSources[index], error_message);
+    if (!programs_[index]) {
+      return false;
+    }
+  }
+  renderer_.Initialize(quad_count);
+  renderer_.set_draw_per_object(draw_per_object);
+
+  unsigned int random_state = 2018052116u;
+  quads_.resize(quad_count);
+  for (Quad& quad : quads_) {
+    quad.x = RandomFloat(&random_state) * 2.0f - 1.0f;
+    quad.y = RandomFloat(&random_state) * 2.0f - 1.0f;
+    quad.size = kQuadSize * (0.5f + RandomFloat(&random_state));
+    quad.phase = RandomFloat(&random_state) * 6.2831853f;
+    quad.color[0] = static_cast<unsigned char>(NextRandom(&random_state));
+    quad.color[1] = static_cast<unsigned char>(NextRandom(&random_state));
+    quad.color[2] = static_cast<unsigned char>(NextRandom(&random_state));
+    quad.color[3] = 255;
+  }
+  return true;
+}
+
+bool BatchScene::Render(FrameProfiler* profiler, int frame, std::string& error_message) {
+  {
+    ScopedProfile scoped_profile(profiler, "clear");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    profiler->CountStateChange();
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  {
+    ScopedProfile scoped_profile(profiler, "build");
+    const float time = frame * kDriftSpeed;
+    for (size_t index = 0; index < quads_.size(); index++) {
+      const Quad& quad = quads_[index];
+      renderer_.AddQuad(programs_[index % 2],
+        quad.x + kDriftDistance * sinf(time + quad.phase),
+        quad.y + kDriftDistance * cosf(time + quad.phase),
+        quad.size, quad.size, quad.color);
+    }
+  }
+  ScopedProfile scoped_profile(profiler, "draw");
+  return renderer_.Flush(profiler, error_message);
+}
+
+} //namespace self
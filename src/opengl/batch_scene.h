@@ -0,0 +1,55 @@
+#ifndef BATCH_SCENE_H_
+#define BATCH_SCENE_H_
+
+#include <string>
+#include <vector>
+
+#include "batch_renderer.h"
+#include "streaming_buffer.h"
+#include "third_party/glad/include/glad/glad.h"
+
+namespace self {
+
+class FrameProfiler;
+
+// The benchmark scene of --quads: small quads drifting every frame, so the
+// geometry is rebuilt and streamed each frame like a real scene of dynamic
+// objects. Every other quad uses the second of two programs, added in that
+// interleaved order, so only sorting by program brings a frame down to two
+// draw calls.
+class BatchScene {
+public:
+  explicit BatchScene(StreamingBuffer::Mode mode);
+
+  ~BatchScene();
+
+  // See BatchRenderer::set_draw_per_object().
+  bool Initialize(int quad_count, bool draw_per_object, std::string& error_message);
+
+  // Clears, adds the quads where they are at |frame| and flushes, in the
+  // "clear", "build" and "draw" scopes of |profiler|.
+  bool Render(FrameProfiler* profiler, int frame, std::string& error_message);
+
+  const BatchRenderer& renderer() const { return renderer_; }
+
+private:
+  struct Quad {
+    float x;
+    float y;
+    float size;
+    float phase;
+    unsigned char color[4];
+  };
+
+private:
+  BatchRenderer renderer_;
+  std::vector<Quad> quads_;
+  GLuint programs_[2];
+
+private:
+  BatchScene(const BatchScene&) = delete;
+  BatchScene& operator=(const BatchScene&) = delete;
+};
+
+} // namespace self
+#endif // BATCH_SCENE_H_
@@ -0,0 +1,176 @@
+#include "frame_profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace self {
+
+namespace {
+const char kFrameScopeName[] = "frame";
+}
+
+FrameProfiler::FrameProfiler()
+  : gpu_timing_(false),
+    frame_count_(0),
+    read_frame_count_(0),
+    stall_count_(0),
+    frame_draw_calls_(0),
+    frame_state_changes_(0),
+    total_draw_calls_(0),
+    total_state_changes_(0),
+    max_draw_calls_(0),
+    max_state_changes_(0) {
+  for (FrameQueries& frame : frame_queries_) {
+    frame.used_query_count = 0;
+  }
+}
+
+FrameProfiler::~FrameProfiler() {
+  for (FrameQueries& frame : frame_queries_) {
+    if (!frame.queries.empty()) {
+      glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+    }
+  }
+}
+
+void FrameProfiler::Initialize() {
+  GLint timestamp_bits = 0;
+  glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &timestamp_bits);
+  gpu_timing_ = timestamp_bits > 0;
+}
+
+void FrameProfiler::BeginFrame() {
+  if (gpu_timing_ && frame_count_ - read_frame_count_ >= kLatencyFrames) {
+    // GPU 落后了一整圈, 只能等这一帧的结果, 不然 query 没法复用
+    ReadBackFrame(&frame_queries_[read_frame_count_ % kLatencyFrames]);
+    read_frame_count_++;
+    stall_count_++;
+  }
+  frame_draw_calls_ = 0;
+  frame_state_changes_ = 0;
+  BeginScope(kFrameScopeName);
+}
+
+void FrameProfiler::EndFrame() {
+  EndScope();
+  frame_count_++;
+  total_draw_calls_ += frame_draw_calls_;
+  total_state_changes_ += frame_state_changes_;
+  max_draw_calls_ = std::max(max_draw_calls_, frame_draw_calls_);
+  max_state_changes_ = std::max(max_state_changes_, frame_state_changes_);
+  if (gpu_timing_) {
+    ReadBackFrames(false);
+  }
+}
+
+void FrameProfiler::BeginScope(const char* name) {
+  OpenScope open_scope;
+  open_scope.scope = FindOrAddScope(name);
+  open_scope.queries_index = -1;
+  if (gpu_timing_) {
+    FrameQueries* frame = &frame_queries_[frame_count_ % kLatencyFrames];
+    ScopeQueries scope_queries;
+    scope_queries.scope = open_scope.scope;
+    scope_queries.begin_query = NextQuery(frame);
+    scope_queries.end_query = 0;
+    glQueryCounter(scope_queries.begin_query, GL_TIMESTAMP);
+    open_scope.queries_index = static_cast<int>(frame->scopes.size());
+    frame->scopes.push_back(scope_queries);
+  }
+  // 最后取 CPU 时间, query 的开销不算在 scope 里
+  open_scope.cpu_start = std::chrono::steady_clock::now();
+  open_scopes_.push_back(open_scope);
+}
+
+void FrameProfiler::EndScope() {
+  const std::chrono::steady_clock::time_point cpu_end = std::chrono::steady_clock::now();
+  const OpenScope open_scope = open_scopes_.back();
+  open_scopes_.pop_back();
+  scopes_[open_scope.scope]->cpu_times.Add(
+    std::chrono::duration<double, std::milli>(cpu_end - open_scope.cpu_start).count());
+  if (open_scope.queries_index >= 0) {
+    FrameQueries* frame = &frame_queries_[frame_count_ % kLatencyFrames];
+    ScopeQueries* scope_queries = &frame->scopes[open_scope.queries_index];
+    scope_queries->end_query = NextQuery(frame);
+    glQueryCounter(scope_queries->end_query, GL_TIMESTAMP);
+  }
+}
+
+void FrameProfiler::Finish() {
+  if (gpu_timing_) {
+    ReadBackFrames(true);
+  }
+}
+
+void FrameProfiler::Print() const {
+  TimeDistribution::PrintHeader("scope");
+  for (const std::unique_ptr<Scope>& scope : scopes_) {
+    scope->cpu_times.Print((scope->name + " cpu").c_str());
+    if (gpu_timing_) {
+      scope->gpu_times.Print((scope->name + " gpu").c_str());
+    }
+  }
+  const double frame_count = static_cast<double>(std::max(frame_count_, 1LL));
+  printf("per frame: %.1f draw calls (max %d), %.1f state changes (max %d)\n",
+    total_draw_calls_ / frame_count, max_draw_calls_,
+    total_state_changes_ / frame_count, max_state_changes_);
+  if (gpu_timing_) {
+    printf("gpu queries read up to %d frames late, %d reads waited\n",
+      kLatencyFrames, stall_count_);
+  } else {
+    printf("no gpu timestamps\n");
+  }
+}
+
+size_t FrameProfiler::FindOrAddScope(const char* name) {
+  for (size_t index = 0; index < scopes_.size(); index++) {
+    if (scopes_[index]->name == name) {
+      return index;
+    }
+  }
+  scopes_.emplace_back(new Scope());
+  scopes_.back()->name = name;
+  return scopes_.size() - 1;
+}
+
+GLuint FrameProfiler::NextQuery(FrameQueries* frame) {
+  if (frame->used_query_count == frame->queries.size()) {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    frame->queries.push_back(query);
+  }
+  return frame->queries[frame->used_query_count++];
+}
+
+void FrameProfiler::ReadBackFrames(bool wait_for_all) {
+  while (read_frame_count_ < frame_count_) {
+    FrameQueries* frame = &frame_queries_[read_frame_count_ % kLatencyFrames];
+    if (!wait_for_all && frame->used_query_count > 0) {
+      // 同一帧的 query 按顺序完成, 看最后一个就够了
+      GLint available = 0;
+      glGetQueryObjectiv(frame->queries[frame->used_query_count - 1],
+        GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        return;
+      }
+    }
+    ReadBackFrame(frame);
+    read_frame_count_++;
+  }
+}
+
+void FrameProfiler::ReadBackFrame(FrameQueries* frame) {
+  for (const ScopeQueries& scope_queries : frame->scopes) {
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    glGetQueryObjectui64v(scope_queries.begin_query, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(scope_queries.end_query, GL_QUERY_RESULT, &end);
+    scopes_[scope_queries.scope]->gpu_times.Add((end - begin) / 1e6);
+  }
+  frame->used_query_count = 0;
+  frame->scopes.clear();
+}
+
+} //namespace self
@@ -0,0 +1,139 @@
+#ifndef FRAME_PROFILER_H_
+#define FRAME_PROFILER_H_
+
+#include <stddef.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "third_party/glad/include/glad/glad.h"
+#include "time_distribution.h"
+
+namespace self {
+
+// Times named scopes of every frame, like "clear", "draw" and "swap", on the
+// CPU and on the GPU, and counts the draw calls and state changes of a frame.
+//
+// The GPU time of a scope is the difference of two glQueryCounter()
+// timestamps, core since GL 3.3. Timestamps rather than GL_TIME_ELAPSED
+// because elapsed queries can not nest and the frame itself is a scope
+// around the others. The queries of a frame are read back kLatencyFrames
+// frames later from a ring of query sets, by then the GPU is done with them
+// and reading never waits. Only when the GPU falls further behind is the
+// oldest set read with a wait, counted as a stall.
+class FrameProfiler {
+public:
+  static const int kLatencyFrames = 4;
+
+  FrameProfiler();
+
+  // Deletes the queries, the context has to be current.
+  ~FrameProfiler();
+
+  // After the context is current. GPU timing is off when the context has no
+  // timestamp bits.
+  void Initialize();
+
+  // Frames are a scope named "frame" around the scopes of the frame.
+  void BeginFrame();
+  void EndFrame();
+
+  // Scopes nest and end in reverse order. |name| is kept.
+  void BeginScope(const char* name);
+  void EndScope();
+
+  void CountDrawCall() { frame_draw_calls_++; }
+  void CountStateChange() { frame_state_changes_++; }
+
+  // Reads back the frames still in flight, waiting for the GPU.
+  void Finish();
+
+  // A CPU and a GPU row per scope, then the counters.
+  void Print() const;
+
+  bool gpu_timing() const { return gpu_timing_; }
+  int stall_count() const { return stall_count_; }
+
+private:
+  struct Scope {
+    std::string name;
+    TimeDistribution cpu_times;
+    TimeDistribution gpu_times;
+  };
+
+  // One scope of a frame whose queries are not read yet.
+  struct ScopeQueries {
+    size_t scope;
+    GLuint begin_query;
+    GLuint end_query;
+  };
+
+  // The queries of one frame in flight.
+  struct FrameQueries {
+    // Allocated on first use, reused every kLatencyFrames frames.
+    std::vector<GLuint> queries;
+    size_t used_query_count;
+    std::vector<ScopeQueries> scopes;
+  };
+
+  struct OpenScope {
+    size_t scope;
+    std::chrono::steady_clock::time_point cpu_start;
+    // Index into the frame's scopes, -1 without GPU timing.
+    int queries_index;
+  };
+
+  size_t FindOrAddScope(const char* name);
+
+  GLuint NextQuery(FrameQueries* frame);
+
+  // Reads back the ended frames in order up to the first one the GPU is
+  // not done with, or all of them with a wait when |wait_for_all|.
+  void ReadBackFrames(bool wait_for_all);
+
+  void ReadBackFrame(FrameQueries* frame);
+
+private:
+  bool gpu_timing_;
+  std::vector<std::unique_ptr<Scope>> scopes_;
+  std::vector<OpenScope> open_scopes_;
+
+  FrameQueries frame_queries_[kLatencyFrames];
+  // Frames begun, and frames whose queries were read back.
+  long long frame_count_;
+  long long read_frame_count_;
+  int stall_count_;
+
+  int frame_draw_calls_;
+  int frame_state_changes_;
+  long long total_draw_calls_;
+  long long total_state_changes_;
+  int max_draw_calls_;
+  int max_state_changes_;
+
+private:
+  FrameProfiler(const FrameProfiler&) = delete;
+  FrameProfiler& operator=(const FrameProfiler&) = delete;
+};
+
+// Begins a scope of |profiler| for the lifetime of this object.
+class ScopedProfile {
+public:
+  ScopedProfile(FrameProfiler* profiler, const char* name) : profiler_(profiler) {
+    profiler_->BeginScope(name);
+  }
+
+  ~ScopedProfile() { profiler_->EndScope(); }
+
+private:
+  FrameProfiler* profiler_;
+
+private:
+  ScopedProfile(const ScopedProfile&) = delete;
+  ScopedProfile& operator=(const ScopedProfile&) = delete;
+};
+
+} // namespace self
+#endif // FRAME_PROFILER_H_
@@ -2,13 +2,64 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-#include "third_party\glad\include\glad\glad.h"
-#include "third_party\glfw\include\glfw3.h"
+#include "third_party/glad/include/glad/glad.h"
+#if defined(OPENGL_USE_GLFW)
+#include "third_party/glfw/include/glfw3.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "batch_scene.h"
+#include "frame_profiler.h"
+#include "offscreen_context.h"
+#include "streaming_buffer.h"
+
+struct Options {
+  // render into a framebuffer object of a context without a window
+  bool offscreen;
+  // offscreen only
+  int frames;
+  int width;
+  int height;
+  std::string dump_frame_path;
+  // draw the batch benchmark scene of that many quads instead of the
+  // tutorial's one
+  int quads;
+  self::StreamingBuffer::Mode stream_mode;
+  bool draw_per_quad;
+};
+
+// the tutorial's quad, or the batch scene when there is one
+struct Scene {
+  int shader_program;
+  unsigned int vertex_buffer_object;
+  unsigned int vertex_array_object;
+  unsigned int element_buffer_object;
+  std::unique_ptr<self::BatchScene> batch_scene;
+};
 
+bool parseOptions(int argc, char* argv[], Options* options);
+int runOffscreen(const Options& options);
+#if defined(OPENGL_USE_GLFW)
+int runWindow(const Options& options);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
+#endif
+bool initializeScene(const Options& options, Scene* scene);
+bool renderScene(self::FrameProfiler* profiler, int frame, Scene* scene);
+void printScene(const Scene& scene);
+void destroyScene(Scene* scene);
+void renderFrame(
+  self::FrameProfiler* profiler,
+  int shader_program,
+  unsigned int vertex_array_object);
 bool initializeShaderProgram(
   int& shader_program, 
   unsigned int& vertex_buffer_object,
@@ -18,6 +69,22 @@ bool initializeShaderProgram(
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const int DEFAULT_OFFSCREEN_FRAMES = 600;
+
+const char* usage =
+    "usage: tutorial_one [--offscreen [--frames=n] [--width=n] [--height=n]\n"
+    "                    [--dump-frame=xxx.ppm]]\n"
+    "                    [--quads=n [--stream=unsynchronized|orphan]\n"
+    "                    [--draw-per-quad]]\n"
+    "  --offscreen     render n frames (600) into a framebuffer object without\n"
+    "                  a window and print the frame time distribution\n"
+    "  --dump-frame    write the last frame as a binary PPM for golden image\n"
+    "                  checks, its pixel hash is printed too\n"
+    "  --quads         draw n small moving quads of two programs through the\n"
+    "                  batch renderer, e.g. --offscreen --quads=100000\n"
+    "  --stream        write the streaming buffers unsynchronized with fences\n"
+    "                  (default) or orphan them every frame\n"
+    "  --draw-per-quad one draw call per quad, the unbatched baseline\n";
 
 const char* vertexShaderSource =
     "#version 330 core\n"
@@ -34,7 +101,117 @@ const char* fragmentShaderSource =
     "   FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
     "}\n\0";
 
-int main() {
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, &options)) {
+    std::cout << usage;
+    return -1;
+  }
+#if defined(OPENGL_USE_GLFW)
+  if (!options.offscreen) {
+    return runWindow(options);
+  }
+#endif
+  // 没有 GLFW 的构建 (linux) 只有离屏模式
+  return runOffscreen(options);
+}
+
+bool parseOptions(int argc, char* argv[], Options* options) {
+  options->offscreen = false;
+  options->frames = DEFAULT_OFFSCREEN_FRAMES;
+  options->width = SCR_WIDTH;
+  options->height = SCR_HEIGHT;
+  options->quads = 0;
+  options->stream_mode = self::StreamingBuffer::Mode::kUnsynchronized;
+  options->draw_per_quad = false;
+  for (int index = 1; index < argc; index++) {
+    const char* arg = argv[index];
+    if (strcmp(arg, "--offscreen") == 0) {
+      options->offscreen = true;
+    } else if (strncmp(arg, "--frames=", 9) == 0) {
+      options->frames = atoi(arg + 9);
+    } else if (strncmp(arg, "--width=", 8) == 0) {
+      options->width = atoi(arg + 8);
+    } else if (strncmp(arg, "--height=", 9) == 0) {
+      options->height = atoi(arg + 9);
+    } else if (strncmp(arg, "--dump-frame=", 13) == 0) {
+      options->dump_frame_path = arg + 13;
+    } else if (strncmp(arg, "--quads=", 8) == 0) {
+      options->quads = atoi(arg + 8);
+    } else if (strcmp(arg, "--stream=unsynchronized") == 0) {
+      options->stream_mode = self::StreamingBuffer::Mode::kUnsynchronized;
+    } else if (strcmp(arg, "--stream=orphan") == 0) {
+      options->stream_mode = self::StreamingBuffer::Mode::kOrphan;
+    } else if (strcmp(arg, "--draw-per-quad") == 0) {
+      options->draw_per_quad = true;
+    } else {
+      return false;
+    }
+  }
+  return options->frames > 0 && options->width > 0 && options->height > 0 &&
+         options->quads >= 0;
+}
+
+// render n frames without a window, each one waited for, and report the time
+// of their scopes
+// ---------------------------------------------------------------------------
+int runOffscreen(const Options& options) {
+  self::OffscreenContext context;
+  std::string error_message;
+  if (!context.Initialize(options.width, options.height, error_message)) {
+    std::cout << "Failed to create offscreen context: " << error_message << std::endl;
+    return -1;
+  }
+  Scene scene;
+  if (!initializeScene(options, &scene)) {
+    return -1;
+  }
+
+  self::FrameProfiler profiler;
+  profiler.Initialize();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < options.frames; frame++) {
+    profiler.BeginFrame();
+    if (!renderScene(&profiler, frame, &scene)) {
+      destroyScene(&scene);
+      return -1;
+    }
+    {
+      // 离屏没有 swap 限速, 每帧等 GPU 画完, 帧时间里包括 GPU 的执行
+      self::ScopedProfile scoped_profile(&profiler, "swap");
+      glFinish();
+    }
+    profiler.EndFrame();
+  }
+  const double elapsed_ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+  profiler.Finish();
+  std::cout << "renderer: " << glGetString(GL_RENDERER) << ", "
+            << options.width << "x" << options.height << ", "
+            << options.frames << " frames, "
+            << options.frames * 1000.0 / elapsed_ms << " fps" << std::endl;
+  profiler.Print();
+  printScene(scene);
+
+  int result = 0;
+  if (!options.dump_frame_path.empty()) {
+    std::vector<unsigned char> rgba;
+    context.ReadPixels(&rgba);
+    if (self::WritePpm(options.dump_frame_path, context.width(), context.height(), rgba)) {
+      std::cout << "last frame: " << options.dump_frame_path << ", pixel hash "
+                << std::hex << self::HashPixels(rgba) << std::dec << std::endl;
+    } else {
+      std::cout << "Failed to write " << options.dump_frame_path << std::endl;
+      result = -1;
+    }
+  }
+
+  destroyScene(&scene);
+  return result;
+}
+
+#if defined(OPENGL_USE_GLFW)
+int runWindow(const Options& options) {
   // glfw: initialize and configure
   // ------------------------------
   glfwInit();
@@ -66,45 +243,47 @@ int main() {
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
-  int shader_program = 0;
-  unsigned int vertex_buffer_object;
-  unsigned int vertex_array_object;
-  unsigned int element_buffer_object;
-  if (!initializeShaderProgram(shader_program, vertex_buffer_object, vertex_array_object, element_buffer_object)) {
+  Scene scene;
+  if (!initializeScene(options, &scene)) {
     return -1;
   }
-  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+  self::FrameProfiler profiler;
+  profiler.Initialize();
 
   // render loop
   // -----------
-  while (!glfwWindowShouldClose(window)) {
+  int result = 0;
+  for (int frame = 0; !glfwWindowShouldClose(window); frame++) {
+    profiler.BeginFrame();
     // input
     // -----
     processInput(window);
 
     // render
     // ------
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    //draw our first triangle
-    glUseProgram(shader_program);
-    glBindVertexArray(vertex_array_object);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    if (!renderScene(&profiler, frame, &scene)) {
+      result = -1;
+      break;
+    }
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved
     // etc.)
     // -------------------------------------------------------------------------------
-    glfwSwapBuffers(window);
+    {
+      self::ScopedProfile scoped_profile(&profiler, "swap");
+      glfwSwapBuffers(window);
+    }
     glfwPollEvents();
+    profiler.EndFrame();
   }
+  profiler.Finish();
+  profiler.Print();
+  printScene(scene);
 
   // glfw: terminate, clearing all previously allocated GLFW resources.
   // ------------------------------------------------------------------
-  glDeleteVertexArrays(1, &vertex_array_object);
-  glDeleteBuffers(1, &vertex_buffer_object);
-  glDeleteBuffers(1, &element_buffer_object);
+  destroyScene(&scene);
   glfwTerminate();
-  return 0;
+  return result;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this
@@ -123,6 +302,90 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
   // and height will be significantly larger than specified on retina displays.
   glViewport(0, 0, width, height);
 }
+#endif
+
+bool initializeScene(const Options& options, Scene* scene) {
+  scene->shader_program = 0;
+  scene->vertex_buffer_object = 0;
+  scene->vertex_array_object = 0;
+  scene->element_buffer_object = 0;
+  if (options.quads > 0) {
+    scene->batch_scene.reset(new self::BatchScene(options.stream_mode));
+    std::string error_message;
+    if (!scene->batch_scene->Initialize(options.quads, options.draw_per_quad, error_message)) {
+      std::cout << "Failed to initialize the batch scene: " << error_message << std::endl;
+      destroyScene(scene);
+      return false;
+    }
+    return true;
+  }
+  if (!initializeShaderProgram(
+        scene->shader_program,
+        scene->vertex_buffer_object,
+        scene->vertex_array_object,
+        scene->element_buffer_object)) {
+    return false;
+  }
+  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+  return true;
+}
+
+bool renderScene(self::FrameProfiler* profiler, int frame, Scene* scene) {
+  if (!scene->batch_scene) {
+    renderFrame(profiler, scene->shader_program, scene->vertex_array_object);
+    return true;
+  }
+  std::string error_message;
+  if (!scene->batch_scene->Render(profiler, frame, error_message)) {
+    std::cout << "Failed to render frame " << frame << ": " << error_message << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void printScene(const Scene& scene) {
+  if (!scene.batch_scene) {
+    return;
+  }
+  // 有 fence 要等说明 GPU 落后了 kRegionCount 帧
+  const self::BatchRenderer& renderer = scene.batch_scene->renderer();
+  std::cout << "vertex buffer: " << renderer.vertex_buffer().region_size() << " bytes per frame, "
+            << renderer.vertex_buffer().wait_count() << " fence waits, "
+            << renderer.vertex_buffer().orphan_count() << " orphaned" << std::endl;
+  std::cout << "index buffer: " << renderer.index_buffer().region_size() << " bytes per frame, "
+            << renderer.index_buffer().wait_count() << " fence waits, "
+            << renderer.index_buffer().orphan_count() << " orphaned" << std::endl;
+}
+
+// the context has to be current
+void destroyScene(Scene* scene) {
+  scene->batch_scene.reset();
+  glDeleteVertexArrays(1, &scene->vertex_array_object);
+  glDeleteBuffers(1, &scene->vertex_buffer_object);
+  glDeleteBuffers(1, &scene->element_buffer_object);
+  glDeleteProgram(scene->shader_program);
+}
+
+void renderFrame(
+  self::FrameProfiler* profiler,
+  int shader_program,
+  unsigned int vertex_array_object) {
+  {
+    self::ScopedProfile scoped_profile(profiler, "clear");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    profiler->CountStateChange();
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+
+  //draw our first triangle
+  self::ScopedProfile scoped_profile(profiler, "draw");
+  glUseProgram(shader_program);
+  glBindVertexArray(vertex_array_object);
+  profiler->CountStateChange();
+  profiler->CountStateChange();
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  profiler->CountDrawCall();
+}
 
 bool initializeShaderProgram(
   int& shader_program, 
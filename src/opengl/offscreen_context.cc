@@ -0,0 +1,259 @@
+#include "offscreen_context.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(OPENGL_USE_EGL)
+#include <EGL/eglext.h>
+#else
+#include "third_party/glfw/include/glfw3.h"
+#endif
+
+namespace self {
+
+namespace {
+#if defined(OPENGL_USE_EGL)
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+bool HasExtension(const char* extensions, const char* name) {
+  if (!extensions) {
+    return false;
+  }
+  // 扩展名之间用空格隔开, 要整个词匹配
+  const size_t length = strlen(name);
+  for (const char* found = strstr(extensions, name); found; found = strstr(found + 1, name)) {
+    if ((found == extensions || found[-1] == ' ') &&
+        (found[length] == ' ' || found[length] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// glad 要 void* (*)(const char*), eglGetProcAddress 返回的是函数指针
+void* GetProcAddress(const char* name) {
+  return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+#endif
+}
+
+OffscreenContext::OffscreenContext()
+  : width_(0),
+    height_(0),
+    framebuffer_(0),
+    color_renderbuffer_(0),
+#if defined(OPENGL_USE_EGL)
+    display_(EGL_NO_DISPLAY),
+    context_(EGL_NO_CONTEXT),
+    pbuffer_(EGL_NO_SURFACE) {
+#else
+    window_(nullptr) {
+#endif
+}
+
+OffscreenContext::~OffscreenContext() {
+  if (framebuffer_) {
+    glDeleteFramebuffers(1, &framebuffer_);
+    glDeleteRenderbuffers(1, &color_renderbuffer_);
+  }
+  DestroyContext();
+}
+
+bool OffscreenContext::Initialize(int width, int height, std::string& error_message) {
+  width_ = width;
+  height_ = height;
+  if (!CreateContext(error_message)) {
+    return false;
+  }
+
+  glGenRenderbuffers(1, &color_renderbuffer_);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+  glGenFramebuffers(1, &framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+    color_renderbuffer_);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    error_message = "framebuffer incomplete";
+    return false;
+  }
+  glViewport(0, 0, width_, height_);
+  return true;
+}
+
+void OffscreenContext::ReadPixels(std::vector<unsigned char>* rgba) {
+  rgba->resize(static_cast<size_t>(width_) * height_ * 4);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, rgba->data());
+}
+
+#if defined(OPENGL_USE_EGL)
+
+bool OffscreenContext::CreateContext(std::string& error_message) {
+  // 没有显示器的机器上用 surfaceless 平台, 不需要 X11 或 DRM 设备
+  const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+    reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display &&
+      HasExtension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+    display_ = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display_ == EGL_NO_DISPLAY) {
+    display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  EGLint major = 0;
+  EGLint minor = 0;
+  if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, &major, &minor)) {
+    error_message = "eglInitialize fail";
+    return false;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    error_message = "eglBindAPI(EGL_OPENGL_API) fail";
+    return false;
+  }
+
+  const bool surfaceless = HasExtension(
+    eglQueryString(display_, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+  const EGLint config_attributes[] = {
+    EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_NONE
+  };
+  EGLConfig config = nullptr;
+  EGLint config_count = 0;
+  if (!eglChooseConfig(display_, config_attributes, &config, 1, &config_count) ||
+      config_count == 0) {
+    error_message = "no EGL config for desktop OpenGL";
+    return false;
+  }
+
+  // 和窗口模式一样要 3.3 core
+  const EGLint context_attributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attributes);
+  if (context_ == EGL_NO_CONTEXT) {
+    error_message = "eglCreateContext fail, no OpenGL 3.3 core";
+    return false;
+  }
+  if (!surfaceless) {
+    // 画在 FBO 上, pbuffer 只是为了能 make current
+    const EGLint pbuffer_attributes[] = {
+      EGL_WIDTH, 1,
+      EGL_HEIGHT, 1,
+      EGL_NONE
+    };
+    pbuffer_ = eglCreatePbufferSurface(display_, config, pbuffer_attributes);
+    if (pbuffer_ == EGL_NO_SURFACE) {
+      error_message = "eglCreatePbufferSurface fail";
+      return false;
+    }
+  }
+  if (!eglMakeCurrent(display_, pbuffer_, pbuffer_, context_)) {
+    error_message = "eglMakeCurrent fail";
+    return false;
+  }
+  if (!gladLoadGLLoader(GetProcAddress)) {
+    error_message = "Failed to initialize GLAD";
+    return false;
+  }
+  return true;
+}
+
+void OffscreenContext::DestroyContext() {
+  if (display_ == EGL_NO_DISPLAY) {
+    return;
+  }
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (pbuffer_ != EGL_NO_SURFACE) {
+    eglDestroySurface(display_, pbuffer_);
+  }
+  if (context_ != EGL_NO_CONTEXT) {
+    eglDestroyContext(display_, context_);
+  }
+  eglTerminate(display_);
+  display_ = EGL_NO_DISPLAY;
+}
+
+#else
+
+bool OffscreenContext::CreateContext(std::string& error_message) {
+  if (!glfwInit()) {
+    error_message = "glfwInit fail";
+    return false;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  // 窗口不显示, 只借它的 context
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  window_ = glfwCreateWindow(1, 1, "LearnOpenGL", nullptr, nullptr);
+  if (!window_) {
+    error_message = "Failed to create GLFW window";
+    return false;
+  }
+  glfwMakeContextCurrent(window_);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    error_message = "Failed to initialize GLAD";
+    return false;
+  }
+  return true;
+}
+
+void OffscreenContext::DestroyContext() {
+  if (window_) {
+    glfwDestroyWindow(window_);
+    window_ = nullptr;
+  }
+  glfwTerminate();
+}
+
+#endif
+
+bool WritePpm(
+  const std::string& file_path,
+  int width,
+  int height,
+  const std::vector<unsigned char>& rgba) {
+  FILE* file = fopen(file_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  bool result = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+  std::vector<unsigned char> row(static_cast<size_t>(width) * 3);
+  // glReadPixels 是从下往上的, PPM 从上往下
+  for (int y = height - 1; result && y >= 0; y--) {
+    const unsigned char* pixel = &rgba[static_cast<size_t>(y) * width * 4];
+    for (int x = 0; x < width; x++) {
+      row[x * 3] = pixel[x * 4];
+      row[x * 3 + 1] = pixel[x * 4 + 1];
+      row[x * 3 + 2] = pixel[x * 4 + 2];
+    }
+    result = fwrite(row.data(), 1, row.size(), file) == row.size();
+  }
+  return fclose(file) == 0 && result;
+}
+
+unsigned long long HashPixels(const std::vector<unsigned char>& rgba) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (unsigned char byte : rgba) {
+    hash ^= byte;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+} //namespace self
@@ -0,0 +1,77 @@
+#ifndef OFFSCREEN_CONTEXT_H_
+#define OFFSCREEN_CONTEXT_H_
+
+#include <string>
+#include <vector>
+
+#include "third_party/glad/include/glad/glad.h"
+
+#if defined(OPENGL_USE_EGL)
+#include <EGL/egl.h>
+#else
+struct GLFWwindow;
+#endif
+
+namespace self {
+
+// A GL 3.3 core context without a window, rendering into a framebuffer object
+// of a fixed size. With OPENGL_USE_EGL it is an EGL context on the surfaceless
+// platform, or on a pbuffer when the driver has no surfaceless contexts, so it
+// runs on machines without a display, e.g. Mesa llvmpipe. Otherwise it is the
+// context of a hidden GLFW window.
+class OffscreenContext {
+public:
+  OffscreenContext();
+
+  ~OffscreenContext();
+
+  // Creates the context, makes it current, loads the GL functions with glad
+  // and binds the framebuffer object.
+  bool Initialize(int width, int height, std::string& error_message);
+
+  // The pixels of the framebuffer object, 4 bytes per pixel, bottom row first
+  // like glReadPixels() returns them.
+  void ReadPixels(std::vector<unsigned char>* rgba);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  GLuint framebuffer() const { return framebuffer_; }
+
+private:
+  bool CreateContext(std::string& error_message);
+
+  void DestroyContext();
+
+private:
+  int width_;
+  int height_;
+  GLuint framebuffer_;
+  GLuint color_renderbuffer_;
+
+#if defined(OPENGL_USE_EGL)
+  EGLDisplay display_;
+  EGLContext context_;
+  // Only without EGL_KHR_surfaceless_context.
+  EGLSurface pbuffer_;
+#else
+  GLFWwindow* window_;
+#endif
+
+private:
+  OffscreenContext(const OffscreenContext&) = delete;
+  OffscreenContext& operator=(const OffscreenContext&) = delete;
+};
+
+// Writes |rgba| from OffscreenContext::ReadPixels() as a binary PPM, top row
+// first, for golden image checks.
+bool WritePpm(
+  const std::string& file_path,
+  int width,
+  int height,
+  const std::vector<unsigned char>& rgba);
+
+// FNV-1a of |rgba|, to compare frames without keeping the images.
+unsigned long long HashPixels(const std::vector<unsigned char>& rgba);
+
+} // namespace self
+#endif // OFFSCREEN_CONTEXT_H_
@@ -0,0 +1,110 @@
+#include "streaming_buffer.h"
+
+namespace self {
+
+namespace {
+// 等 fence 时每次最多等这么久, 之后再 flush 一次接着等
+const GLuint64 kFenceWaitNanoseconds = 1000000000;
+}
+
+StreamingBuffer::StreamingBuffer(GLenum target, size_t element_size, Mode mode)
+  : target_(target),
+    element_size_(element_size),
+    mode_(mode),
+    buffer_(0),
+    region_size_(0),
+    region_(0),
+    wait_count_(0),
+    orphan_count_(0) {
+  for (GLsync& fence : fences_) {
+    fence = nullptr;
+  }
+}
+
+StreamingBuffer::~StreamingBuffer() {
+  for (GLsync fence : fences_) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  if (buffer_) {
+    glDeleteBuffers(1, &buffer_);
+  }
+}
+
+void StreamingBuffer::Initialize(size_t region_size) {
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(target_, buffer_);
+  Orphan(region_size);
+  orphan_count_ = 0;
+}
+
+void* StreamingBuffer::Map(size_t size, size_t* offset) {
+  glBindBuffer(target_, buffer_);
+  if (size > region_size_) {
+    // 放不下就换更大的存储, 旧的等 GPU 用完由驱动释放
+    Orphan(size + size / 2);
+  } else if (mode_ == Mode::kOrphan) {
+    Orphan(region_size_);
+  }
+  if (mode_ == Mode::kOrphan) {
+    *offset = 0;
+    return glMapBufferRange(target_, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  }
+
+  WaitForRegion(region_);
+  *offset = region_ * region_size_;
+  return glMapBufferRange(target_, *offset, size,
+    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+bool StreamingBuffer::Unmap() {
+  glBindBuffer(target_, buffer_);
+  return glUnmapBuffer(target_) == GL_TRUE;
+}
+
+void StreamingBuffer::EndFrame() {
+  if (mode_ == Mode::kOrphan) {
+    return;
+  }
+  // 这一帧没有 Map 过这个 region 时它的 fence 还在, 换新的之前先删掉
+  if (fences_[region_]) {
+    glDeleteSync(fences_[region_]);
+  }
+  fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  region_ = (region_ + 1) % kRegionCount;
+}
+
+void StreamingBuffer::Orphan(size_t region_size) {
+  region_size_ = (region_size + element_size_ - 1) / element_size_ * element_size_;
+  // kOrphan 每帧都换新存储, 一个 region 就够
+  const int region_count = mode_ == Mode::kOrphan ? 1 : kRegionCount;
+  glBufferData(target_, region_size_ * region_count, nullptr, GL_STREAM_DRAW);
+  // 新的存储没有 GPU 在读, 旧的 fence 都不用等了
+  for (GLsync& fence : fences_) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+  region_ = 0;
+  orphan_count_++;
+}
+
+void StreamingBuffer::WaitForRegion(int region) {
+  GLsync fence = fences_[region];
+  if (!fence) {
+    return;
+  }
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    wait_count_++;
+    do {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceWaitNanoseconds);
+    } while (result == GL_TIMEOUT_EXPIRED);
+  }
+  glDeleteSync(fence);
+  fences_[region] = nullptr;
+}
+
+} //namespace self
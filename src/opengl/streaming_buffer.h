@@ -0,0 +1,81 @@
+#ifndef STREAMING_BUFFER_H_
+#define STREAMING_BUFFER_H_
+
+#include <stddef.h>
+
+#include "third_party/glad/include/glad/glad.h"
+
+namespace self {
+
+// A buffer object written once per frame with glMapBufferRange(). It is cut
+// into kRegionCount regions used in turn, one per frame. A region is mapped
+// with GL_MAP_UNSYNCHRONIZED_BIT, so the driver never waits for the draws
+// still reading the buffer, and the fence put after the frame's draws tells
+// when the region may be written again. The frame kRegionCount frames later
+// only waits on the fence when the GPU is that far behind.
+//
+// A frame larger than a region orphans the buffer with glBufferData() into
+// new storage of larger regions. Mode::kOrphan does that every frame, the
+// fallback for drivers where unsynchronized mapping is slow or broken.
+class StreamingBuffer {
+public:
+  enum class Mode {
+    kUnsynchronized,
+    kOrphan,
+  };
+
+  static const int kRegionCount = 3;
+
+  // |target| is GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER, the latter bound
+  // to the vertex array object bound when Initialize() and Map() are called.
+  // Regions are a multiple of |element_size| bytes, so an offset into the
+  // buffer is a whole number of vertices or indices.
+  StreamingBuffer(GLenum target, size_t element_size, Mode mode);
+
+  // Deletes the buffer and the fences, the context has to be current.
+  ~StreamingBuffer();
+
+  void Initialize(size_t region_size);
+
+  // Maps |size| bytes for the writes of this frame, at |*offset| bytes into
+  // the buffer. Once per frame, null when mapping fails.
+  void* Map(size_t size, size_t* offset);
+
+  // Returns false when the data was lost, it is then drawn as garbage for
+  // one frame.
+  bool Unmap();
+
+  // After the draws reading this frame's bytes were issued.
+  void EndFrame();
+
+  GLuint buffer() const { return buffer_; }
+  size_t region_size() const { return region_size_; }
+  // Frames that waited on a fence, and buffers orphaned.
+  int wait_count() const { return wait_count_; }
+  int orphan_count() const { return orphan_count_; }
+
+private:
+  // New storage of |region_size| bytes per region, the old one is freed by
+  // the driver once the GPU is done with it.
+  void Orphan(size_t region_size);
+
+  void WaitForRegion(int region);
+
+private:
+  const GLenum target_;
+  const size_t element_size_;
+  const Mode mode_;
+  GLuint buffer_;
+  size_t region_size_;
+  int region_;
+  GLsync fences_[kRegionCount];
+  int wait_count_;
+  int orphan_count_;
+
+private:
+  StreamingBuffer(const StreamingBuffer&) = delete;
+  StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+};
+
+} // namespace self
+#endif // STREAMING_BUFFER_H_
@@ -0,0 +1,68 @@
+#include "time_distribution.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace self {
+
+TimeDistribution::TimeDistribution() : sorted_(true) {
+}
+
+TimeDistribution::~TimeDistribution() {
+}
+
+void TimeDistribution::Add(double milliseconds) {
+  samples_.push_back(milliseconds);
+  sorted_ = false;
+}
+
+void TimeDistribution::Clear() {
+  samples_.clear();
+  sorted_samples_.clear();
+  sorted_ = true;
+}
+
+double TimeDistribution::Mean() const {
+  if (samples_.empty()) {
+    return 0.0;
+  }
+  double sum = 0.0;
+  for (double sample : samples_) {
+    sum += sample;
+  }
+  return sum / samples_.size();
+}
+
+double TimeDistribution::Percentile(double fraction) const {
+  if (samples_.empty()) {
+    return 0.0;
+  }
+  Sort();
+  fraction = std::min(std::max(fraction, 0.0), 1.0);
+  size_t rank = static_cast<size_t>(std::ceil(fraction * sorted_samples_.size()));
+  return sorted_samples_[rank > 0 ? rank - 1 : 0];
+}
+
+void TimeDistribution::Print(const char* name) const {
+  printf("%-16s %8zu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+    name, count(), Mean(), Percentile(0.0), Percentile(0.5), Percentile(0.9),
+    Percentile(0.99), Percentile(1.0));
+}
+
+void TimeDistribution::PrintHeader(const char* name_title) {
+  printf("%-16s %8s %10s %10s %10s %10s %10s %10s\n",
+    name_title, "count", "mean ms", "min", "p50", "p90", "p99", "max");
+}
+
+void TimeDistribution::Sort() const {
+  if (sorted_) {
+    return;
+  }
+  sorted_samples_ = samples_;
+  std::sort(sorted_samples_.begin(), sorted_samples_.end());
+  sorted_ = true;
+}
+
+} //namespace self
@@ -0,0 +1,50 @@
+#ifndef TIME_DISTRIBUTION_H_
+#define TIME_DISTRIBUTION_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace self {
+
+// Samples of one duration in milliseconds, e.g. the frame time, reported as
+// percentiles so a few slow frames show up instead of vanishing in the mean.
+class TimeDistribution {
+public:
+  TimeDistribution();
+
+  ~TimeDistribution();
+
+  void Add(double milliseconds);
+
+  void Clear();
+
+  size_t count() const { return samples_.size(); }
+
+  double Mean() const;
+
+  // Nearest rank, |fraction| from 0 for the minimum to 1 for the maximum.
+  double Percentile(double fraction) const;
+
+  // One row: count, mean, min, p50, p90, p99 and max, after |name|.
+  void Print(const char* name) const;
+
+  // The header of the rows Print() writes.
+  static void PrintHeader(const char* name_title);
+
+private:
+  void Sort() const;
+
+private:
+  std::vector<double> samples_;
+  // Sorted on demand, the samples are added in frame order.
+  mutable std::vector<double> sorted_samples_;
+  mutable bool sorted_;
+
+private:
+  TimeDistribution(const TimeDistribution&) = delete;
+  TimeDistribution& operator=(const TimeDistribution&) = delete;
+};
+
+} // namespace self
+#endif // TIME_DISTRIBUTION_H_